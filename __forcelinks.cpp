@@ -28,6 +28,12 @@ extern void __forcelink_to_ks_pending_trigger_cpp();
 extern void __forcelink_to_ks_cancel_inspector_cpp();
 extern void __forcelink_to_ks_single_thread_apartment_imp_cpp();
 extern void __forcelink_to_ks_thread_pool_apartment_imp_cpp();
+extern void __forcelink_to_ks_strand_apartment_imp_cpp();
+extern void __forcelink_to_ks_inline_apartment_imp_cpp();
+extern void __forcelink_to_ks_manual_apartment_imp_cpp();
+extern void __forcelink_to_ks_apartment_group_cpp();
+extern void __forcelink_to_ks_epoll_apartment_imp_cpp();
+extern void __forcelink_to_ks_file_io_service_cpp();
 extern void __forcelink_to_ks_notification_center_cpp();
 extern void __forcelink_to_ks_notification_cpp();
 
@@ -46,6 +52,12 @@ void __ks_async_forcelinks() {
     __forcelink_to_ks_cancel_inspector_cpp();
     __forcelink_to_ks_single_thread_apartment_imp_cpp();
     __forcelink_to_ks_thread_pool_apartment_imp_cpp();
+    __forcelink_to_ks_strand_apartment_imp_cpp();
+    __forcelink_to_ks_inline_apartment_imp_cpp();
+    __forcelink_to_ks_manual_apartment_imp_cpp();
+    __forcelink_to_ks_apartment_group_cpp();
+    __forcelink_to_ks_epoll_apartment_imp_cpp();
+    __forcelink_to_ks_file_io_service_cpp();
     __forcelink_to_ks_notification_center_cpp();
     __forcelink_to_ks_notification_cpp();
 }
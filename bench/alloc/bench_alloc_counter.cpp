@@ -0,0 +1,53 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "bench_alloc_counter.h"
+#include <cstdlib>
+#include <new>
+
+
+//注：替换的operator new/delete单独置于此编译单元，本单元内没有new表达式，
+//编译器不会将其与别处的new/delete内联配对而误报-Wmismatched-new-delete。
+//其余形式（数组、nothrow）的默认实现均转调以下几者。
+
+static thread_local bool tls_alloc_counting = false;
+static thread_local int64_t tls_alloc_count = 0;
+
+void bench_alloc_counting_begin() {
+    tls_alloc_count = 0;
+    tls_alloc_counting = true;
+}
+
+int64_t bench_alloc_counting_end() {
+    tls_alloc_counting = false;
+    return tls_alloc_count;
+}
+
+void* operator new(size_t size) {
+    if (tls_alloc_counting)
+        ++tls_alloc_count;
+    void* p = std::malloc(size != 0 ? size : 1);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
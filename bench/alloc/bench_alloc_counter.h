@@ -0,0 +1,26 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <cstdint>
+
+
+// 堆分配计数：以替换全局operator new的方式，统计开启计数的线程（即bench线程）上的分配次数。
+// 注：operator new的替换是进程级的，故用到计数的bench单独构成一个可执行文件（ks-async-bench-alloc），
+// 而不混入ks-async-bench，以免影响其他bench的分配行为。
+
+void bench_alloc_counting_begin();
+int64_t bench_alloc_counting_end(); //返回本线程自bench_alloc_counting_begin以来的分配次数
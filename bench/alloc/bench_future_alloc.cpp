@@ -0,0 +1,57 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "../bench_base.h"
+#include "bench_alloc_counter.h"
+#include "../../ks_manual_apartment_imp.h"
+
+
+// 广播型future的分配次数：一个promise-future挂接1/4/64个下游（on_success），resolve并feed完毕，
+// 以每轮的堆分配次数（allocs_per_round计数器）及耗时计。全程在手动泵送的套间内、于本线程完成，
+// 故计数涵盖complete及feed下游的全部分配。
+// 期望：下游列表与等待套间列表为内联small-vector、且待feed的下游不再复制进schedule的fn，每轮分配次数明显减少。
+
+static void FutureAllocBench_BroadcastResolve(benchmark::State& state) {
+    const int listener_count = (int)state.range(0);
+    ks_manual_apartment_imp apartment_imp("bench_future_alloc");
+    ks_apartment* apartment = &apartment_imp;
+
+    int64_t total_alloc_count = 0;
+    for (auto _ : state) {
+        int fed_count = 0;
+        bench_alloc_counting_begin();
+
+        ks_future<void>::post(apartment, [&fed_count, listener_count, apartment]() {
+            ks_promise<int> promise = ks_promise<int>::create();
+            ks_future<int> future = promise.get_future();
+            for (int i = 0; i < listener_count; ++i)
+                future.on_success(apartment, [&fed_count](const int&) { ++fed_count; });
+            promise.resolve(1);
+        });
+        apartment_imp.run_until_idle();
+
+        total_alloc_count += bench_alloc_counting_end();
+        if (fed_count != listener_count)
+            state.SkipWithError("not all listeners were fed");
+    }
+    state.counters["allocs_per_round"] = benchmark::Counter((double)total_alloc_count / (double)state.iterations());
+    state.SetItemsProcessed(state.iterations() * listener_count);
+
+    apartment->async_stop();
+    apartment->wait();
+}
+BENCHMARK(FutureAllocBench_BroadcastResolve)
+    ->Arg(1)->Arg(4)->Arg(64)
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,69 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "bench_base.h"
+#include "../ks_thread_pool_apartment_imp.h"
+
+
+// 两个线程池套间之间来回接力（每一跳都须唤醒对方的空闲线程），测量每跳的延迟，
+// 对比默认（直接wait）与spin_wait_flag（先自旋再wait）。
+// 期望：spin_wait_flag下每跳延迟明显降低，且spin命中率高。
+
+static void _bench_ping_pong(benchmark::State& state, uint flags) {
+    const int64_t hop_count = 1000;
+    ks_thread_pool_apartment_imp apartment_a_imp("bench_spin_wait_a", 2, flags);
+    ks_thread_pool_apartment_imp apartment_b_imp("bench_spin_wait_b", 2, flags);
+    ks_apartment* apartment_a = &apartment_a_imp;
+    ks_apartment* apartment_b = &apartment_b_imp;
+    apartment_a->start();
+    apartment_b->start();
+
+    for (auto _ : state) {
+        ks_waitgroup work_wg(1);
+        std::function<void(int64_t)> hop;
+        hop = [&](int64_t left) {
+            if (left == 0) {
+                work_wg.done();
+                return;
+            }
+            ks_apartment* next_apartment = (left % 2 == 0) ? apartment_a : apartment_b;
+            next_apartment->schedule([&hop, left]() { hop(left - 1); }, 0);
+        };
+        hop(hop_count);
+        work_wg.wait();
+    }
+    state.SetItemsProcessed(state.iterations() * hop_count);
+
+    const ks_spin_wait_stats stats = apartment_a_imp.spin_wait_stats();
+    state.counters["spin_hit"] = (double)stats.spin_hit_count;
+    state.counters["spin_miss"] = (double)stats.spin_miss_count;
+
+    apartment_a->async_stop();
+    apartment_b->async_stop();
+    apartment_a->wait();
+    apartment_b->wait();
+}
+
+static void ApartmentSpinWaitBench_Park(benchmark::State& state) {
+    _bench_ping_pong(state, 0);
+}
+BENCHMARK(ApartmentSpinWaitBench_Park)
+    ->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+static void ApartmentSpinWaitBench_SpinThenPark(benchmark::State& state) {
+    _bench_ping_pong(state, ks_thread_pool_apartment_imp::spin_wait_flag);
+}
+BENCHMARK(ApartmentSpinWaitBench_SpinThenPark)
+    ->Unit(benchmark::kMicrosecond)->UseRealTime();
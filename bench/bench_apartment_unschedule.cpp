@@ -0,0 +1,60 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "bench_base.h"
+#include "../ks_thread_pool_apartment_imp.h"
+#include "../ks_single_thread_apartment_imp.h"
+
+
+// 在已有大量（0/1k/100k）待执行延时任务的套间上，测量schedule_delayed+try_unschedule的开销
+// （带超时的future完成时即如此：撤销其超时任务）。
+// 期望：开销与待执行延时任务的数量无关。
+
+static void _bench_schedule_and_unschedule(benchmark::State& state, ks_apartment* apartment) {
+    const int64_t pending_count = state.range(0);
+    apartment->start();
+
+    std::vector<uint64_t> pending_ids;
+    pending_ids.reserve((size_t)pending_count);
+    for (int64_t i = 0; i < pending_count; ++i)
+        pending_ids.push_back(apartment->schedule_delayed([]() {}, 0, 3600 * 1000 + i));
+
+    for (auto _ : state) {
+        uint64_t id = apartment->schedule_delayed([]() {}, 0, 1000);
+        apartment->try_unschedule(id);
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    for (uint64_t id : pending_ids)
+        apartment->try_unschedule(id);
+    apartment->async_stop();
+    apartment->wait();
+}
+
+static void ApartmentUnscheduleBench_ThreadPool(benchmark::State& state) {
+    ks_thread_pool_apartment_imp apartment_imp("bench_unschedule_mta", 4);
+    _bench_schedule_and_unschedule(state, &apartment_imp);
+}
+BENCHMARK(ApartmentUnscheduleBench_ThreadPool)
+    ->Arg(0)->Arg(1000)->Arg(100000)
+    ->Unit(benchmark::kNanosecond);
+
+static void ApartmentUnscheduleBench_SingleThread(benchmark::State& state) {
+    ks_single_thread_apartment_imp apartment_imp("bench_unschedule_sta");
+    _bench_schedule_and_unschedule(state, &apartment_imp);
+}
+BENCHMARK(ApartmentUnscheduleBench_SingleThread)
+    ->Arg(0)->Arg(1000)->Arg(100000)
+    ->Unit(benchmark::kNanosecond);
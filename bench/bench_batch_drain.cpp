@@ -0,0 +1,75 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "bench_base.h"
+#include "../ks_single_thread_apartment_imp.h"
+#include "../ks_thread_pool_apartment_imp.h"
+
+
+// 先占住work线程，一次性schedule大量空任务后放行，比较逐项出队与批量出队（set_batch_drain，K=16）的执行吞吐。
+// 期望：批量模式下每K项仅lock一次，吞吐更高。
+
+template <class APARTMENT_IMP>
+static void _bench_batch_drain(benchmark::State& state, APARTMENT_IMP* apartment_imp) {
+    constexpr int fn_count = 10000;
+    ks_apartment* apartment = apartment_imp;
+    apartment->start();
+
+    //注：各event在套间停止后才析构，以免work线程在其返回途中访问已析构的对象
+    ks_event blocked_event(false, false);
+    ks_event release_event(false, false);
+    ks_event done_event(false, false);
+    std::atomic<int> remaining_count = { 0 };
+
+    for (auto _ : state) {
+        apartment->schedule([&]() { blocked_event.set_event(); release_event.wait(); }, 0);
+        blocked_event.wait();
+
+        remaining_count = fn_count;
+        for (int i = 0; i < fn_count; ++i) {
+            apartment->schedule(ks_task_fn([&]() {
+                if (--remaining_count == 0)
+                    done_event.set_event();
+            }), 0);
+        }
+
+        const auto start_time = std::chrono::steady_clock::now();
+        release_event.set_event();
+        done_event.wait();
+        state.SetIterationTime(std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count());
+    }
+    state.SetItemsProcessed(state.iterations() * fn_count);
+
+    apartment->async_stop();
+    apartment->wait();
+}
+
+static void BatchDrainBench_Sta(benchmark::State& state) {
+    ks_single_thread_apartment_imp apartment_imp("bench_batch_drain_sta");
+    apartment_imp.set_batch_drain((size_t)state.range(0));
+    _bench_batch_drain(state, &apartment_imp);
+}
+BENCHMARK(BatchDrainBench_Sta)
+    ->Arg(1)->Arg(16)
+    ->Unit(benchmark::kMillisecond)->UseManualTime();
+
+static void BatchDrainBench_Mta(benchmark::State& state) {
+    ks_thread_pool_apartment_imp apartment_imp("bench_batch_drain_mta", 1);
+    apartment_imp.set_batch_drain((size_t)state.range(0));
+    _bench_batch_drain(state, &apartment_imp);
+}
+BENCHMARK(BatchDrainBench_Mta)
+    ->Arg(1)->Arg(16)
+    ->Unit(benchmark::kMillisecond)->UseManualTime();
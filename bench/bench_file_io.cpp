@@ -0,0 +1,116 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "bench_base.h"
+#include "../ks_file_io_service.h"
+
+#if __KS_EPOLL_APARTMENT_ENABLED
+#include <stdlib.h>
+#include <unistd.h>
+
+
+// 以不同的并发深度（同时在途的读请求数）读取一个16MB文件（64KB一块），比较：
+// ks_file_io_service（io_uring后端 / 线程池后端）与 将pread直接post至default_mta。
+// 期望：io_uring后端以单线程达到不低于default_mta的吞吐，且不占用default_mta的线程。
+
+static constexpr size_t _BENCH_FILE_SIZE = 16 * 1024 * 1024;
+static constexpr size_t _BENCH_BLOCK_SIZE = 64 * 1024;
+
+static int _open_bench_file() {
+    char file_path[] = "/tmp/ks_async_bench_file_io_XXXXXX";
+    int fd = ::mkstemp(file_path);
+    if (fd < 0)
+        return -1;
+    ::unlink(file_path);
+
+    std::vector<char> block(_BENCH_BLOCK_SIZE, 'x');
+    for (size_t offset = 0; offset < _BENCH_FILE_SIZE; offset += block.size()) {
+        if (::pwrite(fd, block.data(), block.size(), (off_t)offset) != (ssize_t)block.size()) {
+            ::close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+template <class READ_FN>
+static void _bench_read_file(benchmark::State& state, READ_FN&& read_fn) {
+    const size_t queue_depth = (size_t)state.range(0);
+    int fd = _open_bench_file();
+    if (fd < 0) {
+        state.SkipWithError("failed to create bench file");
+        return;
+    }
+
+    std::vector<char> bufs(queue_depth * _BENCH_BLOCK_SIZE);
+    for (auto _ : state) {
+        //每轮同时发起queue_depth个读请求，全部完成后再发起下一轮
+        std::vector<ks_future<size_t>> read_futures;
+        read_futures.reserve(queue_depth);
+        for (size_t offset = 0; offset < _BENCH_FILE_SIZE; ) {
+            read_futures.clear();
+            for (size_t i = 0; i < queue_depth && offset < _BENCH_FILE_SIZE; ++i, offset += _BENCH_BLOCK_SIZE)
+                read_futures.push_back(read_fn(fd, &bufs[i * _BENCH_BLOCK_SIZE], _BENCH_BLOCK_SIZE, (int64_t)offset));
+            ks_future_util::all(read_futures).__wait();
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t)_BENCH_FILE_SIZE);
+
+    ::close(fd);
+}
+
+static void FileIoBench_IoUring(benchmark::State& state) {
+    ks_file_io_service io_service("bench_file_io_uring");
+    if (io_service.backend() != ks_file_io_service::io_uring_backend) {
+        state.SkipWithError("io_uring is unavailable");
+        return;
+    }
+    io_service.start();
+    _bench_read_file(state, [&io_service](int fd, void* buf, size_t len, int64_t offset) {
+        return io_service.read(fd, buf, len, offset);
+    });
+    io_service.wait();
+}
+BENCHMARK(FileIoBench_IoUring)
+    ->Arg(1)->Arg(8)->Arg(32)
+    ->Unit(benchmark::kMillisecond);
+
+static void FileIoBench_ThreadPool(benchmark::State& state) {
+    ks_file_io_service io_service("bench_file_io_pool", ks_file_io_service::force_thread_pool_flag);
+    io_service.start();
+    _bench_read_file(state, [&io_service](int fd, void* buf, size_t len, int64_t offset) {
+        return io_service.read(fd, buf, len, offset);
+    });
+    io_service.wait();
+}
+BENCHMARK(FileIoBench_ThreadPool)
+    ->Arg(1)->Arg(8)->Arg(32)
+    ->Unit(benchmark::kMillisecond);
+
+static void FileIoBench_PostPreadToDefaultMta(benchmark::State& state) {
+    _bench_read_file(state, [](int fd, void* buf, size_t len, int64_t offset) {
+        return ks_future<size_t>::post(ks_apartment::default_mta(), [fd, buf, len, offset]() -> ks_result<size_t> {
+            ssize_t ret = ::pread(fd, buf, len, (off_t)offset);
+            if (ret < 0)
+                return ks_error::general_error().with_payload<int>(errno);
+            return (size_t)ret;
+        });
+    });
+}
+BENCHMARK(FileIoBench_PostPreadToDefaultMta)
+    ->Arg(1)->Arg(8)->Arg(32)
+    ->Unit(benchmark::kMillisecond);
+
+#endif //__KS_EPOLL_APARTMENT_ENABLED
@@ -0,0 +1,52 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "bench_base.h"
+
+
+// 向未完成的promise-future挂接下游并resolve，下游均在inline_apartment上就地执行，以排除调度开销。
+// Arg为挂接线程数：各线程并发地挂接下游，同时主线程resolve，用于衡量add_next与complete之间的争用。
+// 期望：无锁下游栈（__KS_ASYNC_RAW_FUTURE_LOCKFREE_NEXT_ENABLED）下，挂接仅一次CAS，多线程时不因future的锁而串行。
+
+static void FutureAttachBench_AttachThenResolve(benchmark::State& state) {
+    const int thread_count = (int)state.range(0);
+    constexpr int next_count_per_thread = 64;
+    ks_apartment* apartment = ks_apartment::inline_apartment();
+
+    for (auto _ : state) {
+        ks_promise<int> promise = ks_promise<int>::create();
+        ks_future<int> future = promise.get_future();
+        std::atomic<int> fed_count = { 0 };
+
+        std::vector<std::thread> threads;
+        for (int t = 1; t < thread_count; ++t) {
+            threads.emplace_back([&]() {
+                for (int i = 0; i < next_count_per_thread; ++i)
+                    future.on_success(apartment, [&fed_count](const int&) { ++fed_count; });
+            });
+        }
+        for (int i = 0; i < next_count_per_thread; ++i)
+            future.on_success(apartment, [&fed_count](const int&) { ++fed_count; });
+        promise.resolve(1);
+        for (auto& thread : threads)
+            thread.join();
+
+        benchmark::DoNotOptimize(fed_count.load());
+    }
+    state.SetItemsProcessed(state.iterations() * thread_count * next_count_per_thread);
+}
+BENCHMARK(FutureAttachBench_AttachThenResolve)
+    ->Arg(1)->Arg(2)->Arg(4)
+    ->Unit(benchmark::kMicrosecond)->UseRealTime();
@@ -0,0 +1,77 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "bench_base.h"
+#include "../ks_single_thread_apartment_imp.h"
+
+
+// 在单线程套间上，以8级then传递并修改一个1MB的std::vector<char>，
+// 比较const T&形式（各级须复制一份再修改）与T&&形式（move-through，唯一下游时直接移入下一级）。
+// 期望：T&&形式免去了各级的1MB复制，耗时大幅降低。
+
+static constexpr size_t _payload_size = 1024 * 1024;
+static constexpr int _chain_length = 8;
+
+template <class BUILD_STAGE_FN>
+static void _bench_move_chain(benchmark::State& state, BUILD_STAGE_FN&& build_stage_fn) {
+    ks_single_thread_apartment_imp apartment_imp("bench_move_chain");
+    ks_apartment* apartment = &apartment_imp;
+    apartment->start();
+
+    for (auto _ : state) {
+        ks_waitgroup chain_wg(1);
+        //链在套间内构建，以免执行时上游仍被本线程持有
+        ks_future<void>::post(apartment, [&]() {
+            ks_future<std::vector<char>> future = ks_future<std::vector<char>>::post(apartment, []() {
+                return std::vector<char>(_payload_size);
+            });
+            for (int i = 0; i < _chain_length; ++i)
+                future = build_stage_fn(future, apartment);
+            future.on_success(apartment, [&chain_wg](const std::vector<char>& buf) {
+                benchmark::DoNotOptimize(buf.data());
+                chain_wg.done();
+            });
+        });
+        chain_wg.wait();
+    }
+    state.SetItemsProcessed(state.iterations() * _chain_length);
+    state.SetBytesProcessed(state.iterations() * _chain_length * (int64_t)_payload_size);
+
+    apartment->async_stop();
+    apartment->wait();
+}
+
+static void MoveChainBench_ConstRef(benchmark::State& state) {
+    _bench_move_chain(state, [](const ks_future<std::vector<char>>& future, ks_apartment* apartment) {
+        return future.then<std::vector<char>>(apartment, [](const std::vector<char>& buf) {
+            std::vector<char> buf2 = buf;
+            ++buf2[0];
+            return buf2;
+        });
+    });
+}
+BENCHMARK(MoveChainBench_ConstRef)
+    ->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+static void MoveChainBench_RvalueRef(benchmark::State& state) {
+    _bench_move_chain(state, [](const ks_future<std::vector<char>>& future, ks_apartment* apartment) {
+        return future.then<std::vector<char>>(apartment, [](std::vector<char>&& buf) {
+            ++buf[0];
+            return std::move(buf);
+        });
+    });
+}
+BENCHMARK(MoveChainBench_RvalueRef)
+    ->Unit(benchmark::kMicrosecond)->UseRealTime();
@@ -0,0 +1,124 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "bench_base.h"
+#include "../ktl/ks_concurrency.h"
+#include <deque>
+
+
+// 对比：ks_mpmc_queue vs. 现有的ks_mutex+std::deque（套间now队列的原实现方式）
+// 线程数为1时，单线程交替push/pop；否则一半线程生产、一半线程消费。
+// 元素类型为std::shared_ptr，与套间中的_FN_ITEM一致。
+
+using _BenchItem = std::shared_ptr<int>;
+
+class _MutexDequeQueue {
+public:
+    bool try_push(_BenchItem&& item) {
+        std::unique_lock<ks_mutex> lock(m_mutex);
+        m_deque.push_back(std::move(item));
+        return true;
+    }
+    bool try_pop(_BenchItem& item) {
+        std::unique_lock<ks_mutex> lock(m_mutex);
+        if (m_deque.empty())
+            return false;
+        item = std::move(m_deque.front());
+        m_deque.pop_front();
+        return true;
+    }
+
+private:
+    ks_mutex m_mutex;
+    std::deque<_BenchItem> m_deque;
+};
+
+template <class QUEUE>
+static void _run_producer_consumer(QUEUE& queue, int num_threads, int64_t total_items) {
+    auto item_proto = std::make_shared<int>(0);
+
+    if (num_threads <= 1) {
+        for (int64_t i = 0; i < total_items; ++i) {
+            _BenchItem item = item_proto;
+            while (!queue.try_push(std::move(item)))
+                std::this_thread::yield();
+            _BenchItem popped;
+            while (!queue.try_pop(popped))
+                std::this_thread::yield();
+        }
+        return;
+    }
+
+    const int num_producers = num_threads / 2;
+    const int num_consumers = num_threads - num_producers;
+    const int64_t items_per_producer = total_items / num_producers;
+    std::atomic<int64_t> remaining = { items_per_producer * num_producers };
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+    for (int i = 0; i < num_producers; ++i) {
+        threads.emplace_back([&queue, &item_proto, items_per_producer]() {
+            for (int64_t j = 0; j < items_per_producer; ++j) {
+                _BenchItem item = item_proto;
+                while (!queue.try_push(std::move(item)))
+                    std::this_thread::yield(); //满
+            }
+        });
+    }
+    for (int i = 0; i < num_consumers; ++i) {
+        threads.emplace_back([&queue, &remaining]() {
+            _BenchItem popped;
+            while (remaining.load(std::memory_order_relaxed) > 0) {
+                if (queue.try_pop(popped))
+                    remaining.fetch_sub(1, std::memory_order_relaxed);
+                else
+                    std::this_thread::yield(); //空
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+
+static void MpmcQueueBench_LockFree(benchmark::State& state) {
+    const int num_threads = (int)state.range(0);
+    const int64_t total_items = state.range(1);
+    for (auto _ : state) {
+        ks_mpmc_queue<_BenchItem> queue(4096);
+        _run_producer_consumer(queue, num_threads, total_items);
+    }
+    state.SetItemsProcessed(state.iterations() * total_items);
+}
+BENCHMARK(MpmcQueueBench_LockFree)
+    ->ArgsProduct({ {1, 2, 4, 8, 16, 32, 64}, {200000} })
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+static void MpmcQueueBench_MutexDeque(benchmark::State& state) {
+    const int num_threads = (int)state.range(0);
+    const int64_t total_items = state.range(1);
+    for (auto _ : state) {
+        _MutexDequeQueue queue;
+        _run_producer_consumer(queue, num_threads, total_items);
+    }
+    state.SetItemsProcessed(state.iterations() * total_items);
+}
+BENCHMARK(MpmcQueueBench_MutexDeque)
+    ->ArgsProduct({ {1, 2, 4, 8, 16, 32, 64}, {200000} })
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
@@ -0,0 +1,62 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "bench_base.h"
+#include "../ks_single_thread_apartment_imp.h"
+
+
+// 1/2/4/8个生产者线程并发地向单线程套间schedule空任务，比较有锁队列与MPSC收件箱模式（mpsc_inbox_flag）的吞吐。
+// 期望：收件箱模式下生产者不与work线程争用mutex，多生产者时吞吐明显更高。
+
+static void _bench_sta_producers(benchmark::State& state, uint flags) {
+    const int producer_count = (int)state.range(0);
+    constexpr int fn_count_per_producer = 20000;
+
+    ks_single_thread_apartment_imp apartment_imp("bench_sta_inbox", flags);
+    ks_apartment* apartment = &apartment_imp;
+    apartment->start();
+
+    for (auto _ : state) {
+        ks_waitgroup done_wg(producer_count * fn_count_per_producer);
+        std::vector<std::thread> producers;
+        for (int p = 0; p < producer_count; ++p) {
+            producers.emplace_back([&]() {
+                for (int i = 0; i < fn_count_per_producer; ++i)
+                    apartment->schedule(ks_task_fn([&done_wg]() { done_wg.done(); }), 0);
+            });
+        }
+        for (auto& producer : producers)
+            producer.join();
+        done_wg.wait();
+    }
+    state.SetItemsProcessed(state.iterations() * producer_count * fn_count_per_producer);
+
+    apartment->async_stop();
+    apartment->wait();
+}
+
+static void StaInboxBench_Locked(benchmark::State& state) {
+    _bench_sta_producers(state, ks_single_thread_apartment_imp::no_flag);
+}
+BENCHMARK(StaInboxBench_Locked)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void StaInboxBench_MpscInbox(benchmark::State& state) {
+    _bench_sta_producers(state, ks_single_thread_apartment_imp::mpsc_inbox_flag);
+}
+BENCHMARK(StaInboxBench_MpscInbox)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,47 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "bench_base.h"
+#include "../ks_single_thread_apartment_imp.h"
+
+
+// 在单线程套间内post一个任务，其后接10级then（均在同一套间），测量自post至链尾完成的延迟，
+// 比较continuation就地执行关闭（max_depth=0）与开启（max_depth=16）。
+// 期望：开启后各级不再经schedule往返，延迟明显降低。
+
+static void ThenChainBench_Latency(benchmark::State& state) {
+    constexpr int chain_length = 10;
+    const int old_max_depth = __ks_async_raw::ks_raw_future::__set_inline_continuation_max_depth((int)state.range(0));
+
+    ks_single_thread_apartment_imp apartment_imp("bench_then_chain");
+    ks_apartment* apartment = &apartment_imp;
+    apartment->start();
+
+    for (auto _ : state) {
+        ks_future<int> future = ks_future<int>::post(apartment, []() { return 0; });
+        for (int i = 0; i < chain_length; ++i)
+            future = future.then<int>(apartment, [](int value) { return value + 1; });
+        future.__wait();
+        benchmark::DoNotOptimize(future.is_completed());
+    }
+    state.SetItemsProcessed(state.iterations() * chain_length);
+
+    apartment->async_stop();
+    apartment->wait();
+    __ks_async_raw::ks_raw_future::__set_inline_continuation_max_depth(old_max_depth);
+}
+BENCHMARK(ThenChainBench_Latency)
+    ->Arg(0)->Arg(16)
+    ->Unit(benchmark::kMicrosecond)->UseRealTime();
@@ -0,0 +1,76 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "bench_base.h"
+#include "../ks_manual_apartment_imp.h"
+
+
+// 在虚拟时钟套间上回放定时器密集型流量：N（1k/10k/100k）个并发的带超时的延时任务，
+// 各自的delay和timeout在1小时内随机分布（固定种子，结果可复现），一次advance回放完毕。
+// 以每个任务（post_delayed+set_timeout，含超时任务的撤销）的平均开销计，用于检测定时器队列的伸缩性。
+// 期望：平均开销随N增长缓慢（对数级）。
+
+static void VirtualTimeBench_PostDelayedWithTimeout(benchmark::State& state) {
+    const int64_t task_count = state.range(0);
+    ks_manual_apartment_imp apartment_imp("bench_virtual_time");
+    ks_apartment* apartment = &apartment_imp;
+
+    for (auto _ : state) {
+        uint32_t seed = 12345;
+        auto next_rand = [&seed]() { seed = seed * 1103515245 + 12345; return (int64_t)((seed >> 8) % (3600 * 1000)); };
+
+        std::vector<ks_future<void>> futures;
+        futures.reserve((size_t)task_count);
+        for (int64_t i = 0; i < task_count; ++i) {
+            const int64_t delay = next_rand();
+            const int64_t timeout = delay + next_rand() % 2000 - 1000; //约半数超时
+            futures.push_back(ks_future<void>::post_delayed(apartment, []() {}, delay).set_timeout((std::max)(timeout, (int64_t)1)));
+        }
+
+        apartment_imp.advance(3600 * 1000 + 1000);
+        benchmark::DoNotOptimize(futures.data());
+    }
+    state.SetItemsProcessed(state.iterations() * task_count);
+
+    apartment->async_stop();
+    apartment->wait();
+}
+BENCHMARK(VirtualTimeBench_PostDelayedWithTimeout)
+    ->Arg(1000)->Arg(10000)->Arg(100000)
+    ->Unit(benchmark::kMillisecond);
+
+// repeat_periodic在虚拟时钟下回放1小时（每秒一轮，共3600轮），以每轮的平均开销计。
+static void VirtualTimeBench_RepeatPeriodicHour(benchmark::State& state) {
+    ks_manual_apartment_imp apartment_imp("bench_virtual_time_periodic");
+    ks_apartment* apartment = &apartment_imp;
+
+    for (auto _ : state) {
+        int rounds = 0;
+        ks_future<void> periodic_future = ks_future_util::repeat_periodic(apartment, [&rounds]() -> ks_result<void> {
+            if (++rounds == 3600)
+                return ks_error::eof_error();
+            return nothing;
+        }, 1000, 1000);
+
+        apartment_imp.advance(3600 * 1000);
+        benchmark::DoNotOptimize(periodic_future.is_completed());
+    }
+    state.SetItemsProcessed(state.iterations() * 3600);
+
+    apartment->async_stop();
+    apartment->wait();
+}
+BENCHMARK(VirtualTimeBench_RepeatPeriodicHour)
+    ->Unit(benchmark::kMillisecond);
@@ -18,8 +18,10 @@ limitations under the License.
 #include "ks_raw_internal_helper.hpp"
 #include "../ktl/ks_concurrency.h"
 #include "../ktl/ks_defer.h"
+#include "../ktl/ks_small_vector.h"
 #include <vector>
 #include <algorithm>
+#include <new>
 
 void __forcelink_to_ks_raw_future_cpp() {}
 
@@ -113,11 +115,45 @@ enum class ks_raw_future_mode {
 
 #define __REAL_IMP
 
+//批量schedule：在批量区间内（参见ks_raw_future::__begin_batch_schedule），各future的schedule被暂存，
+//待最外层区间结束时按(apartment, priority)分组，经apartment->schedule_batch一次入队（带deadline的项则逐个schedule）。
+class ks_raw_future_baseimp;
+struct __BATCH_SCHEDULE_ITEM {
+	ks_apartment* apartment;
+	int priority;
+	ks_task_fn fn;
+	std::chrono::steady_clock::time_point deadline; //参见do_schedule_with_deadline_locked
+	ks_raw_future_ptr future; //保活，直至on_batch_scheduled
+	ks_raw_future_baseimp* future_imp;
+};
+
+static thread_local int tls_batch_schedule_depth = 0;
+
+//continuation就地执行（参见ks_raw_future::__set_inline_continuation_max_depth）
+static std::atomic<int> g_inline_continuation_max_depth = { __KS_ASYNC_RAW_FUTURE_INLINE_CONTINUATION_DEFAULT_MAX_DEPTH };
+static thread_local int tls_inline_continuation_depth = 0;
+static thread_local std::vector<__BATCH_SCHEDULE_ITEM> tls_batch_schedule_items;
+
+
 _ABSTRACT class ks_raw_future_baseimp : public ks_raw_future, public std::enable_shared_from_this<ks_raw_future> {
 protected:
 	explicit ks_raw_future_baseimp() = default;
 	_DISABLE_COPY_CONSTRUCTOR(ks_raw_future_baseimp);
 
+#if __KS_ASYNC_RAW_FUTURE_LOCKFREE_NEXT_ENABLED
+	~ks_raw_future_baseimp() {
+		//未曾completed即析构，则释放仍在栈中的下游
+		__NEXT_NODE* node = m_next_stack_head.exchange(__next_stack_completed(), std::memory_order_acquire);
+		if (node == __next_stack_completed())
+			node = std::exchange(m_feeding_next_nodes, nullptr); //或completed后未及feed的下游
+		while (node != nullptr) {
+			__NEXT_NODE* link = node->link;
+			do_release_next_node(node);
+			node = link;
+		}
+	}
+#endif
+
 	struct __INTERMEDIATE_DATA;
 	void do_init_base_locked(ks_apartment* spec_apartment, const ks_async_context& living_context, __INTERMEDIATE_DATA* intermediate_data_ptr, ks_raw_future_unique_lock& lock) {
 		ASSERT(intermediate_data_ptr != nullptr);
@@ -128,7 +164,7 @@ protected:
 
 		intermediate_data_ptr->m_spec_apartment = spec_apartment;
 		intermediate_data_ptr->m_living_context = living_context;
-		intermediate_data_ptr->m_create_time = std::chrono::steady_clock::now();
+		intermediate_data_ptr->m_create_time = do_determine_timeout_apartment(spec_apartment)->clock_now(); //按计时套间的时钟（参见ks_apartment::clock_now）
 	}
 
 	void do_init_with_result_locked(ks_apartment* spec_apartment, const ks_raw_result& completed_result, ks_raw_future_unique_lock& lock, bool must_keep_locked) {
@@ -141,10 +177,69 @@ protected:
 		this->do_complete_locked(completed_result, spec_apartment, true, false, lock, must_keep_locked);
 	}
 
+	//若处于批量区间内，则暂存fn（被移走）并返回true，待区间结束时schedule，并以其结果回调on_batch_scheduled
+	bool do_try_defer_to_batch_schedule_locked(ks_apartment* apartment, int priority, ks_task_fn& fn, ks_raw_future_unique_lock& lock) {
+		if (tls_batch_schedule_depth == 0)
+			return false;
+
+		tls_batch_schedule_items.push_back(__BATCH_SCHEDULE_ITEM{ apartment, priority, std::move(fn), this->do_get_deadline_locked(lock), this->shared_from_this(), this });
+		return true;
+	}
+
+	//以timeout时点作为deadline（若有），使EDF套间（参见ks_apartment::deadline_schedule_feature）按deadline先后执行
+	std::chrono::steady_clock::time_point do_get_deadline_locked(ks_raw_future_unique_lock& lock) {
+		auto intermediate_data_ptr = __get_intermediate_data_ptr(lock);
+		return intermediate_data_ptr != nullptr ? intermediate_data_ptr->m_timeout_time : std::chrono::steady_clock::time_point{};
+	}
+
+	uint64_t do_schedule_with_deadline_locked(ks_apartment* apartment, int priority, ks_task_fn&& fn, ks_raw_future_unique_lock& lock) {
+		const auto deadline = this->do_get_deadline_locked(lock);
+		return deadline != std::chrono::steady_clock::time_point{}
+			? apartment->schedule_with_deadline(std::move(fn), priority, deadline)
+			: apartment->schedule(std::move(fn), priority);
+	}
+
+	//具备inline_execution_feature的套间（如inline_apartment）在schedule时即同步执行fn，而fn会再次lock本future，故须先解锁
+	static bool do_check_inline_apartment(ks_apartment* apartment) {
+		return (apartment->features() & ks_apartment::inline_execution_feature) != 0;
+	}
+
+	uint64_t do_schedule_inline_unlocked(ks_apartment* apartment, int priority, ks_task_fn&& fn, ks_raw_future_unique_lock& lock) {
+		ASSERT(lock.owns_lock());
+		lock.unlock();
+		const int batch_schedule_depth_backup = std::exchange(tls_batch_schedule_depth, 0); //就地执行期间暂停批量schedule，以免fn内post后wait而死等
+		ks_defer defer_restore_batch_schedule_depth([batch_schedule_depth_backup]() { tls_batch_schedule_depth = batch_schedule_depth_backup; });
+		return apartment->schedule(std::move(fn), priority);
+	}
+
+	//当前线程即属于目标套间、且未超出嵌套深度上限时，下游可就地执行
+	static bool do_check_inline_continuation(ks_apartment* apartment, int priority) {
+		const int max_depth = g_inline_continuation_max_depth.load(std::memory_order_relaxed);
+		return max_depth > 0 && tls_inline_continuation_depth < max_depth
+			&& priority >= 0 && tls_batch_schedule_depth == 0
+			&& ks_apartment::current_thread_apartment() == apartment;
+	}
+
+	static void do_run_inline_continuation_unlocked(ks_task_fn& fn, ks_raw_future_unique_lock& lock) {
+		ASSERT(lock.owns_lock());
+		lock.unlock();
+		++tls_inline_continuation_depth;
+		ks_defer defer_dec_inline_continuation_depth([]() { --tls_inline_continuation_depth; });
+		fn();
+		fn = {};
+	}
+
+	virtual void on_batch_scheduled(uint64_t schedule_id, ks_apartment* apartment) {
+		ASSERT(false);
+	}
+
+	static void do_flush_batch_schedule();
+
 public:
 	virtual ks_raw_future_ptr then(std::function<ks_raw_result(const ks_raw_value&)>&& fn, const ks_async_context& context, ks_apartment* apartment) override final;
 	virtual ks_raw_future_ptr trap(std::function<ks_raw_result(const ks_error&)>&& fn, const ks_async_context& context, ks_apartment* apartment) override final;
 	virtual ks_raw_future_ptr transform(std::function<ks_raw_result(const ks_raw_result&)>&& fn, const ks_async_context& context, ks_apartment* apartment) override final;
+	virtual ks_raw_future_ptr then_by_move(std::function<ks_raw_result(ks_raw_value&&)>&& fn, const ks_async_context& context, ks_apartment* apartment) override final;
 
 	virtual ks_raw_future_ptr flat_then(std::function<ks_raw_future_ptr(const ks_raw_value&)>&& fn, const ks_async_context& context, ks_apartment* apartment) override final;
 	virtual ks_raw_future_ptr flat_trap(std::function<ks_raw_future_ptr(const ks_error&)>&& fn, const ks_async_context& context, ks_apartment* apartment) override final;
@@ -192,7 +287,7 @@ protected:
 				if (intermediate_data_ptr->m_living_context.__check_controller_cancelled())
 					return true;
 
-				if (intermediate_data_ptr->m_timeout_time != std::chrono::steady_clock::time_point{} && (intermediate_data_ptr->m_timeout_time <= std::chrono::steady_clock::now()))
+				if (intermediate_data_ptr->m_timeout_time != std::chrono::steady_clock::time_point{} && (intermediate_data_ptr->m_timeout_time <= do_determine_timeout_apartment(intermediate_data_ptr->m_spec_apartment)->clock_now()))
 					return true;
 			}
 
@@ -218,7 +313,7 @@ protected:
 				if (intermediate_data_ptr->m_living_context.__check_controller_cancelled())
 					return ks_error::cancelled_error();
 
-				if (intermediate_data_ptr->m_timeout_time != std::chrono::steady_clock::time_point{} && (intermediate_data_ptr->m_timeout_time <= std::chrono::steady_clock::now()))
+				if (intermediate_data_ptr->m_timeout_time != std::chrono::steady_clock::time_point{} && (intermediate_data_ptr->m_timeout_time <= do_determine_timeout_apartment(intermediate_data_ptr->m_spec_apartment)->clock_now()))
 					return ks_error::timeout_error();
 			}
 
@@ -281,12 +376,40 @@ protected:
 
 protected:
 	virtual void do_add_next(const ks_raw_future_ptr& next_future) override final {
+	#if __KS_ASYNC_RAW_FUTURE_LOCKFREE_NEXT_ENABLED
+		//未completed时仅一次CAS压栈即可，无须持锁
+		__NEXT_NODE* node = do_acquire_next_node(next_future);
+		if (this->do_try_push_next_nodes(node, node))
+			return;
+		do_release_next_node(node);
+	#endif
+
 		ks_raw_future_unique_lock lock(__get_mutex(), __is_using_pseudo_mutex());
 		return this->do_add_next_locked(next_future, lock, false);
 	}
 
 	virtual void do_add_next_multi(const std::vector<ks_raw_future_ptr>& next_futures) override final {
 		if (!next_futures.empty()) {
+		#if __KS_ASYNC_RAW_FUTURE_LOCKFREE_NEXT_ENABLED
+			//串成一段后一次CAS压栈（栈顶为最后一项）
+			__NEXT_NODE* first_node = nullptr;
+			__NEXT_NODE* last_node = nullptr;
+			for (auto& next_future : next_futures) {
+				__NEXT_NODE* node = do_acquire_next_node(next_future);
+				node->link = last_node;
+				if (first_node == nullptr)
+					first_node = node;
+				last_node = node;
+			}
+			if (this->do_try_push_next_nodes(first_node, last_node))
+				return;
+			for (__NEXT_NODE* node = last_node; node != nullptr; ) {
+				__NEXT_NODE* link = node->link;
+				do_release_next_node(node);
+				node = link;
+			}
+		#endif
+
 			ks_raw_future_unique_lock lock(__get_mutex(), __is_using_pseudo_mutex());
 			return this->do_add_next_multi_locked(next_futures, lock, false);
 		}
@@ -301,30 +424,31 @@ protected:
 		ASSERT(lock.owns_lock() && !must_keep_locked);
 
 		if (!m_completed_result.is_completed()) {
-			auto intermediate_data_ptr = __get_intermediate_data_ptr(lock);
-			ASSERT(intermediate_data_ptr != nullptr);
-
-			ASSERT(intermediate_data_ptr->m_next_future_1st != next_future
-				&& std::find(intermediate_data_ptr->m_next_future_more.cbegin(), intermediate_data_ptr->m_next_future_more.cend(), next_future) == intermediate_data_ptr->m_next_future_more.cend());
-			if (intermediate_data_ptr->m_next_future_1st == nullptr)
-				intermediate_data_ptr->m_next_future_1st = next_future;
-			else
-				intermediate_data_ptr->m_next_future_more.push_back(next_future);
+		#if __KS_ASYNC_RAW_FUTURE_LOCKFREE_NEXT_ENABLED
+			//complete亦持锁，故持锁期间压栈必然成功
+			__NEXT_NODE* node = do_acquire_next_node(next_future);
+			const bool pushed = this->do_try_push_next_nodes(node, node);
+			ASSERT(pushed);
+			(void)pushed;
+		#else
+			ASSERT(std::find(m_next_futures.cbegin(), m_next_futures.cend(), next_future) == m_next_futures.cend());
+			m_next_futures.push_back(next_future);
+		#endif
 		}
 		else {
 			ks_raw_result const my_completed_result = m_completed_result;
 			ks_apartment* const prefer_completed_apartment = m_completed_apartment;
-			uint64_t act_schedule_id = prefer_completed_apartment->schedule(
+			lock.unlock(); //schedule无须持锁（且inline套间会就地执行fn）
+			uint64_t act_schedule_id = prefer_completed_apartment->schedule(ks_task_fn(
 				[this, this_shared = this->shared_from_this(), next_future, my_completed_result, prefer_completed_apartment]() {
 				next_future->on_feeded_by_prev(my_completed_result, this, prefer_completed_apartment);
-			}, 0);
+			}), 0);
 
 			if (act_schedule_id == 0) {
-				lock.unlock();
 				next_future->do_complete(ks_error::terminated_error(), prefer_completed_apartment, false, false);
-				if (must_keep_locked)
-					lock.lock();
 			}
+			if (must_keep_locked)
+				lock.lock();
 		}
 	}
 
@@ -333,34 +457,33 @@ protected:
 
 		if (!next_futures.empty()) {
 			if (!m_completed_result.is_completed()) {
-				auto intermediate_data_ptr = __get_intermediate_data_ptr(lock);
-				ASSERT(intermediate_data_ptr != nullptr);
-
-				auto next_future_it = next_futures.cbegin();
-				if (intermediate_data_ptr->m_next_future_1st == nullptr)
-					intermediate_data_ptr->m_next_future_1st = *next_future_it++;
-				if (next_future_it != next_futures.cend()) {
-					intermediate_data_ptr->m_next_future_more.insert(
-						intermediate_data_ptr->m_next_future_more.end(),
-						next_future_it, next_futures.cend());
+			#if __KS_ASYNC_RAW_FUTURE_LOCKFREE_NEXT_ENABLED
+				for (auto& next_future : next_futures) {
+					__NEXT_NODE* node = do_acquire_next_node(next_future);
+					const bool pushed = this->do_try_push_next_nodes(node, node);
+					ASSERT(pushed);
+					(void)pushed;
 				}
+			#else
+				m_next_futures.append(next_futures.cbegin(), next_futures.cend());
+			#endif
 			}
 			else {
 				ks_raw_result const my_completed_result = m_completed_result;
 				ks_apartment* const prefer_completed_apartment = m_completed_apartment;
-				uint64_t act_schedule_id = prefer_completed_apartment->schedule(
+				lock.unlock(); //schedule无须持锁（且inline套间会就地执行fn）
+				uint64_t act_schedule_id = prefer_completed_apartment->schedule(ks_task_fn(
 					[this, this_shared = this->shared_from_this(), next_futures, my_completed_result, prefer_completed_apartment]() {
 					for (auto& next_future : next_futures)
 						next_future->on_feeded_by_prev(my_completed_result, this, prefer_completed_apartment);
-				}, 0);
+				}), 0);
 
 				if (act_schedule_id == 0) {
-					lock.unlock();
 					for (auto& next_future : next_futures)
 						next_future->do_complete(ks_error::terminated_error(), prefer_completed_apartment, false, false);
-					if (must_keep_locked)
-						lock.lock();
 				}
+				if (must_keep_locked)
+					lock.lock();
 			}
 		}
 	}
@@ -375,10 +498,15 @@ protected:
 		auto intermediate_data_ptr = __get_intermediate_data_ptr(lock);
 		//here, intermediate_data_ptr maybe nullptr (when dx)!
 
-		ks_raw_result const my_completed_result = completed_result.require_completed_or_error();
+		ks_raw_result my_completed_result = completed_result.require_completed_or_error();
 		ks_apartment* const my_completed_apartment = do_determine_completed_apartment(intermediate_data_ptr != nullptr ? intermediate_data_ptr->m_spec_apartment : nullptr, hint_apartment);
 		m_completed_result = my_completed_result;
 		m_completed_apartment = my_completed_apartment;
+	#if __KS_ASYNC_RAW_FUTURE_LOCKFREE_NEXT_ENABLED
+		//转为completed，同时取走下游栈（此后add_next将直接feed）
+		__NEXT_NODE* const t_next_stack = m_next_stack_head.exchange(__next_stack_completed(), std::memory_order_acq_rel);
+		ASSERT(t_next_stack != __next_stack_completed());
+	#endif
 		if (__get_mode() == ks_raw_future_mode::DX) {
 			//dx-future是在init时立即do_complete的，状态初始化为completed后就没什么其他要做的事儿了
 			ASSERT(intermediate_data_ptr == nullptr);
@@ -388,9 +516,7 @@ protected:
 		//除了dx-future以外，其他类型future还需要在状态转为completed时feed其所有下游
 		ASSERT(intermediate_data_ptr != nullptr);
 
-		ks_raw_future_ptr t_next_future_1st = nullptr;
-		std::vector<ks_raw_future_ptr> t_next_future_more{};
-		std::vector<ks_apartment*> t_waiting_for_me_apartments{};
+		__WAITING_APARTMENTS t_waiting_for_me_apartments{};
 		ks_async_context t_living_context = {};
 		if (intermediate_data_ptr != nullptr) {
 			if (intermediate_data_ptr->m_timeout_schedule_id != 0) {
@@ -406,16 +532,21 @@ protected:
 			intermediate_data_ptr->m_completion_waitable_atomic_flag.__notify_all();  //notify all waiting threads
 
 			//take next-futures
-			t_next_future_1st = std::move(intermediate_data_ptr->m_next_future_1st);
-			t_next_future_more.swap(intermediate_data_ptr->m_next_future_more);
-			intermediate_data_ptr->m_next_future_1st = nullptr;
-			intermediate_data_ptr->m_next_future_more.clear();
-			intermediate_data_ptr->m_next_future_more.shrink_to_fit();
+		#if __KS_ASYNC_RAW_FUTURE_LOCKFREE_NEXT_ENABLED
+			//栈为后进先出，反转后即为挂接次序，留待feed（参见do_feed_next_futures_unlocked）
+			ASSERT(m_feeding_next_nodes == nullptr);
+			for (__NEXT_NODE* node = t_next_stack; node != nullptr; ) {
+				__NEXT_NODE* link = node->link;
+				node->link = m_feeding_next_nodes;
+				m_feeding_next_nodes = node;
+				node = link;
+			}
+		#else
+			//m_next_futures自此即为待feed的下游（参见do_feed_next_futures_unlocked）
+		#endif
 
 			//take waiting-apartments
-			t_waiting_for_me_apartments.swap(intermediate_data_ptr->m_waiting_for_me_apartments);
-			intermediate_data_ptr->m_waiting_for_me_apartments.clear();
-			intermediate_data_ptr->m_waiting_for_me_apartments.shrink_to_fit();
+			t_waiting_for_me_apartments = std::move(intermediate_data_ptr->m_waiting_for_me_apartments);
 
 			//完毕，自此刻起，本future进入completed稳态，可清除intermediate-data了
 			t_living_context = std::move(intermediate_data_ptr->m_living_context);
@@ -434,29 +565,27 @@ protected:
 			t_living_context = {};
 
 			//feed next-futures
-			if ((t_next_future_1st != nullptr || !t_next_future_more.empty()) && !from_destructor) {
-				if (from_internal) {
-					if (t_next_future_1st != nullptr)
-						t_next_future_1st->on_feeded_by_prev(my_completed_result, this, my_completed_apartment);
-					for (auto& next_future : t_next_future_more)
-						next_future->on_feeded_by_prev(my_completed_result, this, my_completed_apartment);
+			if (this->do_has_next_futures_to_feed() && !from_destructor) {
+				//当前线程即属于完成套间时，就地喂入下游，省掉一次schedule往返
+				const bool should_inline = !from_internal && this->do_check_inline_continuation(my_completed_apartment, 0);
+				if (from_internal || should_inline) {
+					if (should_inline)
+						++tls_inline_continuation_depth;
+					ks_defer defer_dec_inline_continuation_depth([should_inline]() { if (should_inline) --tls_inline_continuation_depth; });
+
+					this->do_feed_next_futures_unlocked(my_completed_result, my_completed_apartment);
 				}
 				else {
-					uint64_t act_schedule_id = my_completed_apartment->schedule(
-						[this, this_shared = this->shared_from_this(),
-						t_next_future_1st, t_next_future_more,  //因为失败时还需要处理，所以不可以右值引用传递
-						my_completed_result, my_completed_apartment]() {
-						if (t_next_future_1st != nullptr)
-							t_next_future_1st->on_feeded_by_prev(my_completed_result, this, my_completed_apartment);
-						for (auto& next_future : t_next_future_more)
-							next_future->on_feeded_by_prev(my_completed_result, this, my_completed_apartment);
-					}, 0);
+					//待feed的下游留在本future中（而非复制进fn），fn仅持有this_shared；
+					//schedule失败时fn不会被执行，下游仍在，故可再以terminated_error喂入
+					//注：my_completed_result移交给fn，以免多一份引用而妨碍下游move-through（参见ks_raw_value::take）
+					uint64_t act_schedule_id = my_completed_apartment->schedule(ks_task_fn(
+						[this, this_shared = this->shared_from_this(), my_completed_result = std::move(my_completed_result), my_completed_apartment]() {
+						this->do_feed_next_futures_unlocked(my_completed_result, my_completed_apartment);
+					}), 0);
 
 					if (act_schedule_id == 0) {
-						if (t_next_future_1st != nullptr)
-							t_next_future_1st->on_feeded_by_prev(ks_error::terminated_error(), this, my_completed_apartment);
-						for (auto& next_future : t_next_future_more)
-							next_future->on_feeded_by_prev(ks_error::terminated_error(), this, my_completed_apartment);
+						this->do_feed_next_futures_unlocked(ks_error::terminated_error(), my_completed_apartment);
 					}
 				}
 			}
@@ -470,6 +599,42 @@ protected:
 		}
 	}
 
+	//completed后，是否有待feed的下游
+	bool do_has_next_futures_to_feed() {
+	#if __KS_ASYNC_RAW_FUTURE_LOCKFREE_NEXT_ENABLED
+		return m_feeding_next_nodes != nullptr;
+	#else
+		return !m_next_futures.empty();
+	#endif
+	}
+
+	//取出全部待feed的下游，并按挂接次序feed之（多个下游时，其各自的schedule经schedule_batch一次入队）
+	//注：completed后，待feed的下游仅由一方（do_complete或其schedule的fn）取出，故无须持锁
+	void do_feed_next_futures_unlocked(const ks_raw_result& result, ks_apartment* apartment) {
+	#if __KS_ASYNC_RAW_FUTURE_LOCKFREE_NEXT_ENABLED
+		__NEXT_NODE* node = std::exchange(m_feeding_next_nodes, nullptr);
+		const bool should_batch = node != nullptr && node->link != nullptr;
+	#else
+		__NEXT_FUTURES t_next_futures = std::move(m_next_futures);
+		const bool should_batch = t_next_futures.size() > 1;
+	#endif
+		if (should_batch)
+			ks_raw_future::__begin_batch_schedule();
+		ks_defer defer_end_batch_schedule([should_batch]() { if (should_batch) ks_raw_future::__end_batch_schedule(); });
+
+	#if __KS_ASYNC_RAW_FUTURE_LOCKFREE_NEXT_ENABLED
+		while (node != nullptr) {
+			__NEXT_NODE* link = node->link; //注：node释放后可能随即被复用，须先取得link
+			ks_raw_future_ptr next_future = do_release_next_node(node);
+			next_future->on_feeded_by_prev(result, this, apartment);
+			node = link;
+		}
+	#else
+		for (auto& next_future : t_next_futures)
+			next_future->on_feeded_by_prev(result, this, apartment);
+	#endif
+	}
+
 	virtual void do_set_timeout(int64_t timeout, const ks_error& error, bool backtrack) override final {
 		ks_raw_future_unique_lock lock(__get_mutex(), __is_using_pseudo_mutex());
 		if (m_completed_result.is_completed())
@@ -495,7 +660,7 @@ protected:
 			return; //infinity (no-timeout forever)
 
 		//check timeout, at once
-		const std::chrono::steady_clock::time_point now_time = std::chrono::steady_clock::now();
+		const std::chrono::steady_clock::time_point now_time = do_determine_timeout_apartment(intermediate_data_ptr->m_spec_apartment)->clock_now();
 		const int64_t timeout_remain_ms = std::chrono::duration_cast<std::chrono::milliseconds>(intermediate_data_ptr->m_timeout_time - now_time).count();
 		if (timeout_remain_ms <= 0) {
 			if (!m_completed_result.is_completed()) {
@@ -507,7 +672,7 @@ protected:
 
 		//schedule timeout
 		intermediate_data_ptr->m_timeout_apartment = do_determine_timeout_apartment(intermediate_data_ptr->m_spec_apartment);
-		intermediate_data_ptr->m_timeout_schedule_id = intermediate_data_ptr->m_timeout_apartment->schedule_delayed(
+		intermediate_data_ptr->m_timeout_schedule_id = intermediate_data_ptr->m_timeout_apartment->schedule_delayed(ks_task_fn(
 			[this, this_shared = this->shared_from_this(), intermediate_data_ptr, t_timeout_time, error, backtrack]() -> void {
 			ks_raw_future_unique_lock lock2(__get_mutex(), __is_using_pseudo_mutex());
 			if (m_completed_result.is_completed())
@@ -522,7 +687,7 @@ protected:
 
 			lock2.unlock();
 			this->do_try_cancel(error, backtrack); //will become timeout
-		}, 0x8000, timeout_remain_ms);
+		}), 0x8000, timeout_remain_ms);
 
 		if (intermediate_data_ptr->m_timeout_schedule_id == 0) {
 			//we can just ignore scheduling timeout-fn failure, simply.
@@ -570,6 +735,64 @@ protected:
 	ks_raw_result m_completed_result{};
 	ks_apartment* m_completed_apartment = nullptr;
 
+#if __KS_ASYNC_RAW_FUTURE_LOCKFREE_NEXT_ENABLED
+	//无锁的下游栈：m_next_stack_head为带标记的指针，未completed时指向以CAS压入的侵入式下游栈，
+	//complete时被一次exchange为__next_stack_completed()（同时取走整个栈），故add_next与complete互不争锁。
+	//各future内嵌一个node供其作为下游时使用，仅当同时作为多个future的下游（如aggr）时才另行分配node。
+	struct __NEXT_NODE {
+		explicit __NEXT_NODE(bool embedded_) : embedded(embedded_) {}
+		ks_raw_future_ptr next_future = nullptr; //入栈期间持有下游future
+		__NEXT_NODE* link = nullptr;
+		const bool embedded;
+	};
+
+	std::atomic<__NEXT_NODE*> m_next_stack_head = { nullptr };
+	__NEXT_NODE* m_feeding_next_nodes = nullptr; //completed后取出的下游（已按挂接次序），待feed
+	__NEXT_NODE m_embedded_next_node{ true };
+	std::atomic<bool> m_embedded_next_node_busy = { false };
+
+	static __NEXT_NODE* __next_stack_completed() {
+		return reinterpret_cast<__NEXT_NODE*>(uintptr_t(1)); //completed标记
+	}
+
+	static __NEXT_NODE* do_acquire_next_node(const ks_raw_future_ptr& next_future) {
+		ks_raw_future_baseimp* next_future_imp = static_cast<ks_raw_future_baseimp*>(next_future.get());
+		__NEXT_NODE* node = !next_future_imp->m_embedded_next_node_busy.exchange(true, std::memory_order_acquire)
+			? &next_future_imp->m_embedded_next_node
+			: new __NEXT_NODE(false);
+		node->next_future = next_future;
+		node->link = nullptr;
+		return node;
+	}
+
+	static ks_raw_future_ptr do_release_next_node(__NEXT_NODE* node) {
+		ks_raw_future_ptr next_future = std::move(node->next_future);
+		node->next_future = nullptr;
+		if (node->embedded)
+			static_cast<ks_raw_future_baseimp*>(next_future.get())->m_embedded_next_node_busy.store(false, std::memory_order_release);
+		else
+			delete node;
+		return next_future;
+	}
+
+	//将[first_node..last_node]（以link由last_node链向first_node）压栈，若已completed则返回false
+	bool do_try_push_next_nodes(__NEXT_NODE* first_node, __NEXT_NODE* last_node) {
+		__NEXT_NODE* head = m_next_stack_head.load(std::memory_order_acquire);
+		do {
+			if (head == __next_stack_completed())
+				return false;
+			first_node->link = head;
+		} while (!m_next_stack_head.compare_exchange_weak(head, last_node, std::memory_order_release, std::memory_order_acquire));
+		return true;
+	}
+#else
+	//下游列表：未completed时由锁保护，completed后即为待feed的下游
+	using __NEXT_FUTURES = ks_small_vector<ks_raw_future_ptr, 2>;
+	__NEXT_FUTURES m_next_futures;
+#endif
+
+	using __WAITING_APARTMENTS = ks_small_vector<ks_apartment*, 2>;
+
 	struct __INTERMEDIATE_DATA {
 		ks_apartment* m_spec_apartment = nullptr;                  //const-like
 		ks_async_context m_living_context = {};                    //const-like
@@ -579,10 +802,7 @@ protected:
 		ks_apartment* m_timeout_apartment = nullptr;
 		uint64_t m_timeout_schedule_id = 0;
 
-		ks_raw_future_ptr m_next_future_1st = nullptr;
-		std::vector<ks_raw_future_ptr> m_next_future_more{};
-
-		std::vector<ks_apartment*> m_waiting_for_me_apartments{};
+		__WAITING_APARTMENTS m_waiting_for_me_apartments{};
 
 		ks_error m_cancelled_error{}; //volatile-like
 
@@ -743,8 +963,13 @@ private:
 			if (!m_promise_future->m_completed_result.is_completed()) {
 				//若最终未被settle过，则自动reject，以确保future最终completed
 				ks_raw_future_unique_lock lock(m_promise_future->__get_mutex(), m_promise_future->__is_using_pseudo_mutex());
+			#if __KS_ASYNC_RAW_FUTURE_LOCKFREE_NEXT_ENABLED
 				ASSERT((m_promise_future->m_completed_result.is_completed())
-					|| (m_promise_future->__get_intermediate_data_ex_ptr(lock)->m_next_future_1st == nullptr && m_promise_future->__get_intermediate_data_ex_ptr(lock)->m_next_future_more.empty()));
+					|| (m_promise_future->m_next_stack_head.load(std::memory_order_acquire) == nullptr));
+			#else
+				ASSERT((m_promise_future->m_completed_result.is_completed())
+					|| (m_promise_future->m_next_futures.empty()));
+			#endif
 			}
 		#endif
 		}
@@ -801,7 +1026,7 @@ private:
 
 		ks_apartment* prefer_apartment = this->do_determine_prefer_apartment(intermediate_data_ex_ptr->m_spec_apartment);
 
-		std::function<void()> pending_schedule_fn = [this, this_shared = this->shared_from_this(), intermediate_data_ex_ptr, prefer_apartment, context = intermediate_data_ex_ptr->m_living_context]() mutable -> void {
+		ks_task_fn pending_schedule_fn([this, this_shared = this->shared_from_this(), intermediate_data_ex_ptr, prefer_apartment, context = intermediate_data_ex_ptr->m_living_context]() mutable -> void {
 			ks_raw_future_unique_lock lock2(__get_mutex(), __is_using_pseudo_mutex());
 			if (m_completed_result.is_completed())
 				return; //pre-check cancelled
@@ -837,21 +1062,36 @@ private:
 			}
 
 			this->do_complete_locked(result, prefer_apartment, true, false, lock2, false);
-		};
+		});
 
 		int priority = intermediate_data_ex_ptr->m_living_context.__get_priority();
 		bool could_run_locally = (m_task_mode == ks_raw_future_mode::TASK) && (priority >= 0x10000) && (intermediate_data_ex_ptr->m_spec_apartment == nullptr || intermediate_data_ex_ptr->m_spec_apartment == prefer_apartment);
 		if (could_run_locally) {
 			lock.unlock();
+			const int batch_schedule_depth_backup = std::exchange(tls_batch_schedule_depth, 0); //就地执行期间暂停批量schedule，以免fn内post后wait而死等
+			ks_defer defer_restore_batch_schedule_depth([batch_schedule_depth_backup]() { tls_batch_schedule_depth = batch_schedule_depth_backup; });
 			pending_schedule_fn(); //超高优先级、且spec_partment为nullptr，则立即执行，省掉schedule过程
 			pending_schedule_fn = {};
 			if (must_keep_locked)
 				lock.lock();
 		}
+		else if (m_task_mode == ks_raw_future_mode::TASK && this->do_check_inline_apartment(prefer_apartment)) {
+			intermediate_data_ex_ptr->m_pending_aparrment = prefer_apartment;
+			uint64_t act_schedule_id = this->do_schedule_inline_unlocked(prefer_apartment, priority, std::move(pending_schedule_fn), lock);
+			if (act_schedule_id == 0) {
+				//schedule失败，则立即将this标记为错误即可
+				lock.lock();
+				if (!m_completed_result.is_completed())
+					this->do_complete_locked(ks_error::terminated_error(), nullptr, false, false, lock, false);
+			}
+		}
 		else {
 			intermediate_data_ex_ptr->m_pending_aparrment = prefer_apartment;
+			if (m_task_mode == ks_raw_future_mode::TASK && this->do_try_defer_to_batch_schedule_locked(prefer_apartment, priority, pending_schedule_fn, lock))
+				return; //待批量区间结束时schedule，参见on_batch_scheduled
+
 			intermediate_data_ex_ptr->m_pending_schedule_id = (m_task_mode == ks_raw_future_mode::TASK)
-				? intermediate_data_ex_ptr->m_pending_aparrment->schedule(std::move(pending_schedule_fn), priority)
+				? this->do_schedule_with_deadline_locked(intermediate_data_ex_ptr->m_pending_aparrment, priority, std::move(pending_schedule_fn), lock)
 				: intermediate_data_ex_ptr->m_pending_aparrment->schedule_delayed(std::move(pending_schedule_fn), priority, intermediate_data_ex_ptr->m_delay);
 			if (intermediate_data_ex_ptr->m_pending_schedule_id == 0) {
 				//schedule失败，则立即将this标记为错误即可
@@ -866,6 +1106,23 @@ protected:
 		ASSERT(false);
 	}
 
+	virtual void on_batch_scheduled(uint64_t schedule_id, ks_apartment* apartment) override {
+		ks_raw_future_unique_lock lock(__get_mutex(), __is_using_pseudo_mutex());
+		if (m_completed_result.is_completed())
+			return;
+
+		auto intermediate_data_ex_ptr = __get_intermediate_data_ex_ptr(lock);
+		ASSERT(intermediate_data_ex_ptr != nullptr);
+
+		if (schedule_id == 0) {
+			//schedule失败，则立即将this标记为错误即可
+			return this->do_complete_locked(ks_error::terminated_error(), nullptr, false, false, lock, false);
+		}
+
+		if (!intermediate_data_ex_ptr->m_pending_touched_flag)
+			intermediate_data_ex_ptr->m_pending_schedule_id = schedule_id; //若已开始执行，则不必再记录
+	}
+
 	virtual bool is_cancelable_self() override {
 		return true; 
 	}
@@ -883,7 +1140,7 @@ protected:
 		intermediate_data_ex_ptr->m_cancelled_error = error;
 
 		//若为未到期的延时task-future，则立即do_complete
-		if (m_task_mode == ks_raw_future_mode::TASK_DELAYED && intermediate_data_ex_ptr->m_create_time + std::chrono::milliseconds(intermediate_data_ex_ptr->m_delay) > std::chrono::steady_clock::now()) {
+		if (m_task_mode == ks_raw_future_mode::TASK_DELAYED && intermediate_data_ex_ptr->m_create_time + std::chrono::milliseconds(intermediate_data_ex_ptr->m_delay) > do_determine_timeout_apartment(intermediate_data_ex_ptr->m_spec_apartment)->clock_now()) {
 			this->do_complete_locked(error, nullptr, false, false, lock, false);
 		}
 	}
@@ -934,6 +1191,124 @@ private:
 };
 
 
+//pipe-future的fn：按签名原样保存then/trap/on_xxxx的fn（而非再包装为统一签名的fn_ex），以省去一次std::function的堆分配
+//注：各签名的std::function共用同一块存储（union），reset时仅清空fn而保留其签名，以便就地复用
+class ks_raw_pipe_fn final {
+public:
+	using FN_EX = std::function<ks_raw_result(const ks_raw_result&)>;  //transform、forward
+	using FN_THEN = std::function<ks_raw_result(const ks_raw_value&)>;
+	using FN_THEN_MOVE = std::function<ks_raw_result(ks_raw_value&&)>;
+	using FN_TRAP = std::function<ks_raw_result(const ks_error&)>;
+	using FN_ON_SUCCESS = std::function<void(const ks_raw_value&)>;
+	using FN_ON_FAILURE = std::function<void(const ks_error&)>;
+	using FN_ON_COMPLETION = std::function<void(const ks_raw_result&)>;
+
+	ks_raw_pipe_fn() noexcept : m_kind(_KIND::FN_EX) { new (&m_fn_ex_u) FN_EX(); }
+	ks_raw_pipe_fn(FN_EX&& fn) noexcept : m_kind(_KIND::FN_EX) { new (&m_fn_ex_u) FN_EX(std::move(fn)); }
+	ks_raw_pipe_fn(FN_THEN&& fn) noexcept : m_kind(_KIND::FN_THEN) { new (&m_fn_then_u) FN_THEN(std::move(fn)); }
+	ks_raw_pipe_fn(FN_THEN_MOVE&& fn) noexcept : m_kind(_KIND::FN_THEN_MOVE) { new (&m_fn_then_move_u) FN_THEN_MOVE(std::move(fn)); }
+	ks_raw_pipe_fn(FN_TRAP&& fn) noexcept : m_kind(_KIND::FN_TRAP) { new (&m_fn_trap_u) FN_TRAP(std::move(fn)); }
+	ks_raw_pipe_fn(FN_ON_SUCCESS&& fn) noexcept : m_kind(_KIND::FN_ON_SUCCESS) { new (&m_fn_on_success_u) FN_ON_SUCCESS(std::move(fn)); }
+	ks_raw_pipe_fn(FN_ON_FAILURE&& fn) noexcept : m_kind(_KIND::FN_ON_FAILURE) { new (&m_fn_on_failure_u) FN_ON_FAILURE(std::move(fn)); }
+	ks_raw_pipe_fn(FN_ON_COMPLETION&& fn) noexcept : m_kind(_KIND::FN_ON_COMPLETION) { new (&m_fn_on_completion_u) FN_ON_COMPLETION(std::move(fn)); }
+
+	ks_raw_pipe_fn(ks_raw_pipe_fn&& r) noexcept : m_kind(_KIND::FN_EX) {
+		new (&m_fn_ex_u) FN_EX();
+		*this = std::move(r);
+	}
+
+	ks_raw_pipe_fn& operator=(ks_raw_pipe_fn&& r) noexcept {
+		if (this != &r) {
+			this->destroy();
+			m_kind = r.m_kind;
+			switch (m_kind) {
+			case _KIND::FN_EX: new (&m_fn_ex_u) FN_EX(std::move(r.m_fn_ex_u)); break;
+			case _KIND::FN_THEN: new (&m_fn_then_u) FN_THEN(std::move(r.m_fn_then_u)); break;
+			case _KIND::FN_THEN_MOVE: new (&m_fn_then_move_u) FN_THEN_MOVE(std::move(r.m_fn_then_move_u)); break;
+			case _KIND::FN_TRAP: new (&m_fn_trap_u) FN_TRAP(std::move(r.m_fn_trap_u)); break;
+			case _KIND::FN_ON_SUCCESS: new (&m_fn_on_success_u) FN_ON_SUCCESS(std::move(r.m_fn_on_success_u)); break;
+			case _KIND::FN_ON_FAILURE: new (&m_fn_on_failure_u) FN_ON_FAILURE(std::move(r.m_fn_on_failure_u)); break;
+			case _KIND::FN_ON_COMPLETION: new (&m_fn_on_completion_u) FN_ON_COMPLETION(std::move(r.m_fn_on_completion_u)); break;
+			}
+		}
+		return *this;
+	}
+
+	_DISABLE_COPY_CONSTRUCTOR(ks_raw_pipe_fn);
+
+	~ks_raw_pipe_fn() noexcept {
+		this->destroy();
+	}
+
+public:
+	//注：input由调用者让出，透传时直接移交，FN_THEN_MOVE则将其value移交给fn
+	ks_raw_result operator()(ks_raw_result&& input) const {
+		switch (m_kind) {
+		case _KIND::FN_EX:
+			return m_fn_ex_u(input);
+		case _KIND::FN_THEN:
+			return input.is_value() ? m_fn_then_u(input.to_value()) : std::move(input);
+		case _KIND::FN_THEN_MOVE:
+			return input.is_value() ? m_fn_then_move_u(input.__take_value()) : std::move(input);
+		case _KIND::FN_TRAP:
+			return input.is_error() ? m_fn_trap_u(input.to_error()) : std::move(input);
+		case _KIND::FN_ON_SUCCESS:
+			if (input.is_value())
+				m_fn_on_success_u(input.to_value());
+			return std::move(input);
+		case _KIND::FN_ON_FAILURE:
+			if (input.is_error())
+				m_fn_on_failure_u(input.to_error());
+			return std::move(input);
+		case _KIND::FN_ON_COMPLETION:
+			m_fn_on_completion_u(input);
+			return std::move(input);
+		default:
+			ASSERT(false);
+			return ks_error::unexpected_error();
+		}
+	}
+
+	//清空fn（释放其捕获的资源），但保留签名及存储
+	void reset() noexcept {
+		switch (m_kind) {
+		case _KIND::FN_EX: m_fn_ex_u = nullptr; break;
+		case _KIND::FN_THEN: m_fn_then_u = nullptr; break;
+		case _KIND::FN_THEN_MOVE: m_fn_then_move_u = nullptr; break;
+		case _KIND::FN_TRAP: m_fn_trap_u = nullptr; break;
+		case _KIND::FN_ON_SUCCESS: m_fn_on_success_u = nullptr; break;
+		case _KIND::FN_ON_FAILURE: m_fn_on_failure_u = nullptr; break;
+		case _KIND::FN_ON_COMPLETION: m_fn_on_completion_u = nullptr; break;
+		}
+	}
+
+private:
+	void destroy() noexcept {
+		switch (m_kind) {
+		case _KIND::FN_EX: m_fn_ex_u.~FN_EX(); break;
+		case _KIND::FN_THEN: m_fn_then_u.~FN_THEN(); break;
+		case _KIND::FN_THEN_MOVE: m_fn_then_move_u.~FN_THEN_MOVE(); break;
+		case _KIND::FN_TRAP: m_fn_trap_u.~FN_TRAP(); break;
+		case _KIND::FN_ON_SUCCESS: m_fn_on_success_u.~FN_ON_SUCCESS(); break;
+		case _KIND::FN_ON_FAILURE: m_fn_on_failure_u.~FN_ON_FAILURE(); break;
+		case _KIND::FN_ON_COMPLETION: m_fn_on_completion_u.~FN_ON_COMPLETION(); break;
+		}
+	}
+
+private:
+	enum class _KIND { FN_EX, FN_THEN, FN_THEN_MOVE, FN_TRAP, FN_ON_SUCCESS, FN_ON_FAILURE, FN_ON_COMPLETION };
+	_KIND m_kind;
+	union {
+		FN_EX m_fn_ex_u;
+		FN_THEN m_fn_then_u;
+		FN_THEN_MOVE m_fn_then_move_u;
+		FN_TRAP m_fn_trap_u;
+		FN_ON_SUCCESS m_fn_on_success_u;
+		FN_ON_FAILURE m_fn_on_failure_u;
+		FN_ON_COMPLETION m_fn_on_completion_u;
+	};
+};
+
 class ks_raw_pipe_future final : public ks_raw_future_baseimp {
 public:
 	explicit ks_raw_pipe_future(ks_raw_future_mode pipe_mode) 
@@ -948,22 +1323,22 @@ public:
 	}
 	_DISABLE_COPY_CONSTRUCTOR(ks_raw_pipe_future);
 
-	void init(ks_apartment* spec_apartment, std::function<ks_raw_result(const ks_raw_result&)>&& fn_ex, const ks_async_context& living_context, const ks_raw_future_ptr& prev_future) {
+	void init(ks_apartment* spec_apartment, ks_raw_pipe_fn&& fn, const ks_async_context& living_context, const ks_raw_future_ptr& prev_future) {
 		ks_raw_future_unique_lock lock(__get_mutex(), __is_using_pseudo_mutex());
 		do_init_base_locked(spec_apartment, living_context, &m_intermediate_data_ex, lock);
-		do_connect_locked(std::move(fn_ex), prev_future, &m_intermediate_data_ex, lock, false);
+		do_connect_locked(std::move(fn), prev_future, &m_intermediate_data_ex, lock, false);
 	}
 
 private:
 	struct __INTERMEDIATE_DATA_EX;
-	void do_connect_locked(std::function<ks_raw_result(const ks_raw_result&)>&& fn_ex, const ks_raw_future_ptr& prev_future, __INTERMEDIATE_DATA_EX* intermediate_data_ex_ptr, ks_raw_future_unique_lock& lock, bool must_keep_locked) {
+	void do_connect_locked(ks_raw_pipe_fn&& fn, const ks_raw_future_ptr& prev_future, __INTERMEDIATE_DATA_EX* intermediate_data_ex_ptr, ks_raw_future_unique_lock& lock, bool must_keep_locked) {
 		ASSERT(intermediate_data_ex_ptr != nullptr);
 		ASSERT(intermediate_data_ex_ptr == __get_intermediate_data_ex_ptr(lock));
 		ASSERT(lock.owns_lock() && !must_keep_locked);
 		ASSERT(!m_completed_result.is_completed());
 		ASSERT(prev_future != nullptr);
 
-		intermediate_data_ex_ptr->m_fn_ex = std::move(fn_ex);
+		intermediate_data_ex_ptr->m_fn = std::move(fn);
 		intermediate_data_ex_ptr->m_prev_future_weak = prev_future;
 
 		lock.unlock();
@@ -1013,11 +1388,19 @@ protected:
 			return;
 		}
 
+		if (m_pipe_mode == ks_raw_future_mode::THEN && prev_result.is_value() && this->do_check_cancelled_locked(lock)) {
+			//已过deadline（timeout）或已被取消，则不必再schedule，立即以相应错误settle（与执行时的结果一致）
+			ks_apartment* prefer_apartment = do_determine_prefer_apartment_2(intermediate_data_ex_ptr->m_spec_apartment, prev_advice_apartment);
+			this->do_complete_locked(this->do_acquire_cancelled_error_locked(ks_error::unexpected_error(), lock), prefer_apartment, true, false, lock, false);
+			return;
+		}
+
 		int priority = intermediate_data_ex_ptr->m_living_context.__get_priority();
 		ks_apartment* prefer_apartment = do_determine_prefer_apartment_2(intermediate_data_ex_ptr->m_spec_apartment, prev_advice_apartment);
 		bool could_run_locally = (priority >= 0x10000) && (intermediate_data_ex_ptr->m_spec_apartment == nullptr || intermediate_data_ex_ptr->m_spec_apartment == prefer_apartment);
 
-		std::function<void()> run_fn = [this, this_shared = this->shared_from_this(), intermediate_data_ex_ptr, prev_result, prefer_apartment, context = intermediate_data_ex_ptr->m_living_context]() mutable -> void {
+		//注：prev_result以init-capture复制（非const），以便执行时让出
+		ks_task_fn run_fn([this, this_shared = this->shared_from_this(), intermediate_data_ex_ptr, prev_result = ks_raw_result(prev_result), prefer_apartment, context = intermediate_data_ex_ptr->m_living_context]() mutable -> void {
 			ks_raw_future_unique_lock lock2(__get_mutex(), __is_using_pseudo_mutex());
 			if (m_completed_result.is_completed())
 				return; //pre-check cancelled
@@ -1029,15 +1412,15 @@ protected:
 
 			ks_raw_result result;
 			try {
-				ks_raw_result prev_result_alt = prev_result;
-				if (prev_result.is_value() && this->do_check_cancelled_locked(lock2))
+				ks_raw_result prev_result_alt = std::move(prev_result); //run_fn仅执行一次，故可让出prev_result（以便move-through）
+				if (prev_result_alt.is_value() && this->do_check_cancelled_locked(lock2))
 					prev_result_alt = this->do_acquire_cancelled_error_locked(ks_error::unexpected_error(), lock2);
 
-				std::function<ks_raw_result(const ks_raw_result&)> fn_ex = std::move(intermediate_data_ex_ptr->m_fn_ex);
+				ks_raw_pipe_fn fn = std::move(intermediate_data_ex_ptr->m_fn);
 				lock2.unlock();
 				ks_defer defer_relock2([&lock2]() { lock2.lock(); });
-				result = fn_ex(prev_result_alt).require_completed_or_error();
-				fn_ex = {};
+				result = fn(std::move(prev_result_alt)).require_completed_or_error();
+				fn.reset();
 				defer_relock2.apply();
 			}
 			catch (ks_error error) {
@@ -1045,22 +1428,53 @@ protected:
 			}
 
 			this->do_complete_locked(result, prefer_apartment, true, false, lock2, false);
-		};
+		});
 
 		if (could_run_locally) {
 			lock.unlock();
+			const int batch_schedule_depth_backup = std::exchange(tls_batch_schedule_depth, 0); //就地执行期间暂停批量schedule，以免fn内post后wait而死等
+			ks_defer defer_restore_batch_schedule_depth([batch_schedule_depth_backup]() { tls_batch_schedule_depth = batch_schedule_depth_backup; });
 			run_fn(); //超高优先级、且spec_partment为nullptr，则立即执行，省掉schedule过程
 			run_fn = {};
 			return;
 		}
 
-		uint64_t act_schedule_id = prefer_apartment->schedule(std::move(run_fn), priority);
+		if (this->do_check_inline_continuation(prefer_apartment, priority)) {
+			this->do_run_inline_continuation_unlocked(run_fn, lock); //当前线程即属于目标套间，就地执行
+			return;
+		}
+
+		if (this->do_check_inline_apartment(prefer_apartment)) {
+			uint64_t act_schedule_id = this->do_schedule_inline_unlocked(prefer_apartment, priority, std::move(run_fn), lock);
+			if (act_schedule_id == 0) {
+				//schedule失败，则立即将this标记为错误即可
+				lock.lock();
+				if (!m_completed_result.is_completed())
+					this->do_complete_locked(ks_error::terminated_error(), prefer_apartment, true, false, lock, false);
+			}
+			return;
+		}
+
+		if (this->do_try_defer_to_batch_schedule_locked(prefer_apartment, priority, run_fn, lock))
+			return; //待批量区间结束时schedule，参见on_batch_scheduled
+
+		uint64_t act_schedule_id = this->do_schedule_with_deadline_locked(prefer_apartment, priority, std::move(run_fn), lock);
 		if (act_schedule_id == 0) {
 			//schedule失败，则立即将this标记为错误即可
 			return this->do_complete_locked(ks_error::terminated_error(), prefer_apartment, true, false, lock, false);
 		}
 	}
 
+	virtual void on_batch_scheduled(uint64_t schedule_id, ks_apartment* apartment) override {
+		if (schedule_id == 0) {
+			//schedule失败，则立即将this标记为错误即可
+			ks_raw_future_unique_lock lock(__get_mutex(), __is_using_pseudo_mutex());
+			if (m_completed_result.is_completed())
+				return;
+			return this->do_complete_locked(ks_error::terminated_error(), apartment, true, false, lock, false);
+		}
+	}
+
 	virtual bool is_cancelable_self() override {
 		//pipe-future部分是非cancelable的（on_xxxx和forward）
 		return __my_cancelable_flag();
@@ -1129,7 +1543,7 @@ private:
 #endif
 
 	struct __INTERMEDIATE_DATA_EX : __INTERMEDIATE_DATA {
-		std::function<ks_raw_result(const ks_raw_result&)> m_fn_ex;  //在complete后被自动清除
+		ks_raw_pipe_fn m_fn;                                          //在complete后被自动清除
 		std::weak_ptr<ks_raw_future> m_prev_future_weak;             //在complete后被自动清除
 		bool m_prev_future_completed_flag = false;
 	};
@@ -1144,7 +1558,7 @@ private:
 		ASSERT(intermediate_data_ptr == &m_intermediate_data_ex);
 		//ASSERT(m_intermediate_data_ex_ptr != nullptr);
 
-		m_intermediate_data_ex.m_fn_ex = {};
+		m_intermediate_data_ex.m_fn.reset();
 		m_intermediate_data_ex.m_prev_future_weak.reset();
 
 		//m_intermediate_data_ex_ptr.reset();
@@ -1225,11 +1639,18 @@ protected:
 			return;
 		}
 
+		if (m_flatten_mode == ks_raw_future_mode::FLATTEN_THEN && prev_result.is_value() && this->do_check_cancelled_locked(lock)) {
+			//已过deadline（timeout）或已被取消，则不必再schedule，立即以相应错误settle（与执行时的结果一致）
+			ks_apartment* prefer_apartment = do_determine_prefer_apartment_2(intermediate_data_ex_ptr->m_spec_apartment, prev_advice_apartment);
+			this->do_complete_locked(this->do_acquire_cancelled_error_locked(ks_error::unexpected_error(), lock), prefer_apartment, true, false, lock, false);
+			return;
+		}
+
 		int priority = intermediate_data_ex_ptr->m_living_context.__get_priority();
 		ks_apartment* prefer_apartment = do_determine_prefer_apartment_2(intermediate_data_ex_ptr->m_spec_apartment, prev_advice_apartment);
 		bool could_run_locally = (priority >= 0x10000) && (intermediate_data_ex_ptr->m_spec_apartment == nullptr || intermediate_data_ex_ptr->m_spec_apartment == prefer_apartment);
 
-		std::function<void()> run_fn = [this, this_shared = this->shared_from_this(), intermediate_data_ex_ptr, prev_result, prefer_apartment, context = intermediate_data_ex_ptr->m_living_context]() mutable -> void {
+		ks_task_fn run_fn([this, this_shared = this->shared_from_this(), intermediate_data_ex_ptr, prev_result, prefer_apartment, context = intermediate_data_ex_ptr->m_living_context]() mutable -> void {
 			ks_raw_future_unique_lock lock2(__get_mutex(), __is_using_pseudo_mutex());
 			if (m_completed_result.is_completed())
 				return; //pre-check cancelled
@@ -1281,22 +1702,53 @@ protected:
 					this->do_complete_locked(extern_result, prefer_apartment, false, false, lock3, false);
 				}, make_async_context().set_priority(0x10000), prefer_apartment);
 			}
-		};
+		});
 
 		if (could_run_locally) {
 			lock.unlock();
+			const int batch_schedule_depth_backup = std::exchange(tls_batch_schedule_depth, 0); //就地执行期间暂停批量schedule，以免fn内post后wait而死等
+			ks_defer defer_restore_batch_schedule_depth([batch_schedule_depth_backup]() { tls_batch_schedule_depth = batch_schedule_depth_backup; });
 			run_fn(); //超高优先级、且spec_partment为nullptr，则立即执行，省掉schedule过程
 			run_fn = {};
 			return;
 		}
 
-		uint64_t act_schedule_id = prefer_apartment->schedule(std::move(run_fn), priority);
+		if (this->do_check_inline_continuation(prefer_apartment, priority)) {
+			this->do_run_inline_continuation_unlocked(run_fn, lock); //当前线程即属于目标套间，就地执行
+			return;
+		}
+
+		if (this->do_check_inline_apartment(prefer_apartment)) {
+			uint64_t act_schedule_id = this->do_schedule_inline_unlocked(prefer_apartment, priority, std::move(run_fn), lock);
+			if (act_schedule_id == 0) {
+				//schedule失败，则立即将this标记为错误即可
+				lock.lock();
+				if (!m_completed_result.is_completed())
+					this->do_complete_locked(ks_error::terminated_error(), prefer_apartment, true, false, lock, false);
+			}
+			return;
+		}
+
+		if (this->do_try_defer_to_batch_schedule_locked(prefer_apartment, priority, run_fn, lock))
+			return; //待批量区间结束时schedule，参见on_batch_scheduled
+
+		uint64_t act_schedule_id = this->do_schedule_with_deadline_locked(prefer_apartment, priority, std::move(run_fn), lock);
 		if (act_schedule_id == 0) {
 			//schedule失败，则立即将this标记为错误即可
 			return this->do_complete_locked(ks_error::terminated_error(), prefer_apartment, true, false, lock, false);
 		}
 	}
 
+	virtual void on_batch_scheduled(uint64_t schedule_id, ks_apartment* apartment) override {
+		if (schedule_id == 0) {
+			//schedule失败，则立即将this标记为错误即可
+			ks_raw_future_unique_lock lock(__get_mutex(), __is_using_pseudo_mutex());
+			if (m_completed_result.is_completed())
+				return;
+			return this->do_complete_locked(ks_error::terminated_error(), apartment, true, false, lock, false);
+		}
+	}
+
 	virtual bool is_cancelable_self() override {
 		return true; 
 	}
@@ -1621,6 +2073,49 @@ private:
 };
 
 
+//ks_raw_future_baseimp批量schedule实现
+void ks_raw_future_baseimp::do_flush_batch_schedule() {
+	ASSERT(tls_batch_schedule_depth == 0);
+
+	//on_batch_scheduled可能引发新的暂存（例如schedule失败时complete），故循环直至清空
+	while (!tls_batch_schedule_items.empty()) {
+		std::vector<__BATCH_SCHEDULE_ITEM> items;
+		items.swap(tls_batch_schedule_items);
+
+		for (size_t i = 0; i < items.size(); ) {
+			//相邻且(apartment, priority)相同、且不带deadline的项为一组
+			size_t j = i + 1;
+			if (items[i].deadline == std::chrono::steady_clock::time_point{}) {
+				while (j < items.size() && items[j].apartment == items[i].apartment && items[j].priority == items[i].priority && items[j].deadline == std::chrono::steady_clock::time_point{})
+					++j;
+			}
+
+			ks_apartment* apartment = items[i].apartment;
+			if (j - i >= 2 && (apartment->features() & ks_apartment::batch_schedule_feature) != 0) {
+				std::vector<ks_task_fn> fns;
+				fns.reserve(j - i);
+				for (size_t k = i; k < j; ++k)
+					fns.push_back(std::move(items[k].fn));
+
+				uint64_t first_schedule_id = apartment->schedule_batch(std::move(fns), items[i].priority);
+				for (size_t k = i; k < j; ++k)
+					items[k].future_imp->on_batch_scheduled(first_schedule_id != 0 ? first_schedule_id + (k - i) : 0, apartment);
+			}
+			else {
+				for (size_t k = i; k < j; ++k) {
+					uint64_t schedule_id = items[k].deadline != std::chrono::steady_clock::time_point{}
+						? apartment->schedule_with_deadline(std::move(items[k].fn), items[k].priority, items[k].deadline)
+						: apartment->schedule(std::move(items[k].fn), items[k].priority);
+					items[k].future_imp->on_batch_scheduled(schedule_id, apartment);
+				}
+			}
+
+			i = j;
+		}
+	}
+}
+
+
 //ks_raw_future静态方法实现
 ks_raw_future_ptr ks_raw_future::resolved(const ks_raw_value& value, ks_apartment* apartment) {
 	auto dx_future = std::make_shared<ks_raw_dx_future>(ks_raw_future_mode::DX);
@@ -1716,6 +2211,20 @@ void ks_raw_future::__wait() {
 	return (void)this->do_wait();
 }
 
+void ks_raw_future::__begin_batch_schedule() {
+	++tls_batch_schedule_depth;
+}
+
+void ks_raw_future::__end_batch_schedule() {
+	ASSERT(tls_batch_schedule_depth > 0);
+	if (--tls_batch_schedule_depth == 0)
+		ks_raw_future_baseimp::do_flush_batch_schedule();
+}
+
+int ks_raw_future::__set_inline_continuation_max_depth(int max_depth) {
+	return g_inline_continuation_max_depth.exchange((std::max)(max_depth, 0), std::memory_order_relaxed);
+}
+
 ks_raw_promise_ptr ks_raw_promise::create(ks_apartment* apartment) {
 	auto promise_future = std::make_shared<ks_raw_promise_future>(ks_raw_future_mode::PROMISE);
 	promise_future->init(apartment);
@@ -1726,28 +2235,14 @@ ks_raw_promise_ptr ks_raw_promise::create(ks_apartment* apartment) {
 
 //ks_raw_future基础pipe方法实现
 ks_raw_future_ptr ks_raw_future_baseimp::then(std::function<ks_raw_result(const ks_raw_value &)>&& fn, const ks_async_context& context, ks_apartment* apartment) {
-	std::function<ks_raw_result(const ks_raw_result&)> fn_ex = [fn = std::move(fn)](const ks_raw_result& input)->ks_raw_result {
-		if (input.is_value())
-			return fn(input.to_value());
-		else
-			return input;
-	};
-
 	auto pipe_future = std::make_shared<ks_raw_pipe_future>(ks_raw_future_mode::THEN);
-	pipe_future->init(apartment, std::move(fn_ex), context, this->shared_from_this());
+	pipe_future->init(apartment, std::move(fn), context, this->shared_from_this());
 	return std::static_pointer_cast<ks_raw_future>(std::move(pipe_future));
 }
 
 ks_raw_future_ptr ks_raw_future_baseimp::trap(std::function<ks_raw_result(const ks_error &)>&& fn, const ks_async_context& context, ks_apartment* apartment) {
-	std::function<ks_raw_result(const ks_raw_result&)> fn_ex = [fn = std::move(fn)](const ks_raw_result& input)->ks_raw_result {
-		if (input.is_error())
-			return fn(input.to_error());
-		else
-			return input;
-	};
-
 	auto pipe_future = std::make_shared<ks_raw_pipe_future>(ks_raw_future_mode::TRAP);
-	pipe_future->init(apartment, std::move(fn_ex), context, this->shared_from_this());
+	pipe_future->init(apartment, std::move(fn), context, this->shared_from_this());
 	return std::static_pointer_cast<ks_raw_future>(std::move(pipe_future));
 }
 
@@ -1757,6 +2252,12 @@ ks_raw_future_ptr ks_raw_future_baseimp::transform(std::function<ks_raw_result(c
 	return std::static_pointer_cast<ks_raw_future>(std::move(pipe_future));
 }
 
+ks_raw_future_ptr ks_raw_future_baseimp::then_by_move(std::function<ks_raw_result(ks_raw_value&&)>&& fn, const ks_async_context& context, ks_apartment* apartment) {
+	auto pipe_future = std::make_shared<ks_raw_pipe_future>(ks_raw_future_mode::THEN);
+	pipe_future->init(apartment, std::move(fn), context, this->shared_from_this());
+	return std::static_pointer_cast<ks_raw_future>(std::move(pipe_future));
+}
+
 ks_raw_future_ptr ks_raw_future_baseimp::flat_then(std::function<ks_raw_future_ptr(const ks_raw_value&)>&& fn, const ks_async_context& context, ks_apartment* apartment) {
 	std::function<ks_raw_future_ptr(const ks_raw_result&)> afn_ex = [fn = std::move(fn), apartment](const ks_raw_result& input)->ks_raw_future_ptr {
 		if (!input.is_value())
@@ -1794,44 +2295,27 @@ ks_raw_future_ptr ks_raw_future_baseimp::flat_transform(std::function<ks_raw_fut
 }
 
 ks_raw_future_ptr ks_raw_future_baseimp::on_success(std::function<void(const ks_raw_value&)>&& fn, const ks_async_context& context, ks_apartment* apartment) {
-	auto fn_ex = [fn = std::move(fn)](const ks_raw_result& input)->ks_raw_result {
-		if (input.is_value())
-			fn(input.to_value());
-		return input;
-	};
-
 	auto pipe_future = std::make_shared<ks_raw_pipe_future>(ks_raw_future_mode::ON_SUCCESS);
-	pipe_future->init(apartment, std::move(fn_ex), context, this->shared_from_this());
+	pipe_future->init(apartment, std::move(fn), context, this->shared_from_this());
 	return std::static_pointer_cast<ks_raw_future>(std::move(pipe_future));
 }
 
 ks_raw_future_ptr ks_raw_future_baseimp::on_failure(std::function<void(const ks_error&)>&& fn, const ks_async_context& context, ks_apartment* apartment) {
-	auto fn_ex = [fn = std::move(fn)](const ks_raw_result& input)->ks_raw_result {
-		if (input.is_error())
-			fn(input.to_error());
-		return input;
-	};
-
 	auto pipe_future = std::make_shared<ks_raw_pipe_future>(ks_raw_future_mode::ON_FAILURE);
-	pipe_future->init(apartment, std::move(fn_ex), context, this->shared_from_this());
+	pipe_future->init(apartment, std::move(fn), context, this->shared_from_this());
 	return std::static_pointer_cast<ks_raw_future>(std::move(pipe_future));
 }
 
 ks_raw_future_ptr ks_raw_future_baseimp::on_completion(std::function<void(const ks_raw_result&)>&& fn, const ks_async_context& context, ks_apartment* apartment) {
-	auto fn_ex = [fn = std::move(fn)](const ks_raw_result& input)->ks_raw_result {
-		fn(input);
-		return input;
-	};
-
 	auto pipe_future = std::make_shared<ks_raw_pipe_future>(ks_raw_future_mode::ON_COMPLETION);
-	pipe_future->init(apartment, std::move(fn_ex), context, this->shared_from_this());
+	pipe_future->init(apartment, std::move(fn), context, this->shared_from_this());
 	return std::static_pointer_cast<ks_raw_future>(std::move(pipe_future));
 }
 
 ks_raw_future_ptr ks_raw_future_baseimp::noop(ks_apartment* apartment) {
 	auto pipe_future = std::make_shared<ks_raw_pipe_future>(ks_raw_future_mode::FORWARD);
 	pipe_future->init(apartment,
-		[](const auto& input) -> auto { return input; },
+		ks_raw_pipe_fn::FN_EX([](const ks_raw_result& input) -> ks_raw_result { return input; }),
 		make_async_context().set_priority(0x10000), 
 		this->shared_from_this());
 	return std::static_pointer_cast<ks_raw_future>(std::move(pipe_future));
@@ -64,6 +64,9 @@ public:
 	virtual ks_raw_future_ptr trap(std::function<ks_raw_result(const ks_error&)>&& fn, const ks_async_context& context, ks_apartment* apartment) = 0;
 	virtual ks_raw_future_ptr transform(std::function<ks_raw_result(const ks_raw_result &)>&& fn, const ks_async_context& context, ks_apartment* apartment) = 0;
 
+	//move-through版then：fn所得value为其独占的一份（沿途不再复制），若其数据未被共享（即唯一的下游、且上游已不再持有），可直接移出（参见ks_raw_value::take）
+	virtual ks_raw_future_ptr then_by_move(std::function<ks_raw_result(ks_raw_value&&)>&& fn, const ks_async_context& context, ks_apartment* apartment) = 0;
+
 	virtual ks_raw_future_ptr flat_then(std::function<ks_raw_future_ptr(const ks_raw_value&)>&& fn, const ks_async_context& context, ks_apartment* apartment) = 0;
 	virtual ks_raw_future_ptr flat_trap(std::function<ks_raw_future_ptr(const ks_error&)>&& fn, const ks_async_context& context, ks_apartment* apartment) = 0;
 	virtual ks_raw_future_ptr flat_transform(std::function<ks_raw_future_ptr(const ks_raw_result&)>&& fn, const ks_async_context& context, ks_apartment* apartment) = 0;
@@ -88,6 +91,15 @@ public:
 	//慎用，使用不当可能会造成死锁或卡顿！
 	virtual void __wait();
 
+	//批量schedule区间（可嵌套）：区间内各future的schedule被暂存，待最外层区间结束时经apartment->schedule_batch批量入队
+	KS_ASYNC_API static void __begin_batch_schedule();
+	KS_ASYNC_API static void __end_batch_schedule();
+
+	//continuation就地执行策略：future完成时，若当前线程即属于下游的目标套间，则下游（喂入及pipe函数）就地执行，省掉schedule往返。
+	//max_depth为就地执行的嵌套深度上限（超出后回退为schedule，以防长链撑爆栈），0表示关闭；返回原值。
+	//注：开启后，promise.resolve等完成操作可能同步执行下游，调用者不宜在持锁时完成future。idle优先级（<0）的下游及批量schedule区间内不就地执行。
+	KS_ASYNC_API static int __set_inline_continuation_max_depth(int max_depth);
+
 protected:
 	virtual void do_add_next(const ks_raw_future_ptr& next_future) = 0;
 	virtual void do_add_next_multi(const std::vector<ks_raw_future_ptr>& next_futures) = 0;
@@ -69,6 +69,14 @@ public:
 	KS_ASYNC_API ks_error to_error() const;
 	KS_ASYNC_API ks_raw_result require_completed_or_error() const;
 
+	//移出其value（不增减引用计数），this随即被reset
+	KS_ASYNC_INLINE_API ks_raw_value __take_value() noexcept {
+		ASSERT(m_state == _STATE::JUST_VALUE);
+		ks_raw_value value = std::move(m_value_u);
+		this->reset();
+		return value;
+	}
+
 public:
 	KS_ASYNC_API void swap(ks_raw_result& r) noexcept;
 	KS_ASYNC_API void reset() noexcept;
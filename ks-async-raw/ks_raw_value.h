@@ -50,6 +50,12 @@ public:
 		return ks_any::template get<T>(); 
 	}
 
+	//取出值（未被共享时移出，否则复制），this随即被reset
+	template <class T>
+	KS_ASYNC_INLINE_API std::remove_cvref_t<T> take() {
+		return ks_any::template take<T>();
+	}
+
 public:
 	KS_ASYNC_INLINE_API void swap(ks_raw_value& r) noexcept {
 		ks_any::swap(r);
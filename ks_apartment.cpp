@@ -16,6 +16,7 @@ limitations under the License.
 #include "ks_apartment.h"
 #include "ks_single_thread_apartment_imp.h"
 #include "ks_thread_pool_apartment_imp.h"
+#include "ks_inline_apartment_imp.h"
 #include <thread>
 #include <map>
 #include <cmath>
@@ -80,6 +81,7 @@ static ks_spinlock g_public_apartment_mutex {};
 static std::map<std::string, ks_apartment*> g_public_apartment_map {};
 
 static std::atomic<size_t> g_default_mta_max_thread_count = { 0 };
+static ks_thread_affinity_policy g_default_mta_affinity_policy {};
 static std::atomic<void(*)()> g_unified_raw_thread_init_fn = { nullptr };
 static std::atomic<void(*)()> g_unified_raw_thread_term_fn = { nullptr };
 
@@ -130,7 +132,7 @@ ks_apartment* ks_apartment::master_sta() noexcept {
 ks_apartment* ks_apartment::background_sta() noexcept {
 	static ks_single_thread_apartment_imp g_background_sta(
 		"background_sta", 
-		ks_single_thread_apartment_imp::auto_register_flag | ks_single_thread_apartment_imp::endless_instance_flag,
+		ks_single_thread_apartment_imp::auto_register_flag | ks_single_thread_apartment_imp::endless_instance_flag | ks_single_thread_apartment_imp::mpsc_inbox_flag,
 		__determine_unified_thread_init_fn(), __determine_unified_thread_term_fn());
 	return &g_background_sta;
 }
@@ -141,9 +143,21 @@ ks_apartment* ks_apartment::default_mta() noexcept {
 		__determine_default_mta_max_thread_count(),
 		ks_thread_pool_apartment_imp::auto_register_flag | ks_thread_pool_apartment_imp::endless_instance_flag,
 		__determine_unified_thread_init_fn(), __determine_unified_thread_term_fn());
+	static const bool g_default_mta_affinity_policy_applied = 
+		g_default_mta_affinity_policy.kind != ks_thread_affinity_policy::no_affinity && g_default_mta.set_affinity_policy(g_default_mta_affinity_policy);
+	_UNUSED(g_default_mta_affinity_policy_applied);
 	return &g_default_mta;
 }
 
+ks_apartment* ks_apartment::inline_apartment() noexcept {
+	static ks_inline_apartment_imp g_inline_apartment(
+		"inline_apartment",
+		nullptr,
+		ks_inline_apartment_imp::default_max_recursion_depth,
+		ks_inline_apartment_imp::auto_register_flag);
+	return &g_inline_apartment;
+}
+
 ks_apartment* ks_apartment::current_thread_apartment() noexcept {
 	return tls_current_thread_apartment;
 }
@@ -194,6 +208,11 @@ void ks_apartment::__set_default_mta_max_thread_count(size_t max_thread_count) {
 	g_default_mta_max_thread_count.store(max_thread_count, std::memory_order_relaxed);
 }
 
+void ks_apartment::__set_default_mta_affinity_policy(const ks_thread_affinity_policy& affinity_policy) {
+	ASSERT(ks_apartment::find_public_apartment("default_mta") == nullptr);
+	g_default_mta_affinity_policy = affinity_policy;
+}
+
 void ks_apartment::__set_unified_raw_thread_init_fn(void(*raw_thread_init_fn)()) {
 	ASSERT(ks_apartment::find_public_apartment("default_mta") == nullptr);
 	ASSERT(ks_apartment::find_public_apartment("background_sta") == nullptr);
@@ -17,7 +17,24 @@ limitations under the License.
 
 #include "ks_async_base.h"
 #include "ktl/ks_functional.h"
+#include "ktl/ks_task_fn.h"
 #include "ktl/ks_concurrency.h"
+#include <chrono>
+#include <vector>
+
+
+//work线程的CPU亲和性策略（参见ks_thread_pool_apartment_imp::set_affinity_policy）
+struct ks_thread_affinity_policy {
+	enum kind_t {
+		no_affinity,  //不设亲和性（默认）
+		cpu_list,     //各线程依次绑定至cpus中的一个cpu
+		one_per_core, //各线程依次绑定至不同的物理核（即每核一个线程，线程数超出核数时循环）
+		numa_nodes,   //各线程依次分派至各NUMA节点，绑定至该节点的cpu集合；线程优先执行（及窃取）本节点的任务，schedule优先投递至调用者所在的节点
+	};
+
+	kind_t kind = no_affinity;
+	std::vector<int> cpus; //仅cpu_list时有效
+};
 
 
 _INTERFACE_LIKE class ks_apartment {
@@ -31,6 +48,7 @@ public:
 	KS_ASYNC_API static ks_apartment* master_sta() noexcept;     //主逻辑[单线程]套间，亦由APP框架提供（可以与ui-sta相同，但最好区别开）
 	KS_ASYNC_API static ks_apartment* background_sta() noexcept; //后台[单线程]套间
 	KS_ASYNC_API static ks_apartment* default_mta() noexcept;    //默认[多线程]套间
+	KS_ASYNC_API static ks_apartment* inline_apartment() noexcept; //就地执行的套间（参见ks_inline_apartment_imp），适用于廉价的后续处理
 
 	KS_ASYNC_API static ks_apartment* current_thread_apartment() noexcept;
 	KS_ASYNC_API static ks_apartment* current_thread_apartment_or_default_mta() noexcept;
@@ -44,6 +62,9 @@ public:
 		atfork_aware_future           = 0x0002,
 		nested_pump_aware_future      = 0x0004,
 		nested_pump_suppressed_future = 0x0008,
+		batch_schedule_feature        = 0x0010, //schedule_batch在一次lock内完成，且各fn的id连续
+		deadline_schedule_feature     = 0x0020, //schedule_with_deadline按deadline先后（EDF）出队
+		inline_execution_feature      = 0x0040, //schedule时即在调用者线程上同步执行fn（参见inline_apartment）
 	};
 
 public:
@@ -64,6 +85,46 @@ public:
 	virtual uint64_t schedule(std::function<void()>&& fn, int priority) = 0;
 	virtual uint64_t schedule_delayed(std::function<void()>&& fn, int priority, int64_t delay) = 0;
 
+	//注：以ks_task_fn（只可移动，带小对象缓冲）传递fn的版本，内置套间将其直接嵌入任务项，省去std::function的额外分配。
+	//默认实现则转调std::function版本（多一次分配），以兼容其他套间实现。
+	virtual uint64_t schedule(ks_task_fn&& fn, int priority) {
+		auto fn_holder = std::make_shared<ks_task_fn>(std::move(fn));
+		return this->schedule([fn_holder]() { (*fn_holder)(); }, priority);
+	}
+	virtual uint64_t schedule_delayed(ks_task_fn&& fn, int priority, int64_t delay) {
+		auto fn_holder = std::make_shared<ks_task_fn>(std::move(fn));
+		return this->schedule_delayed([fn_holder]() { (*fn_holder)(); }, priority, delay);
+	}
+
+	//注：批量schedule一组fn（优先级相同），返回首个fn的id，fns为空或失败时返回0。
+	//具备batch_schedule_feature的套间在一次lock内全部入队，至多唤醒min(N, 空闲线程数)个线程，且各fn的id依次为[返回值, 返回值+fns.size())；
+	//默认实现则逐个转调schedule，仅返回首个fn的id。
+	virtual uint64_t schedule_batch(std::vector<ks_task_fn>&& fns, int priority) {
+		uint64_t first_fn_id = 0;
+		for (size_t i = 0; i < fns.size(); ++i) {
+			uint64_t fn_id = this->schedule(std::move(fns[i]), priority);
+			if (i == 0 && fn_id == 0)
+				return 0;
+			if (i == 0)
+				first_fn_id = fn_id;
+		}
+		return first_fn_id;
+	}
+
+	//注：按deadline（绝对时点）schedule，deadline为time_point{}时等同于schedule。
+	//具备deadline_schedule_feature的套间，将带deadline的普通fn（priority=0）按deadline先后（earliest-deadline-first）执行，且先于无deadline的普通fn（但仍后于高优先级fn）；
+	//默认实现则忽略deadline，转调schedule。
+	//deadline已过的fn仍会被执行（且因deadline最早而排在最先），由fn自行以timeout_error拒绝（future即是如此），套间不丢弃任务。
+	virtual uint64_t schedule_with_deadline(ks_task_fn&& fn, int priority, std::chrono::steady_clock::time_point deadline) {
+		return this->schedule(std::move(fn), priority);
+	}
+
+	//注：套间的时钟，schedule_delayed的delay即按此计量，future的timeout、repeat_periodic的周期亦据此判定。
+	//默认实现为steady_clock（真实时间）；虚拟时钟套间（参见ks_manual_apartment_imp）则返回其虚拟时间。
+	virtual std::chrono::steady_clock::time_point clock_now() {
+		return std::chrono::steady_clock::now();
+	}
+
 	//注：try_unschedule方法会尝试取消指定的异步过程，其前提是指定的异步过程还未开始执行，若已开始（甚至已完成）则不会再被取消了。
 	virtual void try_unschedule(uint64_t id) = 0;
 
@@ -85,6 +146,7 @@ public:
 public:
 	//注：设定default-mta最大线程数，请在首次调用default_mta()方法前调用。
 	KS_ASYNC_API static void __set_default_mta_max_thread_count(size_t max_thread_count);
+	KS_ASYNC_API static void __set_default_mta_affinity_policy(const ks_thread_affinity_policy& affinity_policy);
 	KS_ASYNC_API static void __set_unified_raw_thread_init_fn(void(*raw_thread_init_fn)());
 	KS_ASYNC_API static void __set_unified_raw_thread_term_fn(void(*raw_thread_term_fn)());
 
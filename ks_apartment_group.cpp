@@ -0,0 +1,143 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "ks_apartment_group.h"
+
+void __forcelink_to_ks_apartment_group_cpp() {}
+
+
+//jump consistent hash（Lamping & Veach），将key映射至[0, bucket_count)
+static size_t _jump_consistent_hash(uint64_t key, size_t bucket_count) {
+	int64_t b = -1, j = 0;
+	while (j < (int64_t)bucket_count) {
+		b = j;
+		key = key * 2862933555777941757ULL + 1;
+		j = (int64_t)((double)(b + 1) * ((double)(1LL << 31) / (double)((key >> 33) + 1)));
+	}
+	return (size_t)b;
+}
+
+//对hash值再混淆一次（splitmix64终止函数），因std::hash对整数通常即为恒等映射
+static uint64_t _mix_key_hash(uint64_t x) {
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+
+ks_apartment_group::ks_apartment_group(const char* name, size_t shard_count, shard_kind_t shard_kind, uint shard_flags, ks_apartment* strand_parent_apartment)
+	: m_name(name != nullptr ? name : ""), m_shard_kind(shard_kind) {
+	ASSERT(name != nullptr);
+	ASSERT(shard_count >= 1);
+	if (shard_count < 1)
+		shard_count = 1;
+
+	if (shard_kind == strand_shards && strand_parent_apartment == nullptr)
+		strand_parent_apartment = ks_apartment::default_mta();
+
+	m_shards.reserve(shard_count);
+	for (size_t i = 0; i < shard_count; ++i) {
+		const std::string shard_name = m_name + "#" + std::to_string(i);
+		if (shard_kind == strand_shards) {
+			m_strand_shards.emplace_back(new ks_strand_apartment_imp(shard_name.c_str(), strand_parent_apartment, shard_flags));
+			m_shards.push_back(m_strand_shards.back().get());
+		}
+		else {
+			m_sta_shards.emplace_back(new ks_single_thread_apartment_imp(shard_name.c_str(), shard_flags));
+			m_shards.push_back(m_sta_shards.back().get());
+		}
+	}
+
+	m_keyed_schedule_counts.reset(new std::atomic<uint64_t>[shard_count]);
+	for (size_t i = 0; i < shard_count; ++i)
+		m_keyed_schedule_counts[i].store(0, std::memory_order_relaxed);
+}
+
+ks_apartment_group::~ks_apartment_group() {
+}
+
+
+const char* ks_apartment_group::name() {
+	return m_name.c_str();
+}
+
+ks_apartment_group::shard_kind_t ks_apartment_group::shard_kind() {
+	return m_shard_kind;
+}
+
+size_t ks_apartment_group::shard_count() {
+	return m_shards.size();
+}
+
+ks_apartment* ks_apartment_group::shard_at(size_t index) {
+	ASSERT(index < m_shards.size());
+	return index < m_shards.size() ? m_shards[index] : nullptr;
+}
+
+size_t ks_apartment_group::concurrency() {
+	size_t total_concurrency = 0;
+	for (ks_apartment* shard : m_shards)
+		total_concurrency += shard->concurrency();
+	return total_concurrency;
+}
+
+
+bool ks_apartment_group::start() {
+	bool all_started = true;
+	for (ks_apartment* shard : m_shards) {
+		if (!shard->start())
+			all_started = false;
+	}
+	return all_started;
+}
+
+void ks_apartment_group::async_stop() {
+	for (ks_apartment* shard : m_shards)
+		shard->async_stop();
+}
+
+void ks_apartment_group::wait() {
+	for (ks_apartment* shard : m_shards)
+		shard->async_stop(); //先全部stop，再逐个wait，以便各分片并行收尾
+	for (ks_apartment* shard : m_shards)
+		shard->wait();
+}
+
+
+size_t ks_apartment_group::shard_index_for_hash(uint64_t key_hash) {
+	return _jump_consistent_hash(_mix_key_hash(key_hash), m_shards.size());
+}
+
+ks_apartment* ks_apartment_group::shard_for_hash(uint64_t key_hash) {
+	return m_shards[this->shard_index_for_hash(key_hash)];
+}
+
+uint64_t ks_apartment_group::schedule_keyed_by_hash(uint64_t key_hash, ks_task_fn&& fn, int priority) {
+	const size_t index = this->shard_index_for_hash(key_hash);
+	m_keyed_schedule_counts[index].fetch_add(1, std::memory_order_relaxed);
+	return m_shards[index]->schedule(std::move(fn), priority);
+}
+
+std::vector<ks_apartment_shard_stats> ks_apartment_group::shard_stats() {
+	std::vector<ks_apartment_shard_stats> stats_seq(m_shards.size());
+	for (size_t i = 0; i < m_shards.size(); ++i) {
+		stats_seq[i].queue_depth = m_shard_kind == strand_shards ? m_strand_shards[i]->pending_fn_count() : m_sta_shards[i]->pending_fn_count();
+		stats_seq[i].keyed_schedule_count = m_keyed_schedule_counts[i].load(std::memory_order_relaxed);
+	}
+	return stats_seq;
+}
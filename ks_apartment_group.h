@@ -0,0 +1,90 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "ks_async_base.h"
+#include "ks_apartment.h"
+#include "ks_single_thread_apartment_imp.h"
+#include "ks_strand_apartment_imp.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+struct ks_apartment_shard_stats {
+	size_t queue_depth = 0;             //当前排队待执行的fn数（含非keyed任务，不含未到期的延时任务）
+	uint64_t keyed_schedule_count = 0;  //累计经由schedule_keyed投递的fn数，据此可发现热点key
+};
+
+
+//分片套间组：持有N个串行的分片（单线程套间或strand），按key将任务投递至固定的分片，
+//由此同一key的任务总是串行地在同一分片上执行（对于单线程套间分片，即总在同一线程上，利于cache）。
+//key至分片的映射采用jump consistent hash，分片数变化时（如由N增至N+1）仅约1/(N+1)的key改变归属。
+//注：分片在group析构时一并析构，须先async_stop及wait。
+class ks_apartment_group {
+public:
+	enum shard_kind_t {
+		sta_shards,    //各分片为独立线程的ks_single_thread_apartment_imp
+		strand_shards, //各分片为寄生于parent套间的ks_strand_apartment_imp，不额外占用线程
+	};
+
+	//shard_flags透传给各分片的构造；strand_parent_apartment仅strand_shards时有效，为nullptr时取default_mta
+	KS_ASYNC_API explicit ks_apartment_group(const char* name, size_t shard_count, shard_kind_t shard_kind = sta_shards, uint shard_flags = 0, ks_apartment* strand_parent_apartment = nullptr);
+	_DISABLE_COPY_CONSTRUCTOR(ks_apartment_group);
+
+	KS_ASYNC_API ~ks_apartment_group();
+
+public:
+	KS_ASYNC_API const char* name();
+	KS_ASYNC_API shard_kind_t shard_kind();
+	KS_ASYNC_API size_t shard_count();
+	KS_ASYNC_API ks_apartment* shard_at(size_t index);
+
+	//各分片concurrency之和
+	KS_ASYNC_API size_t concurrency();
+
+	KS_ASYNC_API bool start();
+	KS_ASYNC_API void async_stop();
+	KS_ASYNC_API void wait();
+
+public:
+	//key所属的分片（key经std::hash取hash值）
+	template <class KEY>
+	ks_apartment* shard_for(const KEY& key) {
+		return this->shard_for_hash((uint64_t)std::hash<KEY>()(key));
+	}
+
+	template <class KEY, class FN>
+	uint64_t schedule_keyed(const KEY& key, FN&& fn, int priority = 0) {
+		return this->schedule_keyed_by_hash((uint64_t)std::hash<KEY>()(key), ks_task_fn(std::forward<FN>(fn)), priority);
+	}
+
+	KS_ASYNC_API size_t shard_index_for_hash(uint64_t key_hash);
+	KS_ASYNC_API ks_apartment* shard_for_hash(uint64_t key_hash);
+	KS_ASYNC_API uint64_t schedule_keyed_by_hash(uint64_t key_hash, ks_task_fn&& fn, int priority = 0);
+
+	KS_ASYNC_API std::vector<ks_apartment_shard_stats> shard_stats();
+
+private:
+	std::string m_name;
+	shard_kind_t m_shard_kind;
+	std::vector<std::unique_ptr<ks_single_thread_apartment_imp>> m_sta_shards; //仅sta_shards
+	std::vector<std::unique_ptr<ks_strand_apartment_imp>> m_strand_shards;     //仅strand_shards
+	std::vector<ks_apartment*> m_shards;
+	std::unique_ptr<std::atomic<uint64_t>[]> m_keyed_schedule_counts;
+};
@@ -42,11 +42,32 @@ limitations under the License.
 
 #define __KS_ASYNC_RAW_FUTURE_SPINLOCK_ENABLED  1
 #define __KS_ASYNC_RAW_FUTURE_GLOBAL_MUTEX_ENABLED  0
+#define __KS_ASYNC_RAW_FUTURE_LOCKFREE_NEXT_ENABLED  1  //future的下游以无锁栈挂接（add_next与complete不争锁），为0时使用原有锁保护的下游列表
+#define __KS_ASYNC_RAW_FUTURE_INLINE_CONTINUATION_DEFAULT_MAX_DEPTH  0  //continuation就地执行的默认嵌套深度上限，0为关闭（参见ks_raw_future::__set_inline_continuation_max_depth）
 
 #define __KS_ASYNC_CONTEXT_FROM_SOURCE_LOCATION_ENABLED  0
 
+#if !defined(__KS_APARTMENT_LOCKFREE_NOW_QUEUE_ENABLED)
+#   define __KS_APARTMENT_LOCKFREE_NOW_QUEUE_ENABLED  0  //为1时thread-pool套间的normal队列使用无锁ks_mpmc_queue（队列满时溢出到有锁队列），默认关闭，可经编译选项定义为1而开启
+#endif
+
 #if defined(_WIN32)
 #   define __KS_APARTMENT_ATFORK_ENABLED  0  //WIN下开启也可通过编译，只是没有被使用需求
 #else
 #   define __KS_APARTMENT_ATFORK_ENABLED  1
 #endif
+
+#if defined(__linux__)
+#   define __KS_EPOLL_APARTMENT_ENABLED  1  //ks_epoll_apartment_imp依赖epoll和eventfd，仅linux下可用
+#else
+#   define __KS_EPOLL_APARTMENT_ENABLED  0
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#   if __has_include(<linux/io_uring.h>)
+#       define __KS_IO_URING_ENABLED  1  //ks_file_io_service的io_uring后端（运行时不可用时仍会回退至线程池）
+#   endif
+#endif
+#if !defined(__KS_IO_URING_ENABLED)
+#   define __KS_IO_URING_ENABLED  0
+#endif
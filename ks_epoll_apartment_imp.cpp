@@ -0,0 +1,438 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "ks_epoll_apartment_imp.h"
+
+void __forcelink_to_ks_epoll_apartment_imp_cpp() {}
+
+#if __KS_EPOLL_APARTMENT_ENABLED
+
+#include <thread>
+#include <algorithm>
+#include <sstream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+static std::atomic<uint64_t> g_last_fn_id { 0 };
+
+static constexpr int _MAX_EPOLL_EVENT_COUNT = 64; //每次epoll_wait至多取得的事件数
+static constexpr size_t _MAX_FN_BATCH_COUNT = 64; //每轮至多连续执行的任务数，之后再poll一次fd，以免I/O被任务洪峰饿死
+
+
+ks_epoll_apartment_imp::ks_epoll_apartment_imp(const char* name, uint flags)
+	: m_d(std::make_shared<_EPOLL_APARTMENT_DATA>()) {
+	ASSERT(name != nullptr);
+
+	m_d->name = name != nullptr ? name : "";
+	m_d->flags = flags;
+
+	m_d->epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+	m_d->wakeup_event_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	ASSERT(m_d->epoll_fd >= 0 && m_d->wakeup_event_fd >= 0);
+	if (m_d->epoll_fd < 0 || m_d->wakeup_event_fd < 0)
+		throw std::runtime_error("failed to create epoll or eventfd");
+
+	struct epoll_event wakeup_event = {};
+	wakeup_event.events = EPOLLIN;
+	wakeup_event.data.fd = m_d->wakeup_event_fd;
+	::epoll_ctl(m_d->epoll_fd, EPOLL_CTL_ADD, m_d->wakeup_event_fd, &wakeup_event);
+
+	if (m_d->flags & auto_register_flag) {
+		ks_apartment::__register_public_apartment(m_d->name.c_str(), this);
+	}
+}
+
+ks_epoll_apartment_imp::~ks_epoll_apartment_imp() {
+	ASSERT(m_d->state_v == _STATE::NOT_START || m_d->state_v == _STATE::STOPPED);
+	if (m_d->state_v != _STATE::STOPPED) {
+		std::unique_lock<ks_mutex> lock(m_d->mutex);
+		_try_stop_locked(m_d, lock);
+		//这里不等了，work线程持有m_d，自行收尾
+	}
+
+	if (m_d->flags & auto_register_flag) {
+		ks_apartment::__unregister_public_apartment(m_d->name.c_str(), this);
+	}
+}
+
+ks_epoll_apartment_imp::_EPOLL_APARTMENT_DATA::~_EPOLL_APARTMENT_DATA() {
+	if (wakeup_event_fd >= 0)
+		::close(wakeup_event_fd);
+	if (epoll_fd >= 0)
+		::close(epoll_fd);
+}
+
+
+const char* ks_epoll_apartment_imp::name() {
+	return m_d->name.c_str();
+}
+
+uint ks_epoll_apartment_imp::features() {
+	//work线程阻塞于epoll_wait，不支持嵌套泵（在本套间内wait future则直接阻塞等待）
+	return sequential_feature | nested_pump_aware_future | nested_pump_suppressed_future;
+}
+
+size_t ks_epoll_apartment_imp::concurrency() {
+	return 1;
+}
+
+
+bool ks_epoll_apartment_imp::start() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	if (m_d->state_v != _STATE::NOT_START && m_d->state_v != _STATE::RUNNING)
+		return false;
+
+	_try_start_locked(m_d, lock);
+	_prepare_work_thread_locked(this, m_d, lock);
+	return true;
+}
+
+void ks_epoll_apartment_imp::async_stop() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	_try_stop_locked(m_d, lock);
+}
+
+void ks_epoll_apartment_imp::wait() {
+	ASSERT(this != ks_apartment::current_thread_apartment());
+
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	_try_stop_locked(m_d, lock); //ensure stop
+
+	ASSERT(m_d->state_v == _STATE::STOPPING || m_d->state_v == _STATE::STOPPED);
+	while (m_d->state_v != _STATE::STOPPED) {
+		m_d->stopped_state_cv.wait(lock);
+	}
+
+	ASSERT(m_d->now_fn_queue_prior.empty() && m_d->now_fn_queue_normal.empty());
+}
+
+bool ks_epoll_apartment_imp::is_stopped() {
+	return m_d->state_v == _STATE::STOPPED;
+}
+
+bool ks_epoll_apartment_imp::is_stopping_or_stopped() {
+	_STATE state = m_d->state_v;
+	return state == _STATE::STOPPED || state == _STATE::STOPPING;
+}
+
+
+uint64_t ks_epoll_apartment_imp::schedule(std::function<void()>&& fn, int priority) {
+	return this->schedule(ks_task_fn(std::move(fn)), priority);
+}
+
+uint64_t ks_epoll_apartment_imp::schedule_delayed(std::function<void()>&& fn, int priority, int64_t delay) {
+	return this->schedule_delayed(ks_task_fn(std::move(fn)), priority, delay);
+}
+
+uint64_t ks_epoll_apartment_imp::schedule(ks_task_fn&& fn, int priority) {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	_try_start_locked(m_d, lock);
+
+	if (m_d->state_v == _STATE::STOPPED) {
+		ASSERT(false);
+		return 0;
+	}
+
+	uint64_t fn_id = ++g_last_fn_id;
+	ASSERT(fn_id != 0);
+
+	_do_put_fn_item_into_now_list_locked(m_d, _FN_ITEM{ std::move(fn), fn_id, priority }, lock);
+	_do_wakeup_work_thread_locked(m_d, lock);
+	_prepare_work_thread_locked(this, m_d, lock);
+
+	return fn_id;
+}
+
+uint64_t ks_epoll_apartment_imp::schedule_delayed(ks_task_fn&& fn, int priority, int64_t delay) {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	_try_start_locked(m_d, lock);
+
+	if (m_d->state_v == _STATE::STOPPED) {
+		ASSERT(false);
+		return 0;
+	}
+
+	uint64_t fn_id = ++g_last_fn_id;
+	ASSERT(fn_id != 0);
+
+	const auto until_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay);
+	m_d->delaying_fn_map.emplace(std::make_pair(until_time, fn_id), _FN_ITEM{ std::move(fn), fn_id, priority });
+	m_d->delaying_fn_index.emplace(fn_id, until_time);
+
+	//仅当新项成为最早到期者时，才需唤醒以缩短epoll_wait的超时
+	if (m_d->delaying_fn_map.begin()->first.second == fn_id)
+		_do_wakeup_work_thread_locked(m_d, lock);
+	_prepare_work_thread_locked(this, m_d, lock);
+
+	return fn_id;
+}
+
+void ks_epoll_apartment_imp::try_unschedule(uint64_t id) {
+	if (id == 0)
+		return;
+
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+
+	//仅延时任务和idle任务可撤销，对于其他任务（normal和prior），没有撤销的必要和意义
+	ks_task_fn found_fn;
+	auto index_it = m_d->delaying_fn_index.find(id);
+	if (index_it != m_d->delaying_fn_index.end()) {
+		auto fn_it = m_d->delaying_fn_map.find(std::make_pair(index_it->second, id));
+		ASSERT(fn_it != m_d->delaying_fn_map.end());
+		found_fn = std::move(fn_it->second.fn);
+		m_d->delaying_fn_map.erase(fn_it);
+		m_d->delaying_fn_index.erase(index_it);
+	}
+	else {
+		auto idle_it = std::find_if(m_d->now_fn_queue_idle.begin(), m_d->now_fn_queue_idle.end(), [id](const _FN_ITEM& fn_item) { return fn_item.fn_id == id; });
+		if (idle_it != m_d->now_fn_queue_idle.end()) {
+			found_fn = std::move(idle_it->fn);
+			m_d->now_fn_queue_idle.erase(idle_it);
+		}
+	}
+
+	//release fn
+	lock.unlock();
+	found_fn = {};
+}
+
+
+bool ks_epoll_apartment_imp::register_fd(int fd) {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	if (m_d->fd_map.find(fd) != m_d->fd_map.end())
+		return false;
+
+	//以EPOLLONESHOT加入且不等待任何事件；注：EPOLLERR和EPOLLHUP总会被报告，oneshot保证其至多被报告一次而不至于空转
+	struct epoll_event fd_event = {};
+	fd_event.events = EPOLLONESHOT;
+	fd_event.data.fd = fd;
+	if (::epoll_ctl(m_d->epoll_fd, EPOLL_CTL_ADD, fd, &fd_event) != 0)
+		return false;
+
+	m_d->fd_map.emplace(fd, _FD_ITEM{});
+	return true;
+}
+
+void ks_epoll_apartment_imp::unregister_fd(int fd) {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	auto fd_it = m_d->fd_map.find(fd);
+	if (fd_it == m_d->fd_map.end())
+		return;
+
+	ks_promise<uint32_t> waiting_promise = std::move(fd_it->second.waiting_promise);
+	m_d->fd_map.erase(fd_it);
+	::epoll_ctl(m_d->epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+	lock.unlock();
+
+	if (waiting_promise != nullptr)
+		waiting_promise.reject(ks_error::cancelled_error());
+}
+
+ks_future<uint32_t> ks_epoll_apartment_imp::wait_fd_events(int fd, uint32_t events) {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	_try_start_locked(m_d, lock);
+
+	if (m_d->state_v != _STATE::RUNNING)
+		return ks_future<uint32_t>::rejected(ks_error::terminated_error());
+
+	auto fd_it = m_d->fd_map.find(fd);
+	if (fd_it == m_d->fd_map.end())
+		return ks_future<uint32_t>::rejected(ks_error::arg_error()); //未register
+	if (fd_it->second.waiting_promise != nullptr)
+		return ks_future<uint32_t>::rejected(ks_error::status_error()); //已在等待
+
+	//重新arm（oneshot），就绪时由work线程resolve
+	struct epoll_event fd_event = {};
+	fd_event.events = events | EPOLLONESHOT;
+	fd_event.data.fd = fd;
+	if (::epoll_ctl(m_d->epoll_fd, EPOLL_CTL_MOD, fd, &fd_event) != 0)
+		return ks_future<uint32_t>::rejected(ks_error::unexpected_error());
+
+	//注：promise须指定本套间，使其在work线程上resolve后就地feed下游（若按默认取调用者套间或default_mta，则每次就绪都要多绕一次跨线程切换）
+	ks_promise<uint32_t> waiting_promise = ks_promise<uint32_t>::__from_raw(__ks_async_raw::ks_raw_promise::create(this));
+	fd_it->second.waiting_promise = waiting_promise;
+	_prepare_work_thread_locked(this, m_d, lock);
+	return waiting_promise.get_future();
+}
+
+
+void ks_epoll_apartment_imp::_try_start_locked(const std::shared_ptr<_EPOLL_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock) {
+	if (d->state_v == _STATE::NOT_START) {
+		d->state_v = _STATE::RUNNING;
+	}
+}
+
+void ks_epoll_apartment_imp::_try_stop_locked(const std::shared_ptr<_EPOLL_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(lock.owns_lock());
+
+	if (d->state_v == _STATE::RUNNING) {
+		if (d->thread_started_flag) {
+			d->state_v = _STATE::STOPPING;
+			_do_wakeup_work_thread_locked(d, lock); //trigger thread
+		}
+		else {
+			ASSERT(d->now_fn_queue_prior.size() + d->now_fn_queue_normal.size() + d->now_fn_queue_idle.size() + d->delaying_fn_map.size() == 0);
+			d->state_v = _STATE::STOPPED;
+			d->stopped_state_cv.notify_all();
+		}
+	}
+	else if (d->state_v == _STATE::NOT_START) {
+		d->state_v = _STATE::STOPPED;
+		d->stopped_state_cv.notify_all();
+	}
+}
+
+void ks_epoll_apartment_imp::_prepare_work_thread_locked(ks_epoll_apartment_imp* self, const std::shared_ptr<_EPOLL_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock) {
+	if (d->thread_started_flag || d->state_v != _STATE::RUNNING)
+		return;
+
+	d->thread_started_flag = true;
+	std::thread([self, d]() {
+		_work_thread_proc(self, d);
+	}).detach();
+}
+
+void ks_epoll_apartment_imp::_work_thread_proc(ks_epoll_apartment_imp* self, const std::shared_ptr<_EPOLL_APARTMENT_DATA>& d) {
+	ASSERT(ks_apartment::current_thread_apartment() == nullptr);
+	ks_apartment::__set_current_thread_apartment(self);
+
+	std::stringstream thread_name_ss;
+	thread_name_ss << d->name << "'s work-thread";
+	ks_apartment::__set_current_thread_name(thread_name_ss.str().c_str());
+
+	struct epoll_event ready_events[_MAX_EPOLL_EVENT_COUNT];
+	std::vector<std::pair<ks_promise<uint32_t>, uint32_t>> ready_promises;
+
+	std::unique_lock<ks_mutex> lock(d->mutex);
+	while (true) {
+		//直接将到期的delaying项移入now队列
+		const auto now = std::chrono::steady_clock::now();
+		while (!d->delaying_fn_map.empty() && d->delaying_fn_map.begin()->first.first <= now) {
+			auto fn_it = d->delaying_fn_map.begin();
+			d->delaying_fn_index.erase(fn_it->second.fn_id);
+			_do_put_fn_item_into_now_list_locked(d, std::move(fn_it->second), lock);
+			d->delaying_fn_map.erase(fn_it);
+		}
+
+		const bool has_now_fn = !d->now_fn_queue_prior.empty() || !d->now_fn_queue_normal.empty() ||
+			(!d->now_fn_queue_idle.empty() && d->state_v == _STATE::RUNNING);
+		if (!has_now_fn && d->state_v == _STATE::STOPPING)
+			break; //end
+
+		//poll：有待执行的任务时不阻塞，否则等至最近的延时任务到期（或被唤醒）
+		int timeout_ms = -1;
+		if (has_now_fn) {
+			timeout_ms = 0;
+		}
+		else if (!d->delaying_fn_map.empty()) {
+			const auto remain_time = d->delaying_fn_map.begin()->first.first - now;
+			timeout_ms = (int)(std::min)(std::chrono::duration_cast<std::chrono::milliseconds>(remain_time + std::chrono::milliseconds(1) - std::chrono::nanoseconds(1)).count(), (int64_t)INT32_MAX); //向上取整
+		}
+
+		d->polling_flag = (timeout_ms != 0);
+		lock.unlock();
+		int ready_event_count = ::epoll_wait(d->epoll_fd, ready_events, _MAX_EPOLL_EVENT_COUNT, timeout_ms);
+		lock.lock();
+		d->polling_flag = false;
+
+		for (int i = 0; i < ready_event_count; ++i) {
+			const int fd = ready_events[i].data.fd;
+			if (fd == d->wakeup_event_fd) {
+				uint64_t wakeup_value;
+				while (::read(d->wakeup_event_fd, &wakeup_value, sizeof(wakeup_value)) > 0) {}
+				d->wakeup_pending_flag = false;
+				continue;
+			}
+
+			auto fd_it = d->fd_map.find(fd);
+			if (fd_it != d->fd_map.end() && fd_it->second.waiting_promise != nullptr) {
+				ready_promises.emplace_back(std::move(fd_it->second.waiting_promise), (uint32_t)ready_events[i].events); //注：epoll_event为packed，须复制
+				fd_it->second.waiting_promise = nullptr;
+			}
+		}
+
+		if (!ready_promises.empty()) {
+			//在本线程resolve，then至本套间的后续任务随即入队，在下面与其他任务一并执行
+			lock.unlock();
+			for (auto& ready_pair : ready_promises)
+				ready_pair.first.resolve(ready_pair.second);
+			ready_promises.clear();
+			lock.lock();
+		}
+
+		//try next now_fn（每轮至多_MAX_FN_BATCH_COUNT个）
+		for (size_t n = 0; n < _MAX_FN_BATCH_COUNT; ++n) {
+			auto* now_fn_queue_sel = !d->now_fn_queue_prior.empty() ? &d->now_fn_queue_prior : &d->now_fn_queue_normal;
+			if (now_fn_queue_sel->empty() && !d->now_fn_queue_idle.empty() && d->state_v == _STATE::RUNNING)
+				now_fn_queue_sel = &d->now_fn_queue_idle;
+			if (now_fn_queue_sel->empty())
+				break;
+
+			ks_task_fn fn = std::move(now_fn_queue_sel->front().fn);
+			now_fn_queue_sel->pop_front();
+
+			lock.unlock();
+			fn();
+			fn = {};
+			lock.lock();
+		}
+	}
+
+	//收尾：未到期的延时任务和idle任务不再执行，尚在等待的fd以terminated_error拒绝
+	ASSERT(d->state_v == _STATE::STOPPING);
+	std::deque<_FN_ITEM> t_now_fn_queue_idle;
+	std::map<std::pair<std::chrono::steady_clock::time_point, uint64_t>, _FN_ITEM> t_delaying_fn_map;
+	d->now_fn_queue_idle.swap(t_now_fn_queue_idle);
+	d->delaying_fn_map.swap(t_delaying_fn_map);
+	d->delaying_fn_index.clear();
+	for (auto& fd_pair : d->fd_map) {
+		if (fd_pair.second.waiting_promise != nullptr) {
+			ready_promises.emplace_back(std::move(fd_pair.second.waiting_promise), (uint32_t)0);
+			fd_pair.second.waiting_promise = nullptr;
+		}
+	}
+	lock.unlock();
+
+	t_now_fn_queue_idle.clear();
+	t_delaying_fn_map.clear();
+	for (auto& ready_pair : ready_promises)
+		ready_pair.first.reject(ks_error::terminated_error());
+	ready_promises.clear();
+
+	lock.lock();
+	d->state_v = _STATE::STOPPED;
+	d->stopped_state_cv.notify_all();
+}
+
+void ks_epoll_apartment_imp::_do_put_fn_item_into_now_list_locked(const std::shared_ptr<_EPOLL_APARTMENT_DATA>& d, _FN_ITEM&& fn_item, std::unique_lock<ks_mutex>& lock) {
+	auto* now_fn_queue_sel =
+		fn_item.priority == 0 ? &d->now_fn_queue_normal :  //priority=0为普通优先级
+		fn_item.priority > 0 ? &d->now_fn_queue_prior :    //priority>0为高优先级
+		&d->now_fn_queue_idle;                             //priority<0为低优先级，简单地加入到idle队列
+	now_fn_queue_sel->push_back(std::move(fn_item));
+}
+
+void ks_epoll_apartment_imp::_do_wakeup_work_thread_locked(const std::shared_ptr<_EPOLL_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock) {
+	//仅当work线程阻塞于epoll_wait时才需唤醒，且在其读取之前不必重复写
+	if (d->polling_flag && !d->wakeup_pending_flag) {
+		d->wakeup_pending_flag = true;
+		const uint64_t wakeup_value = 1;
+		ssize_t written = ::write(d->wakeup_event_fd, &wakeup_value, sizeof(wakeup_value));
+		(void)written;
+	}
+}
+
+#endif //__KS_EPOLL_APARTMENT_ENABLED
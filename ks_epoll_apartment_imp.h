@@ -0,0 +1,133 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "ks_async_base.h"
+#include "ks_apartment.h"
+#include "ks_future.h"
+#include "ks_promise.h"
+#include "ktl/ks_concurrency.h"
+
+#if __KS_EPOLL_APARTMENT_ENABLED
+
+#include <deque>
+#include <map>
+#include <unordered_map>
+
+
+//I/O套间：单个work线程以epoll同时泵fd就绪事件和任务，（唤醒经由eventfd，延时任务映射为epoll_wait的超时）。
+//fd就绪以ks_future<uint32_t>（就绪的epoll事件）交付，其promise属于本套间且在work线程上被resolve，
+//故then至本套间的后续任务与I/O处理同在一个线程，没有跨线程的切换（若context的priority>=0x10000，则更是就地执行）。
+//用法：先register_fd，之后每次需要等待时调用wait_fd_events（一次性，就绪即解除，须再次wait才会再次交付）。
+class ks_epoll_apartment_imp final : public ks_apartment {
+public:
+	enum { //flag consts
+		no_flag                         = 0,
+		auto_register_flag              = 0x00010000,
+	};
+
+	KS_ASYNC_API explicit ks_epoll_apartment_imp(const char* name, uint flags = 0);
+	_DISABLE_COPY_CONSTRUCTOR(ks_epoll_apartment_imp);
+
+	KS_ASYNC_API ~ks_epoll_apartment_imp();
+
+public:
+	virtual const char* name() override;
+	virtual uint features() override;
+	virtual size_t concurrency() override;
+
+	virtual bool start() override;
+	virtual void async_stop() override;
+	virtual void wait() override;
+
+	virtual bool is_stopped() override;
+	virtual bool is_stopping_or_stopped() override;
+
+	virtual uint64_t schedule(std::function<void()>&& fn, int priority) override;
+	virtual uint64_t schedule_delayed(std::function<void()>&& fn, int priority, int64_t delay) override;
+	virtual uint64_t schedule(ks_task_fn&& fn, int priority) override;
+	virtual uint64_t schedule_delayed(ks_task_fn&& fn, int priority, int64_t delay) override;
+
+	virtual void try_unschedule(uint64_t id) override;
+
+public:
+	//将fd加入epoll（此时尚不等待任何事件），返回是否成功
+	KS_ASYNC_API bool register_fd(int fd);
+
+	//将fd移出epoll，若正在等待，则其future以cancelled_error拒绝
+	KS_ASYNC_API void unregister_fd(int fd);
+
+	//等待fd的events（EPOLLIN、EPOLLOUT等）就绪，future以实际就绪的事件resolve（可能含EPOLLERR、EPOLLHUP）。
+	//同一fd同时至多一个等待：fd未register时以arg_error拒绝，已在等待时以status_error拒绝，套间stop时以terminated_error拒绝。
+	KS_ASYNC_API ks_future<uint32_t> wait_fd_events(int fd, uint32_t events);
+
+private:
+	struct _EPOLL_APARTMENT_DATA;
+
+	static void _try_start_locked(const std::shared_ptr<_EPOLL_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
+	static void _try_stop_locked(const std::shared_ptr<_EPOLL_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
+
+	static void _prepare_work_thread_locked(ks_epoll_apartment_imp* self, const std::shared_ptr<_EPOLL_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
+	static void _work_thread_proc(ks_epoll_apartment_imp* self, const std::shared_ptr<_EPOLL_APARTMENT_DATA>& d);
+
+private:
+	struct _FN_ITEM {
+		ks_task_fn fn;
+		uint64_t fn_id;
+		int priority;
+	};
+
+	struct _FD_ITEM {
+		ks_promise<uint32_t> waiting_promise = nullptr; //仅在等待时非空
+	};
+
+	static void _do_put_fn_item_into_now_list_locked(const std::shared_ptr<_EPOLL_APARTMENT_DATA>& d, _FN_ITEM&& fn_item, std::unique_lock<ks_mutex>& lock);
+	static void _do_wakeup_work_thread_locked(const std::shared_ptr<_EPOLL_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
+
+private:
+	enum class _STATE { NOT_START, RUNNING, STOPPING, STOPPED };
+
+	struct _EPOLL_APARTMENT_DATA {
+		ks_mutex mutex;
+
+		std::string name; //const-like
+		uint flags; //const-like
+		int epoll_fd = -1; //const-like
+		int wakeup_event_fd = -1; //const-like
+
+		//prior简化为三级：>0为高优先，=0为普通，<0为低且简单地加入到idle队列
+		std::deque<_FN_ITEM> now_fn_queue_prior;
+		std::deque<_FN_ITEM> now_fn_queue_normal;
+		std::deque<_FN_ITEM> now_fn_queue_idle;
+		std::map<std::pair<std::chrono::steady_clock::time_point, uint64_t>, _FN_ITEM> delaying_fn_map; //按(到期时点, fn_id)排序
+		std::unordered_map<uint64_t, std::chrono::steady_clock::time_point> delaying_fn_index; //fn_id -> 到期时点，使try_unschedule可定位
+
+		std::unordered_map<int, _FD_ITEM> fd_map;
+
+		bool thread_started_flag = false;
+		bool polling_flag = false; //work线程是否正阻塞于epoll_wait（仅此时才需经由eventfd唤醒）
+		bool wakeup_pending_flag = false; //已写eventfd而work线程尚未读取
+
+		volatile _STATE state_v = _STATE::NOT_START;
+		ks_condition_variable stopped_state_cv{};
+
+		~_EPOLL_APARTMENT_DATA();
+	};
+
+	std::shared_ptr<_EPOLL_APARTMENT_DATA> m_d;
+};
+
+#endif //__KS_EPOLL_APARTMENT_ENABLED
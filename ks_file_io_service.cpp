@@ -0,0 +1,504 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "ks_file_io_service.h"
+
+void __forcelink_to_ks_file_io_service_cpp() {}
+
+#if __KS_EPOLL_APARTMENT_ENABLED
+
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+
+#if __KS_IO_URING_ENABLED
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+static constexpr size_t _MAX_IO_LEN = 0x7FFFF000; //同linux单次read/write的上限（MAX_RW_COUNT）
+
+
+#if __KS_IO_URING_ENABLED
+//io_uring的最小封装（不依赖liburing）：SQ/CQ环及SQE数组均mmap自ring fd
+struct ks_file_io_service::_IO_URING {
+	int ring_fd = -1;
+
+	void* sq_ring_ptr = MAP_FAILED;
+	size_t sq_ring_size = 0;
+	void* cq_ring_ptr = MAP_FAILED; //IORING_FEAT_SINGLE_MMAP时与sq_ring_ptr相同
+	size_t cq_ring_size = 0;
+	struct io_uring_sqe* sqes = (struct io_uring_sqe*)MAP_FAILED;
+	size_t sqes_size = 0;
+
+	unsigned* sq_head = nullptr;
+	unsigned* sq_tail = nullptr;
+	unsigned* sq_array = nullptr;
+	unsigned sq_mask = 0;
+	unsigned sq_entries = 0;
+
+	unsigned* cq_head = nullptr;
+	unsigned* cq_tail = nullptr;
+	struct io_uring_cqe* cqes = nullptr;
+	unsigned cq_mask = 0;
+	unsigned cq_entries = 0;
+
+	~_IO_URING() {
+		if (sqes != MAP_FAILED)
+			::munmap(sqes, sqes_size);
+		if (cq_ring_ptr != MAP_FAILED && cq_ring_ptr != sq_ring_ptr)
+			::munmap(cq_ring_ptr, cq_ring_size);
+		if (sq_ring_ptr != MAP_FAILED)
+			::munmap(sq_ring_ptr, sq_ring_size);
+		if (ring_fd >= 0)
+			::close(ring_fd);
+	}
+};
+#else
+struct ks_file_io_service::_IO_URING {};
+#endif
+
+
+ks_file_io_service::ks_file_io_service(const char* name, uint flags, size_t queue_depth, size_t fallback_thread_count)
+	: m_d(std::make_shared<_FILE_IO_SERVICE_DATA>()) {
+	ASSERT(name != nullptr);
+
+	m_d->name = name != nullptr ? name : "";
+	m_d->flags = flags;
+
+#if __KS_IO_URING_ENABLED
+	if (!(flags & force_thread_pool_flag)) {
+		m_uring_apartment.reset(new ks_epoll_apartment_imp((m_d->name + "'s uring").c_str()));
+		if (_try_setup_io_uring(m_d, queue_depth) && m_uring_apartment->register_fd(m_d->ring->ring_fd)) {
+			m_d->backend = io_uring_backend;
+			m_d->io_apartment = m_uring_apartment.get();
+		}
+		else {
+			m_d->ring.reset();
+			m_uring_apartment.reset();
+		}
+	}
+#endif
+
+	if (m_d->backend == thread_pool_backend) {
+		m_pool_apartment.reset(new ks_thread_pool_apartment_imp((m_d->name + "'s pool").c_str(), (std::max)(fallback_thread_count, (size_t)1)));
+		m_d->io_apartment = m_pool_apartment.get();
+	}
+}
+
+ks_file_io_service::~ks_file_io_service() {
+	//在途的I/O仍引用着调用者的buf和本服务的套间，故须等待其完成
+	if (m_d->state_v != _STATE::NOT_START && m_d->state_v != _STATE::STOPPED)
+		this->wait();
+}
+
+ks_file_io_service::_FILE_IO_SERVICE_DATA::~_FILE_IO_SERVICE_DATA() {
+	ASSERT(outstanding_count == 0 && inflight_requests.empty());
+}
+
+
+const char* ks_file_io_service::name() {
+	return m_d->name.c_str();
+}
+
+ks_file_io_service::backend_t ks_file_io_service::backend() {
+	return m_d->backend;
+}
+
+ks_apartment* ks_file_io_service::io_apartment() {
+	return m_d->io_apartment;
+}
+
+uint64_t ks_file_io_service::submit_call_count() {
+	return m_d->submit_call_count.load(std::memory_order_relaxed);
+}
+
+bool ks_file_io_service::register_buffers(const std::vector<std::pair<void*, size_t>>& buffers) {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	if (m_d->state_v != _STATE::NOT_START)
+		return false;
+
+#if __KS_IO_URING_ENABLED
+	if (m_d->backend == io_uring_backend) {
+		if (!m_d->registered_buffers.empty()) {
+			::syscall(__NR_io_uring_register, m_d->ring->ring_fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+			m_d->registered_buffers.clear();
+		}
+
+		if (!buffers.empty()) {
+			std::vector<struct iovec> iovs;
+			iovs.reserve(buffers.size());
+			for (auto& buffer : buffers)
+				iovs.push_back(iovec{ buffer.first, buffer.second });
+			if (::syscall(__NR_io_uring_register, m_d->ring->ring_fd, IORING_REGISTER_BUFFERS, iovs.data(), (unsigned)iovs.size()) != 0)
+				return false; //例如超出RLIMIT_MEMLOCK
+		}
+	}
+#endif
+
+	m_d->registered_buffers = buffers;
+	return true;
+}
+
+
+bool ks_file_io_service::start() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	if (m_d->state_v == _STATE::NOT_START)
+		m_d->state_v = _STATE::RUNNING;
+	if (m_d->state_v != _STATE::RUNNING)
+		return false;
+
+	lock.unlock();
+	return m_d->io_apartment->start();
+}
+
+void ks_file_io_service::async_stop() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	if (m_d->state_v == _STATE::NOT_START) {
+		m_d->state_v = _STATE::STOPPED;
+	}
+	else if (m_d->state_v == _STATE::RUNNING) {
+		m_d->state_v = _STATE::STOPPING;
+		if (m_d->outstanding_count == 0) {
+			lock.unlock();
+			m_d->io_apartment->async_stop();
+		}
+		//否则由最后一个完成的请求stop套间
+	}
+}
+
+void ks_file_io_service::wait() {
+	ASSERT(m_d->io_apartment != ks_apartment::current_thread_apartment());
+
+	this->async_stop(); //ensure stop
+
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	while (m_d->outstanding_count != 0) {
+		m_d->outstanding_cv.wait(lock);
+	}
+	lock.unlock();
+
+	m_d->io_apartment->async_stop();
+	m_d->io_apartment->wait();
+
+	lock.lock();
+	m_d->state_v = _STATE::STOPPED;
+}
+
+
+ks_future<size_t> ks_file_io_service::read(int fd, void* buf, size_t len, int64_t offset, ks_apartment* completion_apartment) {
+	return _do_post_request(m_d, _IO_REQUEST{ _IO_OP::READ, fd, buf, (std::min)(len, _MAX_IO_LEN), offset, completion_apartment, ks_promise<size_t>::create() });
+}
+
+ks_future<size_t> ks_file_io_service::write(int fd, const void* buf, size_t len, int64_t offset, ks_apartment* completion_apartment) {
+	return _do_post_request(m_d, _IO_REQUEST{ _IO_OP::WRITE, fd, const_cast<void*>(buf), (std::min)(len, _MAX_IO_LEN), offset, completion_apartment, ks_promise<size_t>::create() });
+}
+
+ks_future<size_t> ks_file_io_service::fsync(int fd, ks_apartment* completion_apartment) {
+	return _do_post_request(m_d, _IO_REQUEST{ _IO_OP::FSYNC, fd, nullptr, 0, 0, completion_apartment, ks_promise<size_t>::create() });
+}
+
+
+ks_future<size_t> ks_file_io_service::_do_post_request(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d, _IO_REQUEST&& request) {
+	std::unique_lock<ks_mutex> lock(d->mutex);
+	if (d->state_v == _STATE::NOT_START)
+		d->state_v = _STATE::RUNNING;
+	if (d->state_v != _STATE::RUNNING)
+		return ks_future<size_t>::rejected(ks_error::terminated_error());
+
+	ks_future<size_t> future = request.promise.get_future();
+	++d->outstanding_count;
+
+	if (d->backend == thread_pool_backend) {
+		lock.unlock();
+		_IO_REQUEST request_if_unscheduled = request; //request将被移入task，schedule失败时据此settle
+		const uint64_t fn_id = d->io_apartment->schedule(ks_task_fn([d, request = std::move(request)]() mutable {
+			_do_run_blocking_request(d, request);
+		}), 0);
+		if (fn_id == 0) {
+			//io_apartment已不接受任务，请求不会被执行，须在此settle（并计入完成），否则wait将一直等待
+			_do_settle_request(d, request_if_unscheduled, ks_result<size_t>(ks_error::terminated_error()));
+		}
+	}
+	else {
+		//同一轮内累积的请求由一个泵送任务一次性提交
+		d->pending_requests.push_back(std::move(request));
+		if (!d->pump_scheduled_flag) {
+			d->pump_scheduled_flag = true;
+			lock.unlock();
+#if __KS_IO_URING_ENABLED
+			const uint64_t fn_id = d->io_apartment->schedule(ks_task_fn([d]() {
+				_do_pump_io_uring(d);
+			}), 0);
+			if (fn_id == 0) {
+				//同上，本轮累积的请求不会被泵送，一并settle
+				lock.lock();
+				std::vector<_IO_REQUEST> t_pending_requests;
+				t_pending_requests.swap(d->pending_requests);
+				d->pump_scheduled_flag = false;
+				lock.unlock();
+
+				for (auto& pending_request : t_pending_requests)
+					_do_settle_request(d, pending_request, ks_result<size_t>(ks_error::terminated_error()));
+			}
+#endif
+		}
+	}
+
+	return future;
+}
+
+void ks_file_io_service::_do_settle_request(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d, _IO_REQUEST& request, int64_t io_ret) {
+	_do_settle_request(d, request, io_ret >= 0
+		? ks_result<size_t>((size_t)io_ret)
+		: ks_result<size_t>(ks_error::general_error().with_payload<int>((int)-io_ret)));
+}
+
+void ks_file_io_service::_do_settle_request(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d, _IO_REQUEST& request, const ks_result<size_t>& result) {
+	if (request.completion_apartment != nullptr) {
+		const uint64_t schedule_id = request.completion_apartment->schedule(ks_task_fn([promise = request.promise, result]() {
+			promise.try_settle(result);
+		}), 0);
+		if (schedule_id == 0)
+			request.promise.try_settle(result); //交付套间已停止，fn被丢弃，就地settle以免promise悬而未决
+	}
+	else {
+		request.promise.try_settle(result);
+	}
+
+	std::unique_lock<ks_mutex> lock(d->mutex);
+	ASSERT(d->outstanding_count > 0);
+	if (--d->outstanding_count == 0) {
+		d->outstanding_cv.notify_all();
+		if (d->state_v == _STATE::STOPPING) {
+			lock.unlock();
+			d->io_apartment->async_stop();
+		}
+	}
+}
+
+void ks_file_io_service::_do_run_blocking_request(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d, _IO_REQUEST& request) {
+	ssize_t ret = -1;
+	switch (request.op) {
+	case _IO_OP::READ:
+		ret = ::pread(request.fd, request.buf, request.len, (off_t)request.offset);
+		break;
+	case _IO_OP::WRITE:
+		ret = ::pwrite(request.fd, request.buf, request.len, (off_t)request.offset);
+		break;
+	case _IO_OP::FSYNC:
+		ret = ::fsync(request.fd);
+		break;
+	}
+
+	_do_settle_request(d, request, ret >= 0 ? (int64_t)ret : -(int64_t)errno);
+}
+
+
+#if __KS_IO_URING_ENABLED
+bool ks_file_io_service::_try_setup_io_uring(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d, size_t queue_depth) {
+	std::unique_ptr<_IO_URING> ring(new _IO_URING());
+
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	ring->ring_fd = (int)::syscall(__NR_io_uring_setup, (unsigned)(std::max)(queue_depth, (size_t)1), &params);
+	if (ring->ring_fd < 0)
+		return false;
+	if (!(params.features & IORING_FEAT_RW_CUR_POS))
+		return false; //IORING_OP_READ/WRITE需linux 5.6+，以此feature（同版本引入）作为判断
+
+	ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single_mmap)
+		ring->sq_ring_size = ring->cq_ring_size = (std::max)(ring->sq_ring_size, ring->cq_ring_size);
+
+	ring->sq_ring_ptr = ::mmap(nullptr, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring_ptr == MAP_FAILED)
+		return false;
+	ring->cq_ring_ptr = single_mmap ? ring->sq_ring_ptr : ::mmap(nullptr, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING);
+	if (ring->cq_ring_ptr == MAP_FAILED)
+		return false;
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = (struct io_uring_sqe*)::mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED)
+		return false;
+
+	char* sq_ring_base = (char*)ring->sq_ring_ptr;
+	ring->sq_head = (unsigned*)(sq_ring_base + params.sq_off.head);
+	ring->sq_tail = (unsigned*)(sq_ring_base + params.sq_off.tail);
+	ring->sq_array = (unsigned*)(sq_ring_base + params.sq_off.array);
+	ring->sq_mask = *(unsigned*)(sq_ring_base + params.sq_off.ring_mask);
+	ring->sq_entries = params.sq_entries;
+
+	char* cq_ring_base = (char*)ring->cq_ring_ptr;
+	ring->cq_head = (unsigned*)(cq_ring_base + params.cq_off.head);
+	ring->cq_tail = (unsigned*)(cq_ring_base + params.cq_off.tail);
+	ring->cqes = (struct io_uring_cqe*)(cq_ring_base + params.cq_off.cqes);
+	ring->cq_mask = *(unsigned*)(cq_ring_base + params.cq_off.ring_mask);
+	ring->cq_entries = params.cq_entries;
+
+	d->ring = std::move(ring);
+	return true;
+}
+
+void ks_file_io_service::_do_pump_io_uring(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d) {
+	ASSERT(d->io_apartment == ks_apartment::current_thread_apartment());
+
+	std::unique_lock<ks_mutex> lock(d->mutex);
+	std::vector<_IO_REQUEST> t_pending_requests;
+	t_pending_requests.swap(d->pending_requests);
+	d->pump_scheduled_flag = false;
+	lock.unlock();
+
+	for (auto& request : t_pending_requests)
+		d->backlog_requests.push_back(std::move(request));
+	t_pending_requests.clear();
+
+	//先收割以腾出CQ容量，再提交
+	_do_reap_io_uring_completions(d);
+	_do_submit_io_uring_requests(d);
+
+	//有在途请求时等待ring fd可读（即CQ非空），届时再泵送一轮
+	if (!d->inflight_requests.empty() && !d->ring_waiting_flag) {
+		d->ring_waiting_flag = true;
+		ks_epoll_apartment_imp* uring_apartment = static_cast<ks_epoll_apartment_imp*>(d->io_apartment);
+		uring_apartment->wait_fd_events(d->ring->ring_fd, EPOLLIN)
+			.on_completion(uring_apartment, [d](const ks_result<uint32_t>& result) {
+				d->ring_waiting_flag = false;
+				if (result.is_value())
+					_do_pump_io_uring(d);
+			});
+	}
+}
+
+void ks_file_io_service::_do_reap_io_uring_completions(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d) {
+	_IO_URING* ring = d->ring.get();
+
+	std::vector<std::pair<_IO_REQUEST, int64_t>> completed_requests;
+	unsigned cq_head = *ring->cq_head;
+	const unsigned cq_tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	while (cq_head != cq_tail) {
+		const struct io_uring_cqe* cqe = &ring->cqes[cq_head & ring->cq_mask];
+		auto request_it = d->inflight_requests.find(cqe->user_data);
+		ASSERT(request_it != d->inflight_requests.end());
+		if (request_it != d->inflight_requests.end()) {
+			completed_requests.emplace_back(std::move(request_it->second), (int64_t)cqe->res);
+			d->inflight_requests.erase(request_it);
+		}
+		++cq_head;
+	}
+	__atomic_store_n(ring->cq_head, cq_head, __ATOMIC_RELEASE);
+
+	for (auto& completed_pair : completed_requests)
+		_do_settle_request(d, completed_pair.first, completed_pair.second);
+}
+
+void ks_file_io_service::_do_submit_io_uring_requests(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d) {
+	_IO_URING* ring = d->ring.get();
+
+	//填充SQE，受限于SQ空位及CQ容量（在途数不超过cq_entries，以免CQ溢出）
+	unsigned sq_tail = *ring->sq_tail;
+	const unsigned sq_head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	while (!d->backlog_requests.empty() && sq_tail - sq_head < ring->sq_entries && d->inflight_requests.size() < ring->cq_entries) {
+		_IO_REQUEST& request = d->backlog_requests.front();
+
+		const unsigned sqe_index = sq_tail & ring->sq_mask;
+		struct io_uring_sqe* sqe = &ring->sqes[sqe_index];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->fd = request.fd;
+
+		if (request.op == _IO_OP::FSYNC) {
+			sqe->opcode = IORING_OP_FSYNC;
+		}
+		else {
+			const bool is_read = (request.op == _IO_OP::READ);
+			auto buffer_it = std::find_if(d->registered_buffers.cbegin(), d->registered_buffers.cend(), [&request](const std::pair<void*, size_t>& buffer) {
+				return (char*)request.buf >= (char*)buffer.first && (char*)request.buf + request.len <= (char*)buffer.first + buffer.second;
+			});
+			if (buffer_it != d->registered_buffers.cend()) {
+				sqe->opcode = is_read ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+				sqe->buf_index = (uint16_t)(buffer_it - d->registered_buffers.cbegin());
+			}
+			else {
+				sqe->opcode = is_read ? IORING_OP_READ : IORING_OP_WRITE;
+			}
+			sqe->addr = (uint64_t)(uintptr_t)request.buf;
+			sqe->len = (uint32_t)request.len;
+			sqe->off = (uint64_t)request.offset;
+		}
+
+		const uint64_t user_data = ++d->last_user_data;
+		sqe->user_data = user_data;
+		d->inflight_requests.emplace(user_data, std::move(request));
+		d->backlog_requests.pop_front();
+
+		ring->sq_array[sqe_index] = sqe_index;
+		++sq_tail;
+	}
+	__atomic_store_n(ring->sq_tail, sq_tail, __ATOMIC_RELEASE);
+
+	//一次系统调用提交本轮全部SQE
+	const unsigned to_submit = sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	if (to_submit == 0)
+		return;
+
+	d->submit_call_count.fetch_add(1, std::memory_order_relaxed);
+	const long submitted_count = ::syscall(__NR_io_uring_enter, ring->ring_fd, to_submit, 0, 0, nullptr, 0);
+	if (submitted_count < 0 && errno != EAGAIN && errno != EBUSY && errno != EINTR) {
+		//其他失败（例如ring已不可用）：重试无济于事，未被内核取走的请求均以此错误settle
+		_do_fail_unsubmitted_io_uring_requests(d, -(int64_t)errno);
+	}
+	else if (submitted_count < (long)to_submit) {
+		//暂时性失败或部分提交：余下的SQE仍在环中，稍后再泵送一轮重试提交
+		//注：不能指望已提交请求的完成事件来触发下一轮，已提交的可能为0个
+		d->io_apartment->schedule_delayed(ks_task_fn([d]() {
+			_do_pump_io_uring(d);
+		}), 0, 1);
+	}
+}
+
+void ks_file_io_service::_do_fail_unsubmitted_io_uring_requests(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d, int64_t io_ret) {
+	_IO_URING* ring = d->ring.get();
+
+	//撤回环中未被内核取走的SQE（sq_tail由本端维护），连同backlog中的请求一并settle
+	std::vector<_IO_REQUEST> failed_requests;
+	const unsigned sq_head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	const unsigned sq_tail = *ring->sq_tail;
+	for (unsigned sq_pos = sq_head; sq_pos != sq_tail; ++sq_pos) {
+		const struct io_uring_sqe* sqe = &ring->sqes[ring->sq_array[sq_pos & ring->sq_mask]];
+		auto request_it = d->inflight_requests.find(sqe->user_data);
+		ASSERT(request_it != d->inflight_requests.end());
+		if (request_it != d->inflight_requests.end()) {
+			failed_requests.push_back(std::move(request_it->second));
+			d->inflight_requests.erase(request_it);
+		}
+	}
+	__atomic_store_n(ring->sq_tail, sq_head, __ATOMIC_RELEASE);
+
+	for (auto& request : d->backlog_requests)
+		failed_requests.push_back(std::move(request));
+	d->backlog_requests.clear();
+
+	for (auto& request : failed_requests)
+		_do_settle_request(d, request, io_ret);
+}
+#endif //__KS_IO_URING_ENABLED
+
+#endif //__KS_EPOLL_APARTMENT_ENABLED
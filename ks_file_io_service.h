@@ -0,0 +1,155 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "ks_async_base.h"
+#include "ks_apartment.h"
+#include "ks_future.h"
+#include "ks_promise.h"
+#include "ks_epoll_apartment_imp.h"
+#include "ks_thread_pool_apartment_imp.h"
+#include "ktl/ks_concurrency.h"
+
+#if __KS_EPOLL_APARTMENT_ENABLED
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+//异步文件I/O服务：read/write/fsync以ks_future<size_t>交付，不占用default_mta的线程。
+//后端优先采用io_uring：由一个ks_epoll_apartment_imp泵送，同一轮内累积的请求一次性提交（一次io_uring_enter），
+//完成事件经由ring fd的可读通知收割；若io_uring不可用（内核过旧或被禁用，或指定force_thread_pool_flag），
+//则回退至阻塞式的线程池（pread/pwrite/fsync）。
+//完成时：若指定了completion_apartment，则在该套间中resolve，否则直接在I/O线程上resolve。
+//失败时以general_error拒绝，其payload为errno（int）。
+//注：buf须保持有效直至future完成；析构前若尚未wait，则析构时等待在途的I/O完成。
+class ks_file_io_service {
+public:
+	enum { //flag consts
+		no_flag                         = 0,
+		force_thread_pool_flag          = 0x00100000, //不尝试io_uring，总是使用线程池后端
+	};
+
+	enum backend_t {
+		io_uring_backend,
+		thread_pool_backend,
+	};
+
+	static constexpr size_t default_queue_depth = 256;
+	static constexpr size_t default_fallback_thread_count = 4;
+
+	KS_ASYNC_API explicit ks_file_io_service(const char* name, uint flags = 0, size_t queue_depth = default_queue_depth, size_t fallback_thread_count = default_fallback_thread_count);
+	_DISABLE_COPY_CONSTRUCTOR(ks_file_io_service);
+
+	KS_ASYNC_API ~ks_file_io_service();
+
+public:
+	KS_ASYNC_API const char* name();
+	KS_ASYNC_API backend_t backend();
+
+	//执行I/O（或泵送io_uring）的套间
+	KS_ASYNC_API ks_apartment* io_apartment();
+
+	//登记固定缓冲区（io_uring_register），此后落在其中的读写以READ_FIXED/WRITE_FIXED提交，省去每次I/O的页面pin/unpin。
+	//须在start（及首次I/O）前调用，返回是否生效；线程池后端下仅记录，不产生效果。
+	KS_ASYNC_API bool register_buffers(const std::vector<std::pair<void*, size_t>>& buffers);
+
+	KS_ASYNC_API bool start();
+	KS_ASYNC_API void async_stop();
+	KS_ASYNC_API void wait();
+
+public:
+	//读至多len字节，future以实际读取的字节数resolve（0表示EOF）
+	KS_ASYNC_API ks_future<size_t> read(int fd, void* buf, size_t len, int64_t offset, ks_apartment* completion_apartment = nullptr);
+
+	//写至多len字节，future以实际写入的字节数resolve
+	KS_ASYNC_API ks_future<size_t> write(int fd, const void* buf, size_t len, int64_t offset, ks_apartment* completion_apartment = nullptr);
+
+	//future以0 resolve
+	KS_ASYNC_API ks_future<size_t> fsync(int fd, ks_apartment* completion_apartment = nullptr);
+
+	//累计的提交系统调用次数（仅io_uring_backend），与请求数之比即反映批量提交的效果
+	KS_ASYNC_API uint64_t submit_call_count();
+
+private:
+	enum class _IO_OP { READ, WRITE, FSYNC };
+
+	struct _IO_REQUEST {
+		_IO_OP op;
+		int fd;
+		void* buf;
+		size_t len;
+		int64_t offset;
+		ks_apartment* completion_apartment;
+		ks_promise<size_t> promise;
+	};
+
+	struct _IO_URING;
+	struct _FILE_IO_SERVICE_DATA;
+
+	static ks_future<size_t> _do_post_request(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d, _IO_REQUEST&& request);
+	static void _do_settle_request(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d, _IO_REQUEST& request, int64_t io_ret);
+	static void _do_settle_request(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d, _IO_REQUEST& request, const ks_result<size_t>& result);
+	static void _do_run_blocking_request(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d, _IO_REQUEST& request);
+
+#if __KS_IO_URING_ENABLED
+	static bool _try_setup_io_uring(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d, size_t queue_depth);
+	static void _do_pump_io_uring(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d);
+	static void _do_reap_io_uring_completions(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d);
+	static void _do_submit_io_uring_requests(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d);
+	static void _do_fail_unsubmitted_io_uring_requests(const std::shared_ptr<_FILE_IO_SERVICE_DATA>& d, int64_t io_ret);
+#endif
+
+private:
+	enum class _STATE { NOT_START, RUNNING, STOPPING, STOPPED };
+
+	struct _FILE_IO_SERVICE_DATA {
+		ks_mutex mutex;
+
+		std::string name; //const-like
+		uint flags; //const-like
+		backend_t backend = thread_pool_backend; //const-like
+		ks_apartment* io_apartment = nullptr; //const-like
+		std::vector<std::pair<void*, size_t>> registered_buffers; //const-like（start后）
+
+		std::vector<_IO_REQUEST> pending_requests; //仅io_uring_backend：待下一轮提交的请求
+		bool pump_scheduled_flag = false; //仅io_uring_backend：是否已向io_apartment投递了泵送任务
+		size_t outstanding_count = 0; //尚未完成的请求数（含pending、在途）
+		ks_condition_variable outstanding_cv{};
+
+		//以下仅在io_apartment线程上访问（io_uring_backend）
+		std::unique_ptr<_IO_URING> ring;
+		std::deque<_IO_REQUEST> backlog_requests; //因SQ/CQ容量暂未能提交的请求
+		std::unordered_map<uint64_t, _IO_REQUEST> inflight_requests; //user_data -> 请求
+		uint64_t last_user_data = 0;
+		bool ring_waiting_flag = false; //是否正在等待ring fd可读
+		std::atomic<uint64_t> submit_call_count{ 0 };
+
+		volatile _STATE state_v = _STATE::NOT_START;
+
+		~_FILE_IO_SERVICE_DATA();
+	};
+
+	std::shared_ptr<_FILE_IO_SERVICE_DATA> m_d;
+	std::unique_ptr<ks_epoll_apartment_imp> m_uring_apartment; //仅io_uring_backend
+	std::unique_ptr<ks_thread_pool_apartment_imp> m_pool_apartment; //仅thread_pool_backend
+};
+
+#endif //__KS_EPOLL_APARTMENT_ENABLED
@@ -128,7 +128,10 @@ public: //then, transform
 		std::is_convertible_v<FN, std::function<ks_future<R>(const T&)>> ||
 		std::is_convertible_v<FN, std::function<R(const T&, ks_cancel_inspector*)>> ||
 		std::is_convertible_v<FN, std::function<ks_result<R>(const T&, ks_cancel_inspector*)>> ||
-		std::is_convertible_v<FN, std::function<ks_future<R>(const T&, ks_cancel_inspector*)>>>>
+		std::is_convertible_v<FN, std::function<ks_future<R>(const T&, ks_cancel_inspector*)>> ||
+		std::is_convertible_v<FN, std::function<R(T&&)>> ||
+		std::is_convertible_v<FN, std::function<ks_result<R>(T&&)>> ||
+		std::is_convertible_v<FN, std::function<ks_future<R>(T&&)>>>>
 	ks_future<R> then(ks_apartment* apartment, FN&& fn, const ks_async_context& context = {}) const {
 		ASSERT(!this->is_null());
 		ASSERT(apartment != nullptr);
@@ -474,7 +477,8 @@ private: //__choose_then
 	ks_future<R> __choose_then(ks_apartment* apartment, const ks_async_context& context, FN&& fn) const {
 		constexpr int arglist_mode =
 			(std::is_convertible_v<FN, std::function<R(const T&, ks_cancel_inspector*)>> || std::is_convertible_v<FN, std::function<ks_result<R>(const T&, ks_cancel_inspector*)>> || std::is_convertible_v<FN, std::function<ks_future<R>(const T&, ks_cancel_inspector*)>>) ? 2 :
-			(std::is_convertible_v<FN, std::function<R(const T&)>> || std::is_convertible_v<FN, std::function<ks_result<R>(const T&)>> || std::is_convertible_v<FN, std::function<ks_future<R>(const T&)>>) ? 1 : 0;
+			(std::is_convertible_v<FN, std::function<R(const T&)>> || std::is_convertible_v<FN, std::function<ks_result<R>(const T&)>> || std::is_convertible_v<FN, std::function<ks_future<R>(const T&)>>) ? 1 :
+			(std::is_convertible_v<FN, std::function<R(T&&)>> || std::is_convertible_v<FN, std::function<ks_result<R>(T&&)>> || std::is_convertible_v<FN, std::function<ks_future<R>(T&&)>>) ? 3 : 0;
 		static_assert(arglist_mode != 0, "illegal then's arglist");
 		return this->__choose_then_by_arglist<R>(apartment, context, std::forward<FN>(fn), std::integral_constant<int, arglist_mode>());
 	}
@@ -499,6 +503,16 @@ private: //__choose_then
 		static_assert(ret_mode != 0, "illegal then's ret");
 		return this->__choose_then_by_arglist_ret<R>(apartment, context, std::forward<FN>(fn), std::integral_constant<int, 2>(), std::integral_constant<int, ret_mode>());
 	}
+	template <class R, class FN>
+	ks_future<R> __choose_then_by_arglist(ks_apartment* apartment, const ks_async_context& context, FN&& fn, std::integral_constant<int, 3>) const {
+		constexpr int ret_mode =
+			std::is_void_v<std::invoke_result_t<FN, T&&>> ? -1 :
+			std::is_convertible_v<std::invoke_result_t<FN, T&&>, ks_future<R>> ? 3 :
+			std::is_convertible_v<std::invoke_result_t<FN, T&&>, ks_result<R>> ? 2 :
+			std::is_convertible_v<std::invoke_result_t<FN, T&&>, R> ? 1 : 0;
+		static_assert(ret_mode != 0, "illegal then's ret");
+		return this->__choose_then_by_arglist_ret<R>(apartment, context, std::forward<FN>(fn), std::integral_constant<int, 3>(), std::integral_constant<int, ret_mode>());
+	}
 
 	template <class R, class FN>
 	ks_future<R> __choose_then_by_arglist_ret(ks_apartment* apartment, const ks_async_context& context, FN&& fn, std::integral_constant<int, 1>, std::integral_constant<int, -1>) const {
@@ -536,6 +550,24 @@ private: //__choose_then
 		return this->__then_of_arglist_2_ret_3<R>(apartment, context, std::forward<FN>(fn));
 	}
 
+	template <class R, class FN>
+	ks_future<R> __choose_then_by_arglist_ret(ks_apartment* apartment, const ks_async_context& context, FN&& fn, std::integral_constant<int, 3>, std::integral_constant<int, -1>) const {
+		static_assert(std::is_void_v<R>, "R must be void");
+		return this->__then_of_arglist_3_ret_x<R>(apartment, context, std::forward<FN>(fn));
+	}
+	template <class R, class FN>
+	ks_future<R> __choose_then_by_arglist_ret(ks_apartment* apartment, const ks_async_context& context, FN&& fn, std::integral_constant<int, 3>, std::integral_constant<int, 1>) const {
+		return this->__then_of_arglist_3_ret_1<R>(apartment, context, std::forward<FN>(fn));
+	}
+	template <class R, class FN>
+	ks_future<R> __choose_then_by_arglist_ret(ks_apartment* apartment, const ks_async_context& context, FN&& fn, std::integral_constant<int, 3>, std::integral_constant<int, 2>) const {
+		return this->__then_of_arglist_3_ret_2<R>(apartment, context, std::forward<FN>(fn));
+	}
+	template <class R, class FN>
+	ks_future<R> __choose_then_by_arglist_ret(ks_apartment* apartment, const ks_async_context& context, FN&& fn, std::integral_constant<int, 3>, std::integral_constant<int, 3>) const {
+		return this->__then_of_arglist_3_ret_3<R>(apartment, context, std::forward<FN>(fn));
+	}
+
 private: //__choose_transform
 	template <class R, class FN>
 	ks_future<R> __choose_transform(ks_apartment* apartment, const ks_async_context& context, FN&& fn) const {
@@ -813,6 +845,41 @@ private: //__then
 		return ks_future<R>::__from_raw(raw_future2);
 	}
 
+	//arglist为T&&时，经then_by_move取得value：this为其唯一持有者时移出，否则复制一份（参见ks_raw_value::take）
+	template <class R>
+	_NOINLINE ks_future<R> __then_of_arglist_3_ret_1(ks_apartment* apartment, const ks_async_context& context, std::function<R(T&&)> fn) const {
+		auto raw_fn = [fn = std::move(fn)](ks_raw_value&& raw_value)->ks_raw_result {
+			R typed_value2 = fn(raw_value.take<T>());
+			return ks_raw_value::of<R>(std::move(typed_value2));
+		};
+		ks_raw_future_ptr raw_future2 = m_raw_future->then_by_move(std::move(raw_fn), context, apartment);
+		return ks_future<R>::__from_raw(raw_future2);
+	}
+	template <class R>
+	_NOINLINE ks_future<R> __then_of_arglist_3_ret_2(ks_apartment* apartment, const ks_async_context& context, std::function<ks_result<R>(T&&)> fn) const {
+		auto raw_fn = [fn = std::move(fn)](ks_raw_value&& raw_value)->ks_raw_result {
+			ks_result<R> typed_result2 = fn(raw_value.take<T>());
+			return typed_result2.__get_raw();
+		};
+		ks_raw_future_ptr raw_future2 = m_raw_future->then_by_move(std::move(raw_fn), context, apartment);
+		return ks_future<R>::__from_raw(raw_future2);
+	}
+	template <class R>
+	_NOINLINE ks_future<R> __then_of_arglist_3_ret_3(ks_apartment* apartment, const ks_async_context& context, std::function<ks_future<R>(T&&)> fn) const {
+		//raw层无flat_then_by_move，故先then_by_move得到ks_future<ks_future<R>>，再flat_then展平
+		return this->__then_of_arglist_3_ret_1<ks_future<R>>(apartment, context, std::move(fn))
+			.template flat_then<R>(apartment, context, [](const ks_future<R>& value_future) -> ks_future<R> { return value_future; });
+	}
+	template <class R>
+	_NOINLINE ks_future<R> __then_of_arglist_3_ret_x(ks_apartment* apartment, const ks_async_context& context, std::function<void(T&&)> fn) const {
+		auto raw_fn = [fn = std::move(fn)](ks_raw_value&& raw_value)->ks_raw_result {
+			fn(raw_value.take<T>());
+			return ks_raw_value::of<nothing_t>(nothing);
+		};
+		ks_raw_future_ptr raw_future2 = m_raw_future->then_by_move(std::move(raw_fn), context, apartment);
+		return ks_future<R>::__from_raw(raw_future2);
+	}
+
 private: //__transform
 	template <class R>
 	_NOINLINE ks_future<R> __transform_of_arglist_1_ret_1(ks_apartment* apartment, const ks_async_context& context, std::function<R(const ks_result<T>&)> fn) const {
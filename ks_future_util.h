@@ -18,6 +18,7 @@ limitations under the License.
 #include "ks_async_base.h"
 #include "ks_future.h"
 #include "ks_promise.h"
+#include "ktl/ks_defer.h"
 
 
 _NAMESPACE_LIKE class ks_future_util final { //as namespace
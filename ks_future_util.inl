@@ -150,6 +150,10 @@ _NOINLINE ks_future<void> ks_future_util::parallel(
 	else {
 		std::vector<ks_future<void>> future_vec;
 		future_vec.reserve(fns.size());
+
+		//批量投递：各task在区间结束时一次入队
+		ks_raw_future::__begin_batch_schedule();
+		ks_defer defer_end_batch_schedule([]() { ks_raw_future::__end_batch_schedule(); });
 		for (const auto& fn : fns) {
 			future_vec.push_back(
 				ks_future_util::post<void>(apartment, fn, context));
@@ -177,6 +181,9 @@ _NOINLINE ks_future<void> ks_future_util::parallel_n(
 		std::vector<ks_future<void>> future_vec;
 		future_vec.reserve(n);
 
+		//批量投递：各task在区间结束时一次入队
+		ks_raw_future::__begin_batch_schedule();
+		ks_defer defer_end_batch_schedule([]() { ks_raw_future::__end_batch_schedule(); });
 		for (size_t i = 0; i < n; ++i) {
 			future_vec.push_back(
 				ks_future_util::post<void>(apartment, fn, context)
@@ -326,7 +333,7 @@ _NOINLINE ks_future<void> ks_future_util::repeat_periodic(
 	data->interval = interval;
 	data->controller.__mark_bound_with_aproc(true);
 	data->context = make_async_context().bind_controller(&data->controller).set_parent(context, true);
-	data->create_time = std::chrono::steady_clock::now();
+	data->create_time = apartment->clock_now();
 	data->raw_final_promise_void = ks_raw_promise::create(apartment);
 
 	data->raw_final_promise_void->get_future()->on_failure(
@@ -398,7 +405,7 @@ _NOINLINE void ks_future_util::__schedule_periodic_once(const std::shared_ptr<__
 			[data](const ks_result<void>& result) {
 				if (result.is_value()) {
 					data->rounds++;
-					const std::chrono::steady_clock::time_point now_time = std::chrono::steady_clock::now();
+					const std::chrono::steady_clock::time_point now_time = data->apartment->clock_now();
 					const std::chrono::steady_clock::time_point next_time = data->create_time + std::chrono::milliseconds((long long)(data->delay + data->interval * data->rounds));
 					const int64_t next_delay_2 = std::chrono::duration_cast<std::chrono::milliseconds>(next_time - now_time).count();
 					__schedule_periodic_once(data, next_delay_2);
@@ -0,0 +1,212 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "ks_inline_apartment_imp.h"
+#include "ktl/ks_defer.h"
+#include <algorithm>
+
+void __forcelink_to_ks_inline_apartment_imp_cpp() {}
+
+static std::atomic<uint64_t> g_last_fn_id { 0 };
+
+static thread_local size_t tls_inline_recursion_depth = 0;
+
+
+ks_inline_apartment_imp::ks_inline_apartment_imp(const char* name, ks_apartment* parent_apartment, size_t max_recursion_depth, uint flags)
+	: m_d(std::make_shared<_INLINE_APARTMENT_DATA>()) {
+	ASSERT(name != nullptr);
+	ASSERT(parent_apartment != this);
+
+	m_d->name = name != nullptr ? name : "";
+	m_d->flags = flags;
+	m_d->parent_apartment = parent_apartment;
+	m_d->max_recursion_depth = max_recursion_depth;
+
+	if (m_d->flags & auto_register_flag) {
+		ks_apartment::__register_public_apartment(m_d->name.c_str(), this);
+	}
+}
+
+ks_inline_apartment_imp::~ks_inline_apartment_imp() {
+	if (m_d->flags & auto_register_flag) {
+		ks_apartment::__unregister_public_apartment(m_d->name.c_str(), this);
+	}
+}
+
+
+const char* ks_inline_apartment_imp::name() {
+	return m_d->name.c_str();
+}
+
+uint ks_inline_apartment_imp::features() {
+	return inline_execution_feature;
+}
+
+size_t ks_inline_apartment_imp::concurrency() {
+	return 1; //就地执行，实际并发度取决于调用者
+}
+
+
+bool ks_inline_apartment_imp::start() {
+	return !m_d->stopped_v;
+}
+
+void ks_inline_apartment_imp::async_stop() {
+	m_d->stopped_v = true;
+}
+
+void ks_inline_apartment_imp::wait() {
+	m_d->stopped_v = true; //没有排队的任务，无须等待（已转至fallback套间的任务由其负责）
+}
+
+bool ks_inline_apartment_imp::is_stopped() {
+	return m_d->stopped_v;
+}
+
+bool ks_inline_apartment_imp::is_stopping_or_stopped() {
+	return m_d->stopped_v;
+}
+
+
+uint64_t ks_inline_apartment_imp::schedule(std::function<void()>&& fn, int priority) {
+	return this->schedule(ks_task_fn(std::move(fn)), priority);
+}
+
+uint64_t ks_inline_apartment_imp::schedule_delayed(std::function<void()>&& fn, int priority, int64_t delay) {
+	return this->schedule_delayed(ks_task_fn(std::move(fn)), priority, delay);
+}
+
+uint64_t ks_inline_apartment_imp::schedule(ks_task_fn&& fn, int priority) {
+	if (m_d->stopped_v)
+		return 0;
+
+	if (tls_inline_recursion_depth >= m_d->max_recursion_depth) {
+		//嵌套过深，回退至fallback套间，由此栈得以展开
+		return this->_determine_fallback_apartment(false)->schedule(std::move(fn), priority);
+	}
+
+	uint64_t fn_id = ++g_last_fn_id;
+	ASSERT(fn_id != 0);
+
+	++tls_inline_recursion_depth;
+	ks_defer defer_restore_depth([]() { --tls_inline_recursion_depth; });
+	fn();
+	return fn_id;
+}
+
+//延时fn执行或被丢弃时，移除其映射；若映射尚未记录，则留下墓碑
+void ks_inline_apartment_imp::_do_settle_delaying_fn(const std::shared_ptr<_INLINE_APARTMENT_DATA>& d, uint64_t fn_id) {
+	std::unique_lock<ks_mutex> lock(d->mutex);
+	auto index_it = d->delaying_fn_index.find(fn_id);
+	if (index_it != d->delaying_fn_index.end()) {
+		ASSERT(index_it->second.first != nullptr);
+		d->delaying_fn_index.erase(index_it);
+	}
+	else {
+		d->delaying_fn_index.emplace(fn_id, std::make_pair((ks_apartment*)nullptr, (uint64_t)0));
+	}
+}
+
+//延时fn的守卫：fn未执行即被计时的套间销毁时（如其已stop），移除其映射
+struct ks_inline_apartment_imp::_DELAYING_FN_GUARD {
+	std::shared_ptr<_INLINE_APARTMENT_DATA> d;
+	uint64_t fn_id;
+
+	explicit _DELAYING_FN_GUARD(const std::shared_ptr<_INLINE_APARTMENT_DATA>& d_, uint64_t fn_id_) : d(d_), fn_id(fn_id_) {}
+	_DELAYING_FN_GUARD(_DELAYING_FN_GUARD&& r) noexcept : d(std::move(r.d)), fn_id(r.fn_id) {}
+	_DELAYING_FN_GUARD& operator=(_DELAYING_FN_GUARD&&) = delete;
+
+	~_DELAYING_FN_GUARD() {
+		if (d != nullptr)
+			_do_settle_delaying_fn(d, fn_id);
+	}
+
+	std::shared_ptr<_INLINE_APARTMENT_DATA> release() noexcept {
+		return std::move(d);
+	}
+};
+
+uint64_t ks_inline_apartment_imp::schedule_delayed(ks_task_fn&& fn, int priority, int64_t delay) {
+	if (m_d->stopped_v)
+		return 0;
+
+	uint64_t fn_id = ++g_last_fn_id;
+	ASSERT(fn_id != 0);
+
+	//由fallback套间计时，到期后即在其中执行；记录映射，使try_unschedule可转发
+	//注：调用fallback套间时不持锁（其可能就地执行fn，或重入本套间），故fn可能在记录映射之前就已执行或被丢弃，
+	//此时_do_settle_delaying_fn留下墓碑，由下面记录映射时消去
+	ks_apartment* timing_apartment = this->_determine_fallback_apartment(true);
+	uint64_t timing_schedule_id = timing_apartment->schedule_delayed(ks_task_fn([guard = _DELAYING_FN_GUARD(m_d, fn_id), fn = std::move(fn)]() mutable {
+		const std::shared_ptr<_INLINE_APARTMENT_DATA> d2 = guard.release();
+		_do_settle_delaying_fn(d2, guard.fn_id);
+		fn();
+	}), priority, delay);
+
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	if (timing_schedule_id == 0) {
+		m_d->delaying_fn_index.erase(fn_id); //fn已被丢弃，消去其墓碑
+		return 0;
+	}
+
+	auto index_it = m_d->delaying_fn_index.find(fn_id);
+	if (index_it != m_d->delaying_fn_index.end()) {
+		ASSERT(index_it->second.first == nullptr);
+		m_d->delaying_fn_index.erase(index_it); //fn已执行或被丢弃
+	}
+	else {
+		m_d->delaying_fn_index.emplace(fn_id, std::make_pair(timing_apartment, timing_schedule_id));
+	}
+	return fn_id;
+}
+
+void ks_inline_apartment_imp::try_unschedule(uint64_t id) {
+	if (id == 0)
+		return;
+
+	//仅延时任务可撤销，就地执行的任务在schedule返回时已执行完毕
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	auto index_it = m_d->delaying_fn_index.find(id);
+	if (index_it == m_d->delaying_fn_index.end())
+		return;
+
+	const std::pair<ks_apartment*, uint64_t> timing_pair = index_it->second;
+	if (timing_pair.first == nullptr)
+		return; //墓碑：fn已执行或被丢弃
+	lock.unlock();
+
+	//映射留待fn被计时的套间丢弃时（经由_DELAYING_FN_GUARD）再移除
+	timing_pair.first->try_unschedule(timing_pair.second);
+}
+
+size_t ks_inline_apartment_imp::current_recursion_depth() {
+	return tls_inline_recursion_depth;
+}
+
+size_t ks_inline_apartment_imp::delaying_fn_count() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	return (size_t)std::count_if(m_d->delaying_fn_index.cbegin(), m_d->delaying_fn_index.cend(),
+		[](const std::pair<const uint64_t, std::pair<ks_apartment*, uint64_t>>& index_pair) { return index_pair.second.first != nullptr; });
+}
+
+
+ks_apartment* ks_inline_apartment_imp::_determine_fallback_apartment(bool for_delayed) {
+	if (m_d->parent_apartment != nullptr)
+		return m_d->parent_apartment;
+	else if (for_delayed)
+		return ks_apartment::default_mta();
+	else
+		return ks_apartment::current_thread_apartment_or_default_mta();
+}
@@ -0,0 +1,92 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "ks_async_base.h"
+#include "ks_apartment.h"
+#include "ktl/ks_concurrency.h"
+#include <unordered_map>
+
+
+//就地（inline）套间：schedule时在调用者线程上同步执行fn，没有入队、唤醒和线程切换，
+//适用于廉价的then/transform（例如长链中的类型转换），使其开销仅为一次函数调用。
+//为防止长链同步展开导致栈溢出，同一线程上的就地执行嵌套深度超过max_recursion_depth时，回退至parent套间schedule
+//（parent为nullptr时取current_thread_apartment_or_default_mta）；延时任务总是经由parent（为nullptr时取default_mta）计时。
+//注：执行期间current_thread_apartment不变；调用schedule时不可持有fn所需的锁（ks_future内部已就此处理）。
+class ks_inline_apartment_imp final : public ks_apartment {
+public:
+	enum { //flag consts
+		no_flag                         = 0,
+		auto_register_flag              = 0x00010000,
+	};
+
+	static constexpr size_t default_max_recursion_depth = 32;
+
+	KS_ASYNC_API explicit ks_inline_apartment_imp(const char* name, ks_apartment* parent_apartment = nullptr, size_t max_recursion_depth = default_max_recursion_depth, uint flags = 0);
+	_DISABLE_COPY_CONSTRUCTOR(ks_inline_apartment_imp);
+
+	KS_ASYNC_API ~ks_inline_apartment_imp();
+
+public:
+	virtual const char* name() override;
+	virtual uint features() override;
+	virtual size_t concurrency() override;
+
+	virtual bool start() override;
+	virtual void async_stop() override;
+	virtual void wait() override;
+
+	virtual bool is_stopped() override;
+	virtual bool is_stopping_or_stopped() override;
+
+	virtual uint64_t schedule(std::function<void()>&& fn, int priority) override;
+	virtual uint64_t schedule_delayed(std::function<void()>&& fn, int priority, int64_t delay) override;
+	virtual uint64_t schedule(ks_task_fn&& fn, int priority) override;
+	virtual uint64_t schedule_delayed(ks_task_fn&& fn, int priority, int64_t delay) override;
+
+	virtual void try_unschedule(uint64_t id) override;
+
+	//当前线程上就地执行的嵌套深度（各inline套间共计）
+	KS_ASYNC_API static size_t current_recursion_depth();
+
+	//经由fallback套间计时、尚未执行（亦未被丢弃）的延时fn数
+	KS_ASYNC_API size_t delaying_fn_count();
+
+private:
+	ks_apartment* _determine_fallback_apartment(bool for_delayed);
+
+private:
+	struct _INLINE_APARTMENT_DATA;
+	static void _do_settle_delaying_fn(const std::shared_ptr<_INLINE_APARTMENT_DATA>& d, uint64_t fn_id);
+
+	struct _DELAYING_FN_GUARD;
+
+private:
+	struct _INLINE_APARTMENT_DATA {
+		ks_mutex mutex;
+
+		std::string name; //const-like
+		uint flags; //const-like
+		ks_apartment* parent_apartment; //const-like
+		size_t max_recursion_depth; //const-like
+
+		std::unordered_map<uint64_t, std::pair<ks_apartment*, uint64_t>> delaying_fn_index; //fn_id -> (计时的套间, 在其中的schedule_id)，使try_unschedule可转发；(nullptr, 0)为墓碑，见_do_settle_delaying_fn
+
+		volatile bool stopped_v = false;
+	};
+
+	std::shared_ptr<_INLINE_APARTMENT_DATA> m_d;
+};
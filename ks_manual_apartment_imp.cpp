@@ -0,0 +1,291 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "ks_manual_apartment_imp.h"
+#include "ktl/ks_defer.h"
+#include <algorithm>
+
+void __forcelink_to_ks_manual_apartment_imp_cpp() {}
+
+static std::atomic<uint64_t> g_last_fn_id { 0 };
+
+
+ks_manual_apartment_imp::ks_manual_apartment_imp(const char* name, uint flags)
+	: m_d(std::make_shared<_MANUAL_APARTMENT_DATA>()) {
+	ASSERT(name != nullptr);
+
+	m_d->name = name != nullptr ? name : "";
+	m_d->flags = flags;
+	m_d->base_time = std::chrono::steady_clock::now();
+
+	if (m_d->flags & auto_register_flag) {
+		ks_apartment::__register_public_apartment(m_d->name.c_str(), this);
+	}
+}
+
+ks_manual_apartment_imp::~ks_manual_apartment_imp() {
+	ASSERT(m_d->state_v == _STATE::NOT_START || m_d->state_v == _STATE::STOPPED);
+
+	if (m_d->flags & auto_register_flag) {
+		ks_apartment::__unregister_public_apartment(m_d->name.c_str(), this);
+	}
+}
+
+
+const char* ks_manual_apartment_imp::name() {
+	return m_d->name.c_str();
+}
+
+uint ks_manual_apartment_imp::features() {
+	return sequential_feature;
+}
+
+size_t ks_manual_apartment_imp::concurrency() {
+	return 1;
+}
+
+
+bool ks_manual_apartment_imp::start() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	if (m_d->state_v != _STATE::NOT_START && m_d->state_v != _STATE::RUNNING)
+		return false;
+
+	_try_start_locked(m_d, lock);
+	return true;
+}
+
+void ks_manual_apartment_imp::async_stop() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	if (m_d->state_v == _STATE::NOT_START)
+		m_d->state_v = _STATE::STOPPED;
+	else if (m_d->state_v == _STATE::RUNNING)
+		m_d->state_v = _STATE::STOPPING; //已就绪的普通fn仍会在泵送时执行
+}
+
+void ks_manual_apartment_imp::wait() {
+	this->async_stop(); //ensure stop
+
+	//没有work线程，由wait的调用者直接执行完已就绪的普通fn；未到期的延时fn和idle fn则不再执行
+	_do_run_now_fns(this, m_d, false);
+
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	std::deque<_FN_ITEM> t_now_fn_queue_idle;
+	std::map<std::pair<int64_t, uint64_t>, _FN_ITEM> t_delaying_fn_map;
+	m_d->now_fn_queue_idle.swap(t_now_fn_queue_idle);
+	m_d->delaying_fn_map.swap(t_delaying_fn_map);
+	m_d->delaying_fn_index.clear();
+	m_d->state_v = _STATE::STOPPED;
+	lock.unlock();
+
+	t_now_fn_queue_idle.clear();
+	t_delaying_fn_map.clear();
+}
+
+bool ks_manual_apartment_imp::is_stopped() {
+	return m_d->state_v == _STATE::STOPPED;
+}
+
+bool ks_manual_apartment_imp::is_stopping_or_stopped() {
+	_STATE state = m_d->state_v;
+	return state == _STATE::STOPPED || state == _STATE::STOPPING;
+}
+
+
+uint64_t ks_manual_apartment_imp::schedule(std::function<void()>&& fn, int priority) {
+	return this->schedule(ks_task_fn(std::move(fn)), priority);
+}
+
+uint64_t ks_manual_apartment_imp::schedule_delayed(std::function<void()>&& fn, int priority, int64_t delay) {
+	return this->schedule_delayed(ks_task_fn(std::move(fn)), priority, delay);
+}
+
+uint64_t ks_manual_apartment_imp::schedule(ks_task_fn&& fn, int priority) {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	_try_start_locked(m_d, lock);
+
+	if (m_d->state_v == _STATE::STOPPED) {
+		ASSERT(false);
+		return 0;
+	}
+
+	uint64_t fn_id = ++g_last_fn_id;
+	ASSERT(fn_id != 0);
+
+	_do_put_fn_item_into_now_list_locked(m_d, _FN_ITEM{ std::move(fn), fn_id, priority }, lock);
+	return fn_id;
+}
+
+uint64_t ks_manual_apartment_imp::schedule_delayed(ks_task_fn&& fn, int priority, int64_t delay) {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	_try_start_locked(m_d, lock);
+
+	if (m_d->state_v != _STATE::RUNNING) {
+		ASSERT(m_d->state_v == _STATE::STOPPING);
+		return 0;
+	}
+
+	uint64_t fn_id = ++g_last_fn_id;
+	ASSERT(fn_id != 0);
+
+	const int64_t until_time = m_d->virtual_now + (std::max)(delay, (int64_t)0);
+	m_d->delaying_fn_map.emplace(std::make_pair(until_time, fn_id), _FN_ITEM{ std::move(fn), fn_id, priority });
+	m_d->delaying_fn_index.emplace(fn_id, until_time);
+	return fn_id;
+}
+
+void ks_manual_apartment_imp::try_unschedule(uint64_t id) {
+	if (id == 0)
+		return;
+
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+
+	//仅延时任务和idle任务可撤销，对于其他任务（normal和prior），没有撤销的必要和意义
+	ks_task_fn found_fn;
+	auto index_it = m_d->delaying_fn_index.find(id);
+	if (index_it != m_d->delaying_fn_index.end()) {
+		auto fn_it = m_d->delaying_fn_map.find(std::make_pair(index_it->second, id));
+		ASSERT(fn_it != m_d->delaying_fn_map.end());
+		found_fn = std::move(fn_it->second.fn);
+		m_d->delaying_fn_map.erase(fn_it);
+		m_d->delaying_fn_index.erase(index_it);
+	}
+	else {
+		auto idle_it = std::find_if(m_d->now_fn_queue_idle.begin(), m_d->now_fn_queue_idle.end(), [id](const _FN_ITEM& fn_item) { return fn_item.fn_id == id; });
+		if (idle_it != m_d->now_fn_queue_idle.end()) {
+			found_fn = std::move(idle_it->fn);
+			m_d->now_fn_queue_idle.erase(idle_it);
+		}
+	}
+
+	//release fn
+	lock.unlock();
+	found_fn = {};
+}
+
+std::chrono::steady_clock::time_point ks_manual_apartment_imp::clock_now() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	return m_d->base_time + std::chrono::milliseconds(m_d->virtual_now);
+}
+
+
+int64_t ks_manual_apartment_imp::virtual_now() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	return m_d->virtual_now;
+}
+
+size_t ks_manual_apartment_imp::run_until_idle() {
+	return _do_run_now_fns(this, m_d, true);
+}
+
+size_t ks_manual_apartment_imp::advance(int64_t ms) {
+	ASSERT(ms >= 0);
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	const int64_t until_time = m_d->virtual_now + (std::max)(ms, (int64_t)0);
+	lock.unlock();
+
+	return _do_advance_until(this, m_d, until_time, false);
+}
+
+size_t ks_manual_apartment_imp::advance_to_next_delayed() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	const int64_t until_time = !m_d->delaying_fn_map.empty() ? m_d->delaying_fn_map.begin()->first.first : m_d->virtual_now;
+	lock.unlock();
+
+	return _do_advance_until(this, m_d, until_time, true);
+}
+
+size_t ks_manual_apartment_imp::pending_fn_count() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	return m_d->now_fn_queue_prior.size() + m_d->now_fn_queue_normal.size() + m_d->now_fn_queue_idle.size();
+}
+
+size_t ks_manual_apartment_imp::delaying_fn_count() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	return m_d->delaying_fn_map.size();
+}
+
+
+void ks_manual_apartment_imp::_try_start_locked(const std::shared_ptr<_MANUAL_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock) {
+	if (d->state_v == _STATE::NOT_START) {
+		d->state_v = _STATE::RUNNING;
+	}
+}
+
+size_t ks_manual_apartment_imp::_do_run_now_fns(ks_manual_apartment_imp* self, const std::shared_ptr<_MANUAL_APARTMENT_DATA>& d, bool including_idle) {
+	//泵送期间将本套间设为current_thread_apartment（仅当调用线程原本不属于任何套间）
+	const bool should_set_current_thread_apartment = ks_apartment::current_thread_apartment() == nullptr;
+	if (should_set_current_thread_apartment)
+		ks_apartment::__set_current_thread_apartment(self);
+	ks_defer defer_reset_current_thread_apartment([should_set_current_thread_apartment]() {
+		if (should_set_current_thread_apartment)
+			ks_apartment::__set_current_thread_apartment(nullptr);
+	});
+
+	size_t run_count = 0;
+	std::unique_lock<ks_mutex> lock(d->mutex);
+	while (true) {
+		auto* now_fn_queue_sel = !d->now_fn_queue_prior.empty() ? &d->now_fn_queue_prior : &d->now_fn_queue_normal;
+		if (now_fn_queue_sel->empty() && !d->now_fn_queue_idle.empty() && including_idle && d->state_v == _STATE::RUNNING)
+			now_fn_queue_sel = &d->now_fn_queue_idle;
+		if (now_fn_queue_sel->empty())
+			break;
+
+		ks_task_fn fn = std::move(now_fn_queue_sel->front().fn);
+		now_fn_queue_sel->pop_front();
+
+		lock.unlock();
+		fn();
+		fn = {};
+		++run_count;
+		lock.lock();
+	}
+
+	return run_count;
+}
+
+size_t ks_manual_apartment_imp::_do_advance_until(ks_manual_apartment_imp* self, const std::shared_ptr<_MANUAL_APARTMENT_DATA>& d, int64_t until_time, bool stop_at_first_due) {
+	size_t run_count = _do_run_now_fns(self, d, true);
+
+	std::unique_lock<ks_mutex> lock(d->mutex);
+	while (!d->delaying_fn_map.empty() && d->delaying_fn_map.begin()->first.first <= until_time) {
+		//将虚拟时钟拨至最近的到期时点，将同时到期的项移入now队列并执行（其间新schedule的延时任务亦参与后续轮次）
+		const int64_t due_time = d->delaying_fn_map.begin()->first.first;
+		d->virtual_now = (std::max)(d->virtual_now, due_time);
+		while (!d->delaying_fn_map.empty() && d->delaying_fn_map.begin()->first.first == due_time) {
+			auto fn_it = d->delaying_fn_map.begin();
+			d->delaying_fn_index.erase(fn_it->second.fn_id);
+			_do_put_fn_item_into_now_list_locked(d, std::move(fn_it->second), lock);
+			d->delaying_fn_map.erase(fn_it);
+		}
+
+		lock.unlock();
+		run_count += _do_run_now_fns(self, d, true);
+		lock.lock();
+
+		if (stop_at_first_due)
+			break;
+	}
+
+	d->virtual_now = (std::max)(d->virtual_now, until_time);
+	return run_count;
+}
+
+void ks_manual_apartment_imp::_do_put_fn_item_into_now_list_locked(const std::shared_ptr<_MANUAL_APARTMENT_DATA>& d, _FN_ITEM&& fn_item, std::unique_lock<ks_mutex>& lock) {
+	auto* now_fn_queue_sel =
+		fn_item.priority == 0 ? &d->now_fn_queue_normal :  //priority=0为普通优先级
+		fn_item.priority > 0 ? &d->now_fn_queue_prior :    //priority>0为高优先级
+		&d->now_fn_queue_idle;                             //priority<0为低优先级，简单地加入到idle队列
+	now_fn_queue_sel->push_back(std::move(fn_item));
+}
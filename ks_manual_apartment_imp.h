@@ -0,0 +1,119 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "ks_async_base.h"
+#include "ks_apartment.h"
+#include "ktl/ks_concurrency.h"
+#include <deque>
+#include <map>
+#include <unordered_map>
+
+
+//手动泵送的虚拟时钟套间：自身没有线程，由调用者以run_until_idle/advance泵送，延时任务按虚拟时钟计时。
+//虚拟时钟仅由advance推进，故可在数秒内回放数小时的定时器密集型流量（post_delayed、set_timeout等），且执行顺序确定
+//（同一时点到期的延时任务按schedule先后执行），适用于负载模拟、可复现的性能测试及定时器队列的伸缩性检测。
+//注：泵送期间current_thread_apartment为本套间（若调用线程原本不属于任何套间）；不支持嵌套泵，请勿在本套间的fn中wait future。
+class ks_manual_apartment_imp final : public ks_apartment {
+public:
+	enum { //flag consts
+		no_flag                         = 0,
+		auto_register_flag              = 0x00010000,
+	};
+
+	KS_ASYNC_API explicit ks_manual_apartment_imp(const char* name, uint flags = 0);
+	_DISABLE_COPY_CONSTRUCTOR(ks_manual_apartment_imp);
+
+	KS_ASYNC_API ~ks_manual_apartment_imp();
+
+public:
+	virtual const char* name() override;
+	virtual uint features() override;
+	virtual size_t concurrency() override;
+
+	virtual bool start() override;
+	virtual void async_stop() override;
+	virtual void wait() override;
+
+	virtual bool is_stopped() override;
+	virtual bool is_stopping_or_stopped() override;
+
+	virtual uint64_t schedule(std::function<void()>&& fn, int priority) override;
+	virtual uint64_t schedule_delayed(std::function<void()>&& fn, int priority, int64_t delay) override;
+	virtual uint64_t schedule(ks_task_fn&& fn, int priority) override;
+	virtual uint64_t schedule_delayed(ks_task_fn&& fn, int priority, int64_t delay) override;
+
+	virtual void try_unschedule(uint64_t id) override;
+
+	//返回虚拟时间（以构造时的steady_clock时点为起点），future的timeout、repeat_periodic的周期亦由此按虚拟时间判定
+	virtual std::chrono::steady_clock::time_point clock_now() override;
+
+public:
+	//当前虚拟时间（ms，自构造起）
+	KS_ASYNC_API int64_t virtual_now();
+
+	//执行全部就绪的fn（含执行期间新schedule的），不推进虚拟时钟，返回执行的fn数
+	KS_ASYNC_API size_t run_until_idle();
+
+	//将虚拟时钟推进ms：其间的延时任务按到期先后执行（执行时虚拟时钟恰为其到期时点），返回执行的fn数
+	KS_ASYNC_API size_t advance(int64_t ms);
+
+	//将虚拟时钟推进至最近的延时任务到期并执行之（没有延时任务时仅run_until_idle），返回执行的fn数
+	KS_ASYNC_API size_t advance_to_next_delayed();
+
+	KS_ASYNC_API size_t pending_fn_count();   //就绪待执行的fn数
+	KS_ASYNC_API size_t delaying_fn_count();  //未到期的延时fn数
+
+private:
+	struct _MANUAL_APARTMENT_DATA;
+
+	static void _try_start_locked(const std::shared_ptr<_MANUAL_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
+	static size_t _do_run_now_fns(ks_manual_apartment_imp* self, const std::shared_ptr<_MANUAL_APARTMENT_DATA>& d, bool including_idle);
+	static size_t _do_advance_until(ks_manual_apartment_imp* self, const std::shared_ptr<_MANUAL_APARTMENT_DATA>& d, int64_t until_time, bool stop_at_first_due);
+
+private:
+	struct _FN_ITEM {
+		ks_task_fn fn;
+		uint64_t fn_id;
+		int priority;
+	};
+
+	static void _do_put_fn_item_into_now_list_locked(const std::shared_ptr<_MANUAL_APARTMENT_DATA>& d, _FN_ITEM&& fn_item, std::unique_lock<ks_mutex>& lock);
+
+private:
+	enum class _STATE { NOT_START, RUNNING, STOPPING, STOPPED };
+
+	struct _MANUAL_APARTMENT_DATA {
+		ks_mutex mutex;
+
+		std::string name; //const-like
+		uint flags; //const-like
+
+		//prior简化为三级：>0为高优先，=0为普通，<0为低且简单地加入到idle队列
+		std::deque<_FN_ITEM> now_fn_queue_prior;
+		std::deque<_FN_ITEM> now_fn_queue_normal;
+		std::deque<_FN_ITEM> now_fn_queue_idle;
+		std::map<std::pair<int64_t, uint64_t>, _FN_ITEM> delaying_fn_map; //按(虚拟到期时点, fn_id)排序
+		std::unordered_map<uint64_t, int64_t> delaying_fn_index; //fn_id -> 虚拟到期时点，使try_unschedule可定位
+
+		std::chrono::steady_clock::time_point base_time; //const-like
+		int64_t virtual_now = 0;
+
+		volatile _STATE state_v = _STATE::NOT_START;
+	};
+
+	std::shared_ptr<_MANUAL_APARTMENT_DATA> m_d;
+};
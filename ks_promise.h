@@ -106,6 +106,7 @@ private:
 	template <class T2> friend class ks_promise;
 	friend class ks_future_util;
 	friend class ks_async_flow;
+	friend class ks_epoll_apartment_imp;
 
 private:
 	ks_raw_promise_ptr m_raw_promise;
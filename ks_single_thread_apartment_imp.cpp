@@ -36,6 +36,8 @@ ks_single_thread_apartment_imp::ks_single_thread_apartment_imp(const char* name,
 
 	m_d->name = name != nullptr ? name : "";
 	m_d->flags = flags;
+	m_d->edf_enabled = (flags & edf_schedule_flag) != 0;
+	m_d->mpsc_inbox_enabled = (flags & mpsc_inbox_flag) != 0;
 	m_d->thread_init_fn = std::move(thread_init_fn);
 	m_d->thread_term_fn = std::move(thread_term_fn);
 
@@ -85,7 +87,8 @@ const char* ks_single_thread_apartment_imp::name() {
 }
 
 uint ks_single_thread_apartment_imp::features() {
-	return sequential_feature | atfork_aware_future | nested_pump_aware_future;
+	return sequential_feature | atfork_aware_future | nested_pump_aware_future | batch_schedule_feature
+		 | (m_d->edf_enabled ? deadline_schedule_feature : 0);
 }
 
 size_t ks_single_thread_apartment_imp::concurrency() {
@@ -123,6 +126,8 @@ void ks_single_thread_apartment_imp::wait() {
 	}
 
 	ASSERT(m_d->now_fn_queue_prior.empty() && m_d->now_fn_queue_normal.empty());
+	ASSERT(m_d->now_fn_band_queue == nullptr || m_d->now_fn_band_queue->empty());
+	ASSERT(m_d->now_fn_heap_edf.empty());
 }
 
 bool ks_single_thread_apartment_imp::is_stopped() {
@@ -143,8 +148,75 @@ bool ks_single_thread_apartment_imp::is_stopping_or_stopped() {
 	return state == _STATE::STOPPED || state == _STATE::STOPPING;
 }
 
+ks_slab_pool_stats ks_single_thread_apartment_imp::fn_item_pool_stats() {
+	return m_d->fn_item_pool.stats();
+}
+
+bool ks_single_thread_apartment_imp::set_priority_bands(size_t band_count, const std::vector<uint32_t>& band_weights) {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	if (m_d->state_v != _STATE::NOT_START)
+		return false; //须在start前设定
+	if (band_count < ks_priority_band_queue<_FN_ITEM_PTR>::min_band_count || band_count > ks_priority_band_queue<_FN_ITEM_PTR>::max_band_count)
+		return false;
+	if (!band_weights.empty() && band_weights.size() != band_count)
+		return false;
+
+	ASSERT(m_d->now_fn_queue_prior.empty() && m_d->now_fn_queue_normal.empty() && m_d->now_fn_queue_idle.empty());
+	m_d->now_fn_band_queue.reset(new ks_priority_band_queue<_FN_ITEM_PTR>(band_count, band_weights));
+	return true;
+}
+
+std::vector<ks_priority_band_stats> ks_single_thread_apartment_imp::priority_band_stats() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	if (m_d->now_fn_band_queue == nullptr)
+		return {};
+	return m_d->now_fn_band_queue->stats();
+}
+
+bool ks_single_thread_apartment_imp::set_batch_drain(size_t max_batch_count, int64_t time_budget_us) {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	if (m_d->state_v != _STATE::NOT_START)
+		return false; //须在start前设定
+	if (max_batch_count < 1 || time_budget_us < 0)
+		return false;
+
+	m_d->batch_drain_max_count = max_batch_count;
+	m_d->batch_drain_time_budget_us = time_budget_us;
+	m_d->draining_batch.reserve(max_batch_count - 1);
+	return true;
+}
+
+size_t ks_single_thread_apartment_imp::pending_fn_count() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	_do_drain_inbox_locked(m_d, lock);
+	return m_d->now_fn_queue_prior.size() + m_d->now_fn_queue_normal.size() + m_d->now_fn_queue_idle.size() + m_d->now_fn_heap_edf.size()
+		+ (m_d->now_fn_band_queue != nullptr ? m_d->now_fn_band_queue->size() : 0);
+}
+
 
 uint64_t ks_single_thread_apartment_imp::schedule(std::function<void()>&& fn, int priority) {
+	return this->schedule(ks_task_fn(std::move(fn)), priority);
+}
+
+uint64_t ks_single_thread_apartment_imp::schedule_delayed(std::function<void()>&& fn, int priority, int64_t delay) {
+	return this->schedule_delayed(ks_task_fn(std::move(fn)), priority, delay);
+}
+
+uint64_t ks_single_thread_apartment_imp::schedule(ks_task_fn&& fn, int priority) {
+	if (m_d->mpsc_inbox_enabled && m_d->inbox_gate.try_enter()) {
+		//投递至收件箱（不必lock）
+		uint64_t fn_id = ++g_last_fn_id;
+		ASSERT(fn_id != 0);
+
+		auto fn_item = m_d->fn_item_pool.make();
+		fn_item->fn = std::move(fn);
+		fn_item->fn_id = fn_id;
+		fn_item->priority = priority;
+
+		_do_put_fn_items_into_inbox(m_d, &fn_item, 1);
+		return fn_id;
+	}
+
 	std::unique_lock<ks_mutex> lock(m_d->mutex);
 	_try_start_locked(lock);
 
@@ -157,18 +229,19 @@ uint64_t ks_single_thread_apartment_imp::schedule(std::function<void()>&& fn, in
 	ASSERT(fn_id != 0);
 	ASSERT(!_check_fn_id_exists_when_debug_locked(m_d, fn_id, lock));
 
-	auto fn_item = std::make_shared<_FN_ITEM>();
+	auto fn_item = m_d->fn_item_pool.make();
 	fn_item->fn = std::move(fn);
 	fn_item->fn_id = fn_id;
 	fn_item->priority = priority;
 
-	_do_put_fn_item_into_now_list_locked(m_d, std::move(fn_item), lock);
+	_do_drain_inbox_locked(m_d, lock); //先移入收件箱中的先前任务，以保持次序
+	_do_put_fn_item_into_now_list_locked(m_d, std::move(fn_item), true, lock);
 	_prepare_work_thread_locked(this, m_d, lock);
 
 	return fn_id;
 }
 
-uint64_t ks_single_thread_apartment_imp::schedule_delayed(std::function<void()>&& fn, int priority, int64_t delay) {
+uint64_t ks_single_thread_apartment_imp::schedule_delayed(ks_task_fn&& fn, int priority, int64_t delay) {
 	std::unique_lock<ks_mutex> lock(m_d->mutex);
 	_try_start_locked(lock);
 
@@ -181,7 +254,7 @@ uint64_t ks_single_thread_apartment_imp::schedule_delayed(std::function<void()>&
 	ASSERT(fn_id != 0);
 	ASSERT(!_check_fn_id_exists_when_debug_locked(m_d, fn_id, lock));
 
-	auto fn_item = std::make_shared<_FN_ITEM>();
+	auto fn_item = m_d->fn_item_pool.make();
 	fn_item->fn = std::move(fn);
 	fn_item->until_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay);
 	fn_item->fn_id = fn_id;
@@ -195,29 +268,112 @@ uint64_t ks_single_thread_apartment_imp::schedule_delayed(std::function<void()>&
 	return fn_id;
 }
 
+uint64_t ks_single_thread_apartment_imp::schedule_batch(std::vector<ks_task_fn>&& fns, int priority) {
+	if (fns.empty())
+		return 0;
+
+	if (m_d->mpsc_inbox_enabled && m_d->inbox_gate.try_enter()) {
+		//一次性投递至收件箱（仅一次原子exchange）
+		const uint64_t first_fn_id = g_last_fn_id.fetch_add(fns.size()) + 1;
+		ASSERT(first_fn_id != 0);
+
+		std::vector<_FN_ITEM_PTR> fn_items;
+		fn_items.reserve(fns.size());
+		for (size_t i = 0; i < fns.size(); ++i) {
+			auto fn_item = m_d->fn_item_pool.make();
+			fn_item->fn = std::move(fns[i]);
+			fn_item->fn_id = first_fn_id + i;
+			fn_item->priority = priority;
+			fn_items.push_back(std::move(fn_item));
+		}
+
+		_do_put_fn_items_into_inbox(m_d, fn_items.data(), fn_items.size());
+		return first_fn_id;
+	}
+
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	_try_start_locked(lock);
+
+	if (m_d->state_v == _STATE::STOPPED) {
+		ASSERT(false);
+		return 0;
+	}
+
+	//一次取得连续的fn_id
+	const uint64_t first_fn_id = g_last_fn_id.fetch_add(fns.size()) + 1;
+	ASSERT(first_fn_id != 0);
+
+	_do_drain_inbox_locked(m_d, lock); //先移入收件箱中的先前任务，以保持次序
+	for (size_t i = 0; i < fns.size(); ++i) {
+		ASSERT(!_check_fn_id_exists_when_debug_locked(m_d, first_fn_id + i, lock));
+
+		auto fn_item = m_d->fn_item_pool.make();
+		fn_item->fn = std::move(fns[i]);
+		fn_item->fn_id = first_fn_id + i;
+		fn_item->priority = priority;
+		_do_put_fn_item_into_now_list_locked(m_d, std::move(fn_item), false, lock);
+	}
+
+	m_d->any_fn_queue_cv.notify_one(); //仅一个线程
+	_prepare_work_thread_locked(this, m_d, lock);
+
+	return first_fn_id;
+}
+
+uint64_t ks_single_thread_apartment_imp::schedule_with_deadline(ks_task_fn&& fn, int priority, std::chrono::steady_clock::time_point deadline) {
+	//deadline仅对normal任务有效（高优先级任务本就先于normal任务，idle任务须保持可撤销）
+	if (!m_d->edf_enabled || priority != 0 || deadline == std::chrono::steady_clock::time_point{})
+		return this->schedule(std::move(fn), priority);
+
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	_try_start_locked(lock);
+
+	if (m_d->state_v == _STATE::STOPPED) {
+		ASSERT(false);
+		return 0;
+	}
+
+	uint64_t fn_id = ++g_last_fn_id;
+	ASSERT(fn_id != 0);
+	ASSERT(!_check_fn_id_exists_when_debug_locked(m_d, fn_id, lock));
+
+	auto fn_item = m_d->fn_item_pool.make();
+	fn_item->fn = std::move(fn);
+	fn_item->fn_id = fn_id;
+	fn_item->priority = priority;
+	fn_item->deadline = deadline;
+
+	_do_put_fn_item_into_now_list_locked(m_d, std::move(fn_item), true, lock);
+	_prepare_work_thread_locked(this, m_d, lock);
+
+	return fn_id;
+}
+
 void ks_single_thread_apartment_imp::try_unschedule(uint64_t id) {
 	if (id == 0)
 		return;
 
 	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	_do_drain_inbox_locked(m_d, lock); //收件箱中的idle任务尚未索引
 
-	auto do_erase_fn_from = [](std::deque<std::shared_ptr<_FN_ITEM>>* fn_queue, uint64_t fn_id) -> std::shared_ptr<_FN_ITEM> {
-		auto it = std::find_if(fn_queue->begin(), fn_queue->end(),
-			[fn_id](const auto& item) {return item->fn_id == fn_id; });
-		if (it == fn_queue->end())
-			return nullptr;
+	//经由fn_id索引定位（仅延时任务和idle任务在索引中，对于其他任务（normal和prior），没有撤销的必要和意义）
+	auto index_it = m_d->fn_id_index.find(id);
+	if (index_it == m_d->fn_id_index.end())
+		return;
 
-		std::shared_ptr<_FN_ITEM> found_fn = std::move(*it);
-		fn_queue->erase(it);
-		return found_fn;
-	};
+	_FN_ITEM* fn_item = index_it->second;
+	_do_unindex_fn_item_locked(m_d, fn_item, lock);
 
-	//检查延时任务队列
-	std::shared_ptr<_FN_ITEM> found_fn = do_erase_fn_from(&m_d->delaying_fn_queue, id);
-	//检查idle任务队列
-	if (found_fn == nullptr)
-		found_fn = do_erase_fn_from(&m_d->now_fn_queue_idle, id);
-	//对于其他任务队列（normal和prior），没有检查的必要和意义
+	_FN_ITEM_PTR found_fn;
+	ks_task_fn found_fn_fn;
+	if (fn_item->is_in_timer_wheel()) {
+		//延时任务：直接从时间轮中摘除
+		found_fn = m_d->delaying_fn_wheel.erase(fn_item);
+	}
+	else {
+		//idle任务：就地置为墓碑（fn为空），出队时丢弃
+		found_fn_fn.swap(fn_item->fn);
+	}
 
 	//release fn
 	lock.unlock();
@@ -225,6 +381,7 @@ void ks_single_thread_apartment_imp::try_unschedule(uint64_t id) {
 		found_fn->fn = {};
 		found_fn = nullptr;
 	}
+	found_fn_fn = {};
 }
 
 void ks_single_thread_apartment_imp::_try_start_locked(std::unique_lock<ks_mutex>& lock) {
@@ -246,7 +403,9 @@ void ks_single_thread_apartment_imp::_try_stop_locked(bool should_thread_exit, s
 			m_d->any_fn_queue_cv.notify_all(); //trigger thread
 		}
 		else {
-			ASSERT(m_d->now_fn_queue_prior.size() + m_d->now_fn_queue_normal.size() + m_d->now_fn_queue_idle.size() + m_d->delaying_fn_queue.size() == 0);
+			ASSERT(m_d->now_fn_queue_prior.size() + m_d->now_fn_queue_normal.size() + m_d->now_fn_queue_idle.size() + m_d->delaying_fn_wheel.size() == 0);
+			ASSERT(m_d->now_fn_band_queue == nullptr || m_d->now_fn_band_queue->empty());
+			ASSERT(m_d->now_fn_heap_edf.empty());
 			m_d->state_v = _STATE::STOPPED;
 			m_d->stopped_state_cv.notify_all();
 			m_d->thread_init_fn.swap(t_thread_init_fn); //final cleanup
@@ -254,7 +413,9 @@ void ks_single_thread_apartment_imp::_try_stop_locked(bool should_thread_exit, s
 		}
 	}
 	else if (m_d->state_v == _STATE::NOT_START) {
-		ASSERT(m_d->now_fn_queue_prior.size() + m_d->now_fn_queue_normal.size() + m_d->now_fn_queue_idle.size() + m_d->delaying_fn_queue.size() == 0);
+		ASSERT(m_d->now_fn_queue_prior.size() + m_d->now_fn_queue_normal.size() + m_d->now_fn_queue_idle.size() + m_d->delaying_fn_wheel.size() == 0);
+		ASSERT(m_d->now_fn_band_queue == nullptr || m_d->now_fn_band_queue->empty());
+		ASSERT(m_d->now_fn_heap_edf.empty());
 		m_d->state_v = _STATE::STOPPED;
 		m_d->stopped_state_cv.notify_all();
 		m_d->thread_init_fn.swap(t_thread_init_fn); //final cleanup
@@ -298,6 +459,9 @@ void ks_single_thread_apartment_imp::_work_thread_proc(ks_single_thread_apartmen
 	ASSERT(ks_apartment::current_thread_apartment() == nullptr);
 	ks_apartment::__set_current_thread_apartment(self);
 
+	//本线程对fn_item_pool的分配和释放走线程缓存（在本函数结束时归还，并trim掉完全空闲的slab）
+	ks_slab_pool<_FN_ITEM>::thread_cache_scope fn_item_cache_scope(&d->fn_item_pool, true);
+
 	if ((d->flags & no_isolated_thread_flag) == 0) {
 		std::stringstream thread_name_ss;
 		thread_name_ss << d->name << "'s work-thread";
@@ -310,6 +474,8 @@ void ks_single_thread_apartment_imp::_work_thread_proc(ks_single_thread_apartmen
 		std::unique_lock<ks_mutex> lock(d->mutex);
 		using_thread_init_fn = d->thread_init_fn;
 		using_thread_term_fn = d->thread_term_fn;
+		if (d->mpsc_inbox_enabled)
+			d->inbox_gate.open(); //此后schedule可直接投递至收件箱
 	}
 
 	if (using_thread_init_fn) {
@@ -339,16 +505,15 @@ void ks_single_thread_apartment_imp::_work_thread_proc(ks_single_thread_apartmen
 		});
 #endif
 
+		//drain inbox
+		if (d->mpsc_inbox_enabled)
+			_do_drain_inbox_locked(d, lock);
+
 		//try next delaying_fn
-		if (!d->delaying_fn_queue.empty()) {
-			size_t moved_fn_count = 0;
-			const auto now = std::chrono::steady_clock::now();
-			while (!d->delaying_fn_queue.empty() && d->delaying_fn_queue.front()->until_time <= now) {
-				//直接将到期的delaying项移入now队列
-				_do_put_fn_item_into_now_list_locked(d, std::move(d->delaying_fn_queue.front()), lock);
-				d->delaying_fn_queue.pop_front();
-				++moved_fn_count;
-			}
+		if (!d->delaying_fn_wheel.empty()) {
+			//直接将到期的delaying项移入now队列
+			const size_t moved_fn_count = d->delaying_fn_wheel.pop_expired(std::chrono::steady_clock::now(),
+				[&d, &lock](_FN_ITEM_PTR&& fn_item) { _do_put_fn_item_into_now_list_locked(d, std::move(fn_item), true, lock); });
 
 			if (moved_fn_count != 0) {
 				//_prepare_work_thread_locked(self, d, lock); //sta不需要
@@ -362,10 +527,28 @@ void ks_single_thread_apartment_imp::_work_thread_proc(ks_single_thread_apartmen
 			if (now_fn_queue_sel->empty() && !d->now_fn_queue_idle.empty() && d->state_v == _STATE::RUNNING)
 				now_fn_queue_sel = &d->now_fn_queue_idle;
 
-			if (!now_fn_queue_sel->empty()) {
+			_FN_ITEM_PTR picked_fn_item; //从EDF堆或band中取出的任务
+			if (d->now_fn_queue_prior.empty() && !d->now_fn_heap_edf.empty()) {
+				//EDF：deadline任务先于normal任务，按deadline先后出队
+				picked_fn_item = _do_pop_fn_item_from_edf_heap_locked(d, lock);
+			}
+			else if (d->now_fn_band_queue != nullptr) {
+				//band模式：三级队列不再使用，各band按权重公平出队
+				if (!_try_pop_fn_item_from_band_queue_locked(d, picked_fn_item, lock))
+					continue; //墓碑
+			}
+
+			if (picked_fn_item != nullptr || !now_fn_queue_sel->empty()) {
 				//pop and exec a fn
-				auto now_fn_item = std::move(now_fn_queue_sel->front());
-				now_fn_queue_sel->pop_front();
+				const bool batch_draining = picked_fn_item == nullptr && now_fn_queue_sel != &d->now_fn_queue_idle && d->batch_drain_max_count > 1;
+				auto now_fn_item = std::move(picked_fn_item);
+				if (now_fn_item == nullptr) {
+					now_fn_item = std::move(now_fn_queue_sel->front());
+					now_fn_queue_sel->pop_front();
+					_do_unindex_fn_item_locked(d, now_fn_item.get(), lock);
+					if (!now_fn_item->fn)
+						continue; //已被try_unschedule置为墓碑，丢弃
+				}
 
 				ASSERT(!d->busy_thread_flag);
 				d->busy_thread_flag = true;
@@ -376,47 +559,79 @@ void ks_single_thread_apartment_imp::_work_thread_proc(ks_single_thread_apartmen
 					d->busy_thread_flag = false;
 				});
 
+				//批量出队：在同一次lock内再取出若干prior/normal任务，随后连续执行
+				if (batch_draining)
+					_do_take_draining_batch_locked(d, lock);
+
 				lock.unlock();
 				now_fn_item->fn();
 				now_fn_item->fn = {};
 				now_fn_item.reset();
 
+				if (batch_draining)
+					_do_exec_draining_batch_unlocked(d);
+
 				lock.lock(); //for working_rc and busy_thread_count
+				if (batch_draining)
+					_do_put_back_draining_batch_locked(d, lock); //因高优先级任务到达或超出时间预算而中止时，余下的任务放回队头
 				continue;
 			}
 		}
 
 		//pump-idle
 		if (d->state_v == _STATE::STOPPING && d->should_thread_exit_v) {
+			if (d->mpsc_inbox_enabled && d->inbox_gate.is_open()) {
+				//关闭收件箱（并待在途的投递完成），其中已接受的任务仍须执行完毕
+				d->inbox_gate.close_and_wait(lock);
+				continue;
+			}
+			if (d->mpsc_inbox_enabled && !d->now_fn_inbox.empty())
+				continue; //收件箱中仍有任务
 			break; //end
 		}
 
 		//waiting
-		if (d->state_v == _STATE::RUNNING && !d->delaying_fn_queue.empty()) {
-			d->any_fn_queue_cv.wait_until(lock, d->delaying_fn_queue.front()->until_time);
+		if (d->mpsc_inbox_enabled && !_do_park_check_inbox_locked(d, lock))
+			continue; //收件箱非空
+
+		if (d->state_v == _STATE::RUNNING && !d->delaying_fn_wheel.empty()) {
+			_do_wait_any_fn_or_delaying_fn_locked(d, lock);
 		}
 		else {
 			d->any_fn_queue_cv.wait(lock);
 		}
+
+		d->parked_thread_flag_a.store(false, std::memory_order_relaxed);
 	}
 
 	--tls_current_thread_pump_loop_depth;
 	ASSERT(tls_current_thread_pump_loop_depth == 0);
 
-	std::deque<std::shared_ptr<_FN_ITEM>> t_now_fn_queue_prior;
-	std::deque<std::shared_ptr<_FN_ITEM>> t_now_fn_queue_normal;
-	std::deque<std::shared_ptr<_FN_ITEM>> t_now_fn_queue_idle;
-	std::deque<std::shared_ptr<_FN_ITEM>> t_delaying_fn_queue;
+	std::deque<_FN_ITEM_PTR> t_now_fn_queue_prior;
+	std::deque<_FN_ITEM_PTR> t_now_fn_queue_normal;
+	std::deque<_FN_ITEM_PTR> t_now_fn_queue_idle;
+	std::deque<_FN_ITEM_PTR> t_now_fn_band_queue;
+	std::vector<_FN_ITEM_PTR> t_now_fn_heap_edf;
+	std::deque<_FN_ITEM_PTR> t_delaying_fn_queue;
 	std::function<void()> t_thread_init_fn;
 	std::function<void()> t_thread_term_fn;
 	if (true) {
 		std::unique_lock<ks_mutex> lock(d->mutex);
 		if (d->state_v == _STATE::STOPPING) {
-			ASSERT(d->now_fn_queue_idle.empty() && d->delaying_fn_queue.empty());
+			ASSERT(d->now_fn_queue_idle.empty() && d->delaying_fn_wheel.empty());
+			if (d->mpsc_inbox_enabled) {
+				//收件箱已在退出循环前关闭，且已无在途的投递
+				ASSERT(!d->inbox_gate.is_open() && !d->inbox_gate.has_producing_approx());
+				d->now_fn_inbox.drain([&t_now_fn_queue_normal](_FN_ITEM_PTR&& fn_item) { t_now_fn_queue_normal.push_back(std::move(fn_item)); });
+			}
 			d->now_fn_queue_prior.swap(t_now_fn_queue_prior);
 			d->now_fn_queue_normal.swap(t_now_fn_queue_normal);
 			d->now_fn_queue_idle.swap(t_now_fn_queue_idle);
-			d->delaying_fn_queue.swap(t_delaying_fn_queue);
+			d->now_fn_heap_edf.swap(t_now_fn_heap_edf);
+			if (d->now_fn_band_queue != nullptr)
+				d->now_fn_band_queue->clear([&t_now_fn_band_queue](_FN_ITEM_PTR&& fn_item) { t_now_fn_band_queue.push_back(std::move(fn_item)); });
+			d->fn_id_index.clear();
+			d->delaying_fn_wheel.clear([&t_delaying_fn_queue](_FN_ITEM_PTR&& fn_item) { t_delaying_fn_queue.push_back(std::move(fn_item)); });
 			d->thread_init_fn.swap(t_thread_init_fn); //final cleanup
 			d->thread_term_fn.swap(t_thread_term_fn); //final cleanup
 			d->state_v = _STATE::STOPPED;
@@ -431,6 +646,8 @@ void ks_single_thread_apartment_imp::_work_thread_proc(ks_single_thread_apartmen
 	t_now_fn_queue_prior.clear();
 	t_now_fn_queue_normal.clear();
 	t_now_fn_queue_idle.clear();
+	t_now_fn_band_queue.clear();
+	t_now_fn_heap_edf.clear();
 	t_delaying_fn_queue.clear();
 	t_thread_init_fn = nullptr;
 	t_thread_term_fn = nullptr;
@@ -440,13 +657,32 @@ void ks_single_thread_apartment_imp::_work_thread_proc(ks_single_thread_apartmen
 	ASSERT(ks_apartment::current_thread_apartment() == self);
 }
 
-void ks_single_thread_apartment_imp::_do_put_fn_item_into_now_list_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, std::shared_ptr<_FN_ITEM>&& fn_item, std::unique_lock<ks_mutex>& lock) {
+void ks_single_thread_apartment_imp::_do_put_fn_item_into_now_list_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, _FN_ITEM_PTR&& fn_item, bool should_notify, std::unique_lock<ks_mutex>& lock) {
+	if (fn_item->deadline != std::chrono::steady_clock::time_point{} || d->now_fn_band_queue != nullptr) {
+		if (fn_item->deadline != std::chrono::steady_clock::time_point{})
+			_do_put_fn_item_into_edf_heap_locked(d, std::move(fn_item), lock);
+		else
+			_do_put_fn_item_into_band_queue_locked(d, std::move(fn_item), lock);
+		if (should_notify)
+			d->any_fn_queue_cv.notify_one();
+		return;
+	}
+
 	auto* now_fn_queue_sel = 
 		(fn_item->is_delaying_fn && (d->flags & delayed_always_low_prior_flag)) ? &d->now_fn_queue_idle :  //延时任务强制为低优先级?
 		fn_item->priority == 0 ? &d->now_fn_queue_normal :  //priority=0为普通优先级
 		fn_item->priority > 0 ? &d->now_fn_queue_prior :    //priority>0为高优先级
 		&d->now_fn_queue_idle;                              //priority<0为低优先级，简单地加入到idle队列
 
+	//idle任务可被try_unschedule，需在索引中
+	if (now_fn_queue_sel == &d->now_fn_queue_idle)
+		_do_index_fn_item_locked(d, fn_item.get(), lock);
+	else
+		_do_unindex_fn_item_locked(d, fn_item.get(), lock);
+
+	if (now_fn_queue_sel == &d->now_fn_queue_prior)
+		d->prior_fn_put_seq_a.fetch_add(1, std::memory_order_relaxed);
+
 	if (now_fn_queue_sel == &d->now_fn_queue_normal) {
 		//normal队列（priority===0）直入
 		now_fn_queue_sel->push_back(std::move(fn_item));
@@ -467,37 +703,71 @@ void ks_single_thread_apartment_imp::_do_put_fn_item_into_now_list_locked(const
 		//根据优先级插队
 		auto where_it = std::upper_bound(
 			now_fn_queue_sel->begin(), now_fn_queue_sel->end(), fn_item,
-			[](const std::shared_ptr<_FN_ITEM>& a, const std::shared_ptr<_FN_ITEM>& b) { return a->priority > b->priority; });
+			[](const _FN_ITEM_PTR& a, const _FN_ITEM_PTR& b) { return a->priority > b->priority; });
 		now_fn_queue_sel->insert(where_it, std::move(fn_item));
 	}
 
-	d->any_fn_queue_cv.notify_one();
+	if (should_notify)
+		d->any_fn_queue_cv.notify_one();
+}
+
+void ks_single_thread_apartment_imp::_do_put_fn_item_into_edf_heap_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, _FN_ITEM_PTR&& fn_item, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(d->edf_enabled && fn_item->priority == 0 && !fn_item->is_delaying_fn);
+	_do_unindex_fn_item_locked(d, fn_item.get(), lock);
+	d->now_fn_heap_edf.push_back(std::move(fn_item));
+	std::push_heap(d->now_fn_heap_edf.begin(), d->now_fn_heap_edf.end(), &_is_later_edf_fn_item);
+	d->prior_fn_put_seq_a.fetch_add(1, std::memory_order_relaxed); //EDF任务先于normal任务，亦使批量执行中止
 }
 
-void ks_single_thread_apartment_imp::_do_put_fn_item_into_delaying_list_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, std::shared_ptr<_FN_ITEM>&& fn_item, std::unique_lock<ks_mutex>& lock) {
+ks_single_thread_apartment_imp::_FN_ITEM_PTR ks_single_thread_apartment_imp::_do_pop_fn_item_from_edf_heap_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(!d->now_fn_heap_edf.empty());
+	std::pop_heap(d->now_fn_heap_edf.begin(), d->now_fn_heap_edf.end(), &_is_later_edf_fn_item);
+	_FN_ITEM_PTR fn_item = std::move(d->now_fn_heap_edf.back());
+	d->now_fn_heap_edf.pop_back();
+	return fn_item;
+}
+
+void ks_single_thread_apartment_imp::_do_put_fn_item_into_band_queue_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, _FN_ITEM_PTR&& fn_item, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(d->now_fn_band_queue != nullptr);
+	const size_t band =
+		(fn_item->is_delaying_fn && (d->flags & delayed_always_low_prior_flag)) ? d->now_fn_band_queue->band_count() - 1 :  //延时任务强制为最低优先级
+		d->now_fn_band_queue->band_of_priority(fn_item->priority);
+
+	//低于normal的任务（相当于idle任务）可被try_unschedule，需在索引中
+	if (band > d->now_fn_band_queue->normal_band())
+		_do_index_fn_item_locked(d, fn_item.get(), lock);
+	else
+		_do_unindex_fn_item_locked(d, fn_item.get(), lock);
+
+	d->now_fn_band_queue->push(std::move(fn_item), band, std::chrono::steady_clock::now());
+}
+
+bool ks_single_thread_apartment_imp::_try_pop_fn_item_from_band_queue_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, _FN_ITEM_PTR& fn_item, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(d->now_fn_band_queue != nullptr);
+	//非RUNNING时，同三级队列模式，不再执行低于normal的任务
+	const size_t max_band = d->state_v == _STATE::RUNNING ? size_t(-1) : d->now_fn_band_queue->normal_band();
+	if (!d->now_fn_band_queue->try_pop(fn_item, std::chrono::steady_clock::now(), max_band))
+		return true; //无任务，fn_item仍为空
+
+	_do_unindex_fn_item_locked(d, fn_item.get(), lock);
+	if (!fn_item->fn) {
+		fn_item.reset();
+		return false; //已被try_unschedule置为墓碑，丢弃
+	}
+	return true;
+}
+
+void ks_single_thread_apartment_imp::_do_put_fn_item_into_delaying_list_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, _FN_ITEM_PTR&& fn_item, std::unique_lock<ks_mutex>& lock) {
+	//仅当新项早于线程当前wait_until的时点（或线程未在wait_until）时才需要唤醒
 	bool should_notify =
-		(d->delaying_fn_queue.empty() || fn_item->until_time < d->delaying_fn_queue.front()->until_time) &&
-		(d->now_fn_queue_prior.empty() && d->now_fn_queue_normal.empty() && d->now_fn_queue_idle.empty());
+		(fn_item->until_time < d->delaying_waiting_until_time) &&
+		(d->now_fn_queue_prior.empty() && d->now_fn_queue_normal.empty() && d->now_fn_queue_idle.empty()) &&
+		(d->now_fn_band_queue == nullptr || d->now_fn_band_queue->empty()) && d->now_fn_heap_edf.empty();
 
 	//（忽略priority）
-	if (d->delaying_fn_queue.empty()) {
-		//空队列直入
-		d->delaying_fn_queue.push_back(std::move(fn_item));
-	}
-	else if (fn_item->until_time >= d->delaying_fn_queue.back()->until_time) {
-		//最大延时项：插在队尾
-		d->delaying_fn_queue.push_back(std::move(fn_item));
-	}
-	else if (fn_item->until_time < d->delaying_fn_queue.front()->until_time) {
-		//最小延时项：插在队头
-		d->delaying_fn_queue.push_front(std::move(fn_item));
-	}
-	else {
-		//新项的目标时点落在当前队列的时段区间内：插队
-		auto where_it = std::upper_bound(d->delaying_fn_queue.begin(), d->delaying_fn_queue.end(), fn_item,
-			[](const std::shared_ptr<_FN_ITEM>& a, const std::shared_ptr<_FN_ITEM>& b) { return a->until_time < b->until_time; });
-		d->delaying_fn_queue.insert(where_it, std::move(fn_item));
-	}
+	const auto until_time = fn_item->until_time;
+	_do_index_fn_item_locked(d, fn_item.get(), lock);
+	d->delaying_fn_wheel.insert(std::move(fn_item), until_time);
 
 	if (should_notify) {
 		//只需notify_one即可，即使有多项。
@@ -507,17 +777,151 @@ void ks_single_thread_apartment_imp::_do_put_fn_item_into_delaying_list_locked(c
 	}
 }
 
+void ks_single_thread_apartment_imp::_do_take_draining_batch_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(d->draining_batch.empty() && d->draining_batch_pos == 0);
+	d->draining_batch_seq_snapshot = d->prior_fn_put_seq_a.load(std::memory_order_relaxed);
+
+	//按优先级次序续取：先prior队列，后normal队列（若有EDF任务待执行，则不越过它们取normal任务）
+	while (d->draining_batch.size() + 1 < d->batch_drain_max_count) {
+		auto* now_fn_queue_sel = !d->now_fn_queue_prior.empty() ? &d->now_fn_queue_prior : &d->now_fn_queue_normal;
+		if (now_fn_queue_sel->empty() || (now_fn_queue_sel == &d->now_fn_queue_normal && !d->now_fn_heap_edf.empty()))
+			break;
+
+		_FN_ITEM_PTR fn_item = std::move(now_fn_queue_sel->front());
+		now_fn_queue_sel->pop_front();
+		_do_unindex_fn_item_locked(d, fn_item.get(), lock);
+		if (!fn_item->fn)
+			continue; //墓碑，丢弃
+
+		d->draining_batch.push_back(std::move(fn_item));
+	}
+}
+
+void ks_single_thread_apartment_imp::_do_exec_draining_batch_unlocked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d) {
+	const auto budget_until_time = std::chrono::steady_clock::now() + std::chrono::microseconds(d->batch_drain_time_budget_us);
+
+	//注：每项之前重新检查size，因嵌套泵可能已将余下的任务放回队列
+	while (d->draining_batch_pos < d->draining_batch.size()) {
+		if (d->prior_fn_put_seq_a.load(std::memory_order_relaxed) != d->draining_batch_seq_snapshot)
+			break; //有新的高优先级任务，让其先行
+		if (std::chrono::steady_clock::now() >= budget_until_time)
+			break; //超出时间预算
+#if __KS_APARTMENT_ATFORK_ENABLED
+		if (d->atforking_flag_v)
+			break; //atforking
+#endif
+
+		_FN_ITEM_PTR fn_item = std::move(d->draining_batch[d->draining_batch_pos++]);
+		fn_item->fn();
+		fn_item->fn = {};
+		fn_item.reset();
+	}
+}
+
+void ks_single_thread_apartment_imp::_do_put_back_draining_batch_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock) {
+	//逆序放回队头，以保持原有次序（prior任务插在同优先级者之前）
+	while (d->draining_batch.size() > d->draining_batch_pos) {
+		_FN_ITEM_PTR fn_item = std::move(d->draining_batch.back());
+		d->draining_batch.pop_back();
+		if (fn_item->priority == 0) {
+			d->now_fn_queue_normal.push_front(std::move(fn_item));
+		}
+		else {
+			ASSERT(fn_item->priority > 0);
+			auto where_it = std::lower_bound(
+				d->now_fn_queue_prior.begin(), d->now_fn_queue_prior.end(), fn_item,
+				[](const _FN_ITEM_PTR& a, const _FN_ITEM_PTR& b) { return a->priority > b->priority; });
+			d->now_fn_queue_prior.insert(where_it, std::move(fn_item));
+		}
+	}
+
+	d->draining_batch.clear();
+	d->draining_batch_pos = 0;
+}
+
+void ks_single_thread_apartment_imp::_do_put_fn_items_into_inbox(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, _FN_ITEM_PTR* fn_items, size_t count) {
+	ASSERT(d->mpsc_inbox_enabled);
+	ASSERT(d->inbox_gate.has_producing_approx()); //须在inbox_gate.try_enter之后
+	d->now_fn_inbox.push_range(fn_items, fn_items + count);
+
+	//注：先push（seq_cst的exchange）再检查parked_thread_flag，与work线程中的次序相反，
+	//由此保证：要么work线程在停驻前能看到新任务，要么此处能看到其已停驻，不会丢失唤醒。
+	if (d->parked_thread_flag_a.load(std::memory_order_seq_cst)) {
+		std::unique_lock<ks_mutex> lock(d->mutex);
+		d->any_fn_queue_cv.notify_one();
+	}
+
+	//投递（含链接）完毕，退出在途状态
+	d->inbox_gate.leave();
+}
+
+size_t ks_single_thread_apartment_imp::_do_drain_inbox_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock) {
+	if (!d->mpsc_inbox_enabled)
+		return 0;
+
+	//持锁者即为收件箱的唯一消费者，一次性取出全部任务并移入now队列
+	return d->now_fn_inbox.drain([&d, &lock](_FN_ITEM_PTR&& fn_item) { _do_put_fn_item_into_now_list_locked(d, std::move(fn_item), false, lock); });
+}
+
+bool ks_single_thread_apartment_imp::_do_park_check_inbox_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(d->mpsc_inbox_enabled);
+
+	//注：先置parked_thread_flag再检查收件箱，参见_do_put_fn_items_into_inbox
+	d->parked_thread_flag_a.store(true, std::memory_order_seq_cst);
+	if (d->now_fn_inbox.empty())
+		return true; //可以停驻了（持锁直至wait，生产者的notify须在其后）
+
+	d->parked_thread_flag_a.store(false, std::memory_order_relaxed);
+
+	//收件箱非空：可能有生产者正在链接（exchange之后、链接next之前被抢占），让出cpu稍后重试
+	lock.unlock();
+	std::this_thread::yield();
+	lock.lock();
+	return false;
+}
+
+void ks_single_thread_apartment_imp::_do_wait_any_fn_or_delaying_fn_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(!d->delaying_fn_wheel.empty());
+
+	//wait_until最近的到期时点（时间轮给出的时点可能略早于真实到期时点，届时醒来重新计算即可）
+	const auto until_time = d->delaying_fn_wheel.next_expire_time();
+	d->delaying_waiting_until_time = until_time;
+	d->any_fn_queue_cv.wait_until(lock, until_time);
+	d->delaying_waiting_until_time = std::chrono::steady_clock::time_point::max();
+}
+
+void ks_single_thread_apartment_imp::_do_index_fn_item_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, _FN_ITEM* fn_item, std::unique_lock<ks_mutex>& lock) {
+	if (!fn_item->is_indexed) {
+		d->fn_id_index.emplace(fn_item->fn_id, fn_item);
+		fn_item->is_indexed = true;
+	}
+}
+
+void ks_single_thread_apartment_imp::_do_unindex_fn_item_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, _FN_ITEM* fn_item, std::unique_lock<ks_mutex>& lock) {
+	if (fn_item->is_indexed) {
+		d->fn_id_index.erase(fn_item->fn_id);
+		fn_item->is_indexed = false;
+	}
+}
+
 #ifdef _DEBUG
 bool ks_single_thread_apartment_imp::_check_fn_id_exists_when_debug_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, uint64_t fn_id, std::unique_lock<ks_mutex>& lock) {
-	auto do_check_fn_exists = [](std::deque<std::shared_ptr<_FN_ITEM>>* fn_queue, uint64_t a_fn_id) -> bool {
+	auto do_check_fn_exists = [](std::deque<_FN_ITEM_PTR>* fn_queue, uint64_t a_fn_id) -> bool {
 		return std::find_if(fn_queue->cbegin(), fn_queue->cend(),
 			[a_fn_id](const auto& item) {return item->fn_id == a_fn_id; }) != fn_queue->cend();
 	};
 
+	auto do_check_fn_exists_in_bands = [&d](uint64_t a_fn_id) -> bool {
+		return d->now_fn_band_queue != nullptr &&
+			d->now_fn_band_queue->any_of([a_fn_id](const _FN_ITEM_PTR& item) { return item->fn_id == a_fn_id; });
+	};
+
 	return do_check_fn_exists(&d->now_fn_queue_prior, fn_id)
 		|| do_check_fn_exists(&d->now_fn_queue_normal, fn_id)
 		|| do_check_fn_exists(&d->now_fn_queue_idle, fn_id)
-		|| do_check_fn_exists(&d->delaying_fn_queue, fn_id);
+		|| do_check_fn_exists_in_bands(fn_id)
+		|| std::find_if(d->now_fn_heap_edf.cbegin(), d->now_fn_heap_edf.cend(), [fn_id](const auto& item) { return item->fn_id == fn_id; }) != d->now_fn_heap_edf.cend()
+		|| d->fn_id_index.find(fn_id) != d->fn_id_index.end();
 }
 #endif
 
@@ -528,6 +932,13 @@ void ks_single_thread_apartment_imp::atfork_prepare() {
 	if (m_d->atforking_flag_v) 
 		return; //重复prepare
 
+	if (m_d->mpsc_inbox_enabled) {
+		//收件箱的生产者不经mutex，须暂时关闭收件箱并待在途的投递完成，以免fork发生在其链接中途而致子进程中的收件箱残缺
+		std::unique_lock<ks_mutex> lock(m_d->mutex);
+		m_d->inbox_reopen_after_fork = m_d->inbox_gate.is_open();
+		m_d->inbox_gate.close_and_wait(lock);
+	}
+
 	const bool atfork_calling_in_my_thread_flag = (ks_apartment::current_thread_apartment() == this);
 	if (atfork_calling_in_my_thread_flag)
 		return; //该sta线程内调用fork，不必做什么
@@ -545,6 +956,9 @@ void ks_single_thread_apartment_imp::atfork_prepare() {
 
 void ks_single_thread_apartment_imp::atfork_parent() {
 	ASSERT(m_d->state_v == _STATE::NOT_START || m_d->state_v == _STATE::RUNNING);
+	if (std::exchange(m_d->inbox_reopen_after_fork, false))
+		m_d->inbox_gate.open();
+
 	if (!m_d->atforking_flag_v)
 		return;
 
@@ -559,6 +973,9 @@ void ks_single_thread_apartment_imp::atfork_parent() {
 
 void ks_single_thread_apartment_imp::atfork_child() {
 	ASSERT(m_d->state_v == _STATE::NOT_START || m_d->state_v == _STATE::RUNNING);
+	if (std::exchange(m_d->inbox_reopen_after_fork, false))
+		m_d->inbox_gate.open();
+
 	if (!m_d->atforking_flag_v)
 		return;
 
@@ -617,16 +1034,19 @@ bool ks_single_thread_apartment_imp::__run_nested_pump_loop_for_extern_waiting(v
 		ASSERT(d->working_flag_v);
 #endif
 
+		//drain inbox
+		if (d->mpsc_inbox_enabled)
+			_do_drain_inbox_locked(d, lock);
+
+		//外层批量中尚待执行的任务放回队头，使嵌套泵可以执行它们（所等待的可能正是它们）
+		if (d->draining_batch_pos < d->draining_batch.size())
+			_do_put_back_draining_batch_locked(d, lock);
+
 		//try next delaying_fn
-		if (!d->delaying_fn_queue.empty()) {
-			size_t moved_fn_count = 0;
-			const auto now = std::chrono::steady_clock::now();
-			while (!d->delaying_fn_queue.empty() && d->delaying_fn_queue.front()->until_time <= now) {
-				//直接将到期的delaying项移入now队列
-				_do_put_fn_item_into_now_list_locked(d, std::move(d->delaying_fn_queue.front()), lock);
-				d->delaying_fn_queue.pop_front();
-				++moved_fn_count;
-			}
+		if (!d->delaying_fn_wheel.empty()) {
+			//直接将到期的delaying项移入now队列
+			const size_t moved_fn_count = d->delaying_fn_wheel.pop_expired(std::chrono::steady_clock::now(),
+				[&d, &lock](_FN_ITEM_PTR&& fn_item) { _do_put_fn_item_into_now_list_locked(d, std::move(fn_item), true, lock); });
 
 			if (moved_fn_count != 0) {
 				//_prepare_work_thread_locked(self, d, lock); //sta不需要
@@ -640,10 +1060,27 @@ bool ks_single_thread_apartment_imp::__run_nested_pump_loop_for_extern_waiting(v
 			if (now_fn_queue_sel->empty() && !d->now_fn_queue_idle.empty() && d->state_v == _STATE::RUNNING)
 				now_fn_queue_sel = &d->now_fn_queue_idle;
 
-			if (!now_fn_queue_sel->empty()) {
+			_FN_ITEM_PTR picked_fn_item; //从EDF堆或band中取出的任务
+			if (d->now_fn_queue_prior.empty() && !d->now_fn_heap_edf.empty()) {
+				//EDF：deadline任务先于normal任务，按deadline先后出队
+				picked_fn_item = _do_pop_fn_item_from_edf_heap_locked(d, lock);
+			}
+			else if (d->now_fn_band_queue != nullptr) {
+				//band模式：三级队列不再使用，各band按权重公平出队
+				if (!_try_pop_fn_item_from_band_queue_locked(d, picked_fn_item, lock))
+					continue; //墓碑
+			}
+
+			if (picked_fn_item != nullptr || !now_fn_queue_sel->empty()) {
 				//pop and exec a fn
-				auto now_fn_item = std::move(now_fn_queue_sel->front());
-				now_fn_queue_sel->pop_front();
+				auto now_fn_item = std::move(picked_fn_item);
+				if (now_fn_item == nullptr) {
+					now_fn_item = std::move(now_fn_queue_sel->front());
+					now_fn_queue_sel->pop_front();
+					_do_unindex_fn_item_locked(d, now_fn_item.get(), lock);
+					if (!now_fn_item->fn)
+						continue; //已被try_unschedule置为墓碑，丢弃
+				}
 
 				lock.unlock();
 				now_fn_item->fn();
@@ -670,10 +1107,15 @@ bool ks_single_thread_apartment_imp::__run_nested_pump_loop_for_extern_waiting(v
 			d->busy_thread_flag = true;
 		});
 
-		if (!d->delaying_fn_queue.empty()) 
-			d->any_fn_queue_cv.wait_until(lock, d->delaying_fn_queue.front()->until_time);
+		if (d->mpsc_inbox_enabled && !_do_park_check_inbox_locked(d, lock))
+			continue; //收件箱非空
+
+		if (!d->delaying_fn_wheel.empty()) 
+			_do_wait_any_fn_or_delaying_fn_locked(d, lock);
 		else 
 			d->any_fn_queue_cv.wait(lock);
+
+		d->parked_thread_flag_a.store(false, std::memory_order_relaxed);
 	}
 
 	return was_satisified;
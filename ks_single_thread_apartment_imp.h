@@ -18,7 +18,11 @@ limitations under the License.
 #include "ks_async_base.h"
 #include "ks_apartment.h"
 #include "ktl/ks_concurrency.h"
+#include "ktl/ks_timer_wheel.h"
+#include "ktl/ks_slab_pool.h"
+#include "ktl/ks_priority_band_queue.h"
 #include <deque>
+#include <unordered_map>
 
 
 class ks_single_thread_apartment_imp final : public ks_apartment {
@@ -28,9 +32,11 @@ public:
 		auto_register_flag              = 0x00010000,
 		be_ui_sta_flag                  = 0x00020000,
 		be_master_sta_flag              = 0x00040000,
+		edf_schedule_flag               = 0x00800000, //EDF模式：schedule_with_deadline的normal任务按deadline先后出队，先于无deadline的normal任务
 		endless_instance_flag           = 0x01000000,
 		no_isolated_thread_flag         = 0x02000000,
 		delayed_always_low_prior_flag   = 0x04000000,
+		mpsc_inbox_flag                 = 0x08000000, //MPSC收件箱模式：schedule的now任务经由无锁收件箱投递（一次原子exchange，不lock），work线程每次醒来一次性取出，仅当其停驻时生产者才lock以唤醒
 	};
 
 	KS_ASYNC_API explicit ks_single_thread_apartment_imp(const char* name, uint flags = 0);
@@ -53,9 +59,35 @@ public:
 
 	virtual uint64_t schedule(std::function<void()>&& fn, int priority) override;
 	virtual uint64_t schedule_delayed(std::function<void()>&& fn, int priority, int64_t delay) override;
+	virtual uint64_t schedule(ks_task_fn&& fn, int priority) override;
+	virtual uint64_t schedule_delayed(ks_task_fn&& fn, int priority, int64_t delay) override;
+	virtual uint64_t schedule_batch(std::vector<ks_task_fn>&& fns, int priority) override;
+	virtual uint64_t schedule_with_deadline(ks_task_fn&& fn, int priority, std::chrono::steady_clock::time_point deadline) override;
 
 	virtual void try_unschedule(uint64_t id) override;
 
+	//_FN_ITEM节点池的统计（稳态下slab_alloc_count应不再增长，即schedule不再有内存分配）
+	KS_ASYNC_API ks_slab_pool_stats fn_item_pool_stats();
+
+	//启用多优先级band模式（band_count为2~16），须在start（及首次schedule）前调用，返回是否生效。
+	//band模式下，priority依次映射至各band（参见ks_priority_band_queue），各band按权重公平出队，
+	//由此高优先级任务的洪峰不会饿死普通任务及idle任务。band_weights为空时取默认权重（每高一个band权重加倍）。
+	KS_ASYNC_API bool set_priority_bands(size_t band_count, const std::vector<uint32_t>& band_weights = {});
+
+	//各band的排队数和排队时长统计（仅band模式下有效，否则返回空）
+	KS_ASYNC_API std::vector<ks_priority_band_stats> priority_band_stats();
+
+	//当前排队待执行的fn数（不含未到期的延时任务）
+	KS_ASYNC_API size_t pending_fn_count();
+
+	static constexpr int64_t default_batch_drain_time_budget_us = 1000;
+
+	//启用批量出队模式：work线程每次lock至多取出max_batch_count个就绪的prior/normal任务（按优先级次序），解锁后连续执行。
+	//批量执行期间若有新的高优先级任务到达，或自本批开始已超过time_budget_us（微秒），则在下一项之前中止，余下的任务放回队头，
+	//由此高优先级任务的延迟至多增加一项任务的执行时长。须在start（及首次schedule）前调用，返回是否生效；max_batch_count为1即关闭（默认）。
+	//注：band模式及EDF任务、idle任务仍逐项出队。
+	KS_ASYNC_API bool set_batch_drain(size_t max_batch_count, int64_t time_budget_us = default_batch_drain_time_budget_us);
+
 #if __KS_APARTMENT_ATFORK_ENABLED
 	virtual void atfork_prepare() override;
 	virtual void atfork_parent() override;
@@ -75,17 +107,39 @@ private:
 	static void _work_thread_proc(ks_single_thread_apartment_imp* self, const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d);
 
 private:
-	struct _FN_ITEM {
-		std::function<void()> fn;
+	struct _FN_ITEM;
+	using _FN_ITEM_PTR = ks_slab_ptr<_FN_ITEM>; //由套间的fn_item_pool分配
+
+	struct _FN_ITEM : ks_timer_wheel_hook<_FN_ITEM, _FN_ITEM_PTR>, ks_mpsc_queue_hook<_FN_ITEM, _FN_ITEM_PTR> {
+		ks_task_fn fn;
 		std::chrono::steady_clock::time_point until_time;
+		std::chrono::steady_clock::time_point deadline = {}; //仅EDF任务
 		uint64_t fn_id;
 		int64_t delay = 0;
 		int priority = 0;
 		bool is_delaying_fn = false;
+		bool is_indexed = false; //是否在fn_id_index中
 	};
 
-	static void _do_put_fn_item_into_now_list_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, std::shared_ptr<_FN_ITEM>&& fn_item, std::unique_lock<ks_mutex>& lock);
-	static void _do_put_fn_item_into_delaying_list_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, std::shared_ptr<_FN_ITEM>&& fn_item, std::unique_lock<ks_mutex>& lock);
+	static void _do_put_fn_item_into_now_list_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, _FN_ITEM_PTR&& fn_item, bool should_notify, std::unique_lock<ks_mutex>& lock);
+	static void _do_put_fn_item_into_delaying_list_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, _FN_ITEM_PTR&& fn_item, std::unique_lock<ks_mutex>& lock);
+	static bool _is_later_edf_fn_item(const _FN_ITEM_PTR& a, const _FN_ITEM_PTR& b) {
+		//用作std::push_heap/pop_heap的less，使堆顶为deadline最早（相同时为先schedule）者
+		return a->deadline != b->deadline ? a->deadline > b->deadline : a->fn_id > b->fn_id;
+	}
+	static void _do_put_fn_item_into_edf_heap_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, _FN_ITEM_PTR&& fn_item, std::unique_lock<ks_mutex>& lock);
+	static _FN_ITEM_PTR _do_pop_fn_item_from_edf_heap_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
+	static void _do_put_fn_item_into_band_queue_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, _FN_ITEM_PTR&& fn_item, std::unique_lock<ks_mutex>& lock);
+	static bool _try_pop_fn_item_from_band_queue_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, _FN_ITEM_PTR& fn_item, std::unique_lock<ks_mutex>& lock);
+	static void _do_index_fn_item_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, _FN_ITEM* fn_item, std::unique_lock<ks_mutex>& lock);
+	static void _do_unindex_fn_item_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, _FN_ITEM* fn_item, std::unique_lock<ks_mutex>& lock);
+	static void _do_take_draining_batch_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
+	static void _do_exec_draining_batch_unlocked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d);
+	static void _do_put_back_draining_batch_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
+	static void _do_put_fn_items_into_inbox(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, _FN_ITEM_PTR* fn_items, size_t count);
+	static size_t _do_drain_inbox_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
+	static bool _do_park_check_inbox_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
+	static void _do_wait_any_fn_or_delaying_fn_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
 
 #ifdef _DEBUG
 	static bool _check_fn_id_exists_when_debug_locked(const std::shared_ptr<_SINGLE_THREAD_APARTMENT_DATA>& d, uint64_t fn_id, std::unique_lock<ks_mutex>& lock);
@@ -105,11 +159,31 @@ private:
 		std::function<void()> thread_init_fn = nullptr; //const-like, optional
 		std::function<void()> thread_term_fn = nullptr; //const-like, optional
 
+		ks_slab_pool<_FN_ITEM> fn_item_pool{}; //须先于各队列声明，以保证在其后析构
+
 		//prior简化为三级：>0为高优先，=0为普通，<0为低且简单地加入到idle队列
-		std::deque<std::shared_ptr<_FN_ITEM>> now_fn_queue_prior;
-		std::deque<std::shared_ptr<_FN_ITEM>> now_fn_queue_normal;
-		std::deque<std::shared_ptr<_FN_ITEM>> now_fn_queue_idle; //idle任务地位低下，与prior和normal不是同等对待
-		std::deque<std::shared_ptr<_FN_ITEM>> delaying_fn_queue;
+		std::deque<_FN_ITEM_PTR> now_fn_queue_prior;
+		std::deque<_FN_ITEM_PTR> now_fn_queue_normal;
+		std::deque<_FN_ITEM_PTR> now_fn_queue_idle; //idle任务地位低下，与prior和normal不是同等对待
+		std::vector<_FN_ITEM_PTR> now_fn_heap_edf; //EDF任务（按deadline的小顶堆），先于normal任务出队
+		bool edf_enabled = false; //const-like
+		std::unique_ptr<ks_priority_band_queue<_FN_ITEM_PTR>> now_fn_band_queue; //const-like(ptr)，仅band模式（参见set_priority_bands），取代以上三级队列
+		ks_timer_wheel<_FN_ITEM, _FN_ITEM_PTR> delaying_fn_wheel{}; //延时任务，插入和撤销均为O(1)
+		bool mpsc_inbox_enabled = false; //const-like
+		ks_mpsc_queue<_FN_ITEM, _FN_ITEM_PTR> now_fn_inbox{}; //仅mpsc_inbox模式：生产者无锁投递，持锁者（work线程，或try_unschedule等）作为唯一消费者将其移入上述队列
+		ks_producer_gate inbox_gate; //收件箱的投递闸门（work线程运行期间开启），关闭后收件箱中即为全部已接受的任务，且链表完整
+		bool inbox_reopen_after_fork = false; //atfork_prepare时暂时关闭了收件箱，fork后须重新打开
+		std::atomic<bool> parked_thread_flag_a = { false }; //work线程是否停驻（wait），生产者据此决定是否须lock以唤醒
+
+		//批量出队（参见set_batch_drain）
+		size_t batch_drain_max_count = 1; //const-like
+		int64_t batch_drain_time_budget_us = default_batch_drain_time_budget_us; //const-like
+		std::vector<_FN_ITEM_PTR> draining_batch; //仅work线程：本批取出的后续任务，[draining_batch_pos, size)尚待执行
+		size_t draining_batch_pos = 0;
+		uint64_t draining_batch_seq_snapshot = 0; //取出本批时的prior_fn_put_seq_a
+		std::atomic<uint64_t> prior_fn_put_seq_a = { 0 }; //prior队列（及EDF堆）的入队序号，批量执行期间据此不持锁地判断有无新的高优先级任务
+		std::unordered_map<uint64_t, _FN_ITEM*> fn_id_index; //可撤销任务（延时任务和idle任务）的索引，使try_unschedule为O(1)
+		std::chrono::steady_clock::time_point delaying_waiting_until_time = std::chrono::steady_clock::time_point::max(); //线程正在wait_until的时点，max表示未在wait_until
 		ks_condition_variable any_fn_queue_cv{};
 
 		std::shared_ptr<_THREAD_ITEM> isolated_thread_opt; //only when !no_isolated_thread_flag
@@ -0,0 +1,340 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "ks_strand_apartment_imp.h"
+#include "ktl/ks_defer.h"
+#include <algorithm>
+
+void __forcelink_to_ks_strand_apartment_imp_cpp() {}
+
+static std::atomic<uint64_t> g_last_fn_id { 0 };
+
+static thread_local const void* tls_current_strand_data = nullptr; //当前线程正在drain的strand（strand可嵌套于strand之上）
+
+
+ks_strand_apartment_imp::ks_strand_apartment_imp(const char* name, ks_apartment* parent_apartment, uint flags)
+	: m_d(std::make_shared<_STRAND_APARTMENT_DATA>()) {
+	ASSERT(name != nullptr);
+	ASSERT(parent_apartment != nullptr && parent_apartment != this);
+
+	m_d->name = name != nullptr ? name : "";
+	m_d->flags = flags;
+	m_d->parent_apartment = parent_apartment != nullptr ? parent_apartment : ks_apartment::default_mta();
+
+	if (m_d->flags & auto_register_flag) {
+		ks_apartment::__register_public_apartment(m_d->name.c_str(), this);
+	}
+}
+
+ks_strand_apartment_imp::~ks_strand_apartment_imp() {
+	ASSERT(m_d->state_v == _STATE::NOT_START || m_d->state_v == _STATE::STOPPED);
+	if (m_d->state_v != _STATE::STOPPED) {
+		std::unique_lock<ks_mutex> lock(m_d->mutex);
+		_try_stop_locked(m_d, lock);
+		//这里不等了，尚未执行的fn由parent中的drain任务（持有m_d）继续执行完毕
+	}
+
+	if (m_d->flags & auto_register_flag) {
+		ks_apartment::__unregister_public_apartment(m_d->name.c_str(), this);
+	}
+}
+
+
+const char* ks_strand_apartment_imp::name() {
+	return m_d->name.c_str();
+}
+
+uint ks_strand_apartment_imp::features() {
+	return sequential_feature | batch_schedule_feature;
+}
+
+size_t ks_strand_apartment_imp::concurrency() {
+	return 1;
+}
+
+
+bool ks_strand_apartment_imp::start() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	if (m_d->state_v != _STATE::NOT_START && m_d->state_v != _STATE::RUNNING)
+		return false;
+
+	_try_start_locked(m_d, lock);
+	return true;
+}
+
+void ks_strand_apartment_imp::async_stop() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	_try_stop_locked(m_d, lock);
+}
+
+void ks_strand_apartment_imp::wait() {
+	ASSERT(!this->is_running_in_current_thread());
+
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	_try_stop_locked(m_d, lock); //ensure stop
+
+	ASSERT(m_d->state_v == _STATE::STOPPING || m_d->state_v == _STATE::STOPPED);
+	while (m_d->state_v != _STATE::STOPPED) {
+		m_d->stopped_state_cv.wait(lock);
+	}
+
+	ASSERT(m_d->now_fn_queue.empty() && m_d->delaying_fn_index.empty());
+}
+
+bool ks_strand_apartment_imp::is_stopped() {
+	return m_d->state_v == _STATE::STOPPED;
+}
+
+bool ks_strand_apartment_imp::is_stopping_or_stopped() {
+	_STATE state = m_d->state_v;
+	return state == _STATE::STOPPED || state == _STATE::STOPPING;
+}
+
+ks_apartment* ks_strand_apartment_imp::parent_apartment() {
+	return m_d->parent_apartment;
+}
+
+bool ks_strand_apartment_imp::set_drain_batch_count(size_t drain_batch_count) {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	if (m_d->state_v != _STATE::NOT_START)
+		return false; //须在start前设定
+
+	m_d->drain_batch_count = (std::max)(drain_batch_count, (size_t)1);
+	return true;
+}
+
+bool ks_strand_apartment_imp::is_running_in_current_thread() {
+	return tls_current_strand_data == m_d.get();
+}
+
+size_t ks_strand_apartment_imp::pending_fn_count() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	return m_d->now_fn_queue.size();
+}
+
+
+uint64_t ks_strand_apartment_imp::schedule(std::function<void()>&& fn, int priority) {
+	return this->schedule(ks_task_fn(std::move(fn)), priority);
+}
+
+uint64_t ks_strand_apartment_imp::schedule_delayed(std::function<void()>&& fn, int priority, int64_t delay) {
+	return this->schedule_delayed(ks_task_fn(std::move(fn)), priority, delay);
+}
+
+uint64_t ks_strand_apartment_imp::schedule(ks_task_fn&& fn, int priority) {
+	return _do_put_fns_into_now_queue(m_d, &fn, 1, priority);
+}
+
+uint64_t ks_strand_apartment_imp::schedule_delayed(ks_task_fn&& fn, int priority, int64_t delay) {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	_try_start_locked(m_d, lock);
+
+	if (m_d->state_v == _STATE::STOPPED) {
+		ASSERT(false);
+		return 0;
+	}
+
+	uint64_t fn_id = ++g_last_fn_id;
+	ASSERT(fn_id != 0);
+
+	//由parent负责计时，到期时再移入now_fn_queue按FIFO执行
+	//注：在持锁期间向parent投递，以保证到期回调所见的delaying_fn_index已登记
+	uint64_t parent_schedule_id = m_d->parent_apartment->schedule_delayed(ks_task_fn(
+		[d = m_d, fn_id, fn = std::move(fn), priority]() mutable -> void {
+		std::unique_lock<ks_mutex> lock2(d->mutex);
+		auto index_it = d->delaying_fn_index.find(fn_id);
+		if (index_it == d->delaying_fn_index.end())
+			return; //已被撤销（或strand已stop）
+
+		d->delaying_fn_index.erase(index_it);
+		lock2.unlock();
+		_do_put_fns_into_now_queue(d, &fn, 1, priority);
+	}), priority, delay);
+
+	if (parent_schedule_id == 0) {
+		ASSERT(false);
+		return 0;
+	}
+
+	m_d->delaying_fn_index.emplace(fn_id, parent_schedule_id);
+	return fn_id;
+}
+
+uint64_t ks_strand_apartment_imp::schedule_batch(std::vector<ks_task_fn>&& fns, int priority) {
+	if (fns.empty())
+		return 0;
+
+	return _do_put_fns_into_now_queue(m_d, fns.data(), fns.size(), priority);
+}
+
+void ks_strand_apartment_imp::try_unschedule(uint64_t id) {
+	if (id == 0)
+		return;
+
+	//仅延时任务（尚未到期时）可撤销，对于已在now_fn_queue中的任务，没有撤销的必要和意义
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	auto index_it = m_d->delaying_fn_index.find(id);
+	if (index_it == m_d->delaying_fn_index.end())
+		return;
+
+	const uint64_t parent_schedule_id = index_it->second;
+	m_d->delaying_fn_index.erase(index_it);
+	lock.unlock();
+
+	m_d->parent_apartment->try_unschedule(parent_schedule_id);
+}
+
+
+void ks_strand_apartment_imp::_try_start_locked(const std::shared_ptr<_STRAND_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock) {
+	if (d->state_v == _STATE::NOT_START) {
+		d->state_v = _STATE::RUNNING;
+	}
+}
+
+void ks_strand_apartment_imp::_try_stop_locked(const std::shared_ptr<_STRAND_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(lock.owns_lock());
+
+	if (d->state_v == _STATE::RUNNING) {
+		d->state_v = _STATE::STOPPING;
+
+		//尚未到期的延时任务不再执行（与其他套间一致），已在now_fn_queue中的任务则继续执行完毕
+		for (const auto& index_pair : d->delaying_fn_index)
+			d->parent_apartment->try_unschedule(index_pair.second);
+		d->delaying_fn_index.clear();
+
+		_try_settle_stopped_locked(d, lock);
+	}
+	else if (d->state_v == _STATE::NOT_START) {
+		ASSERT(d->now_fn_queue.empty() && d->delaying_fn_index.empty());
+		d->state_v = _STATE::STOPPED;
+		d->stopped_state_cv.notify_all();
+	}
+}
+
+void ks_strand_apartment_imp::_try_settle_stopped_locked(const std::shared_ptr<_STRAND_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock) {
+	if (d->state_v == _STATE::STOPPING && !d->draining_flag && d->now_fn_queue.empty()) {
+		ASSERT(d->delaying_fn_index.empty());
+		d->state_v = _STATE::STOPPED;
+		d->stopped_state_cv.notify_all();
+	}
+}
+
+uint64_t ks_strand_apartment_imp::_do_put_fns_into_now_queue(const std::shared_ptr<_STRAND_APARTMENT_DATA>& d, ks_task_fn* fns, size_t fn_count, int priority) {
+	ASSERT(fn_count >= 1);
+
+	std::unique_lock<ks_mutex> lock(d->mutex);
+	_try_start_locked(d, lock);
+
+	if (d->state_v == _STATE::STOPPED) {
+		ASSERT(false);
+		return 0;
+	}
+
+	//一次取得连续的fn_id
+	const uint64_t first_fn_id = g_last_fn_id.fetch_add(fn_count) + 1;
+	ASSERT(first_fn_id != 0);
+
+	for (size_t i = 0; i < fn_count; ++i)
+		d->now_fn_queue.push_back(_FN_ITEM{ std::move(fns[i]), first_fn_id + i, priority });
+
+	if (d->draining_flag)
+		return first_fn_id; //由已投递的drain任务接续执行
+
+	d->draining_flag = true;
+	lock.unlock();
+
+	if (!_do_post_drain_to_parent(d, priority))
+		return 0;
+
+	return first_fn_id;
+}
+
+//drain任务的守护：drain任务未被执行即被销毁时（parent拒绝投递，或parent在stop时丢弃了它），
+//由此放弃本轮drain，否则draining_flag将不再被复位，wait会一直等待
+struct ks_strand_apartment_imp::_DRAIN_TASK_GUARD {
+	std::shared_ptr<_STRAND_APARTMENT_DATA> d;
+
+	explicit _DRAIN_TASK_GUARD(const std::shared_ptr<_STRAND_APARTMENT_DATA>& d_) : d(d_) {}
+	_DRAIN_TASK_GUARD(_DRAIN_TASK_GUARD&& r) noexcept : d(std::move(r.d)) {}
+	_DRAIN_TASK_GUARD& operator=(_DRAIN_TASK_GUARD&&) = delete;
+
+	~_DRAIN_TASK_GUARD() {
+		if (d != nullptr)
+			_do_abandon_drain(d);
+	}
+
+	std::shared_ptr<_STRAND_APARTMENT_DATA> release() noexcept {
+		return std::move(d);
+	}
+};
+
+bool ks_strand_apartment_imp::_do_post_drain_to_parent(const std::shared_ptr<_STRAND_APARTMENT_DATA>& d, int priority) {
+	ASSERT(d->draining_flag);
+
+	uint64_t parent_schedule_id = d->parent_apartment->schedule(ks_task_fn([guard = _DRAIN_TASK_GUARD(d)]() mutable -> void {
+		const std::shared_ptr<_STRAND_APARTMENT_DATA> d2 = guard.release();
+		_do_drain(d2);
+	}), priority);
+	if (parent_schedule_id != 0)
+		return true;
+
+	//parent已停止：drain任务已随之被销毁，剩余的fn已由_DRAIN_TASK_GUARD丢弃
+	ASSERT(false);
+	return false;
+}
+
+void ks_strand_apartment_imp::_do_abandon_drain(const std::shared_ptr<_STRAND_APARTMENT_DATA>& d) {
+	//parent已不再执行drain任务，则剩余的fn再也无法执行，只能丢弃
+	std::deque<_FN_ITEM> t_now_fn_queue;
+	if (true) {
+		std::unique_lock<ks_mutex> lock(d->mutex);
+		ASSERT(d->draining_flag);
+		d->now_fn_queue.swap(t_now_fn_queue);
+		d->draining_flag = false;
+		_try_settle_stopped_locked(d, lock);
+	}
+
+	t_now_fn_queue.clear();
+}
+
+void ks_strand_apartment_imp::_do_drain(const std::shared_ptr<_STRAND_APARTMENT_DATA>& d) {
+	const void* strand_data_backup = std::exchange(tls_current_strand_data, d.get());
+	ks_defer defer_restore_strand_data([strand_data_backup]() { tls_current_strand_data = strand_data_backup; });
+
+	std::unique_lock<ks_mutex> lock(d->mutex);
+	ASSERT(d->draining_flag);
+
+	//每次至多连续执行drain_batch_count个fn，以分摊向parent投递的开销
+	for (size_t i = 0; i < d->drain_batch_count && !d->now_fn_queue.empty(); ++i) {
+		ks_task_fn fn = std::move(d->now_fn_queue.front().fn);
+		d->now_fn_queue.pop_front();
+
+		lock.unlock();
+		fn();
+		fn = {};
+		lock.lock();
+	}
+
+	if (d->now_fn_queue.empty()) {
+		d->draining_flag = false;
+		_try_settle_stopped_locked(d, lock);
+		return;
+	}
+
+	//仍有剩余，则再次投递（让出parent线程，以免长期独占）
+	const int priority = d->now_fn_queue.front().priority;
+	lock.unlock();
+	_do_post_drain_to_parent(d, priority);
+}
@@ -0,0 +1,115 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "ks_async_base.h"
+#include "ks_apartment.h"
+#include "ktl/ks_concurrency.h"
+#include <deque>
+#include <unordered_map>
+
+
+//strand（串行执行器）套间：寄生于parent套间（如default_mta），自身没有线程。
+//各fn严格按schedule先后（FIFO）、且互不并发地执行，故具有sequential_feature，可作为轻量的单线程套间替代品（例如每会话一个）。
+//实现上，strand有待执行的fn时，向parent投递一个drain任务（同一时刻至多一个），每个drain任务连续执行至多drain_batch_count个fn，
+//若仍有剩余则再次投递，由此既分摊了向parent投递的开销，又不至于长期独占parent的线程。
+//注：strand内不区分优先级（priority仅用于向parent投递drain任务）；执行期间current_thread_apartment仍为parent。
+class ks_strand_apartment_imp final : public ks_apartment {
+public:
+	enum { //flag consts
+		no_flag                         = 0,
+		auto_register_flag              = 0x00010000,
+	};
+
+	static constexpr size_t default_drain_batch_count = 16;
+
+	KS_ASYNC_API explicit ks_strand_apartment_imp(const char* name, ks_apartment* parent_apartment, uint flags = 0);
+	_DISABLE_COPY_CONSTRUCTOR(ks_strand_apartment_imp);
+
+	KS_ASYNC_API ~ks_strand_apartment_imp();
+
+public:
+	virtual const char* name() override;
+	virtual uint features() override;
+	virtual size_t concurrency() override;
+
+	virtual bool start() override;
+	virtual void async_stop() override;
+	virtual void wait() override;
+
+	virtual bool is_stopped() override;
+	virtual bool is_stopping_or_stopped() override;
+
+	virtual uint64_t schedule(std::function<void()>&& fn, int priority) override;
+	virtual uint64_t schedule_delayed(std::function<void()>&& fn, int priority, int64_t delay) override;
+	virtual uint64_t schedule(ks_task_fn&& fn, int priority) override;
+	virtual uint64_t schedule_delayed(ks_task_fn&& fn, int priority, int64_t delay) override;
+	virtual uint64_t schedule_batch(std::vector<ks_task_fn>&& fns, int priority) override;
+
+	virtual void try_unschedule(uint64_t id) override;
+
+	KS_ASYNC_API ks_apartment* parent_apartment();
+
+	//设定每个drain任务至多连续执行的fn数（至少为1），须在start（及首次schedule）前调用，返回是否生效
+	KS_ASYNC_API bool set_drain_batch_count(size_t drain_batch_count);
+
+	//当前线程是否正在执行本strand的fn
+	KS_ASYNC_API bool is_running_in_current_thread();
+
+	//当前排队待执行的fn数（不含未到期的延时任务）
+	KS_ASYNC_API size_t pending_fn_count();
+
+private:
+	struct _STRAND_APARTMENT_DATA;
+
+	static void _try_start_locked(const std::shared_ptr<_STRAND_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
+	static void _try_stop_locked(const std::shared_ptr<_STRAND_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
+	static void _try_settle_stopped_locked(const std::shared_ptr<_STRAND_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
+
+	static uint64_t _do_put_fns_into_now_queue(const std::shared_ptr<_STRAND_APARTMENT_DATA>& d, ks_task_fn* fns, size_t fn_count, int priority);
+	static bool _do_post_drain_to_parent(const std::shared_ptr<_STRAND_APARTMENT_DATA>& d, int priority);
+	static void _do_drain(const std::shared_ptr<_STRAND_APARTMENT_DATA>& d);
+	static void _do_abandon_drain(const std::shared_ptr<_STRAND_APARTMENT_DATA>& d);
+
+	struct _DRAIN_TASK_GUARD;
+
+private:
+	enum class _STATE { NOT_START, RUNNING, STOPPING, STOPPED };
+
+	struct _FN_ITEM {
+		ks_task_fn fn;
+		uint64_t fn_id;
+		int priority;
+	};
+
+	struct _STRAND_APARTMENT_DATA {
+		ks_mutex mutex;
+
+		std::string name; //const-like
+		uint flags; //const-like
+		ks_apartment* parent_apartment; //const-like
+		size_t drain_batch_count = default_drain_batch_count; //const-like
+
+		std::deque<_FN_ITEM> now_fn_queue; //FIFO
+		std::unordered_map<uint64_t, uint64_t> delaying_fn_index; //延时任务：fn_id -> 在parent中的schedule_id，到期时移入now_fn_queue，在此之前可撤销
+		bool draining_flag = false; //是否已向parent投递了drain任务（或正在drain），同一时刻至多一个
+
+		volatile _STATE state_v = _STATE::NOT_START;
+		ks_condition_variable stopped_state_cv{};
+	};
+
+	std::shared_ptr<_STRAND_APARTMENT_DATA> m_d;
+};
@@ -21,11 +21,175 @@ limitations under the License.
 
 void __forcelink_to_ks_thread_pool_apartment_imp_cpp() {}
 
+//CPU拓扑及线程亲和性（参见set_affinity_policy）
+#if defined(_WIN32)
+	#include <Windows.h>
+	static constexpr bool __NATIVE_THREAD_AFFINITY_SUPPORTED = true;
+
+	static std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> __native_get_logical_processor_infos() {
+		DWORD length = 0;
+		::GetLogicalProcessorInformation(nullptr, &length);
+		std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> infos(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+		if (infos.empty() || !::GetLogicalProcessorInformation(infos.data(), &length))
+			return {};
+		infos.resize(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+		return infos;
+	}
+
+	static std::vector<int> __native_mask_to_cpus(ULONG_PTR mask) {
+		std::vector<int> cpus;
+		for (int cpu = 0; cpu < (int)(sizeof(ULONG_PTR) * 8); ++cpu) {
+			if (mask & ((ULONG_PTR)1 << cpu))
+				cpus.push_back(cpu);
+		}
+		return cpus;
+	}
+
+	static std::vector<int> __native_get_core_first_cpus() {
+		std::vector<int> core_first_cpus;
+		for (const auto& info : __native_get_logical_processor_infos()) {
+			if (info.Relationship == RelationProcessorCore) {
+				std::vector<int> cpus = __native_mask_to_cpus(info.ProcessorMask);
+				if (!cpus.empty())
+					core_first_cpus.push_back(cpus.front());
+			}
+		}
+		std::sort(core_first_cpus.begin(), core_first_cpus.end());
+		return core_first_cpus;
+	}
+
+	static std::vector<std::vector<int>> __native_get_numa_node_cpus() {
+		std::vector<std::pair<DWORD, std::vector<int>>> node_cpus_pairs;
+		for (const auto& info : __native_get_logical_processor_infos()) {
+			if (info.Relationship == RelationNumaNode) {
+				std::vector<int> cpus = __native_mask_to_cpus(info.ProcessorMask);
+				if (!cpus.empty())
+					node_cpus_pairs.emplace_back(info.NumaNode.NodeNumber, std::move(cpus));
+			}
+		}
+		std::sort(node_cpus_pairs.begin(), node_cpus_pairs.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+		std::vector<std::vector<int>> node_cpus_seq;
+		for (auto& pair : node_cpus_pairs)
+			node_cpus_seq.push_back(std::move(pair.second));
+		return node_cpus_seq;
+	}
+
+	static bool __native_set_current_thread_affinity(const std::vector<int>& cpus) {
+		ULONG_PTR mask = 0;
+		for (int cpu : cpus) {
+			if (cpu >= 0 && cpu < (int)(sizeof(ULONG_PTR) * 8))
+				mask |= (ULONG_PTR)1 << cpu;
+		}
+		return mask != 0 && ::SetThreadAffinityMask(::GetCurrentThread(), mask) != 0;
+	}
+
+	static int __native_get_current_cpu() {
+		return (int)::GetCurrentProcessorNumber();
+	}
+
+#elif defined(__APPLE__)
+	//注：macOS未提供线程绑核的接口（thread_policy_set的affinity-tag仅为提示），故不支持
+	static constexpr bool __NATIVE_THREAD_AFFINITY_SUPPORTED = false;
+
+	static std::vector<int> __native_get_core_first_cpus() { return {}; }
+	static std::vector<std::vector<int>> __native_get_numa_node_cpus() { return {}; }
+	static bool __native_set_current_thread_affinity(const std::vector<int>& cpus) { return false; }
+	static int __native_get_current_cpu() { return -1; }
+
+#else
+	#include <pthread.h>
+	#include <sched.h>
+	#include <dirent.h>
+	#include <cstring>
+	#include <fstream>
+	static constexpr bool __NATIVE_THREAD_AFFINITY_SUPPORTED = true;
+
+	static std::vector<int> __native_read_cpu_list_file(const std::string& path) {
+		//cpu-list格式形如"0-3,8,10-11"
+		std::ifstream file(path);
+		std::string text;
+		if (!file || !std::getline(file, text))
+			return {};
+
+		std::vector<int> cpus;
+		std::stringstream text_ss(text);
+		std::string part;
+		while (std::getline(text_ss, part, ',')) {
+			if (part.empty() || !isdigit((unsigned char)part[0]))
+				continue;
+			const size_t dash_pos = part.find('-');
+			const int first_cpu = atoi(part.c_str());
+			const int last_cpu = dash_pos != std::string::npos ? atoi(part.c_str() + dash_pos + 1) : first_cpu;
+			for (int cpu = first_cpu; cpu <= last_cpu; ++cpu)
+				cpus.push_back(cpu);
+		}
+		return cpus;
+	}
+
+	static std::vector<int> __native_get_core_first_cpus() {
+		std::vector<int> core_first_cpus;
+		for (int cpu : __native_read_cpu_list_file("/sys/devices/system/cpu/online")) {
+			//同一物理核的各超线程，取其编号最小者
+			std::vector<int> sibling_cpus = __native_read_cpu_list_file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list");
+			const int core_first_cpu = !sibling_cpus.empty() ? sibling_cpus.front() : cpu;
+			if (std::find(core_first_cpus.cbegin(), core_first_cpus.cend(), core_first_cpu) == core_first_cpus.cend())
+				core_first_cpus.push_back(core_first_cpu);
+		}
+		return core_first_cpus;
+	}
+
+	static std::vector<std::vector<int>> __native_get_numa_node_cpus() {
+		std::vector<int> node_ids;
+		if (DIR* dir = opendir("/sys/devices/system/node")) {
+			while (dirent* entry = readdir(dir)) {
+				if (strncmp(entry->d_name, "node", 4) == 0 && isdigit((unsigned char)entry->d_name[4]))
+					node_ids.push_back(atoi(entry->d_name + 4));
+			}
+			closedir(dir);
+		}
+		std::sort(node_ids.begin(), node_ids.end());
+
+		std::vector<std::vector<int>> node_cpus_seq;
+		for (int node_id : node_ids) {
+			std::vector<int> cpus = __native_read_cpu_list_file("/sys/devices/system/node/node" + std::to_string(node_id) + "/cpulist");
+			if (!cpus.empty()) //无cpu的节点（仅有内存）忽略
+				node_cpus_seq.push_back(std::move(cpus));
+		}
+		return node_cpus_seq;
+	}
+
+	static bool __native_set_current_thread_affinity(const std::vector<int>& cpus) {
+		cpu_set_t cpu_set;
+		CPU_ZERO(&cpu_set);
+		for (int cpu : cpus) {
+			if (cpu >= 0 && cpu < CPU_SETSIZE)
+				CPU_SET(cpu, &cpu_set);
+		}
+		return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+	}
+
+	static int __native_get_current_cpu() {
+		return sched_getcpu();
+	}
+#endif
+
 static std::atomic<uint64_t> g_last_fn_id{ 0 };
 
 static thread_local size_t tls_current_thread_index_plus = 0;
 static thread_local int  tls_current_thread_pump_loop_depth = 0;
 static thread_local bool tls_current_thread_pump_loop_busy_for_idle_flag = false;
+static thread_local void* tls_current_thread_item_p = nullptr; //_THREAD_ITEM*，仅work-stealing模式使用
+static thread_local bool tls_current_thread_spun_flag = false; //spin-then-park：本轮空闲已自旋未果
+static thread_local uint64_t tls_current_thread_spun_seq = 0;   //自旋未果时的now_fn_put_seq
+static thread_local std::chrono::steady_clock::time_point tls_current_thread_idle_begin_time;
+
+//work线程最多连续执行若干项无锁队列（局部队列或lockfree队列）中的任务，然后须走一次常规流程（以免饿死延时任务和高优先任务）
+static constexpr int _LOCKLESS_FN_STREAK_MAX = 16;
+
+//spin-then-park的自旋时长上下限：任务到达间隔的平均值超过上限时不再自旋，直接wait
+static constexpr int64_t _SPIN_TIME_NS_MAX = 50 * 1000;
+static constexpr int64_t _SPIN_TIME_NS_MIN = 2 * 1000;
 
 
 ks_thread_pool_apartment_imp::ks_thread_pool_apartment_imp(const char* name, size_t max_thread_count, uint flags) 
@@ -33,13 +197,31 @@ ks_thread_pool_apartment_imp::ks_thread_pool_apartment_imp(const char* name, siz
 }
 
 ks_thread_pool_apartment_imp::ks_thread_pool_apartment_imp(const char* name, size_t max_thread_count, uint flags, std::function<void()>&& thread_init_fn, std::function<void()>&& thread_term_fn) 
+	: ks_thread_pool_apartment_imp(name, max_thread_count, max_thread_count, -1, flags, std::move(thread_init_fn), std::move(thread_term_fn)) {
+}
+
+ks_thread_pool_apartment_imp::ks_thread_pool_apartment_imp(const char* name, size_t min_thread_count, size_t max_thread_count, int64_t idle_timeout, uint flags)
+	: ks_thread_pool_apartment_imp(name, min_thread_count, max_thread_count, idle_timeout, flags, nullptr, nullptr) {
+}
+
+ks_thread_pool_apartment_imp::ks_thread_pool_apartment_imp(const char* name, size_t min_thread_count, size_t max_thread_count, int64_t idle_timeout, uint flags, std::function<void()>&& thread_init_fn, std::function<void()>&& thread_term_fn)
 	: m_d(std::make_shared<_THREAD_POOL_APARTMENT_DATA>()) {
 	ASSERT(name != nullptr);
 	ASSERT(max_thread_count >= 1);
+	ASSERT(min_thread_count <= max_thread_count);
 
 	m_d->name = name != nullptr ? name : "";
 	m_d->max_thread_count = max_thread_count >= 1 ? max_thread_count : 1;
+	m_d->min_thread_count = min_thread_count <= m_d->max_thread_count ? min_thread_count : m_d->max_thread_count;
+	m_d->idle_timeout = idle_timeout;
 	m_d->flags = flags;
+	m_d->work_stealing_enabled = (flags & work_stealing_flag) != 0 && m_d->max_thread_count > 1; //单线程时无意义，且须保持sequential
+#if __KS_APARTMENT_LOCKFREE_NOW_QUEUE_ENABLED
+	m_d->lockfree_now_queue_enabled = m_d->max_thread_count > 1; //单线程时须保持次序，而lockfree队列满时的溢出会打乱次序
+#endif
+	m_d->spin_wait_enabled = (flags & spin_wait_flag) != 0;
+	m_d->edf_enabled = (flags & edf_schedule_flag) != 0;
+	m_d->idle_interval_ewma_ns = _SPIN_TIME_NS_MAX / 2;
 	m_d->thread_init_fn = std::move(thread_init_fn);
 	m_d->thread_term_fn = std::move(thread_term_fn);
 
@@ -70,7 +252,8 @@ const char* ks_thread_pool_apartment_imp::name() {
 
 uint ks_thread_pool_apartment_imp::features() {
 	return (m_d->max_thread_count == 1 ? sequential_feature : 0)
-		 | atfork_aware_future | nested_pump_aware_future;
+		 | atfork_aware_future | nested_pump_aware_future | batch_schedule_feature
+		 | (m_d->edf_enabled ? deadline_schedule_feature : 0);
 }
 
 size_t ks_thread_pool_apartment_imp::concurrency() {
@@ -105,7 +288,9 @@ void ks_thread_pool_apartment_imp::wait() {
 		m_d->stopped_state_cv.wait(lock);
 	}
 
-	ASSERT(m_d->now_fn_queue_prior.empty() && m_d->now_fn_queue_normal.empty());
+	ASSERT(m_d->now_fn_queue_prior.empty() && m_d->now_fn_queue_normal.empty() && m_d->lockless_fn_count == 0);
+	ASSERT(m_d->now_fn_band_queue == nullptr || m_d->now_fn_band_queue->empty());
+	ASSERT(m_d->now_fn_heap_edf.empty());
 }
 
 bool ks_thread_pool_apartment_imp::is_stopped() {
@@ -126,8 +311,214 @@ bool ks_thread_pool_apartment_imp::is_stopping_or_stopped() {
 	return state == _STATE::STOPPED || state == _STATE::STOPPING;
 }
 
+ks_slab_pool_stats ks_thread_pool_apartment_imp::fn_item_pool_stats() {
+	return m_d->fn_item_pool.stats();
+}
+
+ks_spin_wait_stats ks_thread_pool_apartment_imp::spin_wait_stats() {
+	ks_spin_wait_stats stats;
+	stats.spin_hit_count = m_d->spin_hit_count.load(std::memory_order_relaxed);
+	stats.spin_miss_count = m_d->spin_miss_count.load(std::memory_order_relaxed);
+	stats.spin_time_ns = m_d->spin_wait_enabled ? _calc_spin_time_ns(m_d) : 0;
+	return stats;
+}
+
+size_t ks_thread_pool_apartment_imp::work_thread_count() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	return m_d->thread_pool.size();
+}
+
+bool ks_thread_pool_apartment_imp::set_affinity_policy(const ks_thread_affinity_policy& affinity_policy) {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	if (m_d->state_v != _STATE::NOT_START || !m_d->thread_pool.empty())
+		return false; //须在start前设定
+
+	m_d->affinity_cpu_sets.clear();
+	m_d->numa_local_enabled = false;
+	m_d->cpu_to_numa_slot.clear();
+	m_d->work_stealing_enabled = (m_d->flags & work_stealing_flag) != 0 && m_d->max_thread_count > 1 && m_d->now_fn_band_queue == nullptr;
+
+	std::vector<std::vector<int>> cpu_sets;
+	switch (affinity_policy.kind) {
+	case ks_thread_affinity_policy::no_affinity:
+		return true;
+	case ks_thread_affinity_policy::cpu_list:
+		for (int cpu : affinity_policy.cpus) {
+			if (cpu >= 0)
+				cpu_sets.push_back({ cpu });
+		}
+		break;
+	case ks_thread_affinity_policy::one_per_core:
+		for (int cpu : __native_get_core_first_cpus())
+			cpu_sets.push_back({ cpu });
+		break;
+	case ks_thread_affinity_policy::numa_nodes:
+		cpu_sets = __native_get_numa_node_cpus();
+		break;
+	default:
+		ASSERT(false);
+		break;
+	}
+
+	if (!__NATIVE_THREAD_AFFINITY_SUPPORTED || cpu_sets.empty())
+		return false;
+
+	m_d->affinity_cpu_sets = std::move(cpu_sets);
+
+	if (affinity_policy.kind == ks_thread_affinity_policy::numa_nodes && m_d->max_thread_count > 1 && m_d->now_fn_band_queue == nullptr) {
+		//各线程的局部队列即为本节点的任务队列
+		m_d->numa_local_enabled = true;
+		m_d->work_stealing_enabled = true;
+		for (size_t slot = 0; slot < m_d->affinity_cpu_sets.size(); ++slot) {
+			for (int cpu : m_d->affinity_cpu_sets[slot]) {
+				if ((size_t)cpu >= m_d->cpu_to_numa_slot.size())
+					m_d->cpu_to_numa_slot.resize((size_t)cpu + 1, size_t(-1));
+				m_d->cpu_to_numa_slot[(size_t)cpu] = slot;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool ks_thread_pool_apartment_imp::set_priority_bands(size_t band_count, const std::vector<uint32_t>& band_weights) {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	if (m_d->state_v != _STATE::NOT_START || !m_d->thread_pool.empty())
+		return false; //须在start前设定
+	if (band_count < ks_priority_band_queue<_FN_ITEM_PTR>::min_band_count || band_count > ks_priority_band_queue<_FN_ITEM_PTR>::max_band_count)
+		return false;
+	if (!band_weights.empty() && band_weights.size() != band_count)
+		return false;
+
+	ASSERT(m_d->now_fn_queue_prior.empty() && m_d->now_fn_queue_normal.empty() && m_d->now_fn_queue_idle.empty());
+	m_d->now_fn_band_queue.reset(new ks_priority_band_queue<_FN_ITEM_PTR>(band_count, band_weights));
+
+	//各任务须经由band统一排序，故不启用无锁队列
+	m_d->work_stealing_enabled = false;
+	m_d->lockfree_now_queue_enabled = false;
+	m_d->numa_local_enabled = false;
+	return true;
+}
+
+bool ks_thread_pool_apartment_imp::set_batch_drain(size_t max_batch_count, int64_t time_budget_us) {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	if (m_d->state_v != _STATE::NOT_START || !m_d->thread_pool.empty())
+		return false; //须在start前设定
+	if (max_batch_count < 1 || time_budget_us < 0)
+		return false;
+
+	m_d->batch_drain_max_count = max_batch_count;
+	m_d->batch_drain_time_budget_us = time_budget_us;
+	return true;
+}
+
+std::vector<ks_priority_band_stats> ks_thread_pool_apartment_imp::priority_band_stats() {
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	if (m_d->now_fn_band_queue == nullptr)
+		return {};
+	return m_d->now_fn_band_queue->stats();
+}
+
 
 uint64_t ks_thread_pool_apartment_imp::schedule(std::function<void()>&& fn, int priority) {
+	return this->schedule(ks_task_fn(std::move(fn)), priority);
+}
+
+uint64_t ks_thread_pool_apartment_imp::schedule_delayed(std::function<void()>&& fn, int priority, int64_t delay) {
+	return this->schedule_delayed(ks_task_fn(std::move(fn)), priority, delay);
+}
+
+uint64_t ks_thread_pool_apartment_imp::schedule(ks_task_fn&& fn, int priority) {
+	if (m_d->work_stealing_enabled && priority == 0 && tls_current_thread_item_p != nullptr && ks_apartment::current_thread_apartment() == this) {
+		//work线程内schedule的normal任务，直入本线程的局部队列（不必lock）
+		//注：此时本线程尚存活，故state必不为STOPPED
+		uint64_t fn_id = ++g_last_fn_id;
+		ASSERT(fn_id != 0);
+
+		auto fn_item = m_d->fn_item_pool.make();
+		fn_item->fn = std::move(fn);
+		fn_item->fn_id = fn_id;
+		fn_item->priority = priority;
+
+		_do_put_fn_item_into_local_list(this, m_d, (_THREAD_ITEM*)tls_current_thread_item_p, std::move(fn_item));
+		return fn_id;
+	}
+
+	if (m_d->numa_local_enabled && priority == 0 && m_d->state_v == _STATE::RUNNING) {
+		//numa_nodes策略：外部线程schedule的normal任务，投递至调用者所在节点的某线程的局部队列
+		//注：须持有mutex投递，以免该线程恰被回收
+		std::unique_lock<ks_mutex> lock(m_d->mutex);
+		_THREAD_ITEM* node_thread_item = _choose_caller_node_thread_item_locked(m_d, lock);
+		if (node_thread_item != nullptr) {
+			uint64_t fn_id = ++g_last_fn_id;
+			ASSERT(fn_id != 0);
+
+			auto fn_item = m_d->fn_item_pool.make();
+			fn_item->fn = std::move(fn);
+			fn_item->fn_id = fn_id;
+			fn_item->priority = priority;
+
+			if (true) {
+				std::unique_lock<ks_spinlock> spin_lock(node_thread_item->local_fn_queue_spinlock);
+				node_thread_item->local_fn_queue.push_back(std::move(fn_item));
+			}
+
+			lock.unlock();
+			_do_notify_lockless_fn_item_put(this, m_d);
+			return fn_id;
+		}
+	}
+
+#if __KS_APARTMENT_LOCKFREE_NOW_QUEUE_ENABLED
+	_FN_ITEM_PTR spilled_fn_item;
+	if (m_d->lockfree_now_queue_enabled && priority == 0 && m_d->lockfree_now_queue_gate.try_enter()) {
+		//normal任务直入lockfree队列（不必lock）
+		uint64_t fn_id = ++g_last_fn_id;
+		ASSERT(fn_id != 0);
+
+		auto fn_item = m_d->fn_item_pool.make();
+		fn_item->fn = std::move(fn);
+		fn_item->fn_id = fn_id;
+		fn_item->priority = priority;
+
+		if (_do_put_fn_item_into_lockfree_list(this, m_d, fn_item))
+			return fn_id;
+
+		spilled_fn_item = std::move(fn_item); //lockfree队列已满，溢出到有锁的normal队列
+	}
+#endif
+
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	_try_start_locked(lock);
+
+	if (m_d->state_v == _STATE::STOPPED) {
+		ASSERT(false);
+		return 0;
+	}
+
+	_FN_ITEM_PTR fn_item;
+#if __KS_APARTMENT_LOCKFREE_NOW_QUEUE_ENABLED
+	fn_item = std::move(spilled_fn_item);
+#endif
+	if (fn_item == nullptr) {
+		uint64_t fn_id = ++g_last_fn_id;
+		ASSERT(fn_id != 0);
+		ASSERT(!_check_fn_id_exists_when_debug_locked(m_d, fn_id, lock));
+
+		fn_item = m_d->fn_item_pool.make();
+		fn_item->fn = std::move(fn);
+		fn_item->fn_id = fn_id;
+		fn_item->priority = priority;
+	}
+
+	const uint64_t fn_id = fn_item->fn_id;
+	_do_put_fn_item_into_now_list_locked(m_d, std::move(fn_item), true, lock);
+	_prepare_work_thread_locked(this, m_d, lock);
+
+	return fn_id;
+}
+
+uint64_t ks_thread_pool_apartment_imp::schedule_delayed(ks_task_fn&& fn, int priority, int64_t delay) {
 	std::unique_lock<ks_mutex> lock(m_d->mutex);
 	_try_start_locked(lock);
 
@@ -140,18 +531,57 @@ uint64_t ks_thread_pool_apartment_imp::schedule(std::function<void()>&& fn, int
 	ASSERT(fn_id != 0);
 	ASSERT(!_check_fn_id_exists_when_debug_locked(m_d, fn_id, lock));
 
-	auto fn_item = std::make_shared<_FN_ITEM>();
+	auto fn_item = m_d->fn_item_pool.make();
 	fn_item->fn = std::move(fn);
+	fn_item->until_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay);
 	fn_item->fn_id = fn_id;
 	fn_item->priority = priority;
+	fn_item->delay = delay;
+	fn_item->is_delaying_fn = true;
 
-	_do_put_fn_item_into_now_list_locked(m_d, std::move(fn_item), lock);
+	_do_put_fn_item_into_delaying_list_locked(m_d, std::move(fn_item), lock);
 	_prepare_work_thread_locked(this, m_d, lock);
 
 	return fn_id;
 }
 
-uint64_t ks_thread_pool_apartment_imp::schedule_delayed(std::function<void()>&& fn, int priority, int64_t delay) {
+uint64_t ks_thread_pool_apartment_imp::schedule_batch(std::vector<ks_task_fn>&& fns, int priority) {
+	if (fns.empty())
+		return 0;
+
+	std::unique_lock<ks_mutex> lock(m_d->mutex);
+	_try_start_locked(lock);
+
+	if (m_d->state_v == _STATE::STOPPED) {
+		ASSERT(false);
+		return 0;
+	}
+
+	//一次取得连续的fn_id
+	const uint64_t first_fn_id = g_last_fn_id.fetch_add(fns.size()) + 1;
+	ASSERT(first_fn_id != 0);
+
+	for (size_t i = 0; i < fns.size(); ++i) {
+		ASSERT(!_check_fn_id_exists_when_debug_locked(m_d, first_fn_id + i, lock));
+
+		auto fn_item = m_d->fn_item_pool.make();
+		fn_item->fn = std::move(fns[i]);
+		fn_item->fn_id = first_fn_id + i;
+		fn_item->priority = priority;
+		_do_put_fn_item_into_now_list_locked(m_d, std::move(fn_item), false, lock);
+	}
+
+	_do_notify_fn_items_put_locked(m_d, fns.size(), lock);
+	_prepare_work_thread_locked(this, m_d, lock);
+
+	return first_fn_id;
+}
+
+uint64_t ks_thread_pool_apartment_imp::schedule_with_deadline(ks_task_fn&& fn, int priority, std::chrono::steady_clock::time_point deadline) {
+	//deadline仅对normal任务有效（高优先级任务本就先于normal任务，idle任务须保持可撤销）
+	if (!m_d->edf_enabled || priority != 0 || deadline == std::chrono::steady_clock::time_point{})
+		return this->schedule(std::move(fn), priority);
+
 	std::unique_lock<ks_mutex> lock(m_d->mutex);
 	_try_start_locked(lock);
 
@@ -164,15 +594,13 @@ uint64_t ks_thread_pool_apartment_imp::schedule_delayed(std::function<void()>&&
 	ASSERT(fn_id != 0);
 	ASSERT(!_check_fn_id_exists_when_debug_locked(m_d, fn_id, lock));
 
-	auto fn_item = std::make_shared<_FN_ITEM>();
+	auto fn_item = m_d->fn_item_pool.make();
 	fn_item->fn = std::move(fn);
-	fn_item->until_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay);
 	fn_item->fn_id = fn_id;
 	fn_item->priority = priority;
-	fn_item->delay = delay;
-	fn_item->is_delaying_fn = true;
+	fn_item->deadline = deadline;
 
-	_do_put_fn_item_into_delaying_list_locked(m_d, std::move(fn_item), lock);
+	_do_put_fn_item_into_now_list_locked(m_d, std::move(fn_item), true, lock);
 	_prepare_work_thread_locked(this, m_d, lock);
 
 	return fn_id;
@@ -184,23 +612,24 @@ void ks_thread_pool_apartment_imp::try_unschedule(uint64_t id) {
 
 	std::unique_lock<ks_mutex> lock(m_d->mutex);
 
-	auto do_erase_fn_from = [](std::deque<std::shared_ptr<_FN_ITEM>>*fn_queue, uint64_t fn_id) -> std::shared_ptr<_FN_ITEM> {
-		auto it = std::find_if(fn_queue->begin(), fn_queue->end(),
-			[fn_id](const auto& item) {return item->fn_id == fn_id; });
-		if (it == fn_queue->end())
-			return nullptr;
+	//经由fn_id索引定位（仅延时任务和idle任务在索引中，对于其他任务（normal和prior），没有撤销的必要和意义）
+	auto index_it = m_d->fn_id_index.find(id);
+	if (index_it == m_d->fn_id_index.end())
+		return;
 
-		std::shared_ptr<_FN_ITEM> found_fn = std::move(*it);
-		fn_queue->erase(it);
-		return found_fn;
-	};
+	_FN_ITEM* fn_item = index_it->second;
+	_do_unindex_fn_item_locked(m_d, fn_item, lock);
 
-	//检查延时任务队列
-	std::shared_ptr<_FN_ITEM> found_fn = do_erase_fn_from(&m_d->delaying_fn_queue, id);
-	//检查idle任务队列
-	if (found_fn == nullptr)
-		found_fn = do_erase_fn_from(&m_d->now_fn_queue_idle, id);
-	//对于其他任务队列（normal和prior），没有检查的必要和意义
+	_FN_ITEM_PTR found_fn;
+	ks_task_fn found_fn_fn;
+	if (fn_item->is_in_timer_wheel()) {
+		//延时任务：直接从时间轮中摘除
+		found_fn = m_d->delaying_fn_wheel.erase(fn_item);
+	}
+	else {
+		//idle任务：就地置为墓碑（fn为空），出队时丢弃
+		found_fn_fn.swap(fn_item->fn);
+	}
 
 	//release fn
 	lock.unlock();
@@ -208,12 +637,23 @@ void ks_thread_pool_apartment_imp::try_unschedule(uint64_t id) {
 		found_fn->fn = {};
 		found_fn = nullptr;
 	}
+	found_fn_fn = {};
 }
 
 
 void ks_thread_pool_apartment_imp::_try_start_locked(std::unique_lock<ks_mutex>& lock) {
 	if (m_d->state_v == _STATE::NOT_START) {
 		m_d->state_v = _STATE::RUNNING;
+#if __KS_APARTMENT_LOCKFREE_NOW_QUEUE_ENABLED
+		if (m_d->lockfree_now_queue_enabled)
+			m_d->lockfree_now_queue_gate.open();
+#endif
+
+		//预先创建min_thread_count个线程，使启动后的首批任务不必承担线程创建的开销
+		if (m_d->flags & prestart_min_threads_flag) {
+			while (m_d->thread_pool.size() < m_d->min_thread_count)
+				_do_spawn_work_thread_locked(this, m_d, lock);
+		}
 	}
 }
 
@@ -224,13 +664,20 @@ void ks_thread_pool_apartment_imp::_try_stop_locked(bool should_thread_exit, std
 	std::function<void()> t_thread_init_fn;
 	std::function<void()> t_thread_term_fn;
 
+#if __KS_APARTMENT_LOCKFREE_NOW_QUEUE_ENABLED
+	if (m_d->state_v == _STATE::RUNNING && m_d->lockfree_now_queue_enabled)
+		m_d->lockfree_now_queue_gate.close_and_wait(lock); //注：其间可能解锁，故下面重新检查state
+#endif
+
 	if (m_d->state_v == _STATE::RUNNING) {
-		if (!m_d->thread_pool.empty()) {
+		if (m_d->living_thread_count != 0) { //注：被回收的线程先离开thread_pool，稍后才退出
 			m_d->state_v = _STATE::STOPPING;
 			m_d->any_fn_queue_cv.notify_all(); //trigger threads
 		}
 		else {
-			ASSERT(m_d->now_fn_queue_prior.size() + m_d->now_fn_queue_normal.size() + m_d->now_fn_queue_idle.size() + m_d->delaying_fn_queue.size() == 0);
+			ASSERT(m_d->now_fn_queue_prior.size() + m_d->now_fn_queue_normal.size() + m_d->now_fn_queue_idle.size() + m_d->delaying_fn_wheel.size() == 0);
+			ASSERT(m_d->now_fn_band_queue == nullptr || m_d->now_fn_band_queue->empty());
+			ASSERT(m_d->now_fn_heap_edf.empty());
 			m_d->state_v = _STATE::STOPPED;
 			m_d->stopped_state_cv.notify_all();
 			m_d->thread_init_fn.swap(t_thread_init_fn); //final cleanup
@@ -238,7 +685,9 @@ void ks_thread_pool_apartment_imp::_try_stop_locked(bool should_thread_exit, std
 		}
 	}
 	else if (m_d->state_v == _STATE::NOT_START) {
-		ASSERT(m_d->now_fn_queue_prior.size() + m_d->now_fn_queue_normal.size() + m_d->now_fn_queue_idle.size() + m_d->delaying_fn_queue.size() == 0);
+		ASSERT(m_d->now_fn_queue_prior.size() + m_d->now_fn_queue_normal.size() + m_d->now_fn_queue_idle.size() + m_d->delaying_fn_wheel.size() == 0);
+		ASSERT(m_d->now_fn_band_queue == nullptr || m_d->now_fn_band_queue->empty());
+		ASSERT(m_d->now_fn_heap_edf.empty());
 		m_d->state_v = _STATE::STOPPED;
 		m_d->stopped_state_cv.notify_all();
 		m_d->thread_init_fn.swap(t_thread_init_fn); //final cleanup
@@ -266,9 +715,11 @@ void ks_thread_pool_apartment_imp::_prepare_work_thread_locked(ks_thread_pool_ap
 
 	size_t needed_thread_count = 0;
 	if (d->state_v == _STATE::RUNNING || !d->should_thread_exit_v) {
-		needed_thread_count = d->busy_thread_count + d->now_fn_queue_prior.size() + d->now_fn_queue_normal.size();
+		needed_thread_count = d->busy_thread_count + d->now_fn_queue_prior.size() + d->now_fn_queue_normal.size() + d->now_fn_heap_edf.size() + d->lockless_fn_count;
+		if (d->now_fn_band_queue != nullptr)
+			needed_thread_count += d->now_fn_band_queue->size();
 		if (d->state_v == _STATE::RUNNING)
-			needed_thread_count += d->now_fn_queue_idle.size() + (d->delaying_fn_queue.empty() ? 0 : 1);
+			needed_thread_count += d->now_fn_queue_idle.size() + (d->delaying_fn_wheel.empty() ? 0 : 1);
 
 		if (needed_thread_count == 0)
 			needed_thread_count = 1;
@@ -276,22 +727,82 @@ void ks_thread_pool_apartment_imp::_prepare_work_thread_locked(ks_thread_pool_ap
 			needed_thread_count = d->max_thread_count;
 	}
 
-	for (size_t i = d->thread_pool.size(); i < needed_thread_count; ++i) {
-		d->thread_pool.push_back(std::make_shared<_THREAD_ITEM>());
-		d->living_thread_count++;
+	while (d->thread_pool.size() < needed_thread_count) {
+		_do_spawn_work_thread_locked(self, d, lock);
+	}
+}
+
+void ks_thread_pool_apartment_imp::_do_spawn_work_thread_locked(ks_thread_pool_apartment_imp* self, const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(d->thread_pool.size() < d->max_thread_count);
+
+	auto thread_item_sp = std::make_shared<_THREAD_ITEM>();
+	if (!d->affinity_cpu_sets.empty()) {
+		//分派至现有线程数最少的slot（有线程被回收后亦可保持均衡）
+		std::vector<size_t> slot_thread_counts(d->affinity_cpu_sets.size(), 0);
+		for (auto& thread_item : d->thread_pool) {
+			if (thread_item->affinity_slot < slot_thread_counts.size())
+				++slot_thread_counts[thread_item->affinity_slot];
+		}
+		thread_item_sp->affinity_slot = (size_t)(std::min_element(slot_thread_counts.cbegin(), slot_thread_counts.cend()) - slot_thread_counts.cbegin());
+	}
+
+	//注：thread_pool中的位置不能作为thread_index，线程被回收后位置即会变动；
+	//被回收的线程在真正退出时才归还其thread_index，故存活线程间不会重复
+	if (!d->free_thread_indexes.empty()) {
+		auto index_it = std::min_element(d->free_thread_indexes.begin(), d->free_thread_indexes.end());
+		thread_item_sp->thread_index = *index_it;
+		d->free_thread_indexes.erase(index_it);
+	}
+	else {
+		thread_item_sp->thread_index = d->next_thread_index++;
+	}
+
+	d->thread_pool.push_back(thread_item_sp);
+	d->thread_pool_size_a = d->thread_pool.size();
+	d->living_thread_count++;
+
+	std::thread([self, d, thread_item_sp, thread_index = thread_item_sp->thread_index]() {
+		_work_thread_proc(self, d, thread_item_sp, thread_index);
+	}).detach();
+}
+
+bool ks_thread_pool_apartment_imp::_try_reap_work_thread_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _THREAD_ITEM* thread_item, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(d->state_v == _STATE::RUNNING && d->thread_pool.size() > d->min_thread_count);
 
-		std::thread([self, d, thread_index = d->thread_pool.size() - 1]() {
-			_work_thread_proc(self, d, thread_index);
-		}).detach();
+	if (d->work_stealing_enabled) {
+		std::unique_lock<ks_spinlock> spin_lock(thread_item->local_fn_queue_spinlock);
+		if (!thread_item->local_fn_queue.empty())
+			return false;
 	}
+
+	//若仍有待执行的任务（例如尚未到期的延时任务），则须保留至少一个线程
+	const bool has_pending_fn =
+		!d->now_fn_queue_prior.empty() || !d->now_fn_queue_normal.empty() || !d->now_fn_queue_idle.empty() || !d->now_fn_heap_edf.empty() ||
+		!d->delaying_fn_wheel.empty() || d->lockless_fn_count.load(std::memory_order_relaxed) != 0 ||
+		(d->now_fn_band_queue != nullptr && !d->now_fn_band_queue->empty());
+	if (has_pending_fn && d->thread_pool.size() == 1)
+		return false;
+
+	auto it = std::find_if(d->thread_pool.begin(), d->thread_pool.end(),
+		[thread_item](const std::shared_ptr<_THREAD_ITEM>& item) { return item.get() == thread_item; });
+	ASSERT(it != d->thread_pool.end());
+	d->thread_pool.erase(it);
+	d->thread_pool_size_a = d->thread_pool.size();
+
+	if (has_pending_fn)
+		d->any_fn_queue_cv.notify_all(); //由其他线程接替（特别是wait_until延时任务的到期时点）
+	return true;
 }
 
-void ks_thread_pool_apartment_imp::_work_thread_proc(ks_thread_pool_apartment_imp* self, const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, size_t thread_index) {
+void ks_thread_pool_apartment_imp::_work_thread_proc(ks_thread_pool_apartment_imp* self, const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, const std::shared_ptr<_THREAD_ITEM>& thread_item_sp, size_t thread_index) {
 	ASSERT(ks_apartment::current_thread_apartment() == nullptr);
 	ASSERT(tls_current_thread_index_plus == 0);
 	ks_apartment::__set_current_thread_apartment(self);
 	tls_current_thread_index_plus = thread_index + 1;
 
+	//本线程对fn_item_pool的分配和释放走线程缓存（在本函数结束时归还，并trim掉完全空闲的slab）
+	ks_slab_pool<_FN_ITEM>::thread_cache_scope fn_item_cache_scope(&d->fn_item_pool, true);
+
 	if (true) {
 		std::stringstream thread_name_ss;
 		thread_name_ss << d->name << "'s work-thread [" << thread_index << "/" << d->max_thread_count << "]";
@@ -300,12 +811,21 @@ void ks_thread_pool_apartment_imp::_work_thread_proc(ks_thread_pool_apartment_im
 
 	std::function<void()> using_thread_init_fn;
 	std::function<void()> using_thread_term_fn;
+	_THREAD_ITEM* thread_item = thread_item_sp.get();
+
+	if (thread_item->affinity_slot != size_t(-1)) {
+		//注：affinity_cpu_sets在start后不变，故不必lock；设定失败（如cpu不可用）则忽略
+		__native_set_current_thread_affinity(d->affinity_cpu_sets[thread_item->affinity_slot]);
+	}
 	if (true) {
 		std::unique_lock<ks_mutex> lock(d->mutex);
 		using_thread_init_fn = d->thread_init_fn;
 		using_thread_term_fn = d->thread_term_fn;
 	}
 
+	ASSERT(tls_current_thread_item_p == nullptr);
+	tls_current_thread_item_p = thread_item;
+
 	if (using_thread_init_fn) {
 		using_thread_init_fn();
 	}
@@ -313,7 +833,19 @@ void ks_thread_pool_apartment_imp::_work_thread_proc(ks_thread_pool_apartment_im
 	ASSERT(tls_current_thread_pump_loop_depth == 0);
 	++tls_current_thread_pump_loop_depth;
 
+	int lockless_fn_streak = 0;
+	auto idle_begin_time = std::chrono::steady_clock::time_point::max(); //本线程自上次执行任务以来的空闲起始时点（elastic回收用）
 	while (true) {
+		//try next lockless_fn (work-stealing or lockfree), without lock
+		if (d->work_stealing_enabled || d->lockfree_now_queue_enabled) {
+			if (lockless_fn_streak < _LOCKLESS_FN_STREAK_MAX && _try_exec_lockless_fn_item_unlocked(d, thread_item)) {
+				++lockless_fn_streak;
+				idle_begin_time = std::chrono::steady_clock::time_point::max();
+				continue;
+			}
+			lockless_fn_streak = 0;
+		}
+
 		std::unique_lock<ks_mutex> lock(d->mutex);
 
 #if __KS_APARTMENT_ATFORK_ENABLED
@@ -333,17 +865,13 @@ void ks_thread_pool_apartment_imp::_work_thread_proc(ks_thread_pool_apartment_im
 #endif
 
 		//try next delaying_fn
-		if (!d->delaying_fn_queue.empty()) {
-			size_t moved_fn_count = 0;
-			const auto now = std::chrono::steady_clock::now();
-			while (!d->delaying_fn_queue.empty() && d->delaying_fn_queue.front()->until_time <= now) {
-				//直接将到期的delaying项移入now队列
-				_do_put_fn_item_into_now_list_locked(d, std::move(d->delaying_fn_queue.front()), lock);
-				d->delaying_fn_queue.pop_front();
-				++moved_fn_count;
-			}
+		if (!d->delaying_fn_wheel.empty()) {
+			//直接将到期的delaying项移入now队列
+			const size_t moved_fn_count = d->delaying_fn_wheel.pop_expired(std::chrono::steady_clock::now(),
+				[&d, &lock](_FN_ITEM_PTR&& fn_item) { _do_put_fn_item_into_now_list_locked(d, std::move(fn_item), false, lock); });
 
 			if (moved_fn_count != 0) {
+				_do_notify_fn_items_put_locked(d, moved_fn_count - 1, lock); //本线程即将执行其一
 				_prepare_work_thread_locked(self, d, lock);
 				continue;
 			}
@@ -352,14 +880,37 @@ void ks_thread_pool_apartment_imp::_work_thread_proc(ks_thread_pool_apartment_im
 		//try next now_fn
 		if (true) {
 			auto* now_fn_queue_sel = !d->now_fn_queue_prior.empty() ? &d->now_fn_queue_prior : &d->now_fn_queue_normal;
-			if (now_fn_queue_sel->empty() && !d->now_fn_queue_idle.empty() && d->thread_pool.size() > 1 && d->busy_thread_count_for_idle + 1 < d->thread_pool.size() && d->state_v == _STATE::RUNNING)
+			_FN_ITEM_PTR local_fn_item;
+			if (d->now_fn_queue_prior.empty() && !d->now_fn_heap_edf.empty()) {
+				//EDF：deadline任务先于normal任务，按deadline先后出队
+				local_fn_item = _do_pop_fn_item_from_edf_heap_locked(d, lock);
+			}
+			else if (d->now_fn_band_queue != nullptr) {
+				//band模式：三级队列不再使用，各band按权重公平出队
+				if (!_try_pop_fn_item_from_band_queue_locked(d, local_fn_item, lock))
+					continue; //墓碑
+			}
+			else if (now_fn_queue_sel->empty() && (d->work_stealing_enabled || d->lockfree_now_queue_enabled)) {
+				//无锁队列中的任务：先本线程局部队列，再lockfree队列，再窃取
+				local_fn_item = _do_pop_lockless_fn_item(d, thread_item);
+				if (local_fn_item == nullptr && d->work_stealing_enabled)
+					local_fn_item = _do_steal_fn_item_from_local_lists_locked(d, thread_item, lock);
+			}
+			if (local_fn_item == nullptr && now_fn_queue_sel->empty() && !d->now_fn_queue_idle.empty() && d->thread_pool.size() > 1 && d->busy_thread_count_for_idle + 1 < d->thread_pool.size() && d->state_v == _STATE::RUNNING)
 				now_fn_queue_sel = &d->now_fn_queue_idle; //保留1个线程不去执行idle任务（除非是单线程套间）
 
-			if (!now_fn_queue_sel->empty()) {
+			if (local_fn_item != nullptr || !now_fn_queue_sel->empty()) {
 				//pop and exec a fn
-				bool is_now_fn_from_idle = now_fn_queue_sel == &d->now_fn_queue_idle;
-				auto now_fn_item = std::move(now_fn_queue_sel->front());
-				now_fn_queue_sel->pop_front();
+				bool is_now_fn_from_idle = local_fn_item == nullptr && now_fn_queue_sel == &d->now_fn_queue_idle;
+				const bool batch_draining = local_fn_item == nullptr && !is_now_fn_from_idle && d->batch_drain_max_count > 1;
+				auto now_fn_item = std::move(local_fn_item);
+				if (now_fn_item == nullptr) {
+					now_fn_item = std::move(now_fn_queue_sel->front());
+					now_fn_queue_sel->pop_front();
+					_do_unindex_fn_item_locked(d, now_fn_item.get(), lock);
+					if (!now_fn_item->fn)
+						continue; //已被try_unschedule置为墓碑，丢弃
+				}
 
 				ASSERT(d->busy_thread_count < d->thread_pool.size());
 				++d->busy_thread_count;
@@ -382,52 +933,89 @@ void ks_thread_pool_apartment_imp::_work_thread_proc(ks_thread_pool_apartment_im
 					}
 				});
 
+				idle_begin_time = std::chrono::steady_clock::time_point::max();
+
+				//批量出队：在同一次lock内再取出若干prior/normal任务，随后连续执行
+				if (batch_draining)
+					_do_take_draining_batch_locked(d, thread_item, lock);
+
 				lock.unlock();
 				now_fn_item->fn();
 				now_fn_item->fn = {};
 				now_fn_item.reset();
 
+				if (batch_draining)
+					_do_exec_draining_batch_unlocked(d, thread_item);
+
 				lock.lock(); //for working_rc and busy_thread_count
+				if (batch_draining)
+					_do_put_back_draining_batch_locked(d, thread_item, lock); //因高优先级任务到达或超出时间预算而中止时，余下的任务放回队头
 				continue;
 			}
 		}
 
 		//pump-idle
 		if (d->state_v == _STATE::STOPPING && d->should_thread_exit_v) {
+#if __KS_APARTMENT_LOCKFREE_NOW_QUEUE_ENABLED
+			//lockfree队列已于stop时关闭，但在途的生产者可能刚刚完成投递，须再取一遍，以免任务滞留于lockfree队列中
+			if (d->lockfree_now_queue_enabled && d->lockless_fn_count.load(std::memory_order_seq_cst) != 0)
+				continue;
+#endif
 			break; //end
 		}
 
+		//elastic：空闲超过idle_timeout的富余线程退出
+		std::chrono::steady_clock::time_point reap_time = std::chrono::steady_clock::time_point::max();
+		if (d->idle_timeout >= 0 && d->state_v == _STATE::RUNNING && d->thread_pool.size() > d->min_thread_count) {
+			const auto now = std::chrono::steady_clock::now();
+			if (idle_begin_time == std::chrono::steady_clock::time_point::max())
+				idle_begin_time = now;
+			reap_time = idle_begin_time + std::chrono::milliseconds(d->idle_timeout);
+			if (now >= reap_time && _try_reap_work_thread_locked(d, thread_item, lock))
+				break; //reaped
+		}
+
 		//waiting
-		if (d->state_v == _STATE::RUNNING && !d->delaying_fn_queue.empty() && !d->delaying_fn_queue.front()->is_waiting_until_flag) {
-			const auto waiting_fn_item = d->delaying_fn_queue.front();
-			waiting_fn_item->is_waiting_until_flag = true;
-			d->any_fn_queue_cv.wait_until(lock, waiting_fn_item->until_time); //waiting
-			waiting_fn_item->is_waiting_until_flag = false;
+		const auto* idle_until_time = reap_time != std::chrono::steady_clock::time_point::max() ? &reap_time : nullptr;
+		if (d->state_v == _STATE::RUNNING && !d->delaying_fn_wheel.empty()) {
+			_do_wait_any_fn_or_delaying_fn_locked(d, idle_until_time, lock);
 		}
 		else {
-			d->any_fn_queue_cv.wait(lock);
+			_do_wait_any_fn_locked(d, idle_until_time, lock);
 		}
 	}
 
 	--tls_current_thread_pump_loop_depth;
 	ASSERT(tls_current_thread_pump_loop_depth == 0);
 
-	std::deque<std::shared_ptr<_FN_ITEM>> t_now_fn_queue_prior;
-	std::deque<std::shared_ptr<_FN_ITEM>> t_now_fn_queue_normal;
-	std::deque<std::shared_ptr<_FN_ITEM>> t_now_fn_queue_idle;
-	std::deque<std::shared_ptr<_FN_ITEM>> t_delaying_fn_queue;
+	std::deque<_FN_ITEM_PTR> t_now_fn_queue_prior;
+	std::deque<_FN_ITEM_PTR> t_now_fn_queue_normal;
+	std::deque<_FN_ITEM_PTR> t_now_fn_queue_idle;
+	std::deque<_FN_ITEM_PTR> t_now_fn_band_queue;
+	std::vector<_FN_ITEM_PTR> t_now_fn_heap_edf;
+	std::deque<_FN_ITEM_PTR> t_delaying_fn_queue;
 	std::function<void()> t_thread_init_fn;
 	std::function<void()> t_thread_term_fn;
 	if (true) {
 		std::unique_lock<ks_mutex> lock(d->mutex);
 		ASSERT(d->living_thread_count > 0);
 		d->living_thread_count--;
+		d->free_thread_indexes.push_back(thread_index);
 		if (d->state_v == _STATE::STOPPING && d->living_thread_count == 0) {
-			ASSERT(d->now_fn_queue_idle.empty() && d->delaying_fn_queue.empty());
+			ASSERT(d->now_fn_queue_idle.empty() && d->delaying_fn_wheel.empty());
+			ASSERT(d->lockless_fn_count == 0);
 			d->now_fn_queue_prior.swap(t_now_fn_queue_prior);
 			d->now_fn_queue_normal.swap(t_now_fn_queue_normal);
+#if __KS_APARTMENT_LOCKFREE_NOW_QUEUE_ENABLED
+			for (_FN_ITEM_PTR fn_item; d->now_fn_queue_normal_lockfree.try_pop(fn_item); )
+				t_now_fn_queue_normal.push_back(std::move(fn_item));
+#endif
 			d->now_fn_queue_idle.swap(t_now_fn_queue_idle);
-			d->delaying_fn_queue.swap(t_delaying_fn_queue);
+			d->now_fn_heap_edf.swap(t_now_fn_heap_edf);
+			if (d->now_fn_band_queue != nullptr)
+				d->now_fn_band_queue->clear([&t_now_fn_band_queue](_FN_ITEM_PTR&& fn_item) { t_now_fn_band_queue.push_back(std::move(fn_item)); });
+			d->fn_id_index.clear();
+			d->delaying_fn_wheel.clear([&t_delaying_fn_queue](_FN_ITEM_PTR&& fn_item) { t_delaying_fn_queue.push_back(std::move(fn_item)); });
 			d->thread_init_fn.swap(t_thread_init_fn); //final cleanup
 			d->thread_term_fn.swap(t_thread_term_fn); //final cleanup
 			d->state_v = _STATE::STOPPED;
@@ -442,6 +1030,8 @@ void ks_thread_pool_apartment_imp::_work_thread_proc(ks_thread_pool_apartment_im
 	t_now_fn_queue_prior.clear();
 	t_now_fn_queue_normal.clear();
 	t_now_fn_queue_idle.clear();
+	t_now_fn_band_queue.clear();
+	t_now_fn_heap_edf.clear();
 	t_delaying_fn_queue.clear();
 	t_thread_init_fn = nullptr;
 	t_thread_term_fn = nullptr;
@@ -452,13 +1042,33 @@ void ks_thread_pool_apartment_imp::_work_thread_proc(ks_thread_pool_apartment_im
 	ASSERT(tls_current_thread_index_plus == thread_index + 1);
 }
 
-void ks_thread_pool_apartment_imp::_do_put_fn_item_into_now_list_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, std::shared_ptr<_FN_ITEM>&& fn_item, std::unique_lock<ks_mutex>& lock) {
+void ks_thread_pool_apartment_imp::_do_put_fn_item_into_now_list_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _FN_ITEM_PTR&& fn_item, bool should_notify, std::unique_lock<ks_mutex>& lock) {
+	if (fn_item->deadline != std::chrono::steady_clock::time_point{} || d->now_fn_band_queue != nullptr) {
+		if (fn_item->deadline != std::chrono::steady_clock::time_point{})
+			_do_put_fn_item_into_edf_heap_locked(d, std::move(fn_item), lock);
+		else
+			_do_put_fn_item_into_band_queue_locked(d, std::move(fn_item), lock);
+		d->now_fn_put_seq.fetch_add(1, std::memory_order_release);
+		if (should_notify)
+			d->any_fn_queue_cv.notify_one();
+		return;
+	}
+
 	auto* now_fn_queue_sel = 
 		(fn_item->is_delaying_fn && (d->flags & delayed_always_low_prior_flag)) ? &d->now_fn_queue_idle :  //延时任务强制为低优先级?
 		fn_item->priority == 0 ? &d->now_fn_queue_normal :  //priority=0为普通优先级
 		fn_item->priority > 0 ? &d->now_fn_queue_prior :    //priority>0为高优先级
 		&d->now_fn_queue_idle;                              //priority<0为低优先级，简单地加入到idle队列
 
+	//idle任务可被try_unschedule，需在索引中
+	if (now_fn_queue_sel == &d->now_fn_queue_idle)
+		_do_index_fn_item_locked(d, fn_item.get(), lock);
+	else
+		_do_unindex_fn_item_locked(d, fn_item.get(), lock);
+
+	if (now_fn_queue_sel == &d->now_fn_queue_prior)
+		d->prior_fn_put_seq.fetch_add(1, std::memory_order_relaxed);
+
 	if (now_fn_queue_sel == &d->now_fn_queue_normal) {
 		//normal队列（priority===0）直入
 		now_fn_queue_sel->push_back(std::move(fn_item));
@@ -479,55 +1089,478 @@ void ks_thread_pool_apartment_imp::_do_put_fn_item_into_now_list_locked(const st
 		//根据优先级插队
 		auto where_it = std::upper_bound(
 			now_fn_queue_sel->begin(), now_fn_queue_sel->end(), fn_item,
-			[](const std::shared_ptr<_FN_ITEM>& a, const std::shared_ptr<_FN_ITEM>& b) { return a->priority > b->priority; });
+			[](const _FN_ITEM_PTR& a, const _FN_ITEM_PTR& b) { return a->priority > b->priority; });
 		now_fn_queue_sel->insert(where_it, std::move(fn_item));
 	}
 
-	d->any_fn_queue_cv.notify_one();
+	d->now_fn_put_seq.fetch_add(1, std::memory_order_release);
+
+	if (should_notify)
+		d->any_fn_queue_cv.notify_one();
 }
 
-void ks_thread_pool_apartment_imp::_do_put_fn_item_into_delaying_list_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, std::shared_ptr<_FN_ITEM>&& fn_item, std::unique_lock<ks_mutex>& lock) {
-	bool should_notify = d->delaying_fn_queue.empty() || fn_item->until_time < d->delaying_fn_queue.front()->until_time;
+void ks_thread_pool_apartment_imp::_do_put_fn_item_into_edf_heap_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _FN_ITEM_PTR&& fn_item, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(d->edf_enabled && fn_item->priority == 0 && !fn_item->is_delaying_fn);
+	_do_unindex_fn_item_locked(d, fn_item.get(), lock);
+	d->now_fn_heap_edf.push_back(std::move(fn_item));
+	std::push_heap(d->now_fn_heap_edf.begin(), d->now_fn_heap_edf.end(), &_is_later_edf_fn_item);
+	d->prior_fn_put_seq.fetch_add(1, std::memory_order_relaxed); //EDF任务先于normal任务，亦使批量执行中止
+}
 
-	//（忽略priority）
-	if (d->delaying_fn_queue.empty()) {
-		//空队列直入
-		d->delaying_fn_queue.push_back(std::move(fn_item));
+ks_thread_pool_apartment_imp::_FN_ITEM_PTR ks_thread_pool_apartment_imp::_do_pop_fn_item_from_edf_heap_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(!d->now_fn_heap_edf.empty());
+	std::pop_heap(d->now_fn_heap_edf.begin(), d->now_fn_heap_edf.end(), &_is_later_edf_fn_item);
+	_FN_ITEM_PTR fn_item = std::move(d->now_fn_heap_edf.back());
+	d->now_fn_heap_edf.pop_back();
+	return fn_item;
+}
+
+void ks_thread_pool_apartment_imp::_do_put_fn_item_into_band_queue_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _FN_ITEM_PTR&& fn_item, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(d->now_fn_band_queue != nullptr);
+	const size_t band =
+		(fn_item->is_delaying_fn && (d->flags & delayed_always_low_prior_flag)) ? d->now_fn_band_queue->band_count() - 1 :  //延时任务强制为最低优先级
+		d->now_fn_band_queue->band_of_priority(fn_item->priority);
+
+	//低于normal的任务（相当于idle任务）可被try_unschedule，需在索引中
+	if (band > d->now_fn_band_queue->normal_band())
+		_do_index_fn_item_locked(d, fn_item.get(), lock);
+	else
+		_do_unindex_fn_item_locked(d, fn_item.get(), lock);
+
+	d->now_fn_band_queue->push(std::move(fn_item), band, std::chrono::steady_clock::now());
+}
+
+bool ks_thread_pool_apartment_imp::_try_pop_fn_item_from_band_queue_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _FN_ITEM_PTR& fn_item, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(d->now_fn_band_queue != nullptr);
+	//非RUNNING时，同三级队列模式，不再执行低于normal的任务
+	const size_t max_band = d->state_v == _STATE::RUNNING ? size_t(-1) : d->now_fn_band_queue->normal_band();
+	if (!d->now_fn_band_queue->try_pop(fn_item, std::chrono::steady_clock::now(), max_band))
+		return true; //无任务，fn_item仍为空
+
+	_do_unindex_fn_item_locked(d, fn_item.get(), lock);
+	if (!fn_item->fn) {
+		fn_item.reset();
+		return false; //已被try_unschedule置为墓碑，丢弃
 	}
-	else if (fn_item->until_time >= d->delaying_fn_queue.back()->until_time) {
-		//最大延时项：插在队尾
-		d->delaying_fn_queue.push_back(std::move(fn_item));
+	return true;
+}
+
+void ks_thread_pool_apartment_imp::_do_take_draining_batch_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _THREAD_ITEM* thread_item, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(thread_item->draining_batch.empty() && thread_item->draining_batch_pos == 0);
+	thread_item->draining_batch_seq_snapshot = d->prior_fn_put_seq.load(std::memory_order_relaxed);
+
+	//至多取平摊到各线程的份额，以免一个线程揽下全部任务而其他线程空闲
+	const size_t fair_count = (d->now_fn_queue_prior.size() + d->now_fn_queue_normal.size()) / (std::max)(d->thread_pool.size(), (size_t)1);
+	const size_t batch_count = (std::min)(d->batch_drain_max_count - 1, fair_count);
+
+	//按优先级次序续取：先prior队列，后normal队列（若有EDF任务待执行，则不越过它们取normal任务）
+	while (thread_item->draining_batch.size() < batch_count) {
+		auto* now_fn_queue_sel = !d->now_fn_queue_prior.empty() ? &d->now_fn_queue_prior : &d->now_fn_queue_normal;
+		if (now_fn_queue_sel->empty() || (now_fn_queue_sel == &d->now_fn_queue_normal && !d->now_fn_heap_edf.empty()))
+			break;
+
+		_FN_ITEM_PTR fn_item = std::move(now_fn_queue_sel->front());
+		now_fn_queue_sel->pop_front();
+		_do_unindex_fn_item_locked(d, fn_item.get(), lock);
+		if (!fn_item->fn)
+			continue; //墓碑，丢弃
+
+		thread_item->draining_batch.push_back(std::move(fn_item));
 	}
-	else if (fn_item->until_time < d->delaying_fn_queue.front()->until_time) {
-		//最小延时项：插在队头
-		d->delaying_fn_queue.push_front(std::move(fn_item));
+}
+
+void ks_thread_pool_apartment_imp::_do_exec_draining_batch_unlocked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _THREAD_ITEM* thread_item) {
+	const auto budget_until_time = std::chrono::steady_clock::now() + std::chrono::microseconds(d->batch_drain_time_budget_us);
+
+	//注：每项之前重新检查size，因嵌套泵可能已将余下的任务放回队列
+	while (thread_item->draining_batch_pos < thread_item->draining_batch.size()) {
+		if (d->prior_fn_put_seq.load(std::memory_order_relaxed) != thread_item->draining_batch_seq_snapshot)
+			break; //有新的高优先级任务，让其先行
+		if (std::chrono::steady_clock::now() >= budget_until_time)
+			break; //超出时间预算
+#if __KS_APARTMENT_ATFORK_ENABLED
+		if (d->atforking_flag_v)
+			break; //atforking
+#endif
+
+		_FN_ITEM_PTR fn_item = std::move(thread_item->draining_batch[thread_item->draining_batch_pos++]);
+		fn_item->fn();
+		fn_item->fn = {};
+		fn_item.reset();
+	}
+}
+
+void ks_thread_pool_apartment_imp::_do_put_back_draining_batch_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _THREAD_ITEM* thread_item, std::unique_lock<ks_mutex>& lock) {
+	//逆序放回队头，以保持原有次序（prior任务插在同优先级者之前）
+	const size_t put_back_count = thread_item->draining_batch.size() - thread_item->draining_batch_pos;
+	while (thread_item->draining_batch.size() > thread_item->draining_batch_pos) {
+		_FN_ITEM_PTR fn_item = std::move(thread_item->draining_batch.back());
+		thread_item->draining_batch.pop_back();
+		if (fn_item->priority == 0) {
+			d->now_fn_queue_normal.push_front(std::move(fn_item));
+		}
+		else {
+			ASSERT(fn_item->priority > 0);
+			auto where_it = std::lower_bound(
+				d->now_fn_queue_prior.begin(), d->now_fn_queue_prior.end(), fn_item,
+				[](const _FN_ITEM_PTR& a, const _FN_ITEM_PTR& b) { return a->priority > b->priority; });
+			d->now_fn_queue_prior.insert(where_it, std::move(fn_item));
+		}
+	}
+
+	thread_item->draining_batch.clear();
+	thread_item->draining_batch_pos = 0;
+
+	if (put_back_count != 0)
+		_do_notify_fn_items_put_locked(d, put_back_count - 1, lock); //本线程即将执行其一
+}
+
+void ks_thread_pool_apartment_imp::_do_notify_fn_items_put_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, size_t fn_count, std::unique_lock<ks_mutex>& lock) {
+	//至多唤醒min(fn_count, 空闲线程数)个线程
+	if (fn_count == 0)
+		return;
+
+	const size_t sleeping_thread_count = d->sleeping_thread_count.load(std::memory_order_relaxed);
+	if (fn_count >= sleeping_thread_count) {
+		if (sleeping_thread_count != 0)
+			d->any_fn_queue_cv.notify_all();
 	}
 	else {
-		//新项的目标时点落在当前队列的时段区间内：插队
-		auto where_it = std::upper_bound(d->delaying_fn_queue.begin(), d->delaying_fn_queue.end(), fn_item,
-			[](const std::shared_ptr<_FN_ITEM>& a, std::shared_ptr<_FN_ITEM>& b) { return a->until_time < b->until_time; });
-		d->delaying_fn_queue.insert(where_it, std::move(fn_item));
+		for (size_t i = 0; i < fn_count; ++i)
+			d->any_fn_queue_cv.notify_one();
 	}
+}
+
+void ks_thread_pool_apartment_imp::_do_put_fn_item_into_delaying_list_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _FN_ITEM_PTR&& fn_item, std::unique_lock<ks_mutex>& lock) {
+	//仅当新项早于当前wait_until的时点（或当前无线程wait_until）时才需要唤醒
+	const bool should_notify = fn_item->until_time < d->delaying_waiting_until_time;
+
+	//（忽略priority）
+	const auto until_time = fn_item->until_time;
+	_do_index_fn_item_locked(d, fn_item.get(), lock);
+	d->delaying_fn_wheel.insert(std::move(fn_item), until_time);
 
 	if (should_notify) {
 		//只需notify_one即可，即使有多项。
 		//这是因为调度时到期的delayed项会被先移至now队列，即使瞬间由一个线程处理多项也没什么负担。
-		//参见_thread_proc中对于delayed的调度算法。
+		//被唤醒的线程将接替wait_until最近的到期时点，参见_do_wait_any_fn_or_delaying_fn_locked。
 		d->any_fn_queue_cv.notify_one();
 	}
 }
 
+void ks_thread_pool_apartment_imp::_do_put_fn_item_into_local_list(ks_thread_pool_apartment_imp* self, const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _THREAD_ITEM* thread_item, _FN_ITEM_PTR&& fn_item) {
+	ASSERT(d->work_stealing_enabled);
+	ASSERT(fn_item->priority == 0 && !fn_item->is_delaying_fn);
+
+	if (true) {
+		std::unique_lock<ks_spinlock> spin_lock(thread_item->local_fn_queue_spinlock);
+		thread_item->local_fn_queue.push_back(std::move(fn_item));
+	}
+
+	_do_notify_lockless_fn_item_put(self, d);
+}
+
+#if __KS_APARTMENT_LOCKFREE_NOW_QUEUE_ENABLED
+bool ks_thread_pool_apartment_imp::_do_put_fn_item_into_lockfree_list(ks_thread_pool_apartment_imp* self, const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _FN_ITEM_PTR& fn_item) {
+	ASSERT(d->lockfree_now_queue_enabled);
+	ASSERT(fn_item->priority == 0 && !fn_item->is_delaying_fn);
+	ASSERT(d->lockfree_now_queue_gate.has_producing_approx()); //须在lockfree_now_queue_gate.try_enter之后
+
+	const bool pushed = d->now_fn_queue_normal_lockfree.try_push(std::move(fn_item)); //若满，fn_item保持原样
+	if (pushed)
+		_do_notify_lockless_fn_item_put(self, d);
+
+	//退出在途状态须在lockless_fn_count递增之后，使stop后的work线程必能看到本次投递
+	d->lockfree_now_queue_gate.leave();
+	return pushed;
+}
+#endif
+
+void ks_thread_pool_apartment_imp::_do_notify_lockless_fn_item_put(ks_thread_pool_apartment_imp* self, const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d) {
+	//注：先递增lockless_fn_count再检查sleeping_thread_count，与_do_wait_any_fn_locked中的次序相反，
+	//由此保证：要么wait前能看到新任务，要么此处能看到有线程在wait而唤醒之，不会丢失唤醒。
+	//同时，仅当有线程在wait时才需lock，队列非空时生产者与消费者互不阻塞。
+	//注：即使有线程在wait，也须按需扩充线程，被唤醒的线程在重新lock之前仍计入sleeping_thread_count，
+	//连续入队的多个任务可能只唤醒了同一个线程（例如各任务相互等待时，将因线程不足而卡住）。
+	d->lockless_fn_count.fetch_add(1, std::memory_order_seq_cst);
+	const bool has_sleeping_thread = d->sleeping_thread_count.load(std::memory_order_seq_cst) != 0;
+	if (has_sleeping_thread || d->thread_pool_size_a.load(std::memory_order_relaxed) < d->max_thread_count) {
+		std::unique_lock<ks_mutex> lock(d->mutex);
+		if (has_sleeping_thread)
+			d->any_fn_queue_cv.notify_one();
+		_prepare_work_thread_locked(self, d, lock);
+	}
+}
+
+ks_thread_pool_apartment_imp::_FN_ITEM_PTR ks_thread_pool_apartment_imp::_do_pop_lockless_fn_item(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _THREAD_ITEM* thread_item) {
+	ASSERT(d->work_stealing_enabled || d->lockfree_now_queue_enabled);
+	if (d->lockless_fn_count.load(std::memory_order_relaxed) == 0)
+		return nullptr;
+
+	if (d->work_stealing_enabled) {
+		std::unique_lock<ks_spinlock> spin_lock(thread_item->local_fn_queue_spinlock);
+		if (!thread_item->local_fn_queue.empty()) {
+			//owner从队头取，维持本线程所schedule任务的先后次序
+			_FN_ITEM_PTR fn_item = std::move(thread_item->local_fn_queue.front());
+			thread_item->local_fn_queue.pop_front();
+			d->lockless_fn_count.fetch_sub(1, std::memory_order_relaxed);
+			return fn_item;
+		}
+	}
+
+#if __KS_APARTMENT_LOCKFREE_NOW_QUEUE_ENABLED
+	if (d->lockfree_now_queue_enabled) {
+		_FN_ITEM_PTR fn_item;
+		if (d->now_fn_queue_normal_lockfree.try_pop(fn_item)) {
+			d->lockless_fn_count.fetch_sub(1, std::memory_order_relaxed);
+			return fn_item;
+		}
+	}
+#endif
+
+	return nullptr;
+}
+
+ks_thread_pool_apartment_imp::_FN_ITEM_PTR ks_thread_pool_apartment_imp::_do_steal_fn_item_from_local_lists_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _THREAD_ITEM* thief_thread_item, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(d->work_stealing_enabled);
+	if (d->lockless_fn_count.load(std::memory_order_relaxed) == 0)
+		return nullptr;
+
+	//numa_nodes策略下，先窃取本节点的线程，再窃取其他节点的线程
+	for (int pass = d->numa_local_enabled ? 0 : 1; pass < 2; ++pass) {
+		for (auto& victim_thread_item : d->thread_pool) {
+			if (victim_thread_item.get() == thief_thread_item)
+				continue;
+			if (pass == 0 && victim_thread_item->affinity_slot != thief_thread_item->affinity_slot)
+				continue;
+
+			std::unique_lock<ks_spinlock> spin_lock(victim_thread_item->local_fn_queue_spinlock);
+			if (victim_thread_item->local_fn_queue.empty())
+				continue;
+
+			//窃取者从队尾取，尽量避开owner
+			_FN_ITEM_PTR fn_item = std::move(victim_thread_item->local_fn_queue.back());
+			victim_thread_item->local_fn_queue.pop_back();
+			d->lockless_fn_count.fetch_sub(1, std::memory_order_relaxed);
+			return fn_item;
+		}
+	}
+
+	return nullptr;
+}
+
+ks_thread_pool_apartment_imp::_THREAD_ITEM* ks_thread_pool_apartment_imp::_choose_caller_node_thread_item_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(d->numa_local_enabled);
+
+	//注：stop之后不再投递至局部队列（work线程可能正要退出），而走常规队列
+	if (d->state_v != _STATE::RUNNING)
+		return nullptr;
+
+	const int cpu = __native_get_current_cpu();
+	if (cpu < 0 || (size_t)cpu >= d->cpu_to_numa_slot.size() || d->cpu_to_numa_slot[(size_t)cpu] == size_t(-1))
+		return nullptr;
+
+	//在调用者所在节点的各线程中依次选取；该节点尚无线程时返回nullptr（则走常规队列）
+	const size_t slot = d->cpu_to_numa_slot[(size_t)cpu];
+	const size_t thread_count = d->thread_pool.size();
+	for (size_t i = 0; i < thread_count; ++i) {
+		const size_t index = (d->numa_round_robin + i) % thread_count;
+		if (d->thread_pool[index]->affinity_slot == slot) {
+			d->numa_round_robin = index + 1;
+			return d->thread_pool[index].get();
+		}
+	}
+
+	return nullptr;
+}
+
+bool ks_thread_pool_apartment_imp::_try_exec_lockless_fn_item_unlocked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _THREAD_ITEM* thread_item) {
+	ASSERT(d->work_stealing_enabled || d->lockfree_now_queue_enabled);
+
+#if __KS_APARTMENT_ATFORK_ENABLED
+	//不持有mutex而执行，故以local_working_rc代替working_rc，atfork_prepare会等待其归零
+	d->local_working_rc.fetch_add(1, std::memory_order_seq_cst);
+	ks_defer defer_dec_local_working_rc([&d]() {
+		if (d->local_working_rc.fetch_sub(1, std::memory_order_seq_cst) == 1 && d->atforking_flag_v) {
+			std::unique_lock<ks_mutex> lock(d->mutex);
+			d->working_done_cv.notify_all();
+		}
+	});
+
+	if (d->atforking_flag_v)
+		return false;
+#endif
+
+	_FN_ITEM_PTR fn_item = _do_pop_lockless_fn_item(d, thread_item);
+	if (fn_item == nullptr)
+		return false;
+
+	++d->busy_thread_count;
+	fn_item->fn();
+	fn_item->fn = {};
+	fn_item.reset();
+	--d->busy_thread_count;
+	return true;
+}
+
+void ks_thread_pool_apartment_imp::_do_wait_any_fn_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, const std::chrono::steady_clock::time_point* until_time, std::unique_lock<ks_mutex>& lock) {
+	const bool lockless_enabled = d->work_stealing_enabled || d->lockfree_now_queue_enabled;
+
+	//spin-then-park：先自旋，未等到新任务则返回pump循环重新检查一遍（自旋期间的stop等状态变化亦由此得以处理），再次来到这里时才wait
+	if (d->spin_wait_enabled) {
+		if (!tls_current_thread_spun_flag || tls_current_thread_spun_seq != d->now_fn_put_seq.load(std::memory_order_relaxed)) {
+			tls_current_thread_idle_begin_time = std::chrono::steady_clock::now();
+			const int64_t spin_time_ns = _calc_spin_time_ns(d);
+			if (spin_time_ns > 0) {
+				const bool hit = _do_spin_wait_any_fn_locked(d, until_time, spin_time_ns, lock);
+				tls_current_thread_spun_flag = !hit;
+				tls_current_thread_spun_seq = d->now_fn_put_seq.load(std::memory_order_relaxed);
+				return;
+			}
+		}
+		tls_current_thread_spun_flag = false;
+	}
+
+	//注：先递增sleeping_thread_count再检查lockless_fn_count，参见_do_notify_lockless_fn_item_put
+	d->sleeping_thread_count.fetch_add(1, std::memory_order_seq_cst);
+	if (lockless_enabled && d->lockless_fn_count.load(std::memory_order_seq_cst) != 0) {
+		d->sleeping_thread_count.fetch_sub(1, std::memory_order_relaxed);
+		return; //无锁队列中有任务，不wait
+	}
+
+	if (until_time != nullptr)
+		d->any_fn_queue_cv.wait_until(lock, *until_time);
+	else
+		d->any_fn_queue_cv.wait(lock);
+
+	d->sleeping_thread_count.fetch_sub(1, std::memory_order_relaxed);
+
+	if (d->spin_wait_enabled) {
+		//以空闲开始至被唤醒的时长作为一次任务到达间隔的采样
+		const auto idle_interval = std::chrono::steady_clock::now() - tls_current_thread_idle_begin_time;
+		_do_update_idle_interval(d, std::chrono::duration_cast<std::chrono::nanoseconds>(idle_interval).count());
+	}
+}
+
+bool ks_thread_pool_apartment_imp::_do_spin_wait_any_fn_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, const std::chrono::steady_clock::time_point* until_time, int64_t spin_time_ns, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(d->spin_wait_enabled && spin_time_ns > 0);
+	const bool lockless_enabled = d->work_stealing_enabled || d->lockfree_now_queue_enabled;
+	if (lockless_enabled && d->lockless_fn_count.load(std::memory_order_relaxed) != 0)
+		return true; //无锁队列中已有任务，不必自旋（亦不计入统计）
+
+	const uint64_t seen_now_fn_put_seq = d->now_fn_put_seq.load(std::memory_order_relaxed);
+	const auto spin_begin_time = std::chrono::steady_clock::now();
+	auto spin_end_time = spin_begin_time + std::chrono::nanoseconds(spin_time_ns);
+	if (until_time != nullptr && *until_time < spin_end_time)
+		spin_end_time = *until_time;
+
+	//不持锁自旋：仅观察now_fn_put_seq和lockless_fn_count，至多spin_time_ns，或至延时任务到期，或至状态变化
+	lock.unlock();
+	bool hit = false;
+	auto now = spin_begin_time;
+	while (true) {
+		if (d->now_fn_put_seq.load(std::memory_order_acquire) != seen_now_fn_put_seq ||
+			(lockless_enabled && d->lockless_fn_count.load(std::memory_order_acquire) != 0)) {
+			hit = true;
+			break;
+		}
+		if (d->state_v != _STATE::RUNNING)
+			break;
+#if __KS_APARTMENT_ATFORK_ENABLED
+		if (d->atforking_flag_v)
+			break;
+#endif
+
+		now = std::chrono::steady_clock::now();
+		if (now >= spin_end_time)
+			break;
+		std::this_thread::yield();
+	}
+	lock.lock();
+
+	if (hit) {
+		d->spin_hit_count.fetch_add(1, std::memory_order_relaxed);
+		_do_update_idle_interval(d, std::chrono::duration_cast<std::chrono::nanoseconds>(now - spin_begin_time).count());
+	}
+	else {
+		d->spin_miss_count.fetch_add(1, std::memory_order_relaxed);
+	}
+	return hit;
+}
+
+int64_t ks_thread_pool_apartment_imp::_calc_spin_time_ns(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d) {
+	//自旋时长取平均到达间隔的2倍（限于上下限之内），平均间隔超过上限则不自旋
+	const int64_t ewma_ns = d->idle_interval_ewma_ns.load(std::memory_order_relaxed);
+	if (ewma_ns > _SPIN_TIME_NS_MAX)
+		return 0;
+	return (std::min)((std::max)(ewma_ns * 2, _SPIN_TIME_NS_MIN), _SPIN_TIME_NS_MAX);
+}
+
+void ks_thread_pool_apartment_imp::_do_update_idle_interval(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, int64_t idle_interval_ns) {
+	//ewma += (sample - ewma) / 4；多线程并发更新时偶有丢失，无妨
+	const int64_t ewma_ns = d->idle_interval_ewma_ns.load(std::memory_order_relaxed);
+	d->idle_interval_ewma_ns.store(ewma_ns + (idle_interval_ns - ewma_ns) / 4, std::memory_order_relaxed);
+}
+
+void ks_thread_pool_apartment_imp::_do_wait_any_fn_or_delaying_fn_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, const std::chrono::steady_clock::time_point* idle_until_time, std::unique_lock<ks_mutex>& lock) {
+	ASSERT(!d->delaying_fn_wheel.empty());
+
+	//仅由一个线程wait_until最近的到期时点，其他线程无限期（或至idle_until_time）wait（有更早的新项时会被唤醒并接替）
+	const auto until_time = d->delaying_fn_wheel.next_expire_time();
+	if (until_time < d->delaying_waiting_until_time) {
+		d->delaying_waiting_until_time = until_time;
+		const auto wait_until_time = (idle_until_time != nullptr && *idle_until_time < until_time) ? *idle_until_time : until_time;
+		_do_wait_any_fn_locked(d, &wait_until_time, lock); //waiting
+		if (d->delaying_waiting_until_time == until_time)
+			d->delaying_waiting_until_time = std::chrono::steady_clock::time_point::max();
+	}
+	else {
+		_do_wait_any_fn_locked(d, idle_until_time, lock);
+	}
+}
+
+void ks_thread_pool_apartment_imp::_do_index_fn_item_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _FN_ITEM* fn_item, std::unique_lock<ks_mutex>& lock) {
+	if (!fn_item->is_indexed) {
+		d->fn_id_index.emplace(fn_item->fn_id, fn_item);
+		fn_item->is_indexed = true;
+	}
+}
+
+void ks_thread_pool_apartment_imp::_do_unindex_fn_item_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _FN_ITEM* fn_item, std::unique_lock<ks_mutex>& lock) {
+	if (fn_item->is_indexed) {
+		d->fn_id_index.erase(fn_item->fn_id);
+		fn_item->is_indexed = false;
+	}
+}
+
 #ifdef _DEBUG
 bool ks_thread_pool_apartment_imp::_check_fn_id_exists_when_debug_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, uint64_t fn_id, std::unique_lock<ks_mutex>& lock) {
-	auto do_check_fn_exists = [](std::deque<std::shared_ptr<_FN_ITEM>>* fn_queue, uint64_t a_fn_id) -> bool {
+	auto do_check_fn_exists = [](std::deque<_FN_ITEM_PTR>* fn_queue, uint64_t a_fn_id) -> bool {
 		return std::find_if(fn_queue->cbegin(), fn_queue->cend(),
 			[a_fn_id](const auto& item) {return item->fn_id == a_fn_id; }) != fn_queue->cend();
 	};
 
+	auto do_check_fn_exists_in_local = [&d, &do_check_fn_exists](uint64_t a_fn_id) -> bool {
+		for (auto& thread_item : d->thread_pool) {
+			std::unique_lock<ks_spinlock> spin_lock(thread_item->local_fn_queue_spinlock);
+			if (do_check_fn_exists(&thread_item->local_fn_queue, a_fn_id))
+				return true;
+		}
+		return false;
+	};
+
+	auto do_check_fn_exists_in_bands = [&d](uint64_t a_fn_id) -> bool {
+		return d->now_fn_band_queue != nullptr &&
+			d->now_fn_band_queue->any_of([a_fn_id](const _FN_ITEM_PTR& item) { return item->fn_id == a_fn_id; });
+	};
+
 	return do_check_fn_exists(&d->now_fn_queue_prior, fn_id)
 		|| do_check_fn_exists(&d->now_fn_queue_normal, fn_id)
 		|| do_check_fn_exists(&d->now_fn_queue_idle, fn_id)
-		|| do_check_fn_exists(&d->delaying_fn_queue, fn_id);
+		|| do_check_fn_exists_in_bands(fn_id)
+		|| std::find_if(d->now_fn_heap_edf.cbegin(), d->now_fn_heap_edf.cend(), [fn_id](const auto& item) { return item->fn_id == fn_id; }) != d->now_fn_heap_edf.cend()
+		|| d->fn_id_index.find(fn_id) != d->fn_id_index.end()
+		|| do_check_fn_exists_in_local(fn_id);
 }
 #endif
 
@@ -543,15 +1576,15 @@ void ks_thread_pool_apartment_imp::atfork_prepare() {
 
 	std::unique_lock<ks_mutex> lock(m_d->mutex);
 	m_d->atforking_flag_v = true;
+	std::atomic_thread_fence(std::memory_order_seq_cst); //与_try_exec_lockless_fn_item_unlocked中local_working_rc的递增相呼应
 
 	m_d->any_fn_queue_cv.notify_all();
 
-	while (m_d->working_rc_v != 0)
+	while (m_d->working_rc_v != 0 || m_d->local_working_rc != 0)
 		m_d->working_done_cv.wait(lock);
 
 #ifdef _DEBUG
-	for (auto& fn_item : m_d->delaying_fn_queue) 
-		ASSERT(!fn_item->is_waiting_until_flag);
+	ASSERT(m_d->delaying_waiting_until_time == std::chrono::steady_clock::time_point::max());
 #endif
 
 	lock.release();
@@ -576,13 +1609,13 @@ void ks_thread_pool_apartment_imp::atfork_child() {
 		return;
 
 	const bool atfork_calling_in_my_thread_flag = (ks_apartment::current_thread_apartment() == this);
-	const size_t atfork_calling_in_my_thread_index = atfork_calling_in_my_thread_flag ? tls_current_thread_index_plus - 1 : size_t(-1);
+	const void* atfork_calling_in_my_thread_item_p = atfork_calling_in_my_thread_flag ? tls_current_thread_item_p : nullptr;
 
 	//重建线程
 	for (size_t i = 0; i < m_d->thread_pool.size(); ++i) {
-		if (!atfork_calling_in_my_thread_flag || i != atfork_calling_in_my_thread_index) {
-			std::thread([self = this, d = m_d, thread_index = i]() {
-				_work_thread_proc(self, d, thread_index);
+		if (!atfork_calling_in_my_thread_flag || m_d->thread_pool[i].get() != atfork_calling_in_my_thread_item_p) {
+			std::thread([self = this, d = m_d, thread_item_sp = m_d->thread_pool[i], thread_index = m_d->thread_pool[i]->thread_index]() {
+				_work_thread_proc(self, d, thread_item_sp, thread_index);
 			}).detach();
 		}
 	}
@@ -631,21 +1664,22 @@ bool ks_thread_pool_apartment_imp::__run_nested_pump_loop_for_extern_waiting(voi
 #endif
 
 #if __KS_APARTMENT_ATFORK_ENABLED
-		ASSERT(d->working_rc_v != 0);
+		ASSERT(d->working_rc_v != 0 || d->local_working_rc != 0);
 #endif
 
+		//外层批量中尚待执行的任务放回队头，使嵌套泵（或其他线程）可以执行它们（所等待的可能正是它们）
+		_THREAD_ITEM* current_thread_item = (_THREAD_ITEM*)tls_current_thread_item_p;
+		if (current_thread_item->draining_batch_pos < current_thread_item->draining_batch.size())
+			_do_put_back_draining_batch_locked(d, current_thread_item, lock);
+
 		//try next delaying_fn
-		if (!d->delaying_fn_queue.empty()) {
-			size_t moved_fn_count = 0;
-			const auto now = std::chrono::steady_clock::now();
-			while (!d->delaying_fn_queue.empty() && d->delaying_fn_queue.front()->until_time <= now) {
-				//直接将到期的delaying项移入now队列
-				_do_put_fn_item_into_now_list_locked(d, std::move(d->delaying_fn_queue.front()), lock);
-				d->delaying_fn_queue.pop_front();
-				++moved_fn_count;
-			}
+		if (!d->delaying_fn_wheel.empty()) {
+			//直接将到期的delaying项移入now队列
+			const size_t moved_fn_count = d->delaying_fn_wheel.pop_expired(std::chrono::steady_clock::now(),
+				[&d, &lock](_FN_ITEM_PTR&& fn_item) { _do_put_fn_item_into_now_list_locked(d, std::move(fn_item), false, lock); });
 
 			if (moved_fn_count != 0) {
+				_do_notify_fn_items_put_locked(d, moved_fn_count - 1, lock); //本线程即将执行其一
 				_prepare_work_thread_locked(self, d, lock);
 				continue;
 			}
@@ -654,13 +1688,35 @@ bool ks_thread_pool_apartment_imp::__run_nested_pump_loop_for_extern_waiting(voi
 		//try next now_fn
 		if (true) {
 			auto* now_fn_queue_sel = !d->now_fn_queue_prior.empty() ? &d->now_fn_queue_prior : &d->now_fn_queue_normal;
-			if (now_fn_queue_sel->empty() && !d->now_fn_queue_idle.empty() && d->thread_pool.size() > 1 && d->busy_thread_count_for_idle + 1 < d->thread_pool.size() && d->state_v == _STATE::RUNNING)
+			_FN_ITEM_PTR local_fn_item;
+			if (d->now_fn_queue_prior.empty() && !d->now_fn_heap_edf.empty()) {
+				//EDF：deadline任务先于normal任务，按deadline先后出队
+				local_fn_item = _do_pop_fn_item_from_edf_heap_locked(d, lock);
+			}
+			else if (d->now_fn_band_queue != nullptr) {
+				//band模式：三级队列不再使用，各band按权重公平出队
+				if (!_try_pop_fn_item_from_band_queue_locked(d, local_fn_item, lock))
+					continue; //墓碑
+			}
+			else if (now_fn_queue_sel->empty() && (d->work_stealing_enabled || d->lockfree_now_queue_enabled)) {
+				//无锁队列中的任务：先本线程局部队列，再lockfree队列，再窃取
+				local_fn_item = _do_pop_lockless_fn_item(d, (_THREAD_ITEM*)tls_current_thread_item_p);
+				if (local_fn_item == nullptr && d->work_stealing_enabled)
+					local_fn_item = _do_steal_fn_item_from_local_lists_locked(d, (_THREAD_ITEM*)tls_current_thread_item_p, lock);
+			}
+			if (local_fn_item == nullptr && now_fn_queue_sel->empty() && !d->now_fn_queue_idle.empty() && d->thread_pool.size() > 1 && d->busy_thread_count_for_idle + 1 < d->thread_pool.size() && d->state_v == _STATE::RUNNING)
 				now_fn_queue_sel = &d->now_fn_queue_idle; //保留1个线程不去执行idle任务（除非是单线程套间）
 
-			if (!now_fn_queue_sel->empty()) {
+			if (local_fn_item != nullptr || !now_fn_queue_sel->empty()) {
 				//pop and exec a fn
-				auto now_fn_item = std::move(now_fn_queue_sel->front());
-				now_fn_queue_sel->pop_front();
+				auto now_fn_item = std::move(local_fn_item);
+				if (now_fn_item == nullptr) {
+					now_fn_item = std::move(now_fn_queue_sel->front());
+					now_fn_queue_sel->pop_front();
+					_do_unindex_fn_item_locked(d, now_fn_item.get(), lock);
+					if (!now_fn_item->fn)
+						continue; //已被try_unschedule置为墓碑，丢弃
+				}
 
 				lock.unlock();
 				now_fn_item->fn();
@@ -700,14 +1756,11 @@ bool ks_thread_pool_apartment_imp::__run_nested_pump_loop_for_extern_waiting(voi
 			}
 		});
 
-		if (!d->delaying_fn_queue.empty() && !d->delaying_fn_queue.front()->is_waiting_until_flag) {
-			const auto waiting_fn_item = d->delaying_fn_queue.front();
-			waiting_fn_item->is_waiting_until_flag = true;
-			d->any_fn_queue_cv.wait_until(lock, waiting_fn_item->until_time); //waiting
-			waiting_fn_item->is_waiting_until_flag = false;
+		if (!d->delaying_fn_wheel.empty()) {
+			_do_wait_any_fn_or_delaying_fn_locked(d, nullptr, lock);
 		}
 		else {
-			d->any_fn_queue_cv.wait(lock);
+			_do_wait_any_fn_locked(d, nullptr, lock);
 		}
 	}
 
@@ -18,20 +18,37 @@ limitations under the License.
 #include "ks_async_base.h"
 #include "ks_apartment.h"
 #include "ktl/ks_concurrency.h"
+#include "ktl/ks_timer_wheel.h"
+#include "ktl/ks_slab_pool.h"
+#include "ktl/ks_priority_band_queue.h"
 #include <deque>
+#include <unordered_map>
 
 
+struct ks_spin_wait_stats {
+	uint64_t spin_hit_count = 0;  //自旋期间等到新任务的次数
+	uint64_t spin_miss_count = 0; //自旋未果而转入wait的次数
+	int64_t spin_time_ns = 0;     //当前自适应的自旋时长
+};
+
 class ks_thread_pool_apartment_imp final : public ks_apartment {
 public:
 	enum { //flag consts
 		no_flag                       = 0,
 		auto_register_flag            = 0x00010000,
+		work_stealing_flag            = 0x00100000, //work-stealing模式：work线程内schedule的普通任务进入本线程的局部队列，空闲线程可窃取
+		spin_wait_flag                = 0x00200000, //spin-then-park模式：空闲线程先不持锁自旋一小段时间（依近期任务到达间隔自适应），未等到新任务再wait
+		prestart_min_threads_flag     = 0x00400000, //start时即预先创建min_thread_count个线程
+		edf_schedule_flag             = 0x00800000, //EDF模式：schedule_with_deadline的normal任务按deadline先后出队，先于无deadline的normal任务
 		endless_instance_flag         = 0x01000000,
 		delayed_always_low_prior_flag = 0x04000000,
 	};
 
 	KS_ASYNC_API explicit ks_thread_pool_apartment_imp(const char* name, size_t max_thread_count, uint flags = 0);
 	KS_ASYNC_API explicit ks_thread_pool_apartment_imp(const char* name, size_t max_thread_count, uint flags, std::function<void()>&& thread_init_fn, std::function<void()>&& thread_term_fn);
+	//弹性线程池：线程按需增至max_thread_count，空闲超过idle_timeout（单位：毫秒，<0表示永不回收）的富余线程退出，至少保留min_thread_count个
+	KS_ASYNC_API explicit ks_thread_pool_apartment_imp(const char* name, size_t min_thread_count, size_t max_thread_count, int64_t idle_timeout, uint flags);
+	KS_ASYNC_API explicit ks_thread_pool_apartment_imp(const char* name, size_t min_thread_count, size_t max_thread_count, int64_t idle_timeout, uint flags, std::function<void()>&& thread_init_fn, std::function<void()>&& thread_term_fn);
 	_DISABLE_COPY_CONSTRUCTOR(ks_thread_pool_apartment_imp);
 
 	KS_ASYNC_API ~ks_thread_pool_apartment_imp();
@@ -50,9 +67,46 @@ public:
 
 	virtual uint64_t schedule(std::function<void()>&& fn, int priority) override;
 	virtual uint64_t schedule_delayed(std::function<void()>&& fn, int priority, int64_t delay) override;
+	virtual uint64_t schedule(ks_task_fn&& fn, int priority) override;
+	virtual uint64_t schedule_delayed(ks_task_fn&& fn, int priority, int64_t delay) override;
+	virtual uint64_t schedule_batch(std::vector<ks_task_fn>&& fns, int priority) override;
+	virtual uint64_t schedule_with_deadline(ks_task_fn&& fn, int priority, std::chrono::steady_clock::time_point deadline) override;
 
 	virtual void try_unschedule(uint64_t id) override;
 
+	//_FN_ITEM节点池的统计（稳态下slab_alloc_count应不再增长，即schedule不再有内存分配）
+	KS_ASYNC_API ks_slab_pool_stats fn_item_pool_stats();
+
+	//spin-then-park的统计（参见spin_wait_flag）
+	KS_ASYNC_API ks_spin_wait_stats spin_wait_stats();
+
+	//当前的work线程数
+	KS_ASYNC_API size_t work_thread_count();
+
+	//设定work线程的CPU亲和性策略，须在start（及首次schedule）前调用。
+	//返回是否生效（平台不支持、或无法取得所需的CPU拓扑时返回false，仍按无亲和性运行）。
+	//注：numa_nodes策略下（且max_thread_count>1），work线程各有局部队列（同work_stealing_flag），
+	//schedule的normal任务投递至调用者所在节点的某线程的局部队列，空闲线程优先窃取本节点的任务。
+	KS_ASYNC_API bool set_affinity_policy(const ks_thread_affinity_policy& affinity_policy);
+
+	//启用多优先级band模式（band_count为2~16），须在start（及首次schedule）前调用，返回是否生效。
+	//band模式下，priority依次映射至各band（参见ks_priority_band_queue），各band按权重公平出队，不再保留线程不执行idle任务，
+	//由此idle任务不会被无限期饿死，高优先级任务的洪峰也不会饿死普通任务。
+	//band_weights为空时取默认权重（每高一个band权重加倍）。
+	//注：band模式下不启用work-stealing及lockfree队列（各任务须经由band统一排序）。
+	KS_ASYNC_API bool set_priority_bands(size_t band_count, const std::vector<uint32_t>& band_weights = {});
+
+	//各band的排队数和排队时长统计（仅band模式下有效，否则返回空）
+	KS_ASYNC_API std::vector<ks_priority_band_stats> priority_band_stats();
+
+	static constexpr int64_t default_batch_drain_time_budget_us = 1000;
+
+	//启用批量出队模式：work线程每次lock至多取出max_batch_count个就绪的prior/normal任务（按优先级次序，且不超过平摊到各线程的份额），
+	//解锁后连续执行。批量执行期间若有新的高优先级任务到达，或自本批开始已超过time_budget_us（微秒），则在下一项之前中止，余下的任务放回队头。
+	//须在start（及首次schedule）前调用，返回是否生效；max_batch_count为1即关闭（默认）。
+	//注：band模式及EDF任务、idle任务、无锁队列（work-stealing及lockfree）中的任务仍逐项出队。
+	KS_ASYNC_API bool set_batch_drain(size_t max_batch_count, int64_t time_budget_us = default_batch_drain_time_budget_us);
+
 #if __KS_APARTMENT_ATFORK_ENABLED
 	virtual void atfork_prepare() override;
 	virtual void atfork_parent() override;
@@ -69,21 +123,57 @@ private:
 	void _try_stop_locked(bool should_thread_exit, std::unique_lock<ks_mutex>& lock, bool must_keep_locked);
 
 	static void _prepare_work_thread_locked(ks_thread_pool_apartment_imp* self, const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
-	static void _work_thread_proc(ks_thread_pool_apartment_imp* self, const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, size_t thread_index);
+	struct _THREAD_ITEM;
+	static void _do_spawn_work_thread_locked(ks_thread_pool_apartment_imp* self, const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
+	static void _work_thread_proc(ks_thread_pool_apartment_imp* self, const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, const std::shared_ptr<_THREAD_ITEM>& thread_item_sp, size_t thread_index);
+	static bool _try_reap_work_thread_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _THREAD_ITEM* thread_item, std::unique_lock<ks_mutex>& lock);
 
 private:
-	struct _FN_ITEM {
-		std::function<void()> fn;
+	struct _FN_ITEM;
+	using _FN_ITEM_PTR = ks_slab_ptr<_FN_ITEM>; //由套间的fn_item_pool分配
+
+	struct _FN_ITEM : ks_timer_wheel_hook<_FN_ITEM, _FN_ITEM_PTR> {
+		ks_task_fn fn;
 		std::chrono::steady_clock::time_point until_time;
+		std::chrono::steady_clock::time_point deadline = {}; //仅EDF任务
 		uint64_t fn_id;
 		int64_t delay = 0;
 		int priority = 0;
 		bool is_delaying_fn = false;
-		bool is_waiting_until_flag = false;
+		bool is_indexed = false; //是否在fn_id_index中
 	};
 
-	static void _do_put_fn_item_into_now_list_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, std::shared_ptr<_FN_ITEM>&& fn_item, std::unique_lock<ks_mutex>& lock);
-	static void _do_put_fn_item_into_delaying_list_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, std::shared_ptr<_FN_ITEM>&& fn_item, std::unique_lock<ks_mutex>& lock);
+	static void _do_put_fn_item_into_now_list_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _FN_ITEM_PTR&& fn_item, bool should_notify, std::unique_lock<ks_mutex>& lock);
+	static void _do_put_fn_item_into_delaying_list_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _FN_ITEM_PTR&& fn_item, std::unique_lock<ks_mutex>& lock);
+	static bool _is_later_edf_fn_item(const _FN_ITEM_PTR& a, const _FN_ITEM_PTR& b) {
+		//用作std::push_heap/pop_heap的less，使堆顶为deadline最早（相同时为先schedule）者
+		return a->deadline != b->deadline ? a->deadline > b->deadline : a->fn_id > b->fn_id;
+	}
+	static void _do_put_fn_item_into_edf_heap_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _FN_ITEM_PTR&& fn_item, std::unique_lock<ks_mutex>& lock);
+	static _FN_ITEM_PTR _do_pop_fn_item_from_edf_heap_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
+	static void _do_put_fn_item_into_band_queue_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _FN_ITEM_PTR&& fn_item, std::unique_lock<ks_mutex>& lock);
+	static bool _try_pop_fn_item_from_band_queue_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _FN_ITEM_PTR& fn_item, std::unique_lock<ks_mutex>& lock);
+	static void _do_index_fn_item_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _FN_ITEM* fn_item, std::unique_lock<ks_mutex>& lock);
+	static void _do_unindex_fn_item_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _FN_ITEM* fn_item, std::unique_lock<ks_mutex>& lock);
+
+	static void _do_put_fn_item_into_local_list(ks_thread_pool_apartment_imp* self, const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _THREAD_ITEM* thread_item, _FN_ITEM_PTR&& fn_item);
+#if __KS_APARTMENT_LOCKFREE_NOW_QUEUE_ENABLED
+	static bool _do_put_fn_item_into_lockfree_list(ks_thread_pool_apartment_imp* self, const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _FN_ITEM_PTR& fn_item);
+#endif
+	static void _do_notify_fn_items_put_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, size_t fn_count, std::unique_lock<ks_mutex>& lock);
+	static void _do_notify_lockless_fn_item_put(ks_thread_pool_apartment_imp* self, const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d);
+	static _FN_ITEM_PTR _do_pop_lockless_fn_item(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _THREAD_ITEM* thread_item);
+	static _THREAD_ITEM* _choose_caller_node_thread_item_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, std::unique_lock<ks_mutex>& lock);
+	static _FN_ITEM_PTR _do_steal_fn_item_from_local_lists_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _THREAD_ITEM* thief_thread_item, std::unique_lock<ks_mutex>& lock);
+	static bool _try_exec_lockless_fn_item_unlocked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _THREAD_ITEM* thread_item);
+	static void _do_take_draining_batch_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _THREAD_ITEM* thread_item, std::unique_lock<ks_mutex>& lock);
+	static void _do_exec_draining_batch_unlocked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _THREAD_ITEM* thread_item);
+	static void _do_put_back_draining_batch_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, _THREAD_ITEM* thread_item, std::unique_lock<ks_mutex>& lock);
+	static void _do_wait_any_fn_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, const std::chrono::steady_clock::time_point* until_time, std::unique_lock<ks_mutex>& lock);
+	static void _do_wait_any_fn_or_delaying_fn_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, const std::chrono::steady_clock::time_point* idle_until_time, std::unique_lock<ks_mutex>& lock);
+	static bool _do_spin_wait_any_fn_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, const std::chrono::steady_clock::time_point* until_time, int64_t spin_time_ns, std::unique_lock<ks_mutex>& lock);
+	static int64_t _calc_spin_time_ns(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d);
+	static void _do_update_idle_interval(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, int64_t idle_interval_ns);
 
 #ifdef _DEBUG
 	static bool _check_fn_id_exists_when_debug_locked(const std::shared_ptr<_THREAD_POOL_APARTMENT_DATA>& d, uint64_t fn_id, std::unique_lock<ks_mutex>& lock);
@@ -93,6 +183,17 @@ private:
 	enum class _STATE { NOT_START, RUNNING, STOPPING, STOPPED };
 
 	struct _THREAD_ITEM {
+		//work-stealing模式下的局部队列（仅容纳本线程schedule的normal任务），owner从队头取，窃取者从队尾取
+		ks_spinlock local_fn_queue_spinlock;
+		std::deque<_FN_ITEM_PTR> local_fn_queue;
+
+		size_t thread_index = 0; //const-like，在存活线程间唯一（亦用于线程名）
+		size_t affinity_slot = size_t(-1); //const-like，在affinity_cpu_sets中的位置（numa_nodes策略下即节点序号），-1表示不设亲和性
+
+		//批量出队（参见set_batch_drain）：本线程本批取出的后续任务，[draining_batch_pos, size)尚待执行
+		std::vector<_FN_ITEM_PTR> draining_batch;
+		size_t draining_batch_pos = 0;
+		uint64_t draining_batch_seq_snapshot = 0; //取出本批时的prior_fn_put_seq
 	};
 
 	struct _THREAD_POOL_APARTMENT_DATA {
@@ -103,19 +204,61 @@ private:
 		std::function<void()> thread_init_fn = nullptr; //const-like, optional
 		std::function<void()> thread_term_fn = nullptr; //const-like, optional
 
+		ks_slab_pool<_FN_ITEM> fn_item_pool{}; //须先于各队列声明，以保证在其后析构
+
 		//prior简化为三级：>0为高优先，=0为普通，<0为低且简单地加入到idle队列
-		std::deque<std::shared_ptr<_FN_ITEM>> now_fn_queue_prior;
-		std::deque<std::shared_ptr<_FN_ITEM>> now_fn_queue_normal;
-		std::deque<std::shared_ptr<_FN_ITEM>> now_fn_queue_idle; //idle任务地位低下，与prior和normal不是同等对待
-		std::deque<std::shared_ptr<_FN_ITEM>> delaying_fn_queue;
+		std::deque<_FN_ITEM_PTR> now_fn_queue_prior;
+		std::deque<_FN_ITEM_PTR> now_fn_queue_normal;
+		std::deque<_FN_ITEM_PTR> now_fn_queue_idle; //idle任务地位低下，与prior和normal不是同等对待
+		std::vector<_FN_ITEM_PTR> now_fn_heap_edf; //EDF任务（按deadline的小顶堆），先于normal任务出队
+		bool edf_enabled = false; //const-like
+		std::unique_ptr<ks_priority_band_queue<_FN_ITEM_PTR>> now_fn_band_queue; //const-like(ptr)，仅band模式（参见set_priority_bands），取代以上三级队列
+		ks_timer_wheel<_FN_ITEM, _FN_ITEM_PTR> delaying_fn_wheel{}; //延时任务，插入和撤销均为O(1)
+		std::unordered_map<uint64_t, _FN_ITEM*> fn_id_index; //可撤销任务（延时任务和idle任务）的索引，使try_unschedule为O(1)
+		std::chrono::steady_clock::time_point delaying_waiting_until_time = std::chrono::steady_clock::time_point::max(); //仅由一个线程wait_until最近的到期时点，max表示当前无此线程
 		ks_condition_variable any_fn_queue_cv{};
 
 		std::deque<std::shared_ptr<_THREAD_ITEM>> thread_pool;
+		size_t min_thread_count = 0; //const-like
 		size_t max_thread_count = 0; //const-like
+		int64_t idle_timeout = -1; //const-like，空闲超过此时长（毫秒）的富余线程退出，<0表示永不回收
 		size_t living_thread_count = 0; //存活线程数
-		size_t busy_thread_count = 0;
+		size_t next_thread_index = 0; //尚未分配过的最小thread_index
+		std::vector<size_t> free_thread_indexes; //已退出线程的thread_index，新线程优先复用其中最小者
+		std::atomic<size_t> busy_thread_count = { 0 }; //局部任务的执行不持有mutex，故为atomic
 		size_t busy_thread_count_for_idle = 0;
 
+		//work-stealing
+		bool work_stealing_enabled = false; //const-like，仅当work_stealing_flag且max_thread_count>1时启用
+		std::atomic<size_t> lockless_fn_count = { 0 }; //无锁队列（各局部队列及lockfree队列）的总任务数
+		std::atomic<size_t> sleeping_thread_count = { 0 }; //正在wait的线程数，无锁入队时据此判断是否需要唤醒，批量入队时据此决定唤醒几个
+		std::atomic<size_t> thread_pool_size_a = { 0 }; //thread_pool.size()的atomic镜像，无锁入队时据此判断是否需要扩充线程
+
+		//affinity（参见set_affinity_policy）
+		std::vector<std::vector<int>> affinity_cpu_sets; //const-like，各slot的cpu集合，新线程分派至线程数最少的slot
+		bool numa_local_enabled = false; //const-like，numa_nodes策略：slot即节点
+		std::vector<size_t> cpu_to_numa_slot; //const-like，cpu编号至节点slot的映射，据此判断调用者所在节点
+		size_t numa_round_robin = 0; //调用者所在节点内，依次选取投递的线程
+
+		//lockfree（参见__KS_APARTMENT_LOCKFREE_NOW_QUEUE_ENABLED）
+		bool lockfree_now_queue_enabled = false; //const-like
+#if __KS_APARTMENT_LOCKFREE_NOW_QUEUE_ENABLED
+		ks_mpmc_queue<_FN_ITEM_PTR> now_fn_queue_normal_lockfree{ 4096 }; //normal任务的无锁队列，满时溢出到now_fn_queue_normal
+		ks_producer_gate lockfree_now_queue_gate; //lockfree队列的投递闸门（RUNNING期间开启），stop时关闭，此后lockless_fn_count即已计入全部已接受的任务
+#endif
+
+		//批量出队（参见set_batch_drain）
+		size_t batch_drain_max_count = 1; //const-like
+		int64_t batch_drain_time_budget_us = default_batch_drain_time_budget_us; //const-like
+		std::atomic<uint64_t> prior_fn_put_seq = { 0 }; //prior队列（及EDF堆）的入队序号，批量执行期间据此不持锁地判断有无新的高优先级任务
+
+		//spin-then-park（参见spin_wait_flag）
+		bool spin_wait_enabled = false; //const-like
+		std::atomic<uint64_t> now_fn_put_seq = { 0 }; //now队列的入队序号，自旋时据此不持锁地判断有无新任务
+		std::atomic<int64_t> idle_interval_ewma_ns = { 0 }; //线程空闲至新任务到达的间隔（指数滑动平均），据此决定自旋时长
+		std::atomic<uint64_t> spin_hit_count = { 0 };
+		std::atomic<uint64_t> spin_miss_count = { 0 };
+
 		volatile _STATE state_v = _STATE::NOT_START;
 		ks_condition_variable stopped_state_cv{};
 
@@ -123,6 +266,7 @@ private:
 
 #if __KS_APARTMENT_ATFORK_ENABLED
 		volatile int working_rc_v = 0;
+		std::atomic<int> local_working_rc = { 0 }; //不持有mutex而执行局部任务的计数
 		volatile bool atforking_flag_v = false;
 		ks_condition_variable working_done_cv{};
 		ks_condition_variable atforking_done_cv{};
@@ -152,6 +152,25 @@ public:
 		return this->do_get<T>();
 	}
 
+	//取出值，this随即被reset：若数据未被共享（引用计数为1），则直接移出，否则复制一份
+	//注：引用计数为1时，别处已无持有者可并发地再addref，故判定是可靠的
+	template <class T>
+	std::remove_cvref_t<T> take() {
+		using XT = std::remove_cvref_t<T>;
+
+		const XT& x_ref = this->do_get<XT>();
+		if (m_data_p != (void*)(-1) && m_data_p->ref_count.load(std::memory_order_acquire) == 1) {
+			XT x(std::move(const_cast<XT&>(x_ref)));
+			this->reset();
+			return x;
+		}
+		else {
+			XT x(x_ref);
+			this->reset();
+			return x;
+		}
+	}
+
 private:
 	template <class T>
 	const T& do_get() const noexcept {
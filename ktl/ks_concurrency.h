@@ -31,4 +31,8 @@ limitations under the License.
 #include "ks_concurrency/ks_event.h"
 #include "ks_concurrency/ks_waitgroup.h"
 
+#include "ks_concurrency/ks_mpmc_queue.h"
+#include "ks_concurrency/ks_mpsc_queue.h"
+#include "ks_concurrency/ks_producer_gate.h"
+
 #endif //__KS_CONCURRENCY_DEF
@@ -0,0 +1,147 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async/ktl Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#ifndef __KS_MPMC_QUEUE_DEF
+#define __KS_MPMC_QUEUE_DEF
+
+#include "../ks_cxxbase.h"
+#include <atomic>
+#include <new>
+#include <type_traits>
+
+
+//有界的无锁多生产者多消费者环形队列（Vyukov算法）
+//每个cell带有sequence，生产者和消费者分别以CAS推进enqueue_pos和dequeue_pos，无需任何锁。
+//容量取不小于指定值的2的幂；队列满时try_push返回false，由使用者自行决定退化策略（例如转入有锁的溢出队列）。
+template <class T>
+class ks_mpmc_queue {
+public:
+    explicit ks_mpmc_queue(size_t capacity) {
+        size_t real_capacity = 2;
+        while (real_capacity < capacity)
+            real_capacity <<= 1;
+
+        m_capacity_mask = real_capacity - 1;
+        m_cells = new _CELL[real_capacity];
+        for (size_t i = 0; i < real_capacity; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+
+        m_enqueue_pos.store(0, std::memory_order_relaxed);
+        m_dequeue_pos.store(0, std::memory_order_relaxed);
+    }
+
+    ~ks_mpmc_queue() {
+        //析构时已无并发，直接析构残留的元素
+        const size_t enqueue_pos = m_enqueue_pos.load(std::memory_order_acquire);
+        for (size_t pos = m_dequeue_pos.load(std::memory_order_acquire); pos != enqueue_pos; ++pos) {
+            _CELL* cell = &m_cells[pos & m_capacity_mask];
+            if (cell->sequence.load(std::memory_order_acquire) == pos + 1)
+                ((T*)(void*)&cell->storage)->~T();
+        }
+        delete[] m_cells;
+    }
+
+    _DISABLE_COPY_CONSTRUCTOR(ks_mpmc_queue);
+
+public:
+    template <class X, class _ = std::enable_if_t<std::is_convertible<X, T>::value>>
+    _NODISCARD bool try_push(X&& x) {
+        _CELL* cell;
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &m_cells[pos & m_capacity_mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0) {
+                return false; //full
+            }
+            else {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        ::new ((void*)&cell->storage) T(std::forward<X>(x));
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    _NODISCARD bool try_pop(T& out) {
+        _CELL* cell;
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &m_cells[pos & m_capacity_mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0) {
+                return false; //empty (or the producer has not yet finished writing)
+            }
+            else {
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        T* px = (T*)(void*)&cell->storage;
+        out = std::move(*px);
+        px->~T();
+        cell->sequence.store(pos + m_capacity_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+public:
+    size_t capacity() const noexcept {
+        return m_capacity_mask + 1;
+    }
+
+    //近似值，仅供参考（并发时可能瞬时不准确）
+    _NODISCARD size_t size_approx() const noexcept {
+        size_t dequeue_pos = m_dequeue_pos.load(std::memory_order_seq_cst);
+        size_t enqueue_pos = m_enqueue_pos.load(std::memory_order_seq_cst);
+        return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+    }
+
+    _NODISCARD bool empty_approx() const noexcept {
+        return this->size_approx() == 0;
+    }
+
+private:
+    struct _CELL {
+        std::atomic<size_t> sequence;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    //生产者和消费者的位置分处不同cache-line，避免伪共享
+    static constexpr size_t _CACHE_LINE_SIZE = 64;
+
+    _CELL* m_cells = nullptr;
+    size_t m_capacity_mask = 0;
+    char m_pad0[_CACHE_LINE_SIZE];
+    std::atomic<size_t> m_enqueue_pos;
+    char m_pad1[_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> m_dequeue_pos;
+    char m_pad2[_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+};
+
+
+#endif // __KS_MPMC_QUEUE_DEF
@@ -0,0 +1,163 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async/ktl Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#ifndef __KS_MPSC_QUEUE_DEF
+#define __KS_MPSC_QUEUE_DEF
+
+#include "../ks_cxxbase.h"
+#include <atomic>
+#include <memory>
+
+
+template <class ITEM, class HOLDER>
+class ks_mpsc_queue;
+
+//ks_mpsc_queue的侵入式挂钩，ITEM须以其为基类
+//HOLDER为ITEM的所有权类型（shared_ptr或unique_ptr等），入队期间由queue持有
+template <class ITEM, class HOLDER = std::shared_ptr<ITEM>>
+struct ks_mpsc_queue_hook {
+private:
+    friend class ks_mpsc_queue<ITEM, HOLDER>;
+
+    std::atomic<ks_mpsc_queue_hook*> __mpsc_next{ nullptr };
+    HOLDER __mpsc_holder; //入队期间由queue持有
+};
+
+
+//无界的侵入式无锁多生产者单消费者队列（Vyukov算法）
+//生产者每次push仅一次原子exchange（push_range一次挂入多项亦然），不会因其他生产者或消费者而阻塞；
+//消费者沿链表逐项取出，无需CAS。节点即ITEM本身（经由hook），队列不做任何分配。
+//注：同一时刻只允许一个消费者（try_pop/drain/empty），多个线程轮流充当消费者时须由使用者以锁互斥。
+//注：生产者在exchange之后、链接next之前被抢占时，消费者会暂时看到“非空但取不出”，稍后重试即可。
+template <class ITEM, class HOLDER = std::shared_ptr<ITEM>>
+class ks_mpsc_queue {
+    using _HOOK = ks_mpsc_queue_hook<ITEM, HOLDER>;
+
+public:
+    ks_mpsc_queue() {
+        m_head = &m_stub;
+        m_tail.store(&m_stub, std::memory_order_relaxed);
+    }
+
+    ~ks_mpsc_queue() {
+        //析构时已无并发，直接释放残留的项
+        this->drain([](HOLDER&&) {});
+        ASSERT(this->empty());
+    }
+
+    _DISABLE_COPY_CONSTRUCTOR(ks_mpsc_queue);
+
+public:
+    //生产者：入队一项
+    void push(HOLDER&& item) {
+        ASSERT(item != nullptr);
+        _HOOK* hook = static_cast<_HOOK*>(item.get());
+        hook->__mpsc_holder = std::move(item);
+        hook->__mpsc_next.store(nullptr, std::memory_order_relaxed);
+        __link(hook, hook);
+    }
+
+    //生产者：一次性入队[first, last)的各项（保持其次序，且与其他生产者的项不交错）
+    template <class IT>
+    void push_range(IT first, IT last) {
+        _HOOK* range_head = nullptr;
+        _HOOK* range_tail = nullptr;
+        for (IT it = first; it != last; ++it) {
+            ASSERT(*it != nullptr);
+            _HOOK* hook = static_cast<_HOOK*>((*it).get());
+            hook->__mpsc_holder = std::move(*it);
+            hook->__mpsc_next.store(nullptr, std::memory_order_relaxed);
+            if (range_tail != nullptr)
+                range_tail->__mpsc_next.store(hook, std::memory_order_relaxed);
+            else
+                range_head = hook;
+            range_tail = hook;
+        }
+
+        if (range_head != nullptr)
+            __link(range_head, range_tail);
+    }
+
+    //消费者：出队一项，队列为空（或生产者尚未完成链接）时返回false
+    _NODISCARD bool try_pop(HOLDER& out) {
+        _HOOK* head = m_head;
+        _HOOK* next = head->__mpsc_next.load(std::memory_order_acquire);
+        if (head == &m_stub) {
+            if (next == nullptr)
+                return false; //empty
+            m_head = next;
+            head = next;
+            next = next->__mpsc_next.load(std::memory_order_acquire);
+        }
+
+        if (next != nullptr) {
+            m_head = next;
+            out = std::move(head->__mpsc_holder);
+            return true;
+        }
+
+        if (head != m_tail.load(std::memory_order_acquire))
+            return false; //有生产者正在链接，稍后重试
+
+        //head为最后一项：重新挂入stub，使head得以摘下
+        m_stub.__mpsc_next.store(nullptr, std::memory_order_relaxed);
+        __link(&m_stub, &m_stub);
+
+        next = head->__mpsc_next.load(std::memory_order_acquire);
+        if (next != nullptr) {
+            m_head = next;
+            out = std::move(head->__mpsc_holder);
+            return true;
+        }
+
+        return false; //有生产者正在链接，稍后重试
+    }
+
+    //消费者：取出当前可取的全部项，依次回调fn(HOLDER&&)，返回取出的项数
+    //注：遇到生产者尚未链接的项即止步（其后的项亦取不出），须取尽时，使用者应先令生产者静止（如关闭入口并等待在途的push完成）
+    template <class FN>
+    size_t drain(FN&& fn) {
+        size_t count = 0;
+        for (HOLDER item; this->try_pop(item); ++count)
+            fn(std::move(item));
+        return count;
+    }
+
+    //消费者：队列是否为空（为false时亦可能暂时取不出，参见try_pop）
+    //注：以seq_cst读取tail，使用者可借此与生产者push后的检查配对（Dekker式），以免丢失唤醒
+    _NODISCARD bool empty() const noexcept {
+        return m_tail.load(std::memory_order_seq_cst) == &m_stub && m_head == &m_stub;
+    }
+
+private:
+    void __link(_HOOK* range_head, _HOOK* range_tail) {
+        _HOOK* prev = m_tail.exchange(range_tail, std::memory_order_seq_cst);
+        prev->__mpsc_next.store(range_head, std::memory_order_release);
+    }
+
+private:
+    //生产者和消费者的位置分处不同cache-line，避免伪共享
+    static constexpr size_t _CACHE_LINE_SIZE = 64;
+
+    std::atomic<_HOOK*> m_tail;
+    char m_pad0[_CACHE_LINE_SIZE - sizeof(std::atomic<_HOOK*>)];
+    _HOOK* m_head;
+    _HOOK m_stub;
+};
+
+
+#endif // __KS_MPSC_QUEUE_DEF
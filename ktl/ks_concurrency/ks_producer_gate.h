@@ -0,0 +1,85 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async/ktl Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#ifndef __KS_PRODUCER_GATE_DEF
+#define __KS_PRODUCER_GATE_DEF
+
+#include "../ks_cxxbase.h"
+#include <atomic>
+#include <thread>
+
+
+//无锁投递路径的闸门：生产者不经mutex地投递（如无锁队列），关闭者须确认关闭之后已无在途的投递。
+//生产者：try_enter成功后投递，投递（含唤醒等后续动作）完毕再leave；try_enter失败则转走有锁的路径。
+//关闭者：close_and_wait之后，不会再有新的生产者进入，且先前进入的均已leave。
+//注：try_enter先登记为在途再检查open，与close_and_wait中的次序相反（均为seq_cst），
+//由此保证：要么关闭者能等到本次投递完成，要么生产者能看到已关闭。
+class ks_producer_gate {
+public:
+    ks_producer_gate() = default;
+    _DISABLE_COPY_CONSTRUCTOR(ks_producer_gate);
+
+public:
+    void open() {
+        m_open.store(true, std::memory_order_seq_cst);
+    }
+
+    bool is_open() const {
+        return m_open.load(std::memory_order_relaxed);
+    }
+
+    //生产者：进入在途状态，若已关闭则返回false（且不在途）
+    _NODISCARD bool try_enter() {
+        m_producing_count.fetch_add(1, std::memory_order_seq_cst);
+        if (m_open.load(std::memory_order_seq_cst))
+            return true;
+
+        m_producing_count.fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+
+    //生产者：退出在途状态，此前的投递对close_and_wait之后的关闭者可见
+    void leave() {
+        ASSERT(m_producing_count.load(std::memory_order_relaxed) > 0);
+        m_producing_count.fetch_sub(1, std::memory_order_release);
+    }
+
+    bool has_producing_approx() const {
+        return m_producing_count.load(std::memory_order_relaxed) != 0;
+    }
+
+    //关闭，并等待在途的生产者leave
+    //注：等待期间须解开lock，在途的生产者可能正要获取该锁（如唤醒消费者）
+    template <class UNIQUE_LOCK>
+    void close_and_wait(UNIQUE_LOCK& lock) {
+        ASSERT(lock.owns_lock());
+        m_open.store(false, std::memory_order_seq_cst);
+        if (m_producing_count.load(std::memory_order_seq_cst) != 0) {
+            lock.unlock();
+            while (m_producing_count.load(std::memory_order_acquire) != 0)
+                std::this_thread::yield();
+            lock.lock();
+        }
+    }
+
+private:
+    std::atomic<bool> m_open = { false };
+    std::atomic<int> m_producing_count = { 0 };
+};
+
+
+#endif //__KS_PRODUCER_GATE_DEF
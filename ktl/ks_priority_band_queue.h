@@ -0,0 +1,174 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async/ktl Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#ifndef __KS_PRIORITY_BAND_QUEUE_DEF
+#define __KS_PRIORITY_BAND_QUEUE_DEF
+
+#include "ks_cxxbase.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+
+struct ks_priority_band_stats {
+	uint32_t weight = 0;        //该band的权重
+	size_t queue_depth = 0;     //当前排队数
+	uint64_t dequeue_count = 0; //累计出队数
+	int64_t total_wait_ns = 0;  //累计排队时长（出队时计入），除以dequeue_count即平均排队时长
+	int64_t max_wait_ns = 0;    //最长排队时长
+};
+
+
+//多优先级band的队列：band内FIFO，band间按权重公平出队（smooth weighted round-robin），
+//即各非空band按权重比例轮流出队，低band也总能在有限次出队内轮到，不会被高band饿死。
+//band 0为最高，normal_band()对应priority=0，priority每增（减）1则升（降）一个band，超出范围的归入两端的band。
+//注：非线程安全，由使用者（套间）加锁保护。
+template <class T>
+class ks_priority_band_queue {
+public:
+	static constexpr size_t min_band_count = 2;
+	static constexpr size_t max_band_count = 16;
+
+	//band_weights为空时，取默认权重：每高一个band，权重加倍（最低band为1）
+	explicit ks_priority_band_queue(size_t band_count, const std::vector<uint32_t>& band_weights = {})
+		: m_bands(band_count) {
+		ASSERT(band_count >= min_band_count && band_count <= max_band_count);
+		ASSERT(band_weights.empty() || band_weights.size() == band_count);
+		for (size_t band = 0; band < band_count; ++band) {
+			const uint32_t weight = band < band_weights.size() ? band_weights[band] : (uint32_t)1 << (band_count - 1 - band);
+			m_bands[band].weight = weight >= 1 ? weight : 1;
+		}
+	}
+
+	_DISABLE_COPY_CONSTRUCTOR(ks_priority_band_queue);
+
+public:
+	size_t band_count() const noexcept { return m_bands.size(); }
+	size_t normal_band() const noexcept { return (m_bands.size() - 1) / 2; }
+
+	size_t band_of_priority(int priority) const noexcept {
+		const int normal_band = (int)this->normal_band();
+		const int lowest_band = (int)m_bands.size() - 1;
+		const int clamped_priority = (std::min)((std::max)(priority, normal_band - lowest_band), normal_band);
+		return (size_t)(normal_band - clamped_priority);
+	}
+
+	bool empty() const noexcept { return m_size == 0; }
+	size_t size() const noexcept { return m_size; }
+
+	void push(T&& item, size_t band, std::chrono::steady_clock::time_point now) {
+		ASSERT(band < m_bands.size());
+		m_bands[band].items.push_back(_ENTRY{ std::move(item), now });
+		++m_size;
+	}
+
+	//从band 0至max_band（含）之中，按权重选取一个band出队，均为空时返回false
+	bool try_pop(T& item, std::chrono::steady_clock::time_point now, size_t max_band = size_t(-1)) {
+		if (m_size == 0)
+			return false;
+
+		const size_t last_band = (std::min)(max_band, m_bands.size() - 1);
+		_BAND* sel_band = nullptr;
+		int64_t total_weight = 0;
+		for (size_t band = 0; band <= last_band; ++band) {
+			_BAND& a_band = m_bands[band];
+			if (a_band.items.empty())
+				continue;
+			a_band.current_weight += a_band.weight;
+			total_weight += a_band.weight;
+			if (sel_band == nullptr || a_band.current_weight > sel_band->current_weight)
+				sel_band = &a_band;
+		}
+
+		if (sel_band == nullptr)
+			return false;
+
+		sel_band->current_weight -= total_weight;
+
+		_ENTRY& entry = sel_band->items.front();
+		const int64_t wait_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - entry.enqueue_time).count();
+		item = std::move(entry.item);
+		sel_band->items.pop_front();
+		--m_size;
+
+		if (sel_band->items.empty())
+			sel_band->current_weight = 0; //空band不保留余额，再次非空时从头计
+		++sel_band->dequeue_count;
+		sel_band->total_wait_ns += wait_ns;
+		if (wait_ns > sel_band->max_wait_ns)
+			sel_band->max_wait_ns = wait_ns;
+		return true;
+	}
+
+	template <class PRED>
+	bool any_of(PRED&& pred) const {
+		for (const _BAND& a_band : m_bands) {
+			for (const _ENTRY& entry : a_band.items) {
+				if (pred(entry.item))
+					return true;
+			}
+		}
+		return false;
+	}
+
+	//清空，各项所有权交予fn
+	template <class FN>
+	void clear(FN&& fn) {
+		for (_BAND& a_band : m_bands) {
+			for (_ENTRY& entry : a_band.items)
+				fn(std::move(entry.item));
+			a_band.items.clear();
+			a_band.current_weight = 0;
+		}
+		m_size = 0;
+	}
+
+	std::vector<ks_priority_band_stats> stats() const {
+		std::vector<ks_priority_band_stats> stats_seq(m_bands.size());
+		for (size_t band = 0; band < m_bands.size(); ++band) {
+			const _BAND& a_band = m_bands[band];
+			stats_seq[band].weight = a_band.weight;
+			stats_seq[band].queue_depth = a_band.items.size();
+			stats_seq[band].dequeue_count = a_band.dequeue_count;
+			stats_seq[band].total_wait_ns = a_band.total_wait_ns;
+			stats_seq[band].max_wait_ns = a_band.max_wait_ns;
+		}
+		return stats_seq;
+	}
+
+private:
+	struct _ENTRY {
+		T item;
+		std::chrono::steady_clock::time_point enqueue_time;
+	};
+
+	struct _BAND {
+		std::deque<_ENTRY> items;
+		uint32_t weight = 1; //const-like
+		int64_t current_weight = 0;
+		uint64_t dequeue_count = 0;
+		int64_t total_wait_ns = 0;
+		int64_t max_wait_ns = 0;
+	};
+
+	std::vector<_BAND> m_bands; //构造后不再增减（_BAND不可复制）
+	size_t m_size = 0;
+};
+
+
+#endif //__KS_PRIORITY_BAND_QUEUE_DEF
@@ -0,0 +1,303 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async/ktl Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#ifndef __KS_SLAB_POOL_DEF
+#define __KS_SLAB_POOL_DEF
+
+#include "ks_cxxbase.h"
+#include "ks_concurrency.h"
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <new>
+#include <vector>
+
+
+template <class T>
+class ks_slab_pool;
+
+template <class T>
+struct ks_slab_pool_deleter {
+	ks_slab_pool<T>* pool = nullptr;
+	void operator()(T* p) const noexcept;
+};
+
+//由ks_slab_pool分配的对象，独占所有权，析构时归还给pool
+template <class T>
+using ks_slab_ptr = std::unique_ptr<T, ks_slab_pool_deleter<T>>;
+
+struct ks_slab_pool_stats {
+	size_t slab_alloc_count = 0;     //向系统分配slab的次数（稳态下应不再增长）
+	size_t node_capacity = 0;        //已分配的节点总数
+	size_t central_fetch_count = 0;  //线程缓存从central批量取节点的次数
+	size_t central_return_count = 0; //线程缓存向central批量还节点的次数
+	size_t slab_trim_count = 0;      //经trim还给系统的slab数
+};
+
+
+//固定大小对象的slab池：节点按slab（一次分配多个）向系统申请，释放后回到空闲链表复用，
+//完全空闲的slab仅在trim时（或pool析构时）还给系统。
+//空闲节点分两层：
+//  central：由spinlock保护的空闲链表，任意线程均可存取；
+//  线程缓存：在thread_cache_scope期间，本线程对该pool的分配和释放优先走本线程的空闲链表（无锁），
+//            与central之间按batch批量交换。
+//通常由套间持有pool，并在其work线程内声明thread_cache_scope；其他线程的分配和释放直接走central。
+//work线程退出时（thread_cache_scope指定trim_on_exit）trim，以免一次突发长期占住其峰值内存。
+//注：pool须在其分配的全部对象析构之后再析构。
+template <class T>
+class ks_slab_pool {
+private:
+	union _NODE {
+		_NODE* next;
+		std::aligned_storage_t<sizeof(T), alignof(T)> storage;
+	};
+
+	struct _SLAB_DELETER {
+		void operator()(void* slab) const noexcept { ::operator delete(slab); }
+	};
+
+	struct _THREAD_CACHE {
+		ks_slab_pool* pool = nullptr;
+		_NODE* head = nullptr;
+		_NODE* tail = nullptr;
+		size_t count = 0;
+	};
+
+	static thread_local _THREAD_CACHE* tls_cache;
+
+public:
+	explicit ks_slab_pool(size_t slab_node_count = 64, size_t batch_node_count = 32)
+		: m_slab_node_count(slab_node_count >= 1 ? slab_node_count : 1)
+		, m_batch_node_count(batch_node_count >= 1 ? batch_node_count : 1) {
+	}
+
+	~ks_slab_pool() {
+		ASSERT(tls_cache == nullptr || tls_cache->pool != this);
+		for (void* slab : m_slabs)
+			::operator delete(slab);
+	}
+
+	_DISABLE_COPY_CONSTRUCTOR(ks_slab_pool);
+
+public:
+	template <class... ARGS>
+	ks_slab_ptr<T> make(ARGS&&... args) {
+		_NODE* node = this->__alloc_node();
+		try {
+			T* p = ::new ((void*)&node->storage) T(std::forward<ARGS>(args)...);
+			return ks_slab_ptr<T>(p, ks_slab_pool_deleter<T>{ this });
+		}
+		catch (...) {
+			this->__free_node(node);
+			throw;
+		}
+	}
+
+	ks_slab_pool_stats stats() {
+		std::unique_lock<ks_spinlock> lock(m_spinlock);
+		return m_stats;
+	}
+
+	//将完全空闲（其节点全在central中）的slab还给系统，返回还回的slab数
+	//注：线程缓存中的节点不算空闲，故宜在线程缓存归还之后调用
+	size_t trim() {
+		std::unique_lock<ks_spinlock> lock(m_spinlock);
+		if (m_free_head == nullptr)
+			return 0;
+
+		std::sort(m_slabs.begin(), m_slabs.end(), std::less<void*>());
+		std::vector<size_t> free_counts(m_slabs.size(), 0);
+		for (_NODE* node = m_free_head; node != nullptr; node = node->next)
+			++free_counts[this->__find_slab_index_locked(node)];
+
+		//摘除完全空闲的slab的节点
+		_NODE* kept_head = nullptr;
+		_NODE** kept_link = &kept_head;
+		for (_NODE* node = m_free_head; node != nullptr; node = node->next) {
+			if (free_counts[this->__find_slab_index_locked(node)] != m_slab_node_count) {
+				*kept_link = node;
+				kept_link = &node->next;
+			}
+		}
+		*kept_link = nullptr;
+		m_free_head = kept_head;
+
+		//完全空闲的slab移至尾部，解锁后释放
+		size_t kept_count = 0;
+		for (size_t i = 0; i < m_slabs.size(); ++i) {
+			if (free_counts[i] != m_slab_node_count)
+				std::swap(m_slabs[kept_count++], m_slabs[i]);
+		}
+		std::vector<void*> trimmed_slabs(m_slabs.begin() + kept_count, m_slabs.end());
+		m_slabs.resize(kept_count);
+		m_stats.slab_trim_count += trimmed_slabs.size();
+		m_stats.node_capacity -= trimmed_slabs.size() * m_slab_node_count;
+		lock.unlock();
+
+		for (void* slab : trimmed_slabs)
+			::operator delete(slab);
+		return trimmed_slabs.size();
+	}
+
+	//线程缓存作用域，析构时将缓存的节点全部还给central（若trim_on_exit，随即trim）
+	class thread_cache_scope {
+	public:
+		explicit thread_cache_scope(ks_slab_pool* pool, bool trim_on_exit = false) : m_prev_cache(tls_cache), m_trim_on_exit(trim_on_exit) {
+			m_cache.pool = pool;
+			tls_cache = &m_cache;
+		}
+
+		~thread_cache_scope() {
+			ASSERT(tls_cache == &m_cache);
+			if (m_cache.head != nullptr)
+				m_cache.pool->__return_to_central(m_cache.head, m_cache.tail, true);
+			tls_cache = m_prev_cache;
+			if (m_trim_on_exit)
+				m_cache.pool->trim();
+		}
+
+		_DISABLE_COPY_CONSTRUCTOR(thread_cache_scope);
+
+	private:
+		_THREAD_CACHE m_cache;
+		_THREAD_CACHE* m_prev_cache;
+		bool m_trim_on_exit;
+	};
+
+public:
+	void __delete(T* p) noexcept {
+		p->~T();
+		this->__free_node(reinterpret_cast<_NODE*>(p));
+	}
+
+private:
+	_NODE* __alloc_node() {
+		_THREAD_CACHE* cache = tls_cache;
+		if (cache != nullptr && cache->pool == this) {
+			if (cache->head == nullptr) {
+				cache->head = this->__fetch_from_central(m_batch_node_count, &cache->tail, &cache->count);
+			}
+
+			_NODE* node = cache->head;
+			cache->head = node->next;
+			if (--cache->count == 0)
+				cache->tail = nullptr;
+			return node;
+		}
+
+		_NODE* tail;
+		size_t count;
+		return this->__fetch_from_central(1, &tail, &count);
+	}
+
+	void __free_node(_NODE* node) noexcept {
+		_THREAD_CACHE* cache = tls_cache;
+		if (cache != nullptr && cache->pool == this) {
+			node->next = cache->head;
+			cache->head = node;
+			if (cache->count++ == 0)
+				cache->tail = node;
+
+			//缓存过多时，将前batch个节点还给central（留下的仍不少于batch个，以免在边界上来回交换）
+			if (cache->count > m_batch_node_count * 2) {
+				_NODE* batch_head = cache->head;
+				_NODE* batch_tail = batch_head;
+				for (size_t i = 1; i < m_batch_node_count; ++i)
+					batch_tail = batch_tail->next;
+				cache->head = batch_tail->next;
+				cache->count -= m_batch_node_count;
+				this->__return_to_central(batch_head, batch_tail, true);
+			}
+			return;
+		}
+
+		this->__return_to_central(node, node, false);
+	}
+
+	//从central取至多max_count个节点（central为空时新分配一个slab），返回链表头（非空）
+	_NODE* __fetch_from_central(size_t max_count, _NODE** tail, size_t* count) {
+		std::unique_lock<ks_spinlock> lock(m_spinlock);
+		if (max_count > 1)
+			++m_stats.central_fetch_count;
+
+		if (m_free_head == nullptr) {
+			lock.unlock();
+			std::unique_ptr<void, _SLAB_DELETER> slab_holder(::operator new(sizeof(_NODE) * m_slab_node_count));
+			_NODE* slab = static_cast<_NODE*>(slab_holder.get());
+			for (size_t i = 0; i + 1 < m_slab_node_count; ++i)
+				slab[i].next = &slab[i + 1];
+			slab[m_slab_node_count - 1].next = nullptr;
+
+			lock.lock();
+			m_slabs.push_back(slab); //若抛出，slab由slab_holder释放
+			slab_holder.release();
+			++m_stats.slab_alloc_count;
+			m_stats.node_capacity += m_slab_node_count;
+			slab[m_slab_node_count - 1].next = m_free_head;
+			m_free_head = slab;
+		}
+
+		_NODE* head = m_free_head;
+		_NODE* last = head;
+		size_t n = 1;
+		while (n < max_count && last->next != nullptr) {
+			last = last->next;
+			++n;
+		}
+		m_free_head = last->next;
+		last->next = nullptr;
+
+		*tail = last;
+		*count = n;
+		return head;
+	}
+
+	//m_slabs须已排序
+	size_t __find_slab_index_locked(_NODE* node) const noexcept {
+		auto slab_it = std::upper_bound(m_slabs.cbegin(), m_slabs.cend(), (void*)node, std::less<void*>());
+		ASSERT(slab_it != m_slabs.cbegin());
+		return size_t(slab_it - m_slabs.cbegin()) - 1;
+	}
+
+	void __return_to_central(_NODE* head, _NODE* tail, bool from_cache) noexcept {
+		std::unique_lock<ks_spinlock> lock(m_spinlock);
+		if (from_cache)
+			++m_stats.central_return_count;
+		tail->next = m_free_head;
+		m_free_head = head;
+	}
+
+private:
+	const size_t m_slab_node_count;
+	const size_t m_batch_node_count;
+
+	ks_spinlock m_spinlock;
+	_NODE* m_free_head = nullptr;
+	std::vector<void*> m_slabs;
+	ks_slab_pool_stats m_stats;
+};
+
+template <class T>
+thread_local typename ks_slab_pool<T>::_THREAD_CACHE* ks_slab_pool<T>::tls_cache = nullptr;
+
+template <class T>
+void ks_slab_pool_deleter<T>::operator()(T* p) const noexcept {
+	pool->__delete(p);
+}
+
+
+#endif //__KS_SLAB_POOL_DEF
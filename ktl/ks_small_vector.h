@@ -0,0 +1,196 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async/ktl Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#ifndef __KS_SMALL_VECTOR_DEF
+#define __KS_SMALL_VECTOR_DEF
+
+#include "ks_cxxbase.h"
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+//带内联存储的顺序容器：元素数不超过N时存放于对象内部，不做堆分配；超出后才迁移至堆上（按倍数扩容）。
+//适用于通常只有很少几项、偶尔较多的场合（如future的下游列表）。
+//注：仅提供尾部增删及遍历；移动构造/赋值时，内联存储的元素逐一移动，堆存储则直接接管。
+template <class T, size_t N>
+class ks_small_vector {
+	static_assert(N > 0, "N must be positive");
+
+public:
+	using value_type = T;
+	using iterator = T*;
+	using const_iterator = const T*;
+
+	ks_small_vector() noexcept {}
+
+	ks_small_vector(ks_small_vector&& other) noexcept {
+		this->__move_from(other);
+	}
+
+	ks_small_vector& operator=(ks_small_vector&& other) noexcept {
+		if (this != &other) {
+			this->__destroy_all();
+			this->__move_from(other);
+		}
+		return *this;
+	}
+
+	ks_small_vector(const ks_small_vector& other) {
+		this->reserve(other.m_size);
+		for (const T& item : other)
+			this->push_back(item);
+	}
+
+	ks_small_vector& operator=(const ks_small_vector& other) {
+		if (this != &other) {
+			this->clear();
+			this->reserve(other.m_size);
+			for (const T& item : other)
+				this->push_back(item);
+		}
+		return *this;
+	}
+
+	~ks_small_vector() {
+		this->__destroy_all();
+	}
+
+public:
+	size_t size() const noexcept { return m_size; }
+	size_t capacity() const noexcept { return m_capacity; }
+	bool empty() const noexcept { return m_size == 0; }
+
+	//是否仍使用内联存储（即未发生堆分配）
+	bool is_inline() const noexcept { return m_data == __inline_data(); }
+
+	T* data() noexcept { return m_data; }
+	const T* data() const noexcept { return m_data; }
+
+	iterator begin() noexcept { return m_data; }
+	iterator end() noexcept { return m_data + m_size; }
+	const_iterator begin() const noexcept { return m_data; }
+	const_iterator end() const noexcept { return m_data + m_size; }
+	const_iterator cbegin() const noexcept { return m_data; }
+	const_iterator cend() const noexcept { return m_data + m_size; }
+
+	T& operator[](size_t index) noexcept { ASSERT(index < m_size); return m_data[index]; }
+	const T& operator[](size_t index) const noexcept { ASSERT(index < m_size); return m_data[index]; }
+
+	T& front() noexcept { ASSERT(m_size != 0); return m_data[0]; }
+	T& back() noexcept { ASSERT(m_size != 0); return m_data[m_size - 1]; }
+
+public:
+	void push_back(const T& item) {
+		this->emplace_back(item);
+	}
+
+	void push_back(T&& item) {
+		this->emplace_back(std::move(item));
+	}
+
+	template <class... ARGs>
+	T& emplace_back(ARGs&&... args) {
+		if (m_size == m_capacity)
+			this->__grow(m_capacity * 2);
+		T* p = ::new ((void*)(m_data + m_size)) T(std::forward<ARGs>(args)...);
+		++m_size;
+		return *p;
+	}
+
+	template <class IT>
+	void append(IT first, IT last) {
+		for (IT it = first; it != last; ++it)
+			this->emplace_back(*it);
+	}
+
+	void pop_back() noexcept {
+		ASSERT(m_size != 0);
+		m_data[--m_size].~T();
+	}
+
+	//清除所有元素，但保留已有存储（不同于std::vector的shrink_to_fit，不会释放后再分配）
+	void clear() noexcept {
+		for (size_t i = 0; i < m_size; ++i)
+			m_data[i].~T();
+		m_size = 0;
+	}
+
+	void reserve(size_t capacity) {
+		if (capacity > m_capacity)
+			this->__grow(capacity);
+	}
+
+	void swap(ks_small_vector& other) noexcept {
+		ks_small_vector t(std::move(other));
+		other = std::move(*this);
+		*this = std::move(t);
+	}
+
+private:
+	T* __inline_data() noexcept { return reinterpret_cast<T*>(&m_inline_storage); }
+	const T* __inline_data() const noexcept { return reinterpret_cast<const T*>(&m_inline_storage); }
+
+	void __grow(size_t new_capacity) {
+		ASSERT(new_capacity > m_capacity);
+		T* new_data = static_cast<T*>(::operator new(sizeof(T) * new_capacity));
+		for (size_t i = 0; i < m_size; ++i) {
+			::new ((void*)(new_data + i)) T(std::move(m_data[i]));
+			m_data[i].~T();
+		}
+		if (!this->is_inline())
+			::operator delete(m_data);
+		m_data = new_data;
+		m_capacity = new_capacity;
+	}
+
+	void __destroy_all() noexcept {
+		this->clear();
+		if (!this->is_inline())
+			::operator delete(m_data);
+		m_data = __inline_data();
+		m_capacity = N;
+	}
+
+	void __move_from(ks_small_vector& other) noexcept {
+		ASSERT(m_size == 0 && this->is_inline());
+		if (other.is_inline()) {
+			for (size_t i = 0; i < other.m_size; ++i)
+				::new ((void*)(m_data + i)) T(std::move(other.m_data[i]));
+			m_size = other.m_size;
+			other.clear();
+		}
+		else {
+			m_data = other.m_data;
+			m_size = other.m_size;
+			m_capacity = other.m_capacity;
+			other.m_data = other.__inline_data();
+			other.m_size = 0;
+			other.m_capacity = N;
+		}
+	}
+
+private:
+	T* m_data = __inline_data();
+	size_t m_size = 0;
+	size_t m_capacity = N;
+	std::aligned_storage_t<sizeof(T) * N, alignof(T)> m_inline_storage;
+};
+
+
+#endif //__KS_SMALL_VECTOR_DEF
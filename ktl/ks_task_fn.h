@@ -0,0 +1,198 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async/ktl Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#ifndef __KS_TASK_FN_DEF
+#define __KS_TASK_FN_DEF
+
+#include "ks_cxxbase.h"
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+//只可移动（move-only）的void()任务函数对象，带有小对象缓冲（small-buffer）。
+//与std::function<void()>相比：
+//1、不要求fn可复制，故可捕获unique_ptr等只可移动的对象；
+//2、内联容量更大（足以容纳库内部各continuation-lambda），容量之内不再额外分配内存。
+//超出内联容量（或移动构造可能抛异常）的fn则退化为堆分配。
+class ks_task_fn {
+public:
+	static constexpr size_t inline_capacity = 128; //足以容纳ks_raw_future中各continuation-lambda
+
+	ks_task_fn() noexcept {}
+	ks_task_fn(std::nullptr_t) noexcept {}
+
+	template <class FN, class _ = std::enable_if_t<
+		!std::is_same<std::decay_t<FN>, ks_task_fn>::value && !std::is_same<std::decay_t<FN>, std::nullptr_t>::value,
+		decltype(std::declval<std::decay_t<FN>&>()())>>
+	explicit ks_task_fn(FN&& fn) {
+		this->__init(std::forward<FN>(fn));
+	}
+
+	ks_task_fn(ks_task_fn&& other) noexcept {
+		this->__move_from(other);
+	}
+
+	ks_task_fn& operator=(ks_task_fn&& other) noexcept {
+		if (this != &other) {
+			this->reset();
+			this->__move_from(other);
+		}
+		return *this;
+	}
+
+	ks_task_fn& operator=(std::nullptr_t) noexcept {
+		this->reset();
+		return *this;
+	}
+
+	ks_task_fn(const ks_task_fn&) = delete;
+	ks_task_fn& operator=(const ks_task_fn&) = delete;
+
+	~ks_task_fn() {
+		this->reset();
+	}
+
+public:
+	explicit operator bool() const noexcept {
+		return m_vtable != nullptr;
+	}
+
+	void operator()() {
+		if (m_vtable == nullptr)
+			throw std::bad_function_call();
+		m_vtable->invoke(&m_storage);
+	}
+
+	void reset() noexcept {
+		if (m_vtable != nullptr) {
+			const _VTABLE* vtable = m_vtable;
+			m_vtable = nullptr;
+			vtable->destroy(&m_storage);
+		}
+	}
+
+	void swap(ks_task_fn& other) noexcept {
+		ks_task_fn t(std::move(other));
+		other = std::move(*this);
+		*this = std::move(t);
+	}
+
+	//是否内联存储（即未发生堆分配）
+	bool is_inline() const noexcept {
+		return m_vtable != nullptr && m_vtable->is_inline;
+	}
+
+private:
+	using _STORAGE = std::aligned_storage_t<inline_capacity, alignof(std::max_align_t)>;
+
+	struct _VTABLE {
+		void (*invoke)(_STORAGE* storage);
+		void (*move_destroy)(_STORAGE* dst, _STORAGE* src) noexcept; //移至dst并析构src
+		void (*destroy)(_STORAGE* storage) noexcept;
+		bool is_inline;
+	};
+
+	template <class FN>
+	struct _INLINE_IMP {
+		static void invoke(_STORAGE* storage) {
+			(*reinterpret_cast<FN*>(storage))();
+		}
+		static void move_destroy(_STORAGE* dst, _STORAGE* src) noexcept {
+			FN* src_fn = reinterpret_cast<FN*>(src);
+			::new ((void*)dst) FN(std::move(*src_fn));
+			src_fn->~FN();
+		}
+		static void destroy(_STORAGE* storage) noexcept {
+			reinterpret_cast<FN*>(storage)->~FN();
+		}
+		static const _VTABLE vtable;
+	};
+
+	template <class FN>
+	struct _HEAP_IMP {
+		static void invoke(_STORAGE* storage) {
+			(**reinterpret_cast<FN**>(storage))();
+		}
+		static void move_destroy(_STORAGE* dst, _STORAGE* src) noexcept {
+			*reinterpret_cast<FN**>(dst) = *reinterpret_cast<FN**>(src);
+		}
+		static void destroy(_STORAGE* storage) noexcept {
+			delete *reinterpret_cast<FN**>(storage);
+		}
+		static const _VTABLE vtable;
+	};
+
+	template <class FN>
+	using __is_inlinable = std::integral_constant<bool,
+		sizeof(FN) <= inline_capacity && alignof(std::max_align_t) % alignof(FN) == 0 && std::is_nothrow_move_constructible<FN>::value>;
+
+	template <class FN>
+	static bool __is_null_fn(const FN& fn, std::true_type) noexcept { return !fn; }
+	template <class FN>
+	static bool __is_null_fn(const FN& fn, std::false_type) noexcept { return false; }
+	template <class FN>
+	static bool __is_null_fn(const FN& fn) noexcept {
+		//空的std::function或空函数指针，视为空ks_task_fn
+		return __is_null_fn(fn, std::integral_constant<bool,
+			std::is_pointer<FN>::value || std::is_member_pointer<FN>::value || std::is_same<FN, std::function<void()>>::value>());
+	}
+
+	template <class X>
+	void __init(X&& x) {
+		using FN = std::decay_t<X>;
+		if (__is_null_fn(x))
+			return;
+		this->__init_imp<FN>(std::forward<X>(x), __is_inlinable<FN>());
+	}
+
+	template <class FN, class X>
+	void __init_imp(X&& x, std::true_type) {
+		::new ((void*)&m_storage) FN(std::forward<X>(x));
+		m_vtable = &_INLINE_IMP<FN>::vtable;
+	}
+
+	template <class FN, class X>
+	void __init_imp(X&& x, std::false_type) {
+		*reinterpret_cast<FN**>(&m_storage) = new FN(std::forward<X>(x));
+		m_vtable = &_HEAP_IMP<FN>::vtable;
+	}
+
+	void __move_from(ks_task_fn& other) noexcept {
+		if (other.m_vtable != nullptr) {
+			other.m_vtable->move_destroy(&m_storage, &other.m_storage);
+			m_vtable = other.m_vtable;
+			other.m_vtable = nullptr;
+		}
+	}
+
+private:
+	const _VTABLE* m_vtable = nullptr;
+	_STORAGE m_storage;
+};
+
+template <class FN>
+const ks_task_fn::_VTABLE ks_task_fn::_INLINE_IMP<FN>::vtable = {
+	&ks_task_fn::_INLINE_IMP<FN>::invoke, &ks_task_fn::_INLINE_IMP<FN>::move_destroy, &ks_task_fn::_INLINE_IMP<FN>::destroy, true };
+
+template <class FN>
+const ks_task_fn::_VTABLE ks_task_fn::_HEAP_IMP<FN>::vtable = {
+	&ks_task_fn::_HEAP_IMP<FN>::invoke, &ks_task_fn::_HEAP_IMP<FN>::move_destroy, &ks_task_fn::_HEAP_IMP<FN>::destroy, false };
+
+
+#endif //__KS_TASK_FN_DEF
@@ -0,0 +1,357 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async/ktl Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#ifndef __KS_TIMER_WHEEL_DEF
+#define __KS_TIMER_WHEEL_DEF
+
+#include "ks_cxxbase.h"
+#include <chrono>
+#include <memory>
+
+
+template <class ITEM, class HOLDER>
+class ks_timer_wheel;
+
+//ks_timer_wheel的侵入式挂钩，ITEM须以其为基类
+//HOLDER为ITEM的所有权类型（shared_ptr或unique_ptr等），挂入期间由wheel持有
+template <class ITEM, class HOLDER = std::shared_ptr<ITEM>>
+struct ks_timer_wheel_hook {
+private:
+	friend class ks_timer_wheel<ITEM, HOLDER>;
+
+	ks_timer_wheel_hook* __tw_prev = nullptr;
+	ks_timer_wheel_hook* __tw_next = nullptr;
+	uint64_t __tw_expire_tick = 0;
+	int __tw_level = -1; //-1表示未挂入
+	HOLDER __tw_holder; //挂入期间由wheel持有
+
+public:
+	bool is_in_timer_wheel() const noexcept { return __tw_level != -1; }
+};
+
+
+//分层时间轮（类似linux内核的timer-wheel），精度为1ms（到期时点向上取整，故不会提前到期）
+//  level0: 256槽，每槽1tick
+//  level1~3: 各64槽，每槽分别为2^8、2^14、2^20 tick
+//  超出2^26 tick（约18.6小时）的项放入overflow链表，待最高层轮转一周时重新安置
+//插入和删除均为O(1)，到期项按tick先后弹出（同一tick内按插入先后）。
+//注：非线程安全，由使用者加锁保护。
+template <class ITEM, class HOLDER = std::shared_ptr<ITEM>>
+class ks_timer_wheel {
+	using _HOOK = ks_timer_wheel_hook<ITEM, HOLDER>;
+
+public:
+	using time_point = std::chrono::steady_clock::time_point;
+
+	explicit ks_timer_wheel(time_point base_time = std::chrono::steady_clock::now()) : m_base_time(base_time) {
+		for (auto& head : m_ready_head) __init_head(&head);
+		for (auto& head : m_level0_heads) __init_head(&head);
+		for (auto& level_heads : m_upper_level_heads) {
+			for (auto& head : level_heads) __init_head(&head);
+		}
+		__init_head(&m_overflow_head[0]);
+	}
+
+	~ks_timer_wheel() {
+		this->clear([](HOLDER&&) {});
+	}
+
+	_DISABLE_COPY_CONSTRUCTOR(ks_timer_wheel);
+
+public:
+	bool empty() const noexcept { return m_total_count == 0; }
+	size_t size() const noexcept { return m_total_count; }
+
+	//插入，O(1)
+	void insert(HOLDER&& item, time_point until_time) {
+		ASSERT(item != nullptr);
+		_HOOK* hook = static_cast<_HOOK*>(item.get());
+		ASSERT(!hook->is_in_timer_wheel());
+
+		hook->__tw_expire_tick = __time_to_tick_ceil(until_time);
+		hook->__tw_holder = std::move(item);
+		this->__place(hook);
+		++m_total_count;
+	}
+
+	//删除指定项，O(1)，返回其所有权
+	HOLDER erase(ITEM* item) {
+		_HOOK* hook = static_cast<_HOOK*>(item);
+		if (hook == nullptr || !hook->is_in_timer_wheel())
+			return nullptr;
+
+		this->__unlink(hook);
+		--m_total_count;
+		return std::move(hook->__tw_holder);
+	}
+
+	//弹出所有截至now已到期的项，按到期先后依次回调fn(HOLDER&&)，返回弹出的项数
+	template <class FN>
+	size_t pop_expired(time_point now, FN&& fn) {
+		size_t popped_count = 0;
+		popped_count += this->__pop_list(&m_ready_head[0], fn);
+
+		const uint64_t now_tick = __time_to_tick_floor(now);
+		while (m_cur_tick <= now_tick) {
+			if (m_total_count == 0) {
+				m_cur_tick = now_tick + 1;
+				break;
+			}
+
+			const size_t index0 = size_t(m_cur_tick & _LEVEL0_MASK);
+			if (index0 == 0)
+				this->__cascade();
+
+			popped_count += this->__pop_list(&m_level0_heads[index0], fn);
+
+			//快进：若低层均已空，则直接跳至下一个需要cascade的边界
+			uint64_t next_tick = m_cur_tick + 1;
+			if (m_level_counts[0] == 0) {
+				int level = 0;
+				while (level < _UPPER_LEVEL_COUNT && m_level_counts[level] == 0)
+					++level;
+				const int shift = (level == 0) ? 0 : _LEVEL0_BITS + _UPPER_LEVEL_BITS * (level - 1);
+				next_tick = ((m_cur_tick >> shift) + 1) << shift;
+			}
+			m_cur_tick = next_tick <= now_tick + 1 ? next_tick : now_tick + 1;
+		}
+
+		return popped_count;
+	}
+
+	//最近的到期时点（可能早于真实的最近到期时点，但绝不会晚于；空时返回time_point::max()）
+	time_point next_expire_time() const {
+		if (m_total_count == 0)
+			return time_point::max();
+		if (m_ready_head[0].__tw_next != &m_ready_head[0])
+			return m_base_time + std::chrono::milliseconds(m_cur_tick - 1); //已到期（m_cur_tick必>0）
+
+		uint64_t next_tick = uint64_t(-1);
+		if (m_level_counts[0] != 0) {
+			for (uint64_t j = 0; j <= _LEVEL0_MASK; ++j) {
+				const _HOOK* head = &m_level0_heads[(m_cur_tick + j) & _LEVEL0_MASK];
+				if (head->__tw_next != head) {
+					next_tick = m_cur_tick + j;
+					break;
+				}
+			}
+		}
+		for (int level = 1; level <= _UPPER_LEVEL_COUNT; ++level) {
+			if (m_level_counts[level] == 0)
+				continue;
+			const int shift = _LEVEL0_BITS + _UPPER_LEVEL_BITS * (level - 1);
+			for (uint64_t j = 1; j <= _UPPER_LEVEL_MASK + 1; ++j) {
+				const _HOOK* head = &m_upper_level_heads[level - 1][((m_cur_tick >> shift) + j) & _UPPER_LEVEL_MASK];
+				if (head->__tw_next != head) {
+					const uint64_t boundary_tick = ((m_cur_tick >> shift) + j) << shift; //cascade时点
+					if (boundary_tick < next_tick)
+						next_tick = boundary_tick;
+					break;
+				}
+			}
+		}
+		if (m_overflow_head[0].__tw_next != &m_overflow_head[0]) {
+			const uint64_t boundary_tick = ((m_cur_tick >> _TOTAL_BITS) + 1) << _TOTAL_BITS;
+			if (boundary_tick < next_tick)
+				next_tick = boundary_tick;
+		}
+
+		ASSERT(next_tick != uint64_t(-1));
+		return m_base_time + std::chrono::milliseconds(next_tick);
+	}
+
+	//查找（线性，仅用于调试或非热点路径）
+	template <class PRED>
+	ITEM* find_if(PRED&& pred) const {
+		ITEM* found = nullptr;
+		this->__for_each_head([&pred, &found](const _HOOK* head) -> bool {
+			for (_HOOK* hook = head->__tw_next; hook != head; hook = hook->__tw_next) {
+				if (pred(static_cast<const ITEM*>(hook))) {
+					found = static_cast<ITEM*>(hook);
+					return false;
+				}
+			}
+			return true;
+		});
+		return found;
+	}
+
+	//清空，依次回调fn(HOLDER&&)交出所有权
+	template <class FN>
+	void clear(FN&& fn) {
+		this->__for_each_head([this, &fn](const _HOOK* head) -> bool {
+			this->__pop_list(const_cast<_HOOK*>(head), fn);
+			return true;
+		});
+		ASSERT(m_total_count == 0);
+	}
+
+private:
+	static constexpr int _LEVEL0_BITS = 8;
+	static constexpr int _UPPER_LEVEL_BITS = 6;
+	static constexpr int _UPPER_LEVEL_COUNT = 3;
+	static constexpr int _TOTAL_BITS = _LEVEL0_BITS + _UPPER_LEVEL_BITS * _UPPER_LEVEL_COUNT;
+	static constexpr uint64_t _LEVEL0_MASK = (uint64_t(1) << _LEVEL0_BITS) - 1;
+	static constexpr uint64_t _UPPER_LEVEL_MASK = (uint64_t(1) << _UPPER_LEVEL_BITS) - 1;
+	static constexpr int _READY_LEVEL = _UPPER_LEVEL_COUNT + 1;
+	static constexpr int _OVERFLOW_LEVEL = _UPPER_LEVEL_COUNT + 2;
+
+	static void __init_head(_HOOK* head) noexcept {
+		head->__tw_prev = head;
+		head->__tw_next = head;
+	}
+
+	uint64_t __time_to_tick_floor(time_point t) const noexcept {
+		if (t <= m_base_time)
+			return 0;
+		return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(t - m_base_time).count();
+	}
+
+	uint64_t __time_to_tick_ceil(time_point t) const noexcept {
+		if (t <= m_base_time)
+			return 0;
+		const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t - m_base_time).count();
+		return (uint64_t)((ns + 999999) / 1000000);
+	}
+
+	void __place(_HOOK* hook) {
+		const uint64_t expire_tick = hook->__tw_expire_tick;
+		_HOOK* head;
+		int level;
+		if (expire_tick < m_cur_tick) {
+			//已到期（其tick已被处理过），放入ready链表，下次pop_expired时立即弹出
+			head = &m_ready_head[0];
+			level = _READY_LEVEL;
+		}
+		else {
+			const uint64_t delta = expire_tick - m_cur_tick;
+			if (delta <= _LEVEL0_MASK) {
+				head = &m_level0_heads[expire_tick & _LEVEL0_MASK];
+				level = 0;
+			}
+			else if (delta < (uint64_t(1) << _TOTAL_BITS)) {
+				level = 1;
+				while (delta >= (uint64_t(1) << (_LEVEL0_BITS + _UPPER_LEVEL_BITS * level)))
+					++level;
+				const int shift = _LEVEL0_BITS + _UPPER_LEVEL_BITS * (level - 1);
+				head = &m_upper_level_heads[level - 1][(expire_tick >> shift) & _UPPER_LEVEL_MASK];
+			}
+			else {
+				head = &m_overflow_head[0];
+				level = _OVERFLOW_LEVEL;
+			}
+		}
+
+		//append to tail
+		hook->__tw_prev = head->__tw_prev;
+		hook->__tw_next = head;
+		head->__tw_prev->__tw_next = hook;
+		head->__tw_prev = hook;
+		hook->__tw_level = level;
+		if (level <= _UPPER_LEVEL_COUNT)
+			++m_level_counts[level];
+	}
+
+	void __unlink(_HOOK* hook) noexcept {
+		ASSERT(hook->is_in_timer_wheel());
+		hook->__tw_prev->__tw_next = hook->__tw_next;
+		hook->__tw_next->__tw_prev = hook->__tw_prev;
+		hook->__tw_prev = nullptr;
+		hook->__tw_next = nullptr;
+		if (hook->__tw_level <= _UPPER_LEVEL_COUNT)
+			--m_level_counts[hook->__tw_level];
+		hook->__tw_level = -1;
+	}
+
+	template <class FN>
+	size_t __pop_list(_HOOK* head, FN& fn) {
+		size_t popped_count = 0;
+		while (head->__tw_next != head) {
+			_HOOK* hook = head->__tw_next;
+			this->__unlink(hook);
+			--m_total_count;
+			++popped_count;
+			fn(std::move(hook->__tw_holder));
+		}
+		return popped_count;
+	}
+
+	//将上层当前槽中的项重新安置到下层（于level0轮转至0号槽时进行）
+	void __cascade() {
+		ASSERT((m_cur_tick & _LEVEL0_MASK) == 0);
+		for (int level = 1; level <= _UPPER_LEVEL_COUNT; ++level) {
+			const int shift = _LEVEL0_BITS + _UPPER_LEVEL_BITS * (level - 1);
+			const size_t index = size_t((m_cur_tick >> shift) & _UPPER_LEVEL_MASK);
+			this->__replace_list(&m_upper_level_heads[level - 1][index]);
+			if (index != 0)
+				return;
+		}
+
+		//最高层也轮转了一周，重新安置overflow项
+		this->__replace_list(&m_overflow_head[0]);
+	}
+
+	void __replace_list(_HOOK* head) {
+		_HOOK t_head;
+		__init_head(&t_head);
+		if (head->__tw_next != head) {
+			//将整条链表移至t_head，再逐个重新安置
+			t_head.__tw_next = head->__tw_next;
+			t_head.__tw_prev = head->__tw_prev;
+			t_head.__tw_next->__tw_prev = &t_head;
+			t_head.__tw_prev->__tw_next = &t_head;
+			__init_head(head);
+		}
+		while (t_head.__tw_next != &t_head) {
+			_HOOK* hook = t_head.__tw_next;
+			const int old_level = hook->__tw_level;
+			t_head.__tw_next = hook->__tw_next;
+			hook->__tw_next->__tw_prev = &t_head;
+			if (old_level <= _UPPER_LEVEL_COUNT)
+				--m_level_counts[old_level];
+			this->__place(hook);
+		}
+	}
+
+	template <class FN>
+	void __for_each_head(FN&& fn) const {
+		if (!fn(&m_ready_head[0])) return;
+		for (auto& head : m_level0_heads) {
+			if (!fn(&head)) return;
+		}
+		for (auto& level_heads : m_upper_level_heads) {
+			for (auto& head : level_heads) {
+				if (!fn(&head)) return;
+			}
+		}
+		if (!fn(&m_overflow_head[0])) return;
+	}
+
+private:
+	const time_point m_base_time;
+	uint64_t m_cur_tick = 0; //下一个待处理的tick（此前的tick均已处理）
+	size_t m_total_count = 0;
+	size_t m_level_counts[_UPPER_LEVEL_COUNT + 1] = {};
+
+	_HOOK m_ready_head[1];
+	_HOOK m_level0_heads[_LEVEL0_MASK + 1];
+	_HOOK m_upper_level_heads[_UPPER_LEVEL_COUNT][_UPPER_LEVEL_MASK + 1];
+	_HOOK m_overflow_head[1];
+};
+
+
+#endif //__KS_TIMER_WHEEL_DEF
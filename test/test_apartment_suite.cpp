@@ -0,0 +1,1228 @@
+﻿/* Copyright 2024 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "test_base.h"
+#include "../ks_thread_pool_apartment_imp.h"
+#include "../ks_single_thread_apartment_imp.h"
+#include "../ks_strand_apartment_imp.h"
+#include "../ks_inline_apartment_imp.h"
+#include "../ks_manual_apartment_imp.h"
+#include "../ks_apartment_group.h"
+#include "../ks_epoll_apartment_imp.h"
+#include "../ks_file_io_service.h"
+
+TEST(test_apartment_suite, test_work_stealing) {
+    ks_thread_pool_apartment_imp apartment_imp("test_ws_mta", 4, ks_thread_pool_apartment_imp::work_stealing_flag);
+    ks_apartment* apartment = &apartment_imp;
+    apartment->start();
+
+    ks_waitgroup work_wg(0);
+    std::atomic<int> counter = { 0 };
+
+    //在work线程内扇出任务（进入局部队列，由其他线程窃取）
+    std::function<void(int)> fan_out_fn;
+    fan_out_fn = [&](int depth) {
+        ++counter;
+        if (depth < 6) {
+            for (int i = 0; i < 3; ++i) {
+                work_wg.add(1);
+                apartment->schedule([&, depth]() { fan_out_fn(depth + 1); work_wg.done(); }, 0);
+            }
+        }
+    };
+
+    work_wg.add(1);
+    apartment->schedule([&]() { fan_out_fn(0); work_wg.done(); }, 0);
+    work_wg.wait();
+    EXPECT_EQ(counter.load(), (int)((729 * 3 - 1) / 2)); //1+3+...+3^6
+
+    //高优先、低优先、延时任务照常
+    std::atomic<int> other_counter = { 0 };
+    work_wg.add(3);
+    apartment->schedule([&]() {
+        apartment->schedule([&]() { ++other_counter; work_wg.done(); }, 1);
+        apartment->schedule([&]() { ++other_counter; work_wg.done(); }, -1);
+        apartment->schedule_delayed([&]() { ++other_counter; work_wg.done(); }, 0, 10);
+    }, 0);
+    work_wg.wait();
+    EXPECT_EQ(other_counter.load(), 3);
+
+    //try_unschedule对延时任务依然有效
+    std::atomic<bool> unscheduled_fn_called = { false };
+    uint64_t delayed_id = apartment->schedule_delayed([&]() { unscheduled_fn_called = true; }, 0, 100);
+    apartment->try_unschedule(delayed_id);
+
+    apartment->async_stop();
+    apartment->wait();
+    EXPECT_FALSE(unscheduled_fn_called.load());
+}
+
+static void _test_delayed_fns_with(ks_apartment* apartment) {
+    apartment->start();
+
+    std::mutex order_mutex;
+    std::vector<int> order;
+    ks_waitgroup work_wg(0);
+    auto make_fn = [&](int tag) {
+        work_wg.add(1);
+        return [&, tag]() {
+            std::unique_lock<std::mutex> lock(order_mutex);
+            order.push_back(tag);
+            lock.unlock();
+            work_wg.done();
+        };
+    };
+
+    //乱序投递，跨越时间轮的level0和level1（>256ms），按到期先后执行
+    apartment->schedule_delayed(make_fn(300), 0, 300);
+    apartment->schedule_delayed(make_fn(30), 0, 30);
+    apartment->schedule_delayed(make_fn(0), 0, 0);
+    apartment->schedule_delayed(make_fn(120), 0, 120);
+    apartment->schedule_delayed(make_fn(60), 0, 60);
+
+    //撤销：近的、远的（overflow之外也照样）
+    std::atomic<int> unscheduled_fn_count = { 0 };
+    uint64_t id1 = apartment->schedule_delayed([&]() { ++unscheduled_fn_count; }, 0, 50);
+    uint64_t id2 = apartment->schedule_delayed([&]() { ++unscheduled_fn_count; }, 0, 1000 * 3600);
+    uint64_t id3 = apartment->schedule_delayed([&]() { ++unscheduled_fn_count; }, 0, 1000 * 3600 * 24);
+    apartment->try_unschedule(id1);
+    apartment->try_unschedule(id2);
+    apartment->try_unschedule(id3);
+
+    work_wg.wait();
+    EXPECT_EQ(order, (std::vector<int>{ 0, 30, 60, 120, 300 }));
+
+    apartment->async_stop();
+    apartment->wait();
+    EXPECT_EQ(unscheduled_fn_count.load(), 0);
+}
+
+TEST(test_apartment_suite, test_delayed_timer_wheel) {
+    ks_thread_pool_apartment_imp mta_imp("test_delayed_mta", 4);
+    _test_delayed_fns_with(&mta_imp);
+
+    ks_single_thread_apartment_imp sta_imp("test_delayed_sta");
+    _test_delayed_fns_with(&sta_imp);
+}
+
+TEST(test_apartment_suite, test_unschedule_idle_fn) {
+    ks_single_thread_apartment_imp sta_imp("test_unschedule_sta");
+    ks_apartment* apartment = &sta_imp;
+    apartment->start();
+
+    //先以一个任务占住线程，期间投递的idle任务和延时任务均可撤销
+    ks_event blocking_event(false, true);
+    apartment->schedule([&]() { blocking_event.wait(); }, 0);
+
+    std::atomic<int> unscheduled_fn_count = { 0 };
+    std::atomic<int> kept_fn_count = { 0 };
+    std::vector<uint64_t> ids;
+    for (int i = 0; i < 100; ++i) {
+        ids.push_back(apartment->schedule([&]() { ++unscheduled_fn_count; }, -1));
+        apartment->schedule([&]() { ++kept_fn_count; }, -1);
+        ids.push_back(apartment->schedule_delayed([&]() { ++unscheduled_fn_count; }, 0, 10));
+    }
+    for (uint64_t id : ids)
+        apartment->try_unschedule(id);
+    apartment->try_unschedule(ids.front()); //重复撤销无影响
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    blocking_event.set_event();
+
+    ks_waitgroup work_wg(1);
+    apartment->schedule_delayed([&]() { work_wg.done(); }, -1, 30);
+    work_wg.wait();
+
+    apartment->async_stop();
+    apartment->wait();
+    EXPECT_EQ(unscheduled_fn_count.load(), 0);
+    EXPECT_EQ(kept_fn_count.load(), 100);
+}
+
+TEST(test_apartment_suite, test_mpsc_inbox) {
+    ks_single_thread_apartment_imp sta_imp("test_mpsc_inbox_sta", ks_single_thread_apartment_imp::mpsc_inbox_flag);
+    ks_apartment* apartment = &sta_imp;
+    apartment->start();
+
+    //多个生产者并发投递：全部执行，且各生产者的任务保持各自的次序
+    constexpr int producer_count = 4;
+    constexpr int fn_count_per_producer = 10000;
+    std::vector<int> last_seqs(producer_count, -1);
+    std::atomic<int> disorder_count = { 0 };
+    ks_waitgroup all_wg(producer_count * fn_count_per_producer);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < producer_count; ++p) {
+        producers.emplace_back([&, p]() {
+            for (int i = 0; i < fn_count_per_producer; ++i) {
+                apartment->schedule([&, p, i]() {
+                    if (last_seqs[p] + 1 != i)
+                        ++disorder_count;
+                    last_seqs[p] = i;
+                    all_wg.done();
+                }, 0);
+            }
+        });
+    }
+    for (auto& producer : producers)
+        producer.join();
+    all_wg.wait();
+    EXPECT_EQ(disorder_count.load(), 0);
+
+#if __KS_APARTMENT_ATFORK_ENABLED
+    //投递与atfork_prepare/atfork_parent（暂时关闭收件箱，并待在途的投递完成）交错：已接受的任务全部执行，且次序不变
+    if (true) {
+        std::fill(last_seqs.begin(), last_seqs.end(), -1);
+        ks_waitgroup fork_wg(producer_count * fn_count_per_producer);
+        std::atomic<bool> producing = { true };
+        std::vector<std::thread> fork_producers;
+        for (int p = 0; p < producer_count; ++p) {
+            fork_producers.emplace_back([&, p]() {
+                for (int i = 0; i < fn_count_per_producer; ++i) {
+                    uint64_t fn_id = apartment->schedule([&, p, i]() {
+                        if (last_seqs[p] + 1 != i)
+                            ++disorder_count;
+                        last_seqs[p] = i;
+                        fork_wg.done();
+                    }, 0);
+                    EXPECT_NE(fn_id, (uint64_t)0);
+                }
+            });
+        }
+        std::thread forking_thread([&]() {
+            while (producing) {
+                apartment->atfork_prepare();
+                apartment->atfork_parent();
+                std::this_thread::yield();
+            }
+        });
+        for (auto& producer : fork_producers)
+            producer.join();
+        producing = false;
+        forking_thread.join();
+        fork_wg.wait();
+        EXPECT_EQ(disorder_count.load(), 0);
+    }
+#endif
+
+    //占住线程期间投递：prior先于normal执行，schedule_batch保持次序，收件箱中的idle任务亦可撤销
+    ks_event blocking_event(false, true);
+    ks_waitgroup blocking_wg(1);
+    apartment->schedule([&]() { blocking_wg.done(); blocking_event.wait(); }, 0);
+    blocking_wg.wait();
+
+    std::vector<int> order;
+    apartment->schedule([&]() { order.push_back(0); }, 0);
+    apartment->schedule([&]() { order.push_back(1); }, 1);
+    std::vector<ks_task_fn> batch_fns;
+    for (int i = 2; i < 5; ++i)
+        batch_fns.push_back(ks_task_fn([&, i]() { order.push_back(i); }));
+    EXPECT_NE(apartment->schedule_batch(std::move(batch_fns), 0), (uint64_t)0);
+    uint64_t idle_id = apartment->schedule([&]() { order.push_back(-1); }, -1);
+    apartment->try_unschedule(idle_id);
+    EXPECT_GE(sta_imp.pending_fn_count(), (size_t)5); //（已撤销的idle任务以墓碑形式留在队列中，出队时丢弃）
+
+    blocking_event.set_event();
+    ks_waitgroup order_wg(1);
+    apartment->schedule([&]() { order_wg.done(); }, -1);
+    order_wg.wait();
+    EXPECT_EQ(order, std::vector<int>({ 1, 0, 2, 3, 4 }));
+
+    //work线程停驻后，投递可将其唤醒
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ks_waitgroup wake_wg(1);
+    apartment->schedule([&]() { wake_wg.done(); }, 0);
+    wake_wg.wait();
+
+    apartment->async_stop();
+    apartment->wait();
+}
+
+TEST(test_apartment_suite, test_schedule_racing_stop) {
+    //外部线程持续schedule的同时async_stop：stop之前已接受的任务（无论是否经由lockfree队列）均须被执行，不得滞留或丢失
+    //注：async_stop后（wait之前）work线程不退出，故此间schedule仍被接受
+    for (int round = 0; round < 20; ++round) {
+        ks_thread_pool_apartment_imp apartment_imp("test_racing_stop_mta", 4, 0);
+        ks_apartment* apartment = &apartment_imp;
+        apartment->start();
+
+        ks_waitgroup warm_wg(1);
+        apartment->schedule([&]() { warm_wg.done(); }, 0); //确保已有work线程，使async_stop进入STOPPING而非直接STOPPED
+        warm_wg.wait();
+
+        std::atomic<int> scheduled_count = { 0 };
+        std::atomic<int> executed_count = { 0 };
+        std::vector<std::thread> producer_threads;
+        for (int p = 0; p < 4; ++p) {
+            producer_threads.emplace_back([&]() {
+                for (int i = 0; i < 2000; ++i) {
+                    if (apartment->schedule([&]() { ++executed_count; }, 0) != 0)
+                        ++scheduled_count;
+                }
+            });
+        }
+
+        std::this_thread::sleep_for(std::chrono::microseconds(round * 50));
+        apartment->async_stop();
+
+        for (auto& thread : producer_threads) {
+            thread.join();
+        }
+        apartment->wait();
+        EXPECT_EQ(executed_count.load(), scheduled_count.load());
+        EXPECT_EQ(scheduled_count.load(), 4 * 2000);
+    }
+}
+
+TEST(test_apartment_suite, test_batch_drain) {
+    //批量执行中途到达的prior任务在下一项之前抢先，且余下的任务保持原有次序
+    auto check_batch_preempted_by_prior = [](ks_apartment* apartment) {
+        ks_event blocking_event(false, true);
+        ks_waitgroup blocking_wg(1);
+        apartment->schedule([&]() { blocking_wg.done(); blocking_event.wait(); }, 0);
+        blocking_wg.wait();
+
+        std::vector<int> order;
+        for (int i = 0; i < 8; ++i) {
+            apartment->schedule([&, apartment, i]() {
+                order.push_back(i);
+                if (i == 1)
+                    apartment->schedule([&]() { order.push_back(100); }, 1);
+            }, 0);
+        }
+
+        blocking_event.set_event();
+        ks_waitgroup order_wg(1);
+        apartment->schedule([&]() { order_wg.done(); }, 0);
+        order_wg.wait();
+        EXPECT_EQ(order, std::vector<int>({ 0, 1, 100, 2, 3, 4, 5, 6, 7 }));
+    };
+
+    ks_single_thread_apartment_imp sta_imp("test_batch_drain_sta");
+    EXPECT_TRUE(sta_imp.set_batch_drain(16, 1000 * 1000));
+    ks_apartment* sta = &sta_imp;
+    sta->start();
+    EXPECT_FALSE(sta_imp.set_batch_drain(4)); //须在start前设定
+    check_batch_preempted_by_prior(sta);
+
+    //批量中的任务wait同批中其后的任务所完成的future：嵌套泵须能执行到后者
+    if (true) {
+        ks_promise<int> promise = ks_promise<int>::create();
+        ks_future<int> future = promise.get_future();
+        ks_waitgroup nested_wg(1);
+        int nested_value = 0;
+        sta->schedule([&]() { nested_wg.wait(); }, 0); //占住线程，使以下二者同批出队
+        sta->schedule([&]() { future.__wait(); nested_value = future.peek_result().to_value(); }, 0);
+        sta->schedule([&]() { promise.resolve(7); }, 0);
+        nested_wg.done();
+
+        ks_waitgroup done_wg(1);
+        sta->schedule([&]() { done_wg.done(); }, 0);
+        done_wg.wait();
+        EXPECT_EQ(nested_value, 7);
+    }
+
+    sta->async_stop();
+    sta->wait();
+
+    ks_thread_pool_apartment_imp mta_imp("test_batch_drain_mta", 1);
+    EXPECT_TRUE(mta_imp.set_batch_drain(16, 1000 * 1000));
+    ks_apartment* mta = &mta_imp;
+    mta->start();
+    check_batch_preempted_by_prior(mta);
+    mta->async_stop();
+    mta->wait();
+}
+
+TEST(test_apartment_suite, test_fn_item_pool_steady_state) {
+    //逐个投递并等待完成（在途任务数恒为1），各线程缓存的节点有上限，故节点池的容量有上限
+    auto do_ping_pong = [](ks_apartment* apartment, int count) {
+        for (int i = 0; i < count; ++i) {
+            ks_waitgroup work_wg(1);
+            apartment->schedule([&work_wg]() { work_wg.done(); }, 0);
+            work_wg.wait();
+        }
+    };
+
+    //work线程内自我接续的任务链，分配和释放均走线程缓存
+    auto do_chain = [](ks_apartment* apartment, int count) {
+        ks_waitgroup work_wg(1);
+        std::function<void(int)> step;
+        step = [apartment, &step, &work_wg](int left) {
+            if (left == 0)
+                work_wg.done();
+            else
+                apartment->schedule([&step, left]() { step(left - 1); }, 0);
+        };
+        step(count);
+        work_wg.wait();
+    };
+
+    ks_single_thread_apartment_imp sta_imp("test_fn_item_pool_sta");
+    ks_apartment* sta = &sta_imp;
+    sta->start();
+    do_ping_pong(sta, 1000);
+    do_chain(sta, 1000);
+    const ks_slab_pool_stats sta_warm_stats = sta_imp.fn_item_pool_stats();
+    do_ping_pong(sta, 10000);
+    do_chain(sta, 10000);
+    const ks_slab_pool_stats sta_stats = sta_imp.fn_item_pool_stats();
+    EXPECT_EQ(sta_stats.slab_alloc_count, sta_warm_stats.slab_alloc_count); //稳态下不再有内存分配
+    EXPECT_LE(sta_stats.node_capacity, (size_t)256);
+    sta->async_stop();
+    sta->wait();
+
+    ks_thread_pool_apartment_imp mta_imp("test_fn_item_pool_mta", 4);
+    ks_apartment* mta = &mta_imp;
+    mta->start();
+    do_ping_pong(mta, 20000);
+    do_chain(mta, 20000);
+    const ks_slab_pool_stats mta_stats = mta_imp.fn_item_pool_stats();
+    EXPECT_LE(mta_stats.node_capacity, (size_t)1024); //与任务总数无关
+    mta->async_stop();
+    mta->wait();
+
+    //线程被回收时trim：突发过后，完全空闲的slab还给系统
+    ks_thread_pool_apartment_imp elastic_imp("test_fn_item_pool_elastic", 0, 4, 20, 0);
+    ks_apartment* elastic = &elastic_imp;
+    elastic->start();
+    ks_waitgroup burst_wg(4096);
+    for (int i = 0; i < 4096; ++i)
+        elastic->schedule([&burst_wg]() { burst_wg.done(); }, 0);
+    burst_wg.wait();
+    EXPECT_GT(elastic_imp.fn_item_pool_stats().slab_alloc_count, (size_t)0);
+    for (int i = 0; i < 200 && elastic_imp.fn_item_pool_stats().node_capacity != 0; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    const ks_slab_pool_stats elastic_stats = elastic_imp.fn_item_pool_stats();
+    EXPECT_EQ(elastic_stats.node_capacity, (size_t)0);
+    EXPECT_EQ(elastic_stats.slab_trim_count, elastic_stats.slab_alloc_count);
+    elastic->async_stop();
+    elastic->wait();
+}
+
+TEST(test_apartment_suite, test_schedule_batch) {
+    //先以任务占住全部线程，再批量投递idle任务，按连续id撤销其中奇数项
+    auto do_batch = [](ks_apartment* apartment) {
+        EXPECT_TRUE((apartment->features() & ks_apartment::batch_schedule_feature) != 0);
+
+        ks_event blocking_event(false, true);
+        for (size_t i = 0; i < apartment->concurrency(); ++i)
+            apartment->schedule([&]() { blocking_event.wait(); }, 0);
+
+        std::atomic<int> odd_fn_count = { 0 };
+        std::atomic<int> even_fn_count = { 0 };
+        std::vector<ks_task_fn> fns;
+        for (int i = 0; i < 100; ++i) {
+            if (i % 2 != 0)
+                fns.push_back(ks_task_fn([&]() { ++odd_fn_count; }));
+            else
+                fns.push_back(ks_task_fn([&]() { ++even_fn_count; }));
+        }
+        const uint64_t first_id = apartment->schedule_batch(std::move(fns), -1);
+        EXPECT_NE(first_id, (uint64_t)0);
+        for (uint64_t i = 1; i < 100; i += 2)
+            apartment->try_unschedule(first_id + i);
+
+        blocking_event.set_event();
+        ks_waitgroup work_wg(1); //idle任务依次执行，故其完成时批量任务均已执行
+        apartment->schedule([&]() { work_wg.done(); }, -1);
+        work_wg.wait();
+
+        EXPECT_EQ(odd_fn_count.load(), 0);
+        EXPECT_EQ(even_fn_count.load(), 50);
+        EXPECT_EQ(apartment->schedule_batch(std::vector<ks_task_fn>{}, 0), (uint64_t)0);
+    };
+
+    ks_single_thread_apartment_imp sta_imp("test_schedule_batch_sta");
+    ks_apartment* sta = &sta_imp;
+    sta->start();
+    do_batch(sta);
+    sta->async_stop();
+    sta->wait();
+
+    ks_thread_pool_apartment_imp mta_imp("test_schedule_batch_mta", 2);
+    ks_apartment* mta = &mta_imp;
+    mta->start();
+    do_batch(mta);
+    mta->async_stop();
+    mta->wait();
+
+    //同一future的多个后续任务经批量投递
+    std::atomic<int> next_fn_count = { 0 };
+    ks_promise<int> promise = ks_promise<int>::create();
+    std::vector<ks_future<void>> next_futures;
+    for (int i = 0; i < 20; ++i) {
+        next_futures.push_back(promise.get_future().then<void>(ks_apartment::default_mta(), [&](const int& value) {
+            next_fn_count += value;
+        }));
+    }
+    promise.resolve(1);
+    ks_future_util::all(next_futures).__wait();
+    EXPECT_EQ(next_fn_count.load(), 20);
+}
+
+TEST(test_apartment_suite, test_spin_wait) {
+    ks_thread_pool_apartment_imp mta_imp("test_spin_wait_mta", 2, ks_thread_pool_apartment_imp::spin_wait_flag);
+    ks_apartment* mta = &mta_imp;
+    mta->start();
+
+    //逐个投递并等待完成，任务的到达间隔很短，空闲线程多在自旋期间等到新任务
+    std::atomic<int> counter = { 0 };
+    for (int i = 0; i < 2000; ++i) {
+        ks_waitgroup work_wg(1);
+        mta->schedule([&]() { ++counter; work_wg.done(); }, 0);
+        work_wg.wait();
+    }
+    EXPECT_EQ(counter.load(), 2000);
+
+    //长时间空闲后，仍可被唤醒
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ks_waitgroup work_wg(1);
+    mta->schedule_delayed([&]() { work_wg.done(); }, 0, 10);
+    work_wg.wait();
+
+    const ks_spin_wait_stats stats = mta_imp.spin_wait_stats();
+    EXPECT_GT(stats.spin_hit_count, (uint64_t)0);
+    EXPECT_GT(stats.spin_miss_count, (uint64_t)0);
+
+    mta->async_stop();
+    mta->wait();
+}
+
+TEST(test_apartment_suite, test_elastic_thread_pool) {
+    ks_thread_pool_apartment_imp mta_imp("test_elastic_mta", 2, 8, 50, ks_thread_pool_apartment_imp::prestart_min_threads_flag);
+    ks_apartment* mta = &mta_imp;
+    mta->start();
+    EXPECT_EQ(mta_imp.work_thread_count(), (size_t)2); //预先创建min_thread_count个线程
+
+    //突发：8个任务同时阻塞，线程数增至8
+    auto do_burst = [mta]() {
+        ks_event blocking_event(false, true);
+        ks_waitgroup started_wg(8);
+        ks_waitgroup work_wg(8);
+        for (int i = 0; i < 8; ++i) {
+            mta->schedule([&]() { started_wg.done(); blocking_event.wait(); work_wg.done(); }, 0);
+        }
+        started_wg.wait();
+        blocking_event.set_event();
+        work_wg.wait();
+    };
+
+    do_burst();
+    EXPECT_EQ(mta_imp.work_thread_count(), (size_t)8);
+
+    //空闲超过idle_timeout后，富余线程退出，保留min_thread_count个
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    EXPECT_EQ(mta_imp.work_thread_count(), (size_t)2);
+
+    //回收后仍可再次扩充，延时任务亦不受影响
+    do_burst();
+    ks_waitgroup delayed_wg(1);
+    mta->schedule_delayed([&]() { delayed_wg.done(); }, 0, 200);
+    delayed_wg.wait();
+    EXPECT_EQ(mta_imp.work_thread_count(), (size_t)2);
+
+    mta->async_stop();
+    mta->wait();
+
+    //min_thread_count为0：有未到期的延时任务时保留最后一个线程，全部空闲后线程数归零
+    ks_thread_pool_apartment_imp mta0_imp("test_elastic_mta0", 0, 4, 20, 0);
+    ks_apartment* mta0 = &mta0_imp;
+    mta0->start();
+    for (int round = 0; round < 2; ++round) {
+        ks_waitgroup work_wg(1);
+        mta0->schedule_delayed([&]() { work_wg.done(); }, 0, 100);
+        work_wg.wait();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        EXPECT_EQ(mta0_imp.work_thread_count(), (size_t)0);
+    }
+    mta0->async_stop();
+    mta0->wait();
+}
+
+TEST(test_apartment_suite, test_affinity_policy) {
+    //cpu_list：各线程依次绑定到列出的cpu
+    ks_thread_pool_apartment_imp mta_imp("test_affinity_mta", 2, 0);
+    ks_apartment* mta = &mta_imp;
+    ks_thread_affinity_policy cpu_list_policy;
+    cpu_list_policy.kind = ks_thread_affinity_policy::cpu_list;
+    cpu_list_policy.cpus = { 0 };
+#if defined(__APPLE__)
+    EXPECT_FALSE(mta_imp.set_affinity_policy(cpu_list_policy));
+#else
+    EXPECT_TRUE(mta_imp.set_affinity_policy(cpu_list_policy));
+#endif
+    mta->start();
+
+    std::atomic<bool> all_on_cpu0 = { true };
+    ks_waitgroup work_wg(16);
+    for (int i = 0; i < 16; ++i) {
+        mta->schedule([&]() {
+#if defined(__linux__)
+            if (sched_getcpu() != 0)
+                all_on_cpu0 = false;
+#endif
+            work_wg.done();
+        }, 0);
+    }
+    work_wg.wait();
+    EXPECT_TRUE(all_on_cpu0.load());
+
+    //已start则不可再设定
+    EXPECT_FALSE(mta_imp.set_affinity_policy(cpu_list_policy));
+
+    mta->async_stop();
+    mta->wait();
+
+    //numa_nodes：外部线程的任务投递至本节点线程，work线程内的任务进入局部队列，均应执行完毕
+    ks_thread_pool_apartment_imp numa_mta_imp("test_numa_mta", 4, 0);
+    ks_apartment* numa_mta = &numa_mta_imp;
+    ks_thread_affinity_policy numa_policy;
+    numa_policy.kind = ks_thread_affinity_policy::numa_nodes;
+    numa_mta_imp.set_affinity_policy(numa_policy);
+    numa_mta->start();
+
+    std::atomic<int> counter = { 0 };
+    ks_waitgroup numa_wg(0);
+    for (int i = 0; i < 100; ++i) {
+        numa_wg.add(1);
+        numa_mta->schedule([&]() {
+            ++counter;
+            numa_wg.add(1);
+            numa_mta->schedule([&]() { ++counter; numa_wg.done(); }, 0);
+            numa_wg.done();
+        }, 0);
+    }
+    numa_wg.wait();
+    EXPECT_EQ(counter.load(), 200);
+
+    numa_mta->async_stop();
+    numa_mta->wait();
+}
+
+TEST(test_apartment_suite, test_priority_bands) {
+    ks_thread_pool_apartment_imp mta_imp("test_bands_mta", 1, 0);
+    ks_single_thread_apartment_imp sta_imp("test_bands_sta", 0);
+    EXPECT_TRUE(mta_imp.set_priority_bands(8));
+    EXPECT_TRUE(sta_imp.set_priority_bands(8));
+    EXPECT_FALSE(mta_imp.set_priority_bands(64)); //band数超出范围
+
+    ks_apartment* apartments[] = { &mta_imp, &sta_imp };
+    for (ks_apartment* apartment : apartments) {
+        apartment->start();
+
+        //阻塞work线程，再同时投递大量高优先级任务和少量idle任务
+        ks_event blocking_event(false, true);
+        ks_waitgroup started_wg(1);
+        apartment->schedule([&]() { started_wg.done(); blocking_event.wait(); }, 0);
+        started_wg.wait();
+
+        std::mutex order_mutex;
+        std::vector<int> order;
+        ks_waitgroup work_wg(0);
+        for (int i = 0; i < 1000; ++i) {
+            work_wg.add(1);
+            apartment->schedule([&]() { std::lock_guard<std::mutex> guard(order_mutex); order.push_back(3); work_wg.done(); }, 3);
+        }
+        for (int i = 0; i < 2; ++i) {
+            work_wg.add(1);
+            apartment->schedule([&]() { std::lock_guard<std::mutex> guard(order_mutex); order.push_back(-4); work_wg.done(); }, -4);
+        }
+        uint64_t unscheduled_id = apartment->schedule([&]() { std::lock_guard<std::mutex> guard(order_mutex); order.push_back(-999); }, -1);
+        apartment->try_unschedule(unscheduled_id);
+
+        blocking_event.set_event();
+        work_wg.wait();
+
+        //idle任务不被饿死：在高优先级任务全部完成之前即得以执行；被撤销的任务不执行
+        ASSERT_EQ(order.size(), (size_t)1002);
+        EXPECT_NE(order.back(), -4);
+        EXPECT_EQ(std::count(order.begin(), order.end(), -999), 0);
+
+        apartment->async_stop();
+        apartment->wait();
+    }
+
+    auto mta_stats = mta_imp.priority_band_stats();
+    ASSERT_EQ(mta_stats.size(), (size_t)8);
+    EXPECT_EQ(mta_stats[0].dequeue_count, (uint64_t)1000);
+    EXPECT_EQ(mta_stats[7].dequeue_count, (uint64_t)2);
+    EXPECT_GT(mta_stats[0].max_wait_ns, (int64_t)0);
+    EXPECT_EQ(mta_stats[0].queue_depth, (size_t)0);
+    EXPECT_EQ(sta_imp.priority_band_stats().size(), (size_t)8);
+
+    //默认（三级队列）模式下无band统计
+    ks_thread_pool_apartment_imp default_mta_imp("test_no_bands_mta", 1, 0);
+    EXPECT_TRUE(default_mta_imp.priority_band_stats().empty());
+}
+
+TEST(test_apartment_suite, test_edf_schedule) {
+    ks_thread_pool_apartment_imp mta_imp("test_edf_mta", 1, ks_thread_pool_apartment_imp::edf_schedule_flag);
+    ks_single_thread_apartment_imp sta_imp("test_edf_sta", ks_single_thread_apartment_imp::edf_schedule_flag);
+
+    ks_apartment* apartments[] = { &mta_imp, &sta_imp };
+    for (ks_apartment* apartment : apartments) {
+        EXPECT_NE(apartment->features() & ks_apartment::deadline_schedule_feature, 0u);
+
+        //阻塞work线程，再以乱序的deadline投递任务
+        ks_event blocking_event(false, true);
+        ks_waitgroup started_wg(1);
+        apartment->schedule([&]() { started_wg.done(); blocking_event.wait(); }, 0);
+        started_wg.wait();
+
+        std::mutex order_mutex;
+        std::vector<int> order;
+        ks_waitgroup work_wg(0);
+        const auto base_time = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        work_wg.add(1);
+        apartment->schedule([&]() { std::lock_guard<std::mutex> guard(order_mutex); order.push_back(0); work_wg.done(); }, 0);
+        for (int i : { 5, 2, 4, 1, 3 }) {
+            work_wg.add(1);
+            apartment->schedule_with_deadline(ks_task_fn([&, i]() { std::lock_guard<std::mutex> guard(order_mutex); order.push_back(i); work_wg.done(); }), 0, base_time + std::chrono::milliseconds(i));
+        }
+
+        blocking_event.set_event();
+        work_wg.wait();
+
+        //带deadline的任务按deadline先后执行，且先于无deadline的普通任务
+        EXPECT_EQ(order, (std::vector<int>{ 1, 2, 3, 4, 5, 0 }));
+    }
+
+    //future的timeout即为deadline：已过deadline的then任务不再被调度，直接以timeout_error拒绝
+    ks_event blocking_event(false, true);
+    ks_waitgroup started_wg(1);
+    ks_apartment* mta = &mta_imp;
+    mta->schedule([&]() { started_wg.done(); blocking_event.wait(); }, 0);
+    started_wg.wait();
+
+    std::atomic<bool> then_fn_ran = { false };
+    ks_promise<int> promise = ks_promise<int>::create();
+    ks_future<int> future = promise.get_future().then<int>(mta, [&then_fn_ran](int value) { then_fn_ran = true; return value; });
+    future.set_timeout(20);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    promise.resolve(1);
+
+    for (int i = 0; i < 100 && !future.is_completed(); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_TRUE(future.is_completed()); //work线程仍被阻塞，故只可能是被直接拒绝
+    EXPECT_EQ(future.peek_result().to_error().get_code(), ks_error::timeout_error().get_code());
+
+    blocking_event.set_event();
+    for (ks_apartment* apartment : apartments) {
+        apartment->async_stop();
+        apartment->wait();
+    }
+    EXPECT_FALSE(then_fn_ran.load());
+}
+
+TEST(test_apartment_suite, test_strand) {
+    ks_thread_pool_apartment_imp parent_imp("test_strand_parent", 4, 0);
+    ks_apartment* parent = &parent_imp;
+
+    ks_strand_apartment_imp strand_imp1("test_strand1", parent);
+    ks_strand_apartment_imp strand_imp2("test_strand2", parent);
+    EXPECT_TRUE(strand_imp1.set_drain_batch_count(4));
+    ks_apartment* strands[] = { &strand_imp1, &strand_imp2 };
+
+    //各strand内严格FIFO且不并发，strand之间则可并发
+    constexpr int N = 2000;
+    std::atomic<int> running_counts[2] = { { 0 }, { 0 } };
+    std::atomic<bool> overlapped = { false };
+    std::atomic<bool> not_in_strand = { false };
+    std::vector<int> orders[2];
+    ks_waitgroup work_wg(0);
+    for (int i = 0; i < N; ++i) {
+        for (int k = 0; k < 2; ++k) {
+            work_wg.add(1);
+            ks_strand_apartment_imp* strand_imp = k == 0 ? &strand_imp1 : &strand_imp2;
+            strands[k]->schedule([&, k, i, strand_imp]() {
+                if (running_counts[k].fetch_add(1) != 0)
+                    overlapped = true;
+                if (!strand_imp->is_running_in_current_thread())
+                    not_in_strand = true;
+                orders[k].push_back(i);
+                running_counts[k].fetch_sub(1);
+                work_wg.done();
+            }, 0);
+        }
+    }
+    work_wg.wait();
+
+    EXPECT_FALSE(overlapped.load());
+    EXPECT_FALSE(not_in_strand.load());
+    for (int k = 0; k < 2; ++k) {
+        ASSERT_EQ(orders[k].size(), (size_t)N);
+        EXPECT_TRUE(std::is_sorted(orders[k].begin(), orders[k].end()));
+        EXPECT_NE(strands[k]->features() & ks_apartment::sequential_feature, 0u);
+    }
+    EXPECT_FALSE(strand_imp1.is_running_in_current_thread());
+
+    //延时任务及撤销
+    std::atomic<int> delayed_counter = { 0 };
+    work_wg.add(1);
+    strands[0]->schedule_delayed([&]() { ++delayed_counter; work_wg.done(); }, 0, 20);
+    uint64_t unscheduled_id = strands[0]->schedule_delayed([&]() { delayed_counter += 100; }, 0, 20);
+    strands[0]->try_unschedule(unscheduled_id);
+    work_wg.wait();
+
+    //future
+    ks_future<int> future = ks_future<int>::post(strands[1], [&]() { return strand_imp2.is_running_in_current_thread() ? 1 : 0; })
+        .then<int>(strands[0], [](int value) { return value + 1; });
+    future.__wait();
+    EXPECT_EQ(future.peek_result().to_value(), 2);
+
+    for (ks_apartment* strand : strands) {
+        strand->async_stop();
+        strand->wait();
+        EXPECT_TRUE(strand->is_stopped());
+    }
+    EXPECT_EQ(delayed_counter.load(), 1);
+
+    parent->async_stop();
+    parent->wait();
+
+    //parent未执行drain任务即将其丢弃（manual套间stop时不再执行idle任务）：strand的wait不致卡住，余下的fn被丢弃
+    ks_manual_apartment_imp manual_parent_imp("test_strand_manual_parent");
+    ks_apartment* manual_parent = &manual_parent_imp;
+    ks_strand_apartment_imp dropped_strand_imp("test_dropped_strand", manual_parent);
+    ks_apartment* dropped_strand = &dropped_strand_imp;
+    manual_parent->start();
+    std::atomic<bool> dropped_fn_called = { false };
+    dropped_strand->schedule([&]() { dropped_fn_called = true; }, -1);
+    manual_parent->async_stop();
+    manual_parent->wait();
+    dropped_strand->async_stop();
+    dropped_strand->wait();
+    EXPECT_TRUE(dropped_strand->is_stopped());
+    EXPECT_FALSE(dropped_fn_called.load());
+}
+
+TEST(test_apartment_suite, test_apartment_group) {
+    ks_apartment_group sta_group("test_sta_group", 4);
+    ks_apartment_group strand_group("test_strand_group", 8, ks_apartment_group::strand_shards);
+    EXPECT_EQ(sta_group.concurrency(), (size_t)4);
+    EXPECT_EQ(strand_group.concurrency(), (size_t)8);
+    EXPECT_TRUE(sta_group.start());
+
+    ks_apartment_group* groups[] = { &sta_group, &strand_group };
+    for (ks_apartment_group* group : groups) {
+        //同一key总是映射至同一分片，且各分片均有key
+        std::vector<int> key_counts(group->shard_count());
+        for (int key = 0; key < 1000; ++key) {
+            ks_apartment* shard = group->shard_for(key);
+            EXPECT_EQ(shard, group->shard_for(key));
+            for (size_t i = 0; i < group->shard_count(); ++i) {
+                if (group->shard_at(i) == shard)
+                    ++key_counts[i];
+            }
+        }
+        EXPECT_EQ(std::count(key_counts.begin(), key_counts.end(), 0), 0);
+
+        //同一key的任务串行且按序执行
+        constexpr int N = 500;
+        std::vector<int> orders[3];
+        ks_waitgroup work_wg(0);
+        for (int i = 0; i < N; ++i) {
+            for (int k = 0; k < 3; ++k) {
+                work_wg.add(1);
+                group->schedule_keyed(std::string("key") + std::to_string(k), [&orders, &work_wg, k, i]() { orders[k].push_back(i); work_wg.done(); });
+            }
+        }
+        work_wg.wait();
+        for (int k = 0; k < 3; ++k) {
+            ASSERT_EQ(orders[k].size(), (size_t)N);
+            EXPECT_TRUE(std::is_sorted(orders[k].begin(), orders[k].end()));
+        }
+
+        uint64_t total_keyed_count = 0;
+        for (const auto& stats : group->shard_stats()) {
+            total_keyed_count += stats.keyed_schedule_count;
+            EXPECT_EQ(stats.queue_depth, (size_t)0);
+        }
+        EXPECT_EQ(total_keyed_count, (uint64_t)(N * 3));
+    }
+
+    //一致性：分片数由8增至9时，只有少部分key改变归属
+    ks_apartment_group strand_group9("test_strand_group9", 9, ks_apartment_group::strand_shards);
+    int moved_count = 0;
+    for (uint64_t key_hash = 0; key_hash < 9000; ++key_hash) {
+        if (strand_group.shard_index_for_hash(key_hash) != strand_group9.shard_index_for_hash(key_hash)) {
+            ++moved_count;
+            EXPECT_EQ(strand_group9.shard_index_for_hash(key_hash), (size_t)8); //只会移至新增的分片
+        }
+    }
+    EXPECT_LT(moved_count, 2000);
+
+    sta_group.wait();
+    strand_group.wait();
+    strand_group9.wait();
+}
+
+//就地执行一切fn（包括延时fn）的套间，用以验证调用方在schedule期间不持锁
+class _sync_apartment final : public ks_apartment {
+public:
+    virtual const char* name() override { return "test_sync_apartment"; }
+    virtual uint features() override { return 0; }
+    virtual size_t concurrency() override { return 1; }
+
+    virtual bool start() override { return true; }
+    virtual void async_stop() override {}
+    virtual void wait() override {}
+
+    virtual bool is_stopped() override { return false; }
+    virtual bool is_stopping_or_stopped() override { return false; }
+
+    virtual uint64_t schedule(std::function<void()>&& fn, int priority) override { fn(); return ++m_last_id; }
+    virtual uint64_t schedule_delayed(std::function<void()>&& fn, int priority, int64_t delay) override { fn(); return ++m_last_id; }
+    virtual uint64_t schedule(ks_task_fn&& fn, int priority) override { fn(); return ++m_last_id; }
+    virtual uint64_t schedule_delayed(ks_task_fn&& fn, int priority, int64_t delay) override { fn(); return ++m_last_id; }
+
+    virtual void try_unschedule(uint64_t id) override {}
+
+private:
+    uint64_t m_last_id = 0;
+};
+
+TEST(test_apartment_suite, test_inline_apartment) {
+    ks_apartment* inline_apartment = ks_apartment::inline_apartment();
+    EXPECT_TRUE((inline_apartment->features() & ks_apartment::inline_execution_feature) != 0);
+
+    //schedule即同步执行
+    int x = 0;
+    EXPECT_NE(inline_apartment->schedule([&]() { x = 1; }, 0), (uint64_t)0);
+    EXPECT_EQ(x, 1);
+
+    //then至inline套间：后续就地在完成前驱的线程上执行，不经由排队
+    std::vector<std::thread::id> thread_ids;
+    ks_promise<int> chain_promise = ks_promise<int>::create();
+    ks_future<int> chain_future = chain_promise.get_future();
+    for (int i = 0; i < 10; ++i) {
+        chain_future = chain_future.then<int>(inline_apartment, [&](int value) {
+            thread_ids.push_back(std::this_thread::get_id());
+            EXPECT_EQ(ks_apartment::current_thread_apartment(), ks_apartment::default_mta());
+            return value + 1;
+        });
+    }
+    ks_apartment::default_mta()->schedule([chain_promise]() { chain_promise.resolve(0); }, 0);
+    chain_future.__wait();
+    EXPECT_EQ(chain_future.peek_result().to_value(), 10);
+    ASSERT_EQ(thread_ids.size(), (size_t)10);
+    for (auto& thread_id : thread_ids)
+        EXPECT_EQ(thread_id, thread_ids[0]);
+
+    //长链：嵌套深度受限（超过时回退至parent套间），结果不受影响
+    std::atomic<size_t> max_depth = { 0 };
+    ks_promise<int> long_promise = ks_promise<int>::create();
+    ks_future<int> long_future = long_promise.get_future();
+    for (int i = 0; i < 200; ++i) {
+        long_future = long_future.then<int>(inline_apartment, [&](int value) {
+            size_t depth = ks_inline_apartment_imp::current_recursion_depth();
+            if (depth > max_depth)
+                max_depth = depth;
+            return value + 1;
+        });
+    }
+    long_promise.resolve(0);
+    long_future.__wait();
+    EXPECT_EQ(long_future.peek_result().to_value(), 200);
+    EXPECT_GE(max_depth.load(), (size_t)2);
+    EXPECT_LE(max_depth.load(), (size_t)ks_inline_apartment_imp::default_max_recursion_depth);
+
+    //延时任务经由parent计时，且可撤销
+    std::atomic<int> delayed_counter = { 0 };
+    ks_waitgroup delayed_wg(0);
+    delayed_wg.add(1);
+    uint64_t unscheduled_id = inline_apartment->schedule_delayed([&]() { delayed_counter += 100; }, 0, 10);
+    inline_apartment->try_unschedule(unscheduled_id);
+    inline_apartment->schedule_delayed([&]() { ++delayed_counter; delayed_wg.done(); }, 0, 20);
+    delayed_wg.wait();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(delayed_counter.load(), 1);
+
+    //parent就地执行延时任务（并重入inline套间）：不死锁，亦不残留映射
+    _sync_apartment sync_parent;
+    ks_inline_apartment_imp sync_inline_imp("test_inline_sync_parent", &sync_parent);
+    ks_apartment* sync_inline = &sync_inline_imp;
+    int sync_x = 0;
+    EXPECT_NE(sync_inline->schedule_delayed([&]() { sync_x = (int)sync_inline_imp.delaying_fn_count() + 1; }, 0, 10), (uint64_t)0);
+    EXPECT_EQ(sync_x, 1);
+    EXPECT_EQ(sync_inline_imp.delaying_fn_count(), (size_t)0);
+
+    //计时的parent撤销或stop时丢弃延时任务，映射随之移除
+    ks_manual_apartment_imp manual_parent_imp("test_inline_manual_parent");
+    ks_apartment* manual_parent = &manual_parent_imp;
+    ks_inline_apartment_imp manual_inline_imp("test_inline_manual", manual_parent);
+    ks_apartment* manual_inline = &manual_inline_imp;
+    bool dropped_fn_called = false;
+    uint64_t unscheduled_id2 = manual_inline->schedule_delayed([&]() { dropped_fn_called = true; }, 0, 1000);
+    manual_inline->schedule_delayed([&]() { dropped_fn_called = true; }, 0, 1000);
+    EXPECT_EQ(manual_inline_imp.delaying_fn_count(), (size_t)2);
+    manual_inline->try_unschedule(unscheduled_id2);
+    EXPECT_EQ(manual_inline_imp.delaying_fn_count(), (size_t)1);
+    manual_parent->async_stop();
+    manual_parent->wait();
+    EXPECT_EQ(manual_inline_imp.delaying_fn_count(), (size_t)0);
+    EXPECT_FALSE(dropped_fn_called);
+}
+
+TEST(test_apartment_suite, test_manual_apartment) {
+    ks_manual_apartment_imp manual_apartment("manual_apartment");
+    ks_apartment* apartment = &manual_apartment;
+
+    //schedule后须泵送才执行：prior先于normal，idle最后，执行期间新schedule的亦在同一轮内执行
+    std::vector<int> order;
+    apartment->schedule([&]() { order.push_back(-1); }, -1);
+    apartment->schedule([&]() { order.push_back(0); apartment->schedule([&]() { order.push_back(2); }, 0); }, 0);
+    apartment->schedule([&]() { order.push_back(1); }, 1);
+    EXPECT_TRUE(order.empty());
+    EXPECT_EQ(manual_apartment.pending_fn_count(), (size_t)3);
+    EXPECT_EQ(manual_apartment.run_until_idle(), (size_t)4);
+    EXPECT_EQ(order, std::vector<int>({ 1, 0, 2, -1 }));
+    EXPECT_EQ(manual_apartment.virtual_now(), (int64_t)0);
+
+    //延时任务按虚拟时钟到期，同一时点到期的按schedule先后执行，执行时虚拟时钟恰为其到期时点
+    std::vector<std::pair<int, int64_t>> delayed_records;
+    apartment->schedule_delayed([&]() { delayed_records.push_back({ 30, manual_apartment.virtual_now() }); }, 0, 30);
+    apartment->schedule_delayed([&]() { delayed_records.push_back({ 10, manual_apartment.virtual_now() }); }, 0, 10);
+    apartment->schedule_delayed([&]() { delayed_records.push_back({ 11, manual_apartment.virtual_now() }); }, 0, 10);
+    uint64_t unscheduled_id = apartment->schedule_delayed([&]() { delayed_records.push_back({ -1, manual_apartment.virtual_now() }); }, 0, 20);
+    apartment->try_unschedule(unscheduled_id);
+    EXPECT_EQ(manual_apartment.delaying_fn_count(), (size_t)3);
+    EXPECT_EQ(manual_apartment.advance(9), (size_t)0);
+    EXPECT_EQ(manual_apartment.advance(1), (size_t)2);
+    EXPECT_EQ(manual_apartment.advance(100), (size_t)1);
+    EXPECT_EQ(manual_apartment.virtual_now(), (int64_t)110);
+    EXPECT_EQ(delayed_records, (std::vector<std::pair<int, int64_t>>({ { 10, 10 }, { 11, 10 }, { 30, 30 } })));
+
+    apartment->schedule_delayed([&]() {}, 0, 1000);
+    EXPECT_EQ(manual_apartment.advance_to_next_delayed(), (size_t)1);
+    EXPECT_EQ(manual_apartment.virtual_now(), (int64_t)1110);
+
+    //future的timeout按虚拟时间判定
+    ks_future<int> timeout_future = ks_future<int>::post_delayed(apartment, []() { return 1; }, 1000).set_timeout(500);
+    manual_apartment.advance(499);
+    EXPECT_FALSE(timeout_future.is_completed());
+    manual_apartment.advance(1);
+    ASSERT_TRUE(timeout_future.is_completed());
+    EXPECT_TRUE(timeout_future.peek_result().to_error().get_code() == ks_error::TIMEOUT_ERROR_CODE);
+
+    //repeat_periodic：在虚拟时钟下回放1小时（每秒一轮），真实耗时极短
+    const std::chrono::steady_clock::time_point real_start_time = std::chrono::steady_clock::now();
+    const int64_t periodic_start_time = manual_apartment.virtual_now();
+    std::vector<int64_t> periodic_times;
+    ks_future<void> periodic_future = ks_future_util::repeat_periodic(apartment, [&]() -> ks_result<void> {
+        periodic_times.push_back(manual_apartment.virtual_now() - periodic_start_time);
+        if (periodic_times.size() == 3600)
+            return ks_error::eof_error();
+        return nothing;
+    }, 1000, 1000);
+    manual_apartment.advance(3600 * 1000);
+    ASSERT_TRUE(periodic_future.is_completed());
+    EXPECT_TRUE(periodic_future.peek_result().is_value());
+    ASSERT_EQ(periodic_times.size(), (size_t)3600);
+    for (size_t i = 0; i < periodic_times.size(); ++i)
+        EXPECT_EQ(periodic_times[i], (int64_t)((i + 1) * 1000));
+    EXPECT_LT(std::chrono::steady_clock::now() - real_start_time, std::chrono::seconds(10));
+
+    //stop后未到期的延时任务被丢弃
+    int dropped_counter = 0;
+    apartment->schedule_delayed([&]() { ++dropped_counter; }, 0, 10);
+    apartment->async_stop();
+    apartment->wait();
+    EXPECT_TRUE(apartment->is_stopped());
+    EXPECT_EQ(manual_apartment.delaying_fn_count(), (size_t)0);
+    EXPECT_EQ(dropped_counter, 0);
+}
+
+#if __KS_EPOLL_APARTMENT_ENABLED
+#include <sys/epoll.h>
+#include <unistd.h>
+
+TEST(test_apartment_suite, test_epoll_apartment) {
+    ks_epoll_apartment_imp io_imp("test_epoll_apartment");
+    ks_apartment* io = &io_imp;
+
+    //普通任务、延时任务及撤销
+    std::thread::id io_thread_id;
+    std::atomic<int> counter = { 0 };
+    ks_waitgroup work_wg(0);
+    work_wg.add(2);
+    io->schedule([&]() { io_thread_id = std::this_thread::get_id(); ++counter; work_wg.done(); }, 0);
+    io->schedule_delayed([&]() { ++counter; work_wg.done(); }, 0, 20);
+    uint64_t unscheduled_id = io->schedule_delayed([&]() { counter += 100; }, 0, 10);
+    io->try_unschedule(unscheduled_id);
+    work_wg.wait();
+    EXPECT_EQ(counter.load(), 2);
+
+    //fd就绪：future在io线程上resolve，then至io套间的后续任务亦在io线程上执行
+    int pipe_fds[2];
+    ASSERT_EQ(::pipe(pipe_fds), 0);
+    EXPECT_TRUE(io_imp.register_fd(pipe_fds[0]));
+    EXPECT_FALSE(io_imp.register_fd(pipe_fds[0]));
+
+    std::atomic<bool> on_io_thread = { false };
+    ks_future<char> read_future = io_imp.wait_fd_events(pipe_fds[0], EPOLLIN)
+        .then<char>(io, [&, read_fd = pipe_fds[0]](uint32_t events) {
+            on_io_thread = std::this_thread::get_id() == io_thread_id;
+            char ch = 0;
+            if ((events & EPOLLIN) == 0 || ::read(read_fd, &ch, 1) != 1)
+                throw ks_error::unexpected_error();
+            return ch;
+        });
+    EXPECT_EQ(io_imp.wait_fd_events(pipe_fds[0], EPOLLIN).peek_result().to_error().get_code(), ks_error::status_error().get_code()); //已在等待
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(read_future.is_completed());
+    ASSERT_EQ(::write(pipe_fds[1], "x", 1), 1);
+    read_future.__wait();
+    EXPECT_EQ(read_future.peek_result().to_value(), 'x');
+    EXPECT_TRUE(on_io_thread.load());
+
+    //即使在别的套间中发起等待，就绪后的then也直接由io套间feed，不途经发起者的套间
+    ks_manual_apartment_imp caller_imp("test_epoll_caller");
+    ks_apartment* caller = &caller_imp;
+    ks_future<uint32_t> caller_future = ks_future<uint32_t>::rejected(ks_error::unexpected_error());
+    caller->schedule([&]() {
+        caller_future = io_imp.wait_fd_events(pipe_fds[0], EPOLLIN)
+            .then<uint32_t>(io, [](uint32_t events) { return events; });
+    }, 0);
+    caller_imp.run_until_idle();
+    ASSERT_EQ(::write(pipe_fds[1], "y", 1), 1);
+    for (int i = 0; i < 200 && !caller_future.is_completed(); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_TRUE(caller_future.is_completed());
+    EXPECT_EQ(caller_imp.pending_fn_count(), (size_t)0);
+    caller_imp.run_until_idle();
+    caller_future.__wait();
+    EXPECT_TRUE((caller_future.peek_result().to_value() & EPOLLIN) != 0);
+    char drained_ch = 0;
+    EXPECT_EQ(::read(pipe_fds[0], &drained_ch, 1), 1);
+    caller->async_stop();
+    caller->wait();
+
+    //未register的fd被拒绝；unregister时正在等待的future被取消
+    EXPECT_TRUE(io_imp.wait_fd_events(pipe_fds[1], EPOLLOUT).peek_result().is_error());
+    ks_future<uint32_t> cancelled_future = io_imp.wait_fd_events(pipe_fds[0], EPOLLIN);
+    io_imp.unregister_fd(pipe_fds[0]);
+    cancelled_future.__wait();
+    EXPECT_EQ(cancelled_future.peek_result().to_error().get_code(), ks_error::cancelled_error().get_code());
+
+    io->async_stop();
+    io->wait();
+    ::close(pipe_fds[0]);
+    ::close(pipe_fds[1]);
+}
+
+//模拟已停止的套间：schedule一律返回0（真实套间在stop后schedule会在debug下ASSERT）
+class _rejecting_apartment final : public ks_apartment {
+public:
+    virtual const char* name() override { return "test_rejecting_apartment"; }
+    virtual uint features() override { return 0; }
+    virtual size_t concurrency() override { return 1; }
+
+    virtual bool start() override { return false; }
+    virtual void async_stop() override {}
+    virtual void wait() override {}
+
+    virtual bool is_stopped() override { return true; }
+    virtual bool is_stopping_or_stopped() override { return true; }
+
+    virtual uint64_t schedule(std::function<void()>&& fn, int priority) override { return 0; }
+    virtual uint64_t schedule_delayed(std::function<void()>&& fn, int priority, int64_t delay) override { return 0; }
+    virtual uint64_t schedule(ks_task_fn&& fn, int priority) override { return 0; }
+    virtual uint64_t schedule_delayed(ks_task_fn&& fn, int priority, int64_t delay) override { return 0; }
+
+    virtual void try_unschedule(uint64_t id) override {}
+};
+
+TEST(test_apartment_suite, test_file_io_service) {
+    char file_path[] = "/tmp/ks_async_test_file_io_XXXXXX";
+    int fd = ::mkstemp(file_path);
+    ASSERT_GE(fd, 0);
+    ::unlink(file_path);
+
+    ks_single_thread_apartment_imp sta_imp("test_file_io_sta");
+    ks_apartment* sta = &sta_imp;
+
+    for (uint flags : { (uint)ks_file_io_service::no_flag, (uint)ks_file_io_service::force_thread_pool_flag }) {
+        ks_file_io_service io_service("test_file_io", flags);
+        if (flags & ks_file_io_service::force_thread_pool_flag) {
+            EXPECT_EQ(io_service.backend(), ks_file_io_service::thread_pool_backend);
+        }
+
+        static char fixed_buf[4096];
+        EXPECT_TRUE(io_service.register_buffers({ { fixed_buf, sizeof(fixed_buf) } }));
+        io_service.start();
+        EXPECT_FALSE(io_service.register_buffers({})); //须在start前
+
+        //批量写入（io线程忙时累积的请求被合批提交），再经固定缓冲区读回，并在sta中交付
+        std::atomic<bool> io_blocking = { true };
+        io_service.io_apartment()->schedule([&]() { while (io_blocking) std::this_thread::sleep_for(std::chrono::milliseconds(1)); }, 0);
+        const uint64_t submit_call_count0 = io_service.submit_call_count();
+        std::vector<std::string> blocks;
+        std::vector<ks_future<size_t>> write_futures;
+        for (int i = 0; i < 16; ++i) {
+            blocks.push_back(std::string(256, (char)('a' + i)));
+            write_futures.push_back(io_service.write(fd, blocks.back().data(), blocks.back().size(), i * 256));
+        }
+        io_blocking = false;
+        size_t written_total = 0;
+        for (auto& write_future : write_futures) {
+            write_future.__wait();
+            written_total += write_future.peek_result().to_value();
+        }
+        EXPECT_EQ(written_total, (size_t)16 * 256);
+        if (io_service.backend() == ks_file_io_service::io_uring_backend) {
+            EXPECT_EQ(io_service.submit_call_count() - submit_call_count0, (uint64_t)1);
+        }
+
+        ks_future<size_t> fsync_future = io_service.fsync(fd);
+        fsync_future.__wait();
+        EXPECT_EQ(fsync_future.peek_result().to_value(), (size_t)0);
+
+        memset(fixed_buf, 0, sizeof(fixed_buf));
+        ks_future<size_t> read_future = io_service.read(fd, fixed_buf, sizeof(fixed_buf), 0, sta);
+        read_future.__wait();
+        EXPECT_EQ(read_future.peek_result().to_value(), (size_t)4096);
+        EXPECT_EQ(fixed_buf[0], 'a');
+        EXPECT_EQ(fixed_buf[15 * 256 + 255], 'p');
+
+        char eof_buf[16];
+        ks_future<size_t> eof_future = io_service.read(fd, eof_buf, sizeof(eof_buf), 1 << 20);
+        eof_future.__wait();
+        EXPECT_EQ(eof_future.peek_result().to_value(), (size_t)0);
+
+        //失败以general_error交付，payload为errno
+        ks_future<size_t> error_future = io_service.read(-1, eof_buf, sizeof(eof_buf), 0);
+        error_future.__wait();
+        ASSERT_TRUE(error_future.peek_result().is_error());
+        EXPECT_EQ(error_future.peek_result().to_error().get_code(), ks_error::general_error().get_code());
+
+        //交付套间拒绝schedule（已停止）时，请求就地settle，其下游照常执行
+        _rejecting_apartment rejecting_apartment;
+        ks_future<size_t> dropped_future = io_service.read(fd, eof_buf, sizeof(eof_buf), 0, &rejecting_apartment)
+            .then<size_t>(sta, [](size_t n) { return n; });
+        dropped_future.__wait();
+        EXPECT_EQ(dropped_future.peek_result().to_value(), sizeof(eof_buf));
+
+        io_service.async_stop();
+        io_service.wait();
+        EXPECT_TRUE(io_service.read(fd, eof_buf, sizeof(eof_buf), 0).peek_result().is_error()); //stop后被拒绝
+    }
+
+    sta->async_stop();
+    sta->wait();
+    ::close(fd);
+}
+#endif
@@ -601,3 +601,175 @@ TEST(test_future_suite, test_methods_combination) {
     work_wg.wait();
     EXPECT_EQ(failure, 0);
 }
+
+TEST(test_future_suite, test_inline_continuation) {
+    //在套间内resolve，下游then均在同一套间：就地执行的阶段数受max_depth约束，且各阶段的次序和所在套间不变
+    auto run_chain = [](int max_depth, int* synchronous_count) -> std::vector<int> {
+        const int old_max_depth = __ks_async_raw::ks_raw_future::__set_inline_continuation_max_depth(max_depth);
+        ks_apartment* sta = ks_apartment::background_sta();
+        std::vector<int> stages;
+        bool all_on_sta = true;
+        ks_waitgroup chain_wg(2); //链的完成 + resolve所在fn的返回（就地执行时前者先于后者）
+
+        ks_future<void>::post(sta, [&]() {
+            ks_promise<int> promise = ks_promise<int>::create();
+            ks_future<int> future = promise.get_future();
+            for (int i = 0; i < 10; ++i) {
+                future = future.then<int>(sta, [&](int value) {
+                    stages.push_back(value);
+                    all_on_sta = all_on_sta && ks_apartment::current_thread_apartment() == sta;
+                    return value + 1;
+                });
+            }
+            future.on_completion(sta, [&](const ks_result<int>&) { chain_wg.done(); });
+
+            promise.resolve(0);
+            *synchronous_count = (int)stages.size();
+            chain_wg.done();
+        });
+
+        chain_wg.wait();
+        EXPECT_TRUE(all_on_sta);
+        __ks_async_raw::ks_raw_future::__set_inline_continuation_max_depth(old_max_depth);
+        return stages;
+    };
+
+    const std::vector<int> expected_stages = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+    int synchronous_count = -1;
+
+    EXPECT_EQ(run_chain(0, &synchronous_count), expected_stages);
+    EXPECT_EQ(synchronous_count, 0); //关闭时，各阶段均经schedule
+
+    EXPECT_EQ(run_chain(64, &synchronous_count), expected_stages);
+    EXPECT_EQ(synchronous_count, 10); //整条链在resolve中就地执行
+
+    EXPECT_EQ(run_chain(4, &synchronous_count), expected_stages);
+    EXPECT_GT(synchronous_count, 0);
+    EXPECT_LT(synchronous_count, 10); //超出深度上限后回退为schedule
+}
+
+TEST(test_future_suite, test_then_by_move) {
+    //计数复制次数的payload（移动不计）
+    struct _counted_payload {
+        std::vector<int> data;
+        std::atomic<int>* copy_count;
+
+        _counted_payload(std::vector<int> data_, std::atomic<int>* copy_count_p) : data(std::move(data_)), copy_count(copy_count_p) {}
+        _counted_payload(const _counted_payload& r) : data(r.data), copy_count(r.copy_count) { ++(*copy_count); }
+        _counted_payload(_counted_payload&& r) noexcept = default;
+        _counted_payload& operator=(const _counted_payload&) = delete;
+        _counted_payload& operator=(_counted_payload&&) = delete;
+    };
+
+    ks_apartment* sta = ks_apartment::background_sta();
+
+    //链上各阶段只有唯一的下游，且上游均不再被持有：value沿途被移动，不发生复制
+    {
+        std::atomic<int> copy_count = { 0 };
+        std::vector<int> stages;
+        ks_waitgroup chain_wg(1);
+
+        ks_future<void>::post(sta, [&]() {
+            ks_future<_counted_payload> future = ks_future<_counted_payload>::post(sta, [&]() {
+                return _counted_payload({ 0 }, &copy_count);
+            });
+            for (int i = 1; i < 5; ++i) {
+                future = future.then<_counted_payload>(sta, [&stages, i](_counted_payload&& payload) {
+                    stages.push_back(payload.data.back());
+                    payload.data.push_back(i);
+                    return std::move(payload);
+                });
+            }
+            future.then<void>(sta, [&](_counted_payload&& payload) {
+                EXPECT_EQ(payload.data, std::vector<int>({ 0, 1, 2, 3, 4 }));
+                chain_wg.done();
+            });
+        }); //注：链在sta上构建，待此fn返回、局部future均被释放后才开始执行
+
+        chain_wg.wait();
+        EXPECT_EQ(stages, std::vector<int>({ 0, 1, 2, 3 }));
+        EXPECT_EQ(copy_count, 0);
+    }
+
+    //上游仍被持有（或有多个下游）时，T&&所得为复制品，上游的value不受影响
+    {
+        std::atomic<int> copy_count = { 0 };
+        ks_waitgroup chain_wg(2);
+
+        ks_future<_counted_payload> held_future = ks_future<_counted_payload>::resolved(_counted_payload({ 1, 2, 3 }, &copy_count));
+        copy_count = 0;
+        held_future.then<void>(sta, [&](_counted_payload&& payload) {
+            payload.data.clear();
+            chain_wg.done();
+        });
+        held_future.then<void>(sta, [&](const _counted_payload& payload) {
+            EXPECT_EQ(payload.data, std::vector<int>({ 1, 2, 3 }));
+            chain_wg.done();
+        });
+
+        chain_wg.wait();
+        EXPECT_EQ(copy_count, 1);
+        EXPECT_EQ(held_future.peek_result().to_value().data, std::vector<int>({ 1, 2, 3 }));
+    }
+
+    //T&&与返回ks_future<R>、ks_result<R>的组合
+    {
+        ks_waitgroup chain_wg(1);
+        ks_future<std::string>::resolved("a")
+            .then<std::string>(sta, [](std::string&& value) {
+                return ks_result<std::string>(std::move(value) + ".then_ks_result<R>");
+            })
+            .then<std::string>(sta, [](std::string&& value) {
+                return ks_future<std::string>::resolved(std::move(value) + ".then_ks_future<R>");
+            })
+            .on_completion(sta, [&chain_wg](const ks_result<std::string>& result) {
+                EXPECT_EQ(_result_to_str(result), "a.then_ks_result<R>.then_ks_future<R>");
+                chain_wg.done();
+            });
+        chain_wg.wait();
+    }
+}
+
+TEST(test_future_suite, test_add_next_racing_complete) {
+    //同一线程先后挂接的下游，按挂接次序被feed
+    {
+        ks_promise<int> promise = ks_promise<int>::create();
+        ks_future<int> future = promise.get_future();
+        std::vector<int> order;
+        ks_waitgroup wg(5);
+        for (int i = 0; i < 5; ++i)
+            future.on_completion(ks_apartment::background_sta(), [&order, &wg, i](const ks_result<int>&) { order.push_back(i); wg.done(); });
+        promise.resolve(1);
+        wg.wait();
+        EXPECT_EQ(order, std::vector<int>({ 0, 1, 2, 3, 4 }));
+    }
+
+    //多线程挂接下游与complete相竞争：每个下游均恰被feed一次
+    constexpr int thread_count = 4;
+    constexpr int next_count_per_thread = 50;
+    for (int round = 0; round < 50; ++round) {
+        ks_promise<int> promise = ks_promise<int>::create();
+        ks_future<int> future = promise.get_future();
+        std::atomic<int> fed_count = { 0 };
+        ks_waitgroup wg(thread_count * next_count_per_thread);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < thread_count; ++t) {
+            threads.emplace_back([&]() {
+                for (int i = 0; i < next_count_per_thread; ++i) {
+                    future.on_completion(ks_apartment::default_mta(), [&fed_count, &wg](const ks_result<int>& result) {
+                        EXPECT_TRUE(result.is_value());
+                        ++fed_count;
+                        wg.done();
+                    });
+                }
+            });
+        }
+        promise.resolve(round);
+        for (auto& thread : threads)
+            thread.join();
+
+        wg.wait();
+        EXPECT_EQ(fed_count.load(), thread_count * next_count_per_thread);
+    }
+}
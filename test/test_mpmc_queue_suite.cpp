@@ -0,0 +1,119 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "test_base.h"
+#include "../ktl/ks_concurrency/ks_mpmc_queue.h"
+
+#include <thread>
+#include <vector>
+
+TEST(test_mpmc_queue_suite, test_fifo_and_full) {
+    ks_mpmc_queue<int> queue(5);
+    EXPECT_EQ(queue.capacity(), (size_t)8); //取不小于指定值的2的幂
+
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_TRUE(queue.try_push(i));
+    }
+    EXPECT_FALSE(queue.try_push(8)); //full
+    EXPECT_EQ(queue.size_approx(), (size_t)8);
+
+    int x = -1;
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_TRUE(queue.try_pop(x));
+        EXPECT_EQ(x, i);
+    }
+    EXPECT_FALSE(queue.try_pop(x)); //empty
+    EXPECT_TRUE(queue.empty_approx());
+}
+
+TEST(test_mpmc_queue_suite, test_destroy_remaining) {
+    auto item = std::make_shared<int>(0);
+    if (true) {
+        ks_mpmc_queue<std::shared_ptr<int>> queue(16);
+        for (int i = 0; i < 10; ++i) {
+            EXPECT_TRUE(queue.try_push(item));
+        }
+        std::shared_ptr<int> popped;
+        EXPECT_TRUE(queue.try_pop(popped));
+        popped.reset();
+        EXPECT_EQ(item.use_count(), 10);
+    }
+    EXPECT_EQ(item.use_count(), 1); //析构时残留的元素亦被析构
+}
+
+TEST(test_mpmc_queue_suite, test_multi_producer_multi_consumer) {
+    //容量远小于总量，使队列反复满/空并回绕；
+    //各元素恰被取出一次，且同一消费者所见同一生产者的元素保持其push次序
+    constexpr int producer_count = 4;
+    constexpr int consumer_count = 4;
+    constexpr int item_count_per_producer = 100000;
+    constexpr int64_t total_item_count = (int64_t)producer_count * item_count_per_producer;
+
+    ks_mpmc_queue<int64_t> queue(64);
+    std::atomic<int64_t> popped_total = { 0 };
+    std::vector<std::vector<int64_t>> popped_by_consumer(consumer_count);
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producer_count; ++p) {
+        threads.emplace_back([&queue, p]() {
+            for (int i = 0; i < item_count_per_producer; ++i) {
+                const int64_t x = (int64_t)p * item_count_per_producer + i;
+                while (!queue.try_push(x))
+                    std::this_thread::yield();
+            }
+        });
+    }
+    for (int c = 0; c < consumer_count; ++c) {
+        threads.emplace_back([&queue, &popped_total, &popped_by_consumer, c]() {
+            auto& popped = popped_by_consumer[c];
+            while (popped_total.load(std::memory_order_relaxed) < total_item_count) {
+                int64_t x;
+                if (queue.try_pop(x)) {
+                    popped.push_back(x);
+                    popped_total.fetch_add(1, std::memory_order_relaxed);
+                }
+                else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(popped_total.load(), total_item_count);
+    EXPECT_TRUE(queue.empty_approx());
+
+    std::vector<int> hit_counts(total_item_count, 0);
+    bool order_ok = true;
+    for (const auto& popped : popped_by_consumer) {
+        std::vector<int64_t> last_by_producer(producer_count, -1);
+        for (int64_t x : popped) {
+            ASSERT_TRUE(x >= 0 && x < total_item_count);
+            ++hit_counts[x];
+            const int p = int(x / item_count_per_producer);
+            order_ok = order_ok && x > last_by_producer[p];
+            last_by_producer[p] = x;
+        }
+    }
+    EXPECT_TRUE(order_ok);
+
+    bool exactly_once = true;
+    for (int hit_count : hit_counts) {
+        exactly_once = exactly_once && hit_count == 1;
+    }
+    EXPECT_TRUE(exactly_once);
+}
@@ -37,27 +37,27 @@ TEST(test_notification_center_suite, test_notification_center) {
         work_wg.done();
         });
 
-    ks_notification_center::default_center()->post_notification(&sender, "a.x.y.z");
     work_wg.add(1);
+    ks_notification_center::default_center()->post_notification(&sender, "a.x.y.z");
     
-    ks_notification_center::default_center()->post_notification_with_payload<int>(&sender, "a.x.y.z", 1);
     work_wg.add(1);
+    ks_notification_center::default_center()->post_notification_with_payload<int>(&sender, "a.x.y.z", 1);
     
-    ks_notification_center::default_center()->post_notification_with_payload<std::string>(&sender, "a.b.c.e", "xxx");
     work_wg.add(2);
+    ks_notification_center::default_center()->post_notification_with_payload<std::string>(&sender, "a.b.c.e", "xxx");
     
-    ks_notification_center::default_center()->post_notification_with_payload<std::string>(&sender, "a.b.c", "xxx");
     work_wg.add(2);
+    ks_notification_center::default_center()->post_notification_with_payload<std::string>(&sender, "a.b.c", "xxx");
     
-    ks_notification_center::default_center()->post_notification_with_payload<std::string>(&sender, "a.c", "xxx");
     work_wg.add(1);
+    ks_notification_center::default_center()->post_notification_with_payload<std::string>(&sender, "a.c", "xxx");
 
     work_wg.wait();
 
     ks_notification_center::default_center()->remove_observer(&observer, observer_id);
 
-    ks_notification_center::default_center()->post_notification_with_payload<std::string>(&sender, "a.b.d", "xxx");
     work_wg.add(1);
+    ks_notification_center::default_center()->post_notification_with_payload<std::string>(&sender, "a.b.d", "xxx");
 
     work_wg.wait();
     ks_notification_center::default_center()->remove_observer(&observer);
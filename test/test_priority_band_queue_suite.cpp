@@ -0,0 +1,72 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "test_base.h"
+#include "../ktl/ks_priority_band_queue.h"
+
+#include <climits>
+
+TEST(test_priority_band_queue_suite, test_band_of_priority) {
+    ks_priority_band_queue<int> queue(8);
+    EXPECT_EQ(queue.normal_band(), (size_t)3);
+    EXPECT_EQ(queue.band_of_priority(0), (size_t)3);
+    EXPECT_EQ(queue.band_of_priority(1), (size_t)2);
+    EXPECT_EQ(queue.band_of_priority(3), (size_t)0);
+    EXPECT_EQ(queue.band_of_priority(0x10000), (size_t)0);
+    EXPECT_EQ(queue.band_of_priority(-1), (size_t)4);
+    EXPECT_EQ(queue.band_of_priority(-4), (size_t)7);
+    EXPECT_EQ(queue.band_of_priority(INT_MIN), (size_t)7);
+}
+
+TEST(test_priority_band_queue_suite, test_weighted_fair_pop) {
+    //权重4:2:1，各band均持续非空时，出队次数按权重比例
+    ks_priority_band_queue<int> queue(3, { 4, 2, 1 });
+    const auto now = std::chrono::steady_clock::now();
+    for (int i = 0; i < 700; ++i) {
+        queue.push(0, 0, now);
+        queue.push(1, 1, now);
+        queue.push(2, 2, now);
+    }
+
+    int pop_counts[3] = { 0, 0, 0 };
+    for (int i = 0; i < 700; ++i) {
+        int band = -1;
+        ASSERT_TRUE(queue.try_pop(band, now + std::chrono::microseconds(1)));
+        ++pop_counts[band];
+    }
+    EXPECT_EQ(pop_counts[0], 400);
+    EXPECT_EQ(pop_counts[1], 200);
+    EXPECT_EQ(pop_counts[2], 100);
+
+    //max_band限定可出队的band
+    int item = -1;
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_TRUE(queue.try_pop(item, now, 0));
+        EXPECT_EQ(item, 0);
+    }
+
+    auto stats = queue.stats();
+    EXPECT_EQ(stats[0].weight, (uint32_t)4);
+    EXPECT_EQ(stats[0].dequeue_count, (uint64_t)410);
+    EXPECT_EQ(stats[2].queue_depth, (size_t)600);
+    EXPECT_EQ(stats[2].total_wait_ns, (int64_t)100 * 1000);
+    EXPECT_EQ(stats[2].max_wait_ns, (int64_t)1000);
+
+    size_t cleared_count = 0;
+    queue.clear([&cleared_count](int&&) { ++cleared_count; });
+    EXPECT_EQ(cleared_count, (size_t)(2100 - 710));
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.try_pop(item, now));
+}
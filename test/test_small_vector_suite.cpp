@@ -0,0 +1,72 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "test_base.h"
+#include "../ktl/ks_small_vector.h"
+
+#include <memory>
+
+TEST(test_small_vector_suite, test_inline_then_heap) {
+    ks_small_vector<int, 2> vec;
+    EXPECT_TRUE(vec.empty());
+    EXPECT_TRUE(vec.is_inline());
+
+    vec.push_back(1);
+    vec.push_back(2);
+    EXPECT_TRUE(vec.is_inline()); //容量之内不分配
+    EXPECT_EQ(vec.capacity(), (size_t)2);
+
+    vec.push_back(3);
+    const int more[] = { 4, 5 };
+    vec.append(std::begin(more), std::end(more));
+    EXPECT_FALSE(vec.is_inline());
+    EXPECT_EQ(vec.size(), (size_t)5);
+    EXPECT_EQ(std::vector<int>(vec.begin(), vec.end()), std::vector<int>({ 1, 2, 3, 4, 5 }));
+
+    //clear保留存储
+    const size_t capacity = vec.capacity();
+    vec.clear();
+    EXPECT_TRUE(vec.empty());
+    EXPECT_EQ(vec.capacity(), capacity);
+}
+
+TEST(test_small_vector_suite, test_move) {
+    auto shared = std::make_shared<int>(7);
+
+    //内联存储：逐一移动元素，源被清空
+    ks_small_vector<std::shared_ptr<int>, 2> inline_vec;
+    inline_vec.push_back(shared);
+    ks_small_vector<std::shared_ptr<int>, 2> inline_vec2(std::move(inline_vec));
+    EXPECT_TRUE(inline_vec.empty());
+    EXPECT_EQ(inline_vec2.size(), (size_t)1);
+    EXPECT_EQ(shared.use_count(), 2);
+
+    //堆存储：直接接管，元素不被移动
+    ks_small_vector<std::shared_ptr<int>, 2> heap_vec;
+    for (int i = 0; i < 4; ++i)
+        heap_vec.push_back(shared);
+    const std::shared_ptr<int>* heap_data = heap_vec.data();
+    ks_small_vector<std::shared_ptr<int>, 2> heap_vec2;
+    heap_vec2 = std::move(heap_vec);
+    EXPECT_TRUE(heap_vec.empty());
+    EXPECT_TRUE(heap_vec.is_inline());
+    EXPECT_EQ(heap_vec2.data(), heap_data);
+    EXPECT_EQ(shared.use_count(), 6);
+
+    //析构释放全部元素
+    inline_vec2 = {};
+    heap_vec2 = {};
+    EXPECT_EQ(shared.use_count(), 1);
+}
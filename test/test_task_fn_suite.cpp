@@ -0,0 +1,68 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "test_base.h"
+#include "../ktl/ks_task_fn.h"
+
+TEST(test_task_fn_suite, test_task_fn) {
+    int counter = 0;
+
+    //内联存储，可移动
+    ks_task_fn fn1([&counter]() { ++counter; });
+    EXPECT_TRUE((bool)fn1);
+    EXPECT_TRUE(fn1.is_inline());
+    ks_task_fn fn2(std::move(fn1));
+    EXPECT_FALSE((bool)fn1);
+    fn2();
+    EXPECT_EQ(counter, 1);
+
+    //只可移动的捕获
+    std::unique_ptr<int> p(new int(10));
+    ks_task_fn fn3([p = std::move(p), &counter]() { counter += *p; });
+    fn3();
+    EXPECT_EQ(counter, 11);
+
+    //超出内联容量则堆分配
+    struct { char data[ks_task_fn::inline_capacity + 1]; } big = {};
+    ks_task_fn fn4([big, &counter]() { counter += (int)sizeof(big.data); });
+    EXPECT_FALSE(fn4.is_inline());
+    fn4.swap(fn2);
+    fn2();
+    EXPECT_EQ(counter, 11 + (int)ks_task_fn::inline_capacity + 1);
+
+    //空的std::function视为空
+    ks_task_fn fn5(std::function<void()>{});
+    EXPECT_FALSE((bool)fn5);
+
+    fn2 = nullptr;
+    EXPECT_FALSE((bool)fn2);
+}
+
+TEST(test_task_fn_suite, test_schedule_task_fn) {
+    ks_waitgroup work_wg(0);
+    std::atomic<int> counter = { 0 };
+
+    ks_apartment* apartments[] = { ks_apartment::default_mta(), ks_apartment::background_sta() };
+    for (ks_apartment* apartment : apartments) {
+        std::unique_ptr<int> p1(new int(1));
+        std::unique_ptr<int> p2(new int(2));
+        work_wg.add(2);
+        apartment->schedule(ks_task_fn([p1 = std::move(p1), &counter, &work_wg]() { counter += *p1; work_wg.done(); }), 0);
+        apartment->schedule_delayed(ks_task_fn([p2 = std::move(p2), &counter, &work_wg]() { counter += *p2; work_wg.done(); }), 0, 10);
+    }
+
+    work_wg.wait();
+    EXPECT_EQ(counter.load(), 6);
+}
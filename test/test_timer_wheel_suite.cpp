@@ -0,0 +1,93 @@
+﻿/* Copyright 2025 The Kingsoft's ks-async Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "test_base.h"
+#include "../ktl/ks_timer_wheel.h"
+
+#include <random>
+#include <vector>
+
+namespace {
+    struct _TW_ITEM : ks_timer_wheel_hook<_TW_ITEM> {
+        std::chrono::steady_clock::time_point until_time;
+        int id = 0;
+    };
+}
+
+TEST(test_timer_wheel_suite, test_pop_expired_in_order) {
+    const auto base_time = std::chrono::steady_clock::now();
+    ks_timer_wheel<_TW_ITEM> wheel(base_time);
+
+    //随机跨越各层及overflow的延时
+    std::mt19937_64 rng(12345);
+    const int64_t max_delays[] = { 200, 10000, 1000000, 100000000, 200000000 };
+    std::vector<std::shared_ptr<_TW_ITEM>> items;
+    for (int i = 0; i < 2000; ++i) {
+        auto item = std::make_shared<_TW_ITEM>();
+        item->id = i;
+        item->until_time = base_time + std::chrono::microseconds(rng() % (max_delays[i % 5] * 1000));
+        items.push_back(item);
+        wheel.insert(std::move(item), items.back()->until_time);
+    }
+    EXPECT_EQ(wheel.size(), (size_t)2000);
+
+    //撤销一部分
+    for (int i = 0; i < 2000; i += 7) {
+        auto erased = wheel.erase(items[i].get());
+        EXPECT_EQ(erased, items[i]);
+        EXPECT_FALSE(items[i]->is_in_timer_wheel());
+    }
+
+    //按next_expire_time推进，到期项不早于until_time、不晚于其后的1ms，且到期时点单调不减
+    size_t popped_count = 0;
+    auto last_until_time = base_time;
+    bool all_ok = true;
+    while (!wheel.empty()) {
+        const auto now = wheel.next_expire_time();
+        all_ok = all_ok && now != std::chrono::steady_clock::time_point::max();
+        popped_count += wheel.pop_expired(now, [&](std::shared_ptr<_TW_ITEM>&& item) {
+            all_ok = all_ok && item->until_time <= now;
+            all_ok = all_ok && now - item->until_time < std::chrono::milliseconds(1);
+            all_ok = all_ok && item->until_time >= last_until_time - std::chrono::milliseconds(1);
+            all_ok = all_ok && item->id % 7 != 0;
+            last_until_time = item->until_time;
+        });
+    }
+    EXPECT_TRUE(all_ok);
+    EXPECT_EQ(popped_count, (size_t)(2000 - 286));
+}
+
+TEST(test_timer_wheel_suite, test_insert_expired_and_clear) {
+    const auto base_time = std::chrono::steady_clock::now();
+    ks_timer_wheel<_TW_ITEM> wheel(base_time);
+
+    EXPECT_EQ(wheel.next_expire_time(), std::chrono::steady_clock::time_point::max());
+    EXPECT_EQ(wheel.pop_expired(base_time + std::chrono::milliseconds(100), [](std::shared_ptr<_TW_ITEM>&&) {}), (size_t)0);
+
+    //插入已到期的项，下次pop_expired即弹出
+    auto item = std::make_shared<_TW_ITEM>();
+    wheel.insert(std::move(item), base_time + std::chrono::milliseconds(50));
+    EXPECT_LE(wheel.next_expire_time(), base_time + std::chrono::milliseconds(100));
+    EXPECT_EQ(wheel.pop_expired(base_time + std::chrono::milliseconds(100), [](std::shared_ptr<_TW_ITEM>&&) {}), (size_t)1);
+
+    //clear交出全部所有权
+    std::vector<std::shared_ptr<_TW_ITEM>> t_items;
+    for (int i = 0; i < 10; ++i) {
+        wheel.insert(std::make_shared<_TW_ITEM>(), base_time + std::chrono::milliseconds(1000 * i));
+    }
+    wheel.clear([&t_items](std::shared_ptr<_TW_ITEM>&& a_item) { t_items.push_back(std::move(a_item)); });
+    EXPECT_TRUE(wheel.empty());
+    EXPECT_EQ(t_items.size(), (size_t)10);
+}